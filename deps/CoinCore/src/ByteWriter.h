@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ByteWriter.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <iterator>
+#include <vector>
+#include <stdint.h>
+
+namespace Coin
+{
+
+// Appends wire-format fields to a caller-owned buffer. Reserve the result of getSize()
+// up front and reuse the buffer across calls to serialize without reallocating.
+class ByteWriter
+{
+public:
+    explicit ByteWriter(std::vector<unsigned char>& buffer) : buffer_(buffer) { }
+
+    void reserve(uint64_t n) { buffer_.reserve(buffer_.size() + n); }
+    size_t size() const { return buffer_.size(); }
+
+    void write(const unsigned char* data, size_t len) { buffer_.insert(buffer_.end(), data, data + len); }
+    void write(const std::vector<unsigned char>& bytes) { buffer_.insert(buffer_.end(), bytes.begin(), bytes.end()); }
+
+    // For hashes we keep in the opposite byte order from the wire
+    void writeReversed(const unsigned char* data, size_t len) { buffer_.insert(buffer_.end(), std::reverse_iterator<const unsigned char*>(data + len), std::reverse_iterator<const unsigned char*>(data)); }
+    void writeReversed(const std::vector<unsigned char>& bytes) { buffer_.insert(buffer_.end(), bytes.rbegin(), bytes.rend()); }
+
+    // Little endian, as used throughout the protocol
+    template<typename T>
+    void writeUint(T n)
+    {
+        unsigned char bytes[sizeof(T)];
+        for (unsigned int i = 0; i < sizeof(T); i++) { bytes[i] = (unsigned char)(n >> (8 * i)); }
+        write(bytes, sizeof(T));
+    }
+
+    void writeVarInt(uint64_t n)
+    {
+        if (n < 0xfd)               { buffer_.push_back((unsigned char)n); }
+        else if (n <= 0xffff)       { buffer_.push_back(0xfd); writeUint<uint16_t>(n); }
+        else if (n <= 0xffffffff)   { buffer_.push_back(0xfe); writeUint<uint32_t>(n); }
+        else                        { buffer_.push_back(0xff); writeUint<uint64_t>(n); }
+    }
+
+private:
+    std::vector<unsigned char>& buffer_;
+};
+
+}
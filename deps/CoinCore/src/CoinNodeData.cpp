@@ -36,6 +36,7 @@
 
 #include <iomanip>
 #include <algorithm>
+#include <memory>
 
 #include <assert.h>
 
@@ -58,6 +59,40 @@ void SetMultiSigAddressVersion(unsigned char version)
     g_multiSigAddressVersion = version;
 }
 
+// Bounds checks and little endian reads for the in-place parsers
+namespace
+{
+
+inline void requireBytes(const unsigned char* pos, const unsigned char* end, uint64_t n, const char* error)
+{
+    if (n > (uint64_t)(end - pos)) throw runtime_error(error);
+}
+
+// Guards against counts that could not possibly fit before allocating room for them
+inline void requireItems(const unsigned char* pos, const unsigned char* end, uint64_t count, uint64_t minItemSize, const char* error)
+{
+    if (count > (uint64_t)(end - pos) / minItemSize) throw runtime_error(error);
+}
+
+template<typename T>
+inline T readUint(const unsigned char*& pos)
+{
+    T n = 0;
+    for (uint i = 0; i < sizeof(T); i++) { n |= (T)pos[i] << (8 * i); }
+    pos += sizeof(T);
+    return n;
+}
+
+template<typename T>
+CoinNodeStructure* parsePayload(const unsigned char* pos, const unsigned char* end)
+{
+    std::unique_ptr<T> payload(new T());
+    payload->deserialize(pos, end);
+    return payload.release();
+}
+
+}
+
 const char* itemTypeToString(uint itemType)
 {
     switch (itemType) {
@@ -107,6 +142,17 @@ string satoshisToBtcString(uint64_t satoshis, bool trailing_zeros)
 //
 // class CoinNodeStructure implementation
 //
+void CoinNodeStructure::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    this->setSerialized(uchar_vector(pos, end));
+    pos += this->getSize();
+}
+
+void CoinNodeStructure::serializeTo(ByteWriter& writer) const
+{
+    writer.write(this->getSerialized());
+}
+
 const uchar_vector& CoinNodeStructure::getHash() const
 {
     hash_ = sha256_2(getSerialized());
@@ -152,40 +198,40 @@ uint64_t VarInt::getSize() const
 uchar_vector VarInt::getSerialized() const
 {
     uchar_vector rval;
-    if (this->value < 0xfd) {
-        rval.push_back(value);
-        return rval;
-    }
-    if (this->value <= 0xffff) {
-        rval.push_back(0xfd);
-        rval += uint_to_vch<uint16_t>(this->value, LITTLE_ENDIAN_);
-        return rval;
-    }
-    if (this->value <= 0xffffffff) {
-        rval.push_back(0xfe);
-        rval += uint_to_vch<uint32_t>(this->value, LITTLE_ENDIAN_);
-        return rval;
-    }
-    rval.push_back(0xff);
-    rval += uint_to_vch<uint64_t>(this->value, LITTLE_ENDIAN_);
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
     return rval;
 }
 
+void VarInt::serializeTo(ByteWriter& writer) const
+{
+    writer.writeVarInt(this->value);
+}
+
 void VarInt::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_VAR_INT_SIZE)
-        throw runtime_error("Invalid data - VarInt too small.");
-
-    if (bytes[0] < 0xfd)
-        this->value = bytes[0];
-    else if ((bytes[0] == 0xfd) && (bytes.size() >= 3))
-        this->value = vch_to_uint<uint16_t>(uchar_vector(bytes.begin() + 1, bytes.begin() + 3), LITTLE_ENDIAN_);
-    else if ((bytes[0] == 0xfe) && (bytes.size() >= 5))
-        this->value = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 1, bytes.begin() + 5), LITTLE_ENDIAN_);
-    else if (bytes.size() >= 9)
-        this->value = vch_to_uint<uint64_t>(uchar_vector(bytes.begin() + 1, bytes.begin() + 9), LITTLE_ENDIAN_);
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
+
+void VarInt::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_VAR_INT_SIZE, "Invalid data - VarInt too small.");
+
+    unsigned char prefix = *pos;
+    uint size = (prefix < 0xfd) ? 1 : (prefix == 0xfd) ? 3 : (prefix == 0xfe) ? 5 : 9;
+    requireBytes(pos, end, size, "Invalid data - VarInt length is wrong.");
+    pos++;
+
+    if (prefix < 0xfd)
+        this->value = prefix;
+    else if (prefix == 0xfd)
+        this->value = readUint<uint16_t>(pos);
+    else if (prefix == 0xfe)
+        this->value = readUint<uint32_t>(pos);
     else
-        throw runtime_error("Invalid data - VarInt length is wrong.");
+        this->value = readUint<uint64_t>(pos);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -368,6 +414,14 @@ void MessageHeader::setSerialized(const uchar_vector& bytes)
         this->checksum = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 20, bytes.begin() + 24), LITTLE_ENDIAN_);
 }
 
+bool MessageHeader::isChecksumValid(const unsigned char* payload) const
+{
+    if (!this->hasChecksum) return true;
+
+    uchar_vector hash = sha256_2_raw(payload, this->length);
+    return (this->checksum == vch_to_uint<uint32_t>(uchar_vector(hash.begin(), hash.begin() + 4), LITTLE_ENDIAN_));
+}
+
 string MessageHeader::toString() const
 {
     stringstream ss;
@@ -514,24 +568,34 @@ uchar_vector CoinNodeMessage::getSerialized() const
 
 void CoinNodeMessage::setSerialized(const uchar_vector& bytes)
 {
-    this->header.setSerialized(bytes);
-    string command = this->header.command;
+    MessageHeader messageHeader(bytes);
 //      if ((command == "version") || (command == "verack"))
 // VERSION_CHECKSUM_CHANGE
 /*      if (command == "verack")
-            this->header.removeChecksum();
+            messageHeader.removeChecksum();
 */
-    if (bytes.size() < header.getSize() + header.length)
+    if (bytes.size() < messageHeader.getSize() + messageHeader.length)
         throw runtime_error("Invalid data - CoinNodeMessage too small.");
 
+    setPayload(messageHeader, &bytes[0] + messageHeader.getSize());
+}
+
+void CoinNodeMessage::setPayload(const MessageHeader& messageHeader, const unsigned char* payload)
+{
+    this->header = messageHeader;
+    string command = this->header.command;
+
     if (pPayload) {
         delete pPayload;
         pPayload = NULL;
     }
 
+    // Structures that can parse in place read straight from the payload, the rest get a copy.
+    const unsigned char* end = payload + this->header.length;
+
     if (command == "version") {
         this->pPayload =
-        new VersionMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        new VersionMessage(uchar_vector(payload, end));
     }
     else if (command == "verack") {
         this->pPayload = new BlankMessage("verack");
@@ -541,65 +605,58 @@ void CoinNodeMessage::setSerialized(const uchar_vector& bytes)
     }
     else if (command == "addr") {
         this->pPayload =
-            new AddrMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new AddrMessage(uchar_vector(payload, end));
     }
     else if (command == "inv") {
-        this->pPayload =
-            new Inventory(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<Inventory>(payload, end);
     }
     else if (command == "getdata") {
-        this->pPayload =
-            new GetDataMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<GetDataMessage>(payload, end);
     }
     else if (command == "notfound") {
-        this->pPayload =
-            new NotFoundMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<NotFoundMessage>(payload, end);
     }
     else if (command == "getblocks") {
         this->pPayload =
-            new GetBlocksMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new GetBlocksMessage(uchar_vector(payload, end));
     }
     else if (command == "getheaders") {
         this->pPayload =
-            new GetHeadersMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new GetHeadersMessage(uchar_vector(payload, end));
     }
     else if (command == "tx") {
-        this->pPayload =
-            new Transaction(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<Transaction>(payload, end);
     }
     else if (command == "block") {
-        this->pPayload =
-            new CoinBlock(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<CoinBlock>(payload, end);
     }
     else if (command == "merkleblock") {
-        this->pPayload =
-            new MerkleBlock(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<MerkleBlock>(payload, end);
     }
     else if (command == "headers") {
-        this->pPayload =
-            new HeadersMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = parsePayload<HeadersMessage>(payload, end);
     }
     else if (command == "getaddr") {
         this->pPayload = new GetAddrMessage();
     }
     else if (command == "filterload") {
         this->pPayload =
-            new FilterLoadMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new FilterLoadMessage(uchar_vector(payload, end));
     }
     else if (command == "filteradd") {
         this->pPayload =
-            new FilterAddMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new FilterAddMessage(uchar_vector(payload, end));
     }
     else if (command == "filterclear") {
         this->pPayload = new BlankMessage("filterclear");
     }
     else if (command == "ping") {
         this->pPayload =
-            new PingMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new PingMessage(uchar_vector(payload, end));
     }
     else if (command == "pong") {
         this->pPayload =
-            new PongMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+            new PongMessage(uchar_vector(payload, end));
     }
     else {
         string error_msg = "Unrecognized command: ";
@@ -815,22 +872,31 @@ string AddrMessage::toIndentedString(uint spaces) const
 //
 uchar_vector InventoryItem::getSerialized() const
 {
-    uchar_vector rval = uint_to_vch(itemType, LITTLE_ENDIAN_);
-    uchar_vector hashBytes((unsigned char*)hash, 32);
-    hashBytes.reverse(); // to little endian
-    rval += hashBytes;
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
     return rval;
 }
 
+void InventoryItem::serializeTo(ByteWriter& writer) const
+{
+    writer.writeUint<uint32_t>(this->itemType);
+    writer.writeReversed((const unsigned char*)this->hash, 32); // to little endian
+}
+
 void InventoryItem::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_INVENTORY_ITEM_SIZE)
-        throw runtime_error("Invalid data - InventoryItem too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
+
+void InventoryItem::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_INVENTORY_ITEM_SIZE, "Invalid data - InventoryItem too small.");
 
-    this->itemType = vch_to_uint<uint32_t>(bytes, LITTLE_ENDIAN_);
-    uchar_vector hashBytes(bytes.begin() + 4, bytes.begin() + 36);
-    hashBytes.reverse(); // to big endian
-    hashBytes.copyToArray((unsigned char*)this->hash);
+    this->itemType = readUint<uint32_t>(pos);
+    std::reverse_copy(pos, pos + 32, (unsigned char*)this->hash); pos += 32; // to big endian
 }
 
 string InventoryItem::toString() const
@@ -854,26 +920,34 @@ string InventoryItem::toIndentedString(uint spaces) const
 //
 uchar_vector Inventory::getSerialized() const
 {
-    uchar_vector data = VarInt(this->items.size()).getSerialized();
-
-    for (uint i = 0; i < this->items.size(); i++)
-        data += (this->items)[i].getSerialized();
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
+    return rval;
+}
 
-    return data;
+void Inventory::serializeTo(ByteWriter& writer) const
+{
+    writer.writeVarInt(this->items.size());
+    for (auto& item: this->items) { item.serializeTo(writer); }
 }
 
 void Inventory::setSerialized(const uchar_vector& bytes)
 {
-    VarInt count(bytes);
-    uint pos = count.getSize();
-    if (bytes.size() < pos + MIN_INVENTORY_ITEM_SIZE*count.value)
-        throw runtime_error("Invalid data - message too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
 
-    for (uint i = 0; i < count.value; i++) {
-        uchar_vector field(bytes.begin() + pos, bytes.end());
-        InventoryItem item(field); pos += item.getSerialized().size();
-        (this->items).push_back(item);
-    }
+void Inventory::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    VarInt count;
+    count.deserialize(pos, end);
+    requireItems(pos, end, count.value, MIN_INVENTORY_ITEM_SIZE, "Invalid data - message too small.");
+
+    this->items.clear();
+    this->items.resize(count.value);
+    for (auto& item: this->items) { item.deserialize(pos, end); }
 }
 
 string Inventory::toString() const
@@ -1090,22 +1164,31 @@ void OutPoint::setPoint(const uchar_vector& hashBytes, uint index)
 
 uchar_vector OutPoint::getSerialized() const
 {
-    uchar_vector rval(this->hash, 32);
-    rval.reverse(); // to big endian
-    rval += uint_to_vch(this->index, LITTLE_ENDIAN_);
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
     return rval;
 }
 
+void OutPoint::serializeTo(ByteWriter& writer) const
+{
+    writer.writeReversed(this->hash, 32); // to big endian
+    writer.writeUint<uint32_t>(this->index);
+}
+
 void OutPoint::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_OUT_POINT_SIZE)
-        throw runtime_error("Invalid data - OutPoint too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
 
-    uchar_vector hashBytes(bytes.begin(), bytes.begin() + 32);
-    hashBytes.reverse(); // to little endian
+void OutPoint::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_OUT_POINT_SIZE, "Invalid data - OutPoint too small.");
 
-    memcpy(this->hash, &hashBytes[0], 32);
-    this->index = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 32, bytes.begin() + 36), LITTLE_ENDIAN_);
+    std::reverse_copy(pos, pos + 32, this->hash); pos += 32; // to little endian
+    this->index = readUint<uint32_t>(pos);
 }
 
 string OutPoint::toDelimited(const string& delimiter) const
@@ -1145,30 +1228,41 @@ TxIn::TxIn(const OutPoint& previousOut, const string& scriptSigHex, uint32_t seq
 
 uchar_vector TxIn::getSerialized(bool includeScriptSigLength) const
 {
-    uchar_vector rval = this->previousOut.getSerialized();
-    if (includeScriptSigLength)
-        rval += VarInt(this->scriptSig.size()).getSerialized();
-    rval += this->scriptSig;
-    rval += uint_to_vch(this->sequence, LITTLE_ENDIAN_);
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer, includeScriptSigLength);
     return rval;
 }
 
+void TxIn::serializeTo(ByteWriter& writer, bool includeScriptSigLength) const
+{
+    this->previousOut.serializeTo(writer);
+    if (includeScriptSigLength)
+        writer.writeVarInt(this->scriptSig.size());
+    writer.write(this->scriptSig);
+    writer.writeUint<uint32_t>(this->sequence);
+}
+
 void TxIn::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_TX_IN_SIZE)
-        throw runtime_error("Invalid data - TxIn too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
 
-    this->previousOut.setSerialized(bytes);
-    VarInt scriptLength(uchar_vector(bytes.begin() + 36, bytes.end()));
-    uint pos =  scriptLength.getSize() + 36;
-    if (bytes.size() < pos + scriptLength.value) {
-        cout << "TxIn: " << bytes.getHex() << endl;
-        throw runtime_error("Invalid data - TxIn script length too small.");
-    }
+void TxIn::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_TX_IN_SIZE, "Invalid data - TxIn too small.");
 
-    this->scriptSig.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    this->previousOut.deserialize(pos, end);
+    VarInt scriptLength;
+    scriptLength.deserialize(pos, end);
+    requireBytes(pos, end, scriptLength.value, "Invalid data - TxIn script length too small.");
+
+    this->scriptSig.assign(pos, pos + scriptLength.value);
     pos += scriptLength.value;
-    this->sequence = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_);
+    requireBytes(pos, end, 4, "Invalid data - TxIn missing sequence.");
+    this->sequence = readUint<uint32_t>(pos);
 }
 
 string TxIn::getAddress() const
@@ -1237,24 +1331,37 @@ TxOut::TxOut(uint64_t value, const string& scriptPubKeyHex)
 
 uchar_vector TxOut::getSerialized() const
 {
-    uchar_vector rval = uint_to_vch(this->value, LITTLE_ENDIAN_);
-    rval += VarInt(this->scriptPubKey.size()).getSerialized();
-    rval += this->scriptPubKey;
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
     return rval;
 }
 
+void TxOut::serializeTo(ByteWriter& writer) const
+{
+    writer.writeUint<uint64_t>(this->value);
+    writer.writeVarInt(this->scriptPubKey.size());
+    writer.write(this->scriptPubKey);
+}
+
 void TxOut::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_TX_OUT_SIZE)
-        throw runtime_error("Invalid data - TxOut too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
 
-    this->value = vch_to_uint<uint64_t>(bytes, LITTLE_ENDIAN_);
-    VarInt scriptLength(uchar_vector(bytes.begin() + 8, bytes.end()));
-    uint pos = scriptLength.getSize() + 8;
-    if (bytes.size() < pos + scriptLength.value)
-        throw runtime_error("Invalid data - TxOut script length too small.");
+void TxOut::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_TX_OUT_SIZE, "Invalid data - TxOut too small.");
+
+    this->value = readUint<uint64_t>(pos);
+    VarInt scriptLength;
+    scriptLength.deserialize(pos, end);
+    requireBytes(pos, end, scriptLength.value, "Invalid data - TxOut script length too small.");
 
-    this->scriptPubKey.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    this->scriptPubKey.assign(pos, pos + scriptLength.value);
+    pos += scriptLength.value;
 }
 
 string TxOut::getAddress() const
@@ -1337,61 +1444,63 @@ uint64_t Transaction::getSize() const
 }
 
 uchar_vector Transaction::getSerialized(bool includeScriptSigLength) const
+{
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer, includeScriptSigLength);
+    return rval;
+}
+
+void Transaction::serializeTo(ByteWriter& writer, bool includeScriptSigLength) const
 {
     // version
-    uchar_vector rval = uint_to_vch(this->version, LITTLE_ENDIAN_);
+    writer.writeUint<uint32_t>(this->version);
 
-    uint64_t i;
     // inputs
-    rval += VarInt(this->inputs.size()).getSerialized();
-    for (i = 0; i < this->inputs.size(); i++)
-        rval += this->inputs[i].getSerialized(includeScriptSigLength);
+    writer.writeVarInt(this->inputs.size());
+    for (auto& txIn: this->inputs) { txIn.serializeTo(writer, includeScriptSigLength); }
 
     // outputs
-    rval += VarInt(this->outputs.size()).getSerialized();
-    for (i = 0; i < this->outputs.size(); i++)
-        rval += this->outputs[i].getSerialized();
+    writer.writeVarInt(this->outputs.size());
+    for (auto& txOut: this->outputs) { txOut.serializeTo(writer); }
 
     // lock time
-    rval += uint_to_vch(this->lockTime, LITTLE_ENDIAN_);
-
-    return rval;
+    writer.writeUint<uint32_t>(this->lockTime);
 }
 
 void Transaction::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_TRANSACTION_SIZE)
-        throw runtime_error(string("Invalid data - Transaction too small: ") + bytes.getHex());
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
+
+void Transaction::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    if ((uint64_t)(end - pos) < MIN_TRANSACTION_SIZE)
+        throw runtime_error(string("Invalid data - Transaction too small: ") + uchar_vector(pos, end).getHex());
 
     // version
-    this->version = vch_to_uint<uint32_t>(uchar_vector(bytes.begin(), bytes.begin() + 4), LITTLE_ENDIAN_);
+    this->version = readUint<uint32_t>(pos);
 
-    uint64_t i;
     // inputs
+    VarInt count;
+    count.deserialize(pos, end);
+    requireItems(pos, end, count.value, MIN_TX_IN_SIZE, "Invalid data - TxIn too small.");
     this->inputs.clear();
-    VarInt count(uchar_vector(bytes.begin() + 4, bytes.end()));
-    uint pos = count.getSize() + 4;
-    for (i = 0; i < count.value; i++) {
-        TxIn txIn(uchar_vector(bytes.begin() + pos, bytes.end()));
-        this->addInput(txIn);
-        pos += txIn.getSize();
-    }
+    this->inputs.resize(count.value);
+    for (auto& txIn: this->inputs) { txIn.deserialize(pos, end); }
 
     // outputs
+    count.deserialize(pos, end);
+    requireItems(pos, end, count.value, MIN_TX_OUT_SIZE, "Invalid data - TxOut too small.");
     this->outputs.clear();
-    count.setSerialized(uchar_vector(bytes.begin() + pos, bytes.end()));
-    pos = pos + count.getSize();
-    for (i = 0; i < count.value; i++) {
-        TxOut txOut(uchar_vector(bytes.begin() + pos, bytes.end()));
-        this->addOutput(txOut);
-        pos += txOut.getSize();
-    }
-
-    if (bytes.size() < pos + 4)
-        throw runtime_error("Invalid data - Transaction missing lockTime.");
+    this->outputs.resize(count.value);
+    for (auto& txOut: this->outputs) { txOut.deserialize(pos, end); }
 
     // lock time
-    this->lockTime = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_);
+    requireBytes(pos, end, 4, "Invalid data - Transaction missing lockTime.");
+    this->lockTime = readUint<uint32_t>(pos);
 }
 
 string Transaction::toString() const
@@ -1474,7 +1583,12 @@ uint64_t Transaction::getTotalSent() const
 
 uchar_vector Transaction::getHashWithAppendedCode(uint32_t code) const
 {
-    return sha256_2(this->getSerialized() + uint_to_vch(code, LITTLE_ENDIAN_));
+    uchar_vector bytes;
+    bytes.reserve(this->getSize() + 4);
+    ByteWriter writer(bytes);
+    this->serializeTo(writer);
+    writer.writeUint<uint32_t>(code);
+    return sha256_2(bytes);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1496,33 +1610,44 @@ CoinBlockHeader::CoinBlockHeader(const string& hex)
 
 uchar_vector CoinBlockHeader::getSerialized() const
 {
-    uchar_vector rval = uint_to_vch(version_, LITTLE_ENDIAN_);
-    rval += prevBlockHash_.getReverse(); // all big endian
-    rval += merkleRoot_.getReverse();
-    rval += uint_to_vch(timestamp_, LITTLE_ENDIAN_);
-    rval += uint_to_vch(bits_, LITTLE_ENDIAN_);
-    rval += uint_to_vch(nonce_, LITTLE_ENDIAN_);
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
     return rval;
 }
 
+void CoinBlockHeader::serializeTo(ByteWriter& writer) const
+{
+    writer.writeUint<uint32_t>(version_);
+    writer.writeReversed(prevBlockHash_); // all big endian
+    writer.writeReversed(merkleRoot_);
+    writer.writeUint<uint32_t>(timestamp_);
+    writer.writeUint<uint32_t>(bits_);
+    writer.writeUint<uint32_t>(nonce_);
+}
+
 void CoinBlockHeader::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_COIN_BLOCK_HEADER_SIZE)
-        throw runtime_error("Invalid data - CoinBlockHeader too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
+
+void CoinBlockHeader::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_COIN_BLOCK_HEADER_SIZE, "Invalid data - CoinBlockHeader too small.");
 
-    version_ = vch_to_uint<uint32_t>(bytes, LITTLE_ENDIAN_); uint pos = 4;
+    version_ = readUint<uint32_t>(pos);
 
-    uchar_vector subbytes(bytes.begin() + pos, bytes.begin() + pos + 32); pos += 32;
-    subbytes.reverse();
-    prevBlockHash_ = subbytes;
+    prevBlockHash_.assign(pos, pos + 32); pos += 32;
+    prevBlockHash_.reverse();
 
-    subbytes.assign(bytes.begin() + pos, bytes.begin() + pos + 32); pos += 32;
-    subbytes.reverse();
-    merkleRoot_ = subbytes;
+    merkleRoot_.assign(pos, pos + 32); pos += 32;
+    merkleRoot_.reverse();
 
-    timestamp_ = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_); pos += 4;
-    bits_ = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_); pos += 4;
-    nonce_ = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_); pos += 4;
+    timestamp_ = readUint<uint32_t>(pos);
+    bits_ = readUint<uint32_t>(pos);
+    nonce_ = readUint<uint32_t>(pos);
 
     resetHash();
 }
@@ -1579,6 +1704,32 @@ const BigInt CoinBlockHeader::getWork() const
     return (BigInt(1) << 256) / (getTarget() + 1);
 }
 
+const uint256 CoinBlockHeader::getTarget256(bool* pfOverflow) const
+{
+    uint256 target;
+    target.SetCompact(bits_, NULL, pfOverflow);
+    return target;
+}
+
+const uint256 CoinBlockHeader::getWork256() const
+{
+    bool fOverflow;
+    uint256 target = getTarget256(&fOverflow);
+    if (fOverflow || !target) return 0;
+
+    // 2^256 / (target + 1) == ~target / (target + 1) + 1, which fits in 256 bits.
+    return (~target / (target + 1)) + 1;
+}
+
+bool CoinBlockHeader::checkProofOfWork() const
+{
+    bool fOverflow;
+    uint256 target = getTarget256(&fOverflow);
+    if (fOverflow) return true;
+
+    return uint256(getPOWHash()) <= target;
+}
+
 string CoinBlockHeader::toString() const
 {
     stringstream ss;
@@ -1666,33 +1817,70 @@ uint64_t CoinBlock::getSize() const
 
 uchar_vector CoinBlock::getSerialized() const
 {
-    uchar_vector rval = this->blockHeader.getSerialized();
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
+    return rval;
+}
+
+void CoinBlock::serializeTo(ByteWriter& writer) const
+{
+    this->blockHeader.serializeTo(writer);
 
     // add transactions
-    rval += VarInt(this->txs.size()).getSerialized();
-    for (uint i = 0; i < this->txs.size(); i++)
-        rval += this->txs[i].getSerialized();
-    return rval;
+    writer.writeVarInt(this->txs.size());
+    for (auto& tx: this->txs) { tx.serializeTo(writer); }
 }
 
 void CoinBlock::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_COIN_BLOCK_SIZE)
-        throw runtime_error("Invalid data - CoinBlock too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
 
-    this->blockHeader.setSerialized(bytes);
-    uint pos = MIN_COIN_BLOCK_HEADER_SIZE;
+namespace
+{
 
-    MerkleTree txMerkleTree;
-    VarInt count(uchar_vector(bytes.begin() + pos, bytes.end())); pos += count.getSize();
-    for (uint i = 0; i < count.value; i++) {
-        Transaction tx(uchar_vector(bytes.begin() + pos, bytes.end())); pos += tx.getSize();
-        this->txs.push_back(tx);
-        txMerkleTree.addHash(tx.getHash());
-        if (bytes.size() < pos)
-            throw runtime_error("Invalid data - CoinBlock transactions exceed block size.");
+// Consumes the 32-byte tx hashes in txHashes
+uchar_vector merkleRootLittleEndian(uchar_vector& txHashes, std::size_t count)
+{
+    computeMerkleRoot(&txHashes[0], count);
+    return uchar_vector(txHashes.rend() - 32, txHashes.rend());
+}
+
+uchar_vector txMerkleRootLittleEndian(const std::vector<Transaction>& txs)
+{
+    if (txs.empty()) return uchar_vector();
+
+    uchar_vector txHashes;
+    txHashes.reserve(32 * txs.size());
+    for (auto& tx: txs) { txHashes += tx.getHash(); }
+    return merkleRootLittleEndian(txHashes, txs.size());
+}
+
+}
+
+void CoinBlock::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_COIN_BLOCK_SIZE, "Invalid data - CoinBlock too small.");
+
+    this->blockHeader.deserialize(pos, end);
+
+    VarInt count;
+    count.deserialize(pos, end);
+    requireItems(pos, end, count.value, MIN_TRANSACTION_SIZE, "Invalid data - CoinBlock transactions exceed block size.");
+
+    // Hash each transaction straight from the wire bytes rather than serializing it again
+    uchar_vector txHashes(32 * count.value);
+    this->txs.clear();
+    this->txs.resize(count.value);
+    for (uint64_t i = 0; i < count.value; i++) {
+        const unsigned char* txBegin = pos;
+        this->txs[i].deserialize(pos, end);
+        sha256_2_raw(txBegin, pos - txBegin, &txHashes[32 * i]);
     }
-    if (blockHeader.merkleRoot() != txMerkleTree.getRootLittleEndian()) {
+    if (count.value == 0 || blockHeader.merkleRoot() != merkleRootLittleEndian(txHashes, count.value)) {
         throw runtime_error("Invalid data - CoinBlock merkle root mismatch.");
     }
 }
@@ -1737,20 +1925,12 @@ string CoinBlock::toRedactedIndentedString(uint spaces) const
 
 bool CoinBlock::isValidMerkleRoot() const
 {
-    MerkleTree tree;
-    for (uint i = 0; i < this->txs.size(); i++)
-        tree.addHash(txs[i].getHash());
-
-    return (blockHeader.merkleRoot() == tree.getRootLittleEndian());
+    return (blockHeader.merkleRoot() == txMerkleRootLittleEndian(this->txs));
 }
 
 void CoinBlock::updateMerkleRoot()
 {
-    MerkleTree tree;
-    for (uint i = 0; i < this->txs.size(); i++)
-        tree.addHash(txs[i].getHash());
-
-    blockHeader.merkleRoot_ = tree.getRootLittleEndian();
+    blockHeader.merkleRoot_ = txMerkleRootLittleEndian(this->txs);
     blockHeader.resetHash();
 }
 
@@ -1805,45 +1985,56 @@ uint64_t MerkleBlock::getSize() const
 
 uchar_vector MerkleBlock::getSerialized() const
 {
-    uchar_vector rval = blockHeader.getSerialized();
-    rval += uint_to_vch(nTxs, LITTLE_ENDIAN_);
-    rval += VarInt(hashes.size()).getSerialized();
-    for (uint i = 0; i < hashes.size(); i++) {
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
+    return rval;
+}
+
+void MerkleBlock::serializeTo(ByteWriter& writer) const
+{
+    blockHeader.serializeTo(writer);
+    writer.writeUint<uint32_t>(nTxs);
+    writer.writeVarInt(hashes.size());
+    for (auto& hash: hashes) {
         // TODO: make sure hashes are all 32 bytes
-        rval += hashes[i];
+        writer.write(hash);
     }
-    rval += VarInt(flags.size()).getSerialized();
-    rval += flags;
-    return rval;
+    writer.writeVarInt(flags.size());
+    writer.write(flags);
 }
 
 void MerkleBlock::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_MERKLE_BLOCK_SIZE)
-        throw runtime_error("Invalid data - MerkleBlock too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
 
-    this->blockHeader.setSerialized(bytes);
-    uint pos = MIN_COIN_BLOCK_HEADER_SIZE;
+void MerkleBlock::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    requireBytes(pos, end, MIN_MERKLE_BLOCK_SIZE, "Invalid data - MerkleBlock too small.");
 
-    nTxs = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_); pos += 4;
+    this->blockHeader.deserialize(pos, end);
+    nTxs = readUint<uint32_t>(pos);
 
-    VarInt nHashes(uchar_vector(bytes.begin() + pos, bytes.end())); pos += nHashes.getSize();
-    if (bytes.size() < pos + (nHashes.value * 32) + 1)
-        throw runtime_error("Invalid data - MerkleBlock hash count invalid.");
+    VarInt nHashes;
+    nHashes.deserialize(pos, end);
+    if (pos == end) throw runtime_error("Invalid data - MerkleBlock hash count invalid.");
+    requireItems(pos, end - 1, nHashes.value, 32, "Invalid data - MerkleBlock hash count invalid.");
 
     hashes.clear();
+    hashes.reserve(nHashes.value);
     for (uint i = 0; i < nHashes.value; i++) {
-        hashes.push_back(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 32)); pos += 32;
+        hashes.push_back(uchar_vector(pos, pos + 32)); pos += 32;
     }
-        
-    VarInt nFlags(uchar_vector(bytes.begin() + pos, bytes.end())); pos += nFlags.getSize();
-    if (bytes.size() < pos + nFlags.value)
-        throw runtime_error("Invalid data - MerkleBlock flag count invalid.");
 
-    flags.clear();
-    for (uint i = 0; i < nFlags.value; i++) {
-        flags.push_back(bytes[pos + i]);
-    }
+    VarInt nFlags;
+    nFlags.deserialize(pos, end);
+    requireBytes(pos, end, nFlags.value, "Invalid data - MerkleBlock flag count invalid.");
+
+    flags.assign(pos, pos + nFlags.value);
+    pos += nFlags.value;
 }
 
 string MerkleBlock::toString() const
@@ -1903,26 +2094,39 @@ uint64_t HeadersMessage::getSize() const
 
 uchar_vector HeadersMessage::getSerialized() const
 {
-    uchar_vector rval = VarInt(this->headers.size()).getSerialized();
-    for (uint i = 0; i < this->headers.size(); i++) {
-        rval += this->headers[i].getSerialized();
-        rval.push_back(0);
-    }
+    uchar_vector rval;
+    rval.reserve(this->getSize());
+    ByteWriter writer(rval);
+    this->serializeTo(writer);
     return rval;
 }
 
+void HeadersMessage::serializeTo(ByteWriter& writer) const
+{
+    writer.writeVarInt(this->headers.size());
+    for (auto& header: this->headers) {
+        header.serializeTo(writer);
+        writer.writeVarInt(0); // an extra blank byte is added.
+    }
+}
+
 void HeadersMessage::setSerialized(const uchar_vector& bytes)
 {
-    VarInt count(bytes);
-    if (bytes.size() < count.getSize() + count.value*(MIN_COIN_BLOCK_HEADER_SIZE + 1))
-        throw runtime_error("Invalid data - HeadersMessage too small.");
+    const unsigned char* pos = bytes.data();
+    this->deserialize(pos, pos + bytes.size());
+}
+
+void HeadersMessage::deserialize(const unsigned char*& pos, const unsigned char* end)
+{
+    VarInt count;
+    count.deserialize(pos, end);
+    requireItems(pos, end, count.value, MIN_COIN_BLOCK_HEADER_SIZE + 1, "Invalid data - HeadersMessage too small.");
 
-    uint pos = count.getSize();
     this->headers.clear();
-    for (uint i = 0; i < count.value; i++) {
-        CoinBlockHeader header(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + MIN_COIN_BLOCK_HEADER_SIZE));
-        this->headers.push_back(header);
-        pos += MIN_COIN_BLOCK_HEADER_SIZE + 1; // an extra blank byte is added.
+    this->headers.resize(count.value);
+    for (auto& header: this->headers) {
+        header.deserialize(pos, end);
+        pos++; // an extra blank byte is added.
     }
 }
 
@@ -29,6 +29,7 @@
 #include "MerkleTree.h"
 
 #include "BigInt.h"
+#include "ByteWriter.h"
 
 #include <stdutils/uchar_vector.h>
 
@@ -113,6 +114,15 @@ public:
     virtual uchar_vector getSerialized() const = 0;
     virtual void setSerialized(const uchar_vector& bytes) = 0;
 
+    // Parses the structure at pos and advances pos past it, throwing if end is reached first.
+    // The default goes through setSerialized - structures found in bulk in blocks and messages
+    // override it to parse in place.
+    virtual void deserialize(const unsigned char*& pos, const unsigned char* end);
+
+    // Appends the serialized structure to writer. The default copies from getSerialized -
+    // structures found in bulk write their fields directly.
+    virtual void serializeTo(ByteWriter& writer) const;
+
     virtual std::string toString() const = 0;
     virtual std::string toIndentedString(uint spaces = 0) const = 0;
 
@@ -137,7 +147,9 @@ public:
     const char* getCommand() const { return ""; }
     uint64_t getSize() const;
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const
     {
@@ -219,6 +231,10 @@ public:
     std::string toIndentedString(uint spaces = 0) const;
 
     void removeChecksum() { hasChecksum = false; }
+
+    // Checks the checksum against length bytes of serialized payload.
+    bool isChecksumValid(const unsigned char* payload) const;
+
     uint32_t magic;
     char command[12];
     uint32_t length;
@@ -238,10 +254,14 @@ public:
     CoinNodeMessage(const CoinNodeMessage& message) { this->setMessage(message.header.magic, message.pPayload); }
     CoinNodeMessage(uint32_t magic, CoinNodeStructure* pPayload) { this->setMessage(magic, pPayload); }
     CoinNodeMessage(const uchar_vector& bytes) { this->pPayload = NULL; this->setSerialized(bytes); }
+    CoinNodeMessage(const MessageHeader& header, const unsigned char* payload) { this->pPayload = NULL; this->setPayload(header, payload); }
     ~CoinNodeMessage();
 
     void setMessage(uint32_t magic, CoinNodeStructure* pPayload);
 
+    // Decodes header.length bytes of serialized payload for an already parsed header.
+    void setPayload(const MessageHeader& header, const unsigned char* payload);
+
     const char* getCommand() const { return this->pPayload->getCommand(); }
     uint64_t getSize() const;
     uchar_vector getSerialized() const;
@@ -389,7 +409,9 @@ public:
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return 36; }
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -417,7 +439,9 @@ public:
     const char* getCommand() const { return "inv"; }
     uint64_t getSize() const { return VarInt(this->items.size()).getSize() + 36*this->items.size(); }
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -562,7 +586,9 @@ public:
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return 36; }
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string getTxHash() const { return uchar_vector(this->hash, 32).getHex(); }
 	
@@ -590,7 +616,10 @@ public:
     uint64_t getSize() const { return VarInt(this->scriptSig.size()).getSize() + scriptSig.size() + 40; } // 40 = previousOut + sequence
     uchar_vector getSerialized() const { return this->getSerialized(true); }
     uchar_vector getSerialized(bool includeScriptSigLength) const;
+    void serializeTo(ByteWriter& writer) const { this->serializeTo(writer, true); }
+    void serializeTo(ByteWriter& writer, bool includeScriptSigLength) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     uchar_vector getOutpointHash() const { return uchar_vector(this->previousOut.hash, 32); }
     uint32_t getOutpointIndex() const { return this->previousOut.index; }
@@ -617,7 +646,9 @@ public:
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return VarInt(this->scriptPubKey.size()).getSize() + scriptPubKey.size() + 8; } // 8 = sizeof(value)
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string getAddress() const;
     std::string toString() const;
@@ -645,7 +676,10 @@ public:
     uint64_t getSize() const;
     uchar_vector getSerialized() const { return this->getSerialized(true); }
     uchar_vector getSerialized(bool includeScriptSigLength) const;
+    void serializeTo(ByteWriter& writer) const { this->serializeTo(writer, true); }
+    void serializeTo(ByteWriter& writer, bool includeScriptSigLength) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -704,7 +738,9 @@ public:
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return 80; }
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -717,6 +753,12 @@ public:
 
     const BigInt getWork() const;
 
+    // Fixed-width versions of the above that do not allocate, for use when validating headers in bulk.
+    // A target too large to fit in 256 bits sets pfOverflow and is truncated.
+    const uint256 getTarget256(bool* pfOverflow = NULL) const;
+    const uint256 getWork256() const;
+    bool checkProofOfWork() const;
+
     static void setHashFunc(hashfunc_t hashfunc) { hashfunc_ = hashfunc; }
     static void setPOWHashFunc(hashfunc_t hashfunc) { powhashfunc_ = hashfunc; }
 
@@ -786,7 +828,9 @@ public:
     const char* getCommand() const { return "block"; }
     uint64_t getSize() const;
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -838,7 +882,9 @@ public:
     const char* getCommand() const { return "merkleblock"; }
     uint64_t getSize() const;
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -860,7 +906,9 @@ public:
     const char* getCommand() const { return "headers"; }
     uint64_t getSize() const;
     uchar_vector getSerialized() const;
+    void serializeTo(ByteWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void deserialize(const unsigned char*& pos, const unsigned char* end);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -27,6 +27,7 @@
 #include "random.h"
 
 #include <stdexcept>
+#include <cstring>
 #include <algorithm>
 #include <ctime>
 
@@ -38,29 +39,60 @@ using namespace Coin;
 //
 uchar_vector MerkleTree::getRoot() const
 {
-    uchar_vector pairedHashes;
     if (hashes_.size() == 0)
-        return pairedHashes; // empty vector
+        return uchar_vector(); // empty vector
 
     if (hashes_.size() == 1)
         return hashes_[0];
 
-    MerkleTree tree;
-    for (unsigned int i = 0; i < hashes_.size(); i += 2) {
-        pairedHashes = hashes_[i];
-        if (i + 1 < hashes_.size()) {
-            // two different nodes
-            pairedHashes += hashes_[i + 1];
+    uchar_vector nodes;
+    nodes.reserve(32 * hashes_.size());
+    for (auto& hash: hashes_) {
+        if (hash.size() != 32) throw std::runtime_error("MerkleTree::getRoot - Invalid hash size.");
+        nodes += hash;
+    }
+
+    computeMerkleRoot(&nodes[0], hashes_.size());
+    nodes.resize(32);
+    return nodes;
+}
+
+void Coin::computeMerkleRoot(unsigned char* nodes, std::size_t count)
+{
+    while (count > 1) {
+        std::size_t pairs = count / 2;
+        if (count & 1) {
+            // the last node is paired with itself
+            unsigned char pair[64];
+            std::memcpy(pair, nodes + 32 * (count - 1), 32);
+            std::memcpy(pair + 32, pair, 32);
+            sha256d64(nodes, nodes, pairs);
+            sha256d64(nodes + 32 * pairs, pair, 1);
+            count = pairs + 1;
         }
         else {
-            // the same node with itself
-            pairedHashes += hashes_[i];
+            sha256d64(nodes, nodes, pairs);
+            count = pairs;
         }
-        //pairedHashes.reverse();
-        tree.addHash(sha256_2(pairedHashes));
     }
+}
+
+namespace
+{
+
+// Hashes two child nodes without building their concatenation on the heap
+uchar_vector hashPair(const uchar_vector& left, const uchar_vector& right)
+{
+    if (left.size() != 32 || right.size() != 32) return sha256_2(left + right);
+
+    unsigned char pair[64];
+    std::memcpy(pair, &left[0], 32);
+    std::memcpy(pair + 32, &right[0], 32);
+    uchar_vector hash(32);
+    sha256d64(&hash[0], pair, 1);
+    return hash;
+}
 
-    return tree.getRoot(); // recurse
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -168,14 +200,14 @@ void PartialMerkleTree::setCompressed(std::queue<uchar_vector>& hashQueue, std::
         PartialMerkleTree rightSubtree;
         rightSubtree.setCompressed(hashQueue, bitQueue, depth);
 
-        root_ = sha256_2(leftSubtree.root_ + rightSubtree.root_);
+        root_ = hashPair(leftSubtree.root_, rightSubtree.root_);
         merkleHashes_.splice(merkleHashes_.end(), rightSubtree.merkleHashes_);
         txHashes_.splice(txHashes_.end(), rightSubtree.txHashes_);
         bits_.splice(bits_.end(), rightSubtree.bits_);
     }
     else {
         // There's no right subtree - copy over this node's hash
-        root_ = sha256_2(leftSubtree.root_ + leftSubtree.root_);
+        root_ = hashPair(leftSubtree.root_, leftSubtree.root_);
     }
 }
 
@@ -236,14 +268,14 @@ void PartialMerkleTree::setUncompressed(const std::vector<MerkleLeaf>& leaves, s
         PartialMerkleTree rightSubtree;
         rightSubtree.setUncompressed(leaves, begin + partitionPos, end, depth);
 
-        root_ = sha256_2(leftSubtree.root_ + rightSubtree.root_);
+        root_ = hashPair(leftSubtree.root_, rightSubtree.root_);
 
         merkleHashes_.splice(merkleHashes_.end(), rightSubtree.merkleHashes_);
         txHashes_.splice(txHashes_.end(), rightSubtree.txHashes_);
         bits_.splice(bits_.end(), rightSubtree.bits_);
     }
     else {
-        root_ = sha256_2(leftSubtree.root_ + leftSubtree.root_);
+        root_ = hashPair(leftSubtree.root_, leftSubtree.root_);
     }
 
     if (txHashes_.empty()) {
@@ -367,14 +399,14 @@ void PartialMerkleTree::merge(std::queue<uchar_vector>& hashQueue1, std::queue<u
         PartialMerkleTree rightSubtree;
         rightSubtree.setCompressed(hashQueue1, bitQueue1, depth);
 
-        root = sha256_2(leftSubtree.root_ + rightSubtree.root_);
+        root = hashPair(leftSubtree.root_, rightSubtree.root_);
         merkleHashes_.splice(merkleHashes_.end(), rightSubtree.merkleHashes_);
         txHashes_.splice(txHashes_.end(), rightSubtree.txHashes_);
         bits_.splice(bits_.end(), rightSubtree.bits_);
     }
     else
     {
-        root = sha256_2(leftSubtree.root_ + leftSubtree.root_);
+        root = hashPair(leftSubtree.root_, leftSubtree.root_);
     }
 
     if (root != hashQueue2.front())
@@ -410,8 +442,7 @@ uchar_vector PartialMerkleTree::getFlags() const
 
 void PartialMerkleTree::updateTxIndices()
 {
-    // TODO: optimize
-    std::set<uchar_vector> txHashesSet = getTxHashesSet();
+    std::unordered_set<hash256_t> txHashesSet = getTxHashesSet();
     txIndices_.clear();
     unsigned int i = 0;
     for (auto& hash: merkleHashes_)
@@ -25,6 +25,8 @@
 #pragma once
 
 #include "hash.h"
+#include "hashtypes.h"
+#include "sha256d64.h"
 
 #include <stdutils/uchar_vector.h>
 
@@ -32,6 +34,7 @@
 #include <set>
 #include <queue>
 #include <sstream>
+#include <unordered_set>
 
 namespace Coin
 {
@@ -56,6 +59,11 @@ private:
     std::vector<uchar_vector> hashes_;
 };
 
+// Reduces count 32-byte hashes stored back to back at nodes to their merkle root, one level at a
+// time in place, pairing the last node with itself on odd levels. The root ends up in the first
+// 32 bytes. count must not be zero.
+void computeMerkleRoot(unsigned char* nodes, std::size_t count);
+
 class PartialMerkleTree
 {
 public:
@@ -92,16 +100,16 @@ public:
         return rval;
     }
 
-    std::set<uchar_vector> getTxHashesSet() const
+    std::unordered_set<hash256_t> getTxHashesSet() const
     {
-        std::set<uchar_vector> rval;
+        std::unordered_set<hash256_t> rval(txHashes_.size());
         for (auto& hash: txHashes_) { rval.insert(hash); }
         return rval;
     }
-    std::set<uchar_vector> getTxHashesLittleEndianSet() const
+    std::unordered_set<hash256_t> getTxHashesLittleEndianSet() const
     {
-        std::set<uchar_vector> rval;
-        for (auto& hash: txHashes_) { rval.insert(uchar_vector(hash).getReverse()); }
+        std::unordered_set<hash256_t> rval(txHashes_.size());
+        for (auto& hash: txHashes_) { rval.insert(hash256_t(hash, LittleEndian())); }
         return rval;
     }
 
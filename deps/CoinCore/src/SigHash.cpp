@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// SigHash.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "SigHash.h"
+
+#include <stdexcept>
+
+using namespace Coin;
+
+// Outpoint followed by the empty script's length byte
+const size_t EMPTY_INPUT_PREFIX_SIZE = 37;
+
+SigHashEngine::SigHashEngine(const Transaction& tx)
+{
+    ByteWriter writer(skeleton_);
+    writer.reserve(tx.getSize());
+
+    writer.writeUint<uint32_t>(tx.version);
+    writer.writeVarInt(tx.inputs.size());
+    for (auto& txIn: tx.inputs)
+    {
+        inputOffsets_.push_back(skeleton_.size());
+        txIn.previousOut.serializeTo(writer);
+        writer.writeVarInt(0);
+        writer.writeUint<uint32_t>(txIn.sequence);
+    }
+
+    writer.writeVarInt(tx.outputs.size());
+    for (auto& txOut: tx.outputs) { txOut.serializeTo(writer); }
+    writer.writeUint<uint32_t>(tx.lockTime);
+
+    // Every input shares the bytes before it with all the inputs that follow
+    midstates_.resize(inputOffsets_.size());
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    size_t hashed = 0;
+    for (size_t i = 0; i < inputOffsets_.size(); i++)
+    {
+        SHA256_Update(&ctx, &skeleton_[hashed], inputOffsets_[i] - hashed);
+        hashed = inputOffsets_[i];
+        midstates_[i] = ctx;
+    }
+}
+
+uchar_vector SigHashEngine::getHash(unsigned int index, const uchar_vector& scriptCode, uint32_t hashType) const
+{
+    if (index >= inputOffsets_.size()) throw std::runtime_error("SigHashEngine::getHash - input index out of range.");
+    if (hashType != SIGHASH_ALL) throw std::runtime_error("SigHashEngine::getHash - only SIGHASH_ALL is supported.");
+
+    SHA256_CTX ctx = midstates_[index];
+
+    // Outpoint, then the script code in place of the empty script
+    size_t offset = inputOffsets_[index];
+    SHA256_Update(&ctx, &skeleton_[offset], 36);
+
+    std::vector<unsigned char> scratch;
+    scratch.reserve(9);
+    ByteWriter writer(scratch);
+    writer.writeVarInt(scriptCode.size());
+    SHA256_Update(&ctx, scratch.data(), scratch.size());
+    SHA256_Update(&ctx, scriptCode.data(), scriptCode.size());
+
+    // The rest of the transaction is unchanged
+    offset += EMPTY_INPUT_PREFIX_SIZE;
+    SHA256_Update(&ctx, &skeleton_[offset], skeleton_.size() - offset);
+
+    scratch.clear();
+    writer.writeUint<uint32_t>(hashType);
+    SHA256_Update(&ctx, scratch.data(), scratch.size());
+
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_Final(hash, &ctx);
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, hash, SHA256_DIGEST_LENGTH);
+    SHA256_Final(hash, &ctx);
+    return uchar_vector(hash, SHA256_DIGEST_LENGTH);
+}
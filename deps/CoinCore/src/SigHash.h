@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// SigHash.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include "CoinNodeData.h"
+
+#include <openssl/sha.h>
+
+#include <vector>
+
+namespace Coin
+{
+
+// Computes the SIGHASH_ALL signing hash of each input of a transaction. The transaction is
+// serialized once with every input script empty, and the SHA-256 state reached at the start
+// of each input is kept, so signing an input only hashes the bytes from that input onwards
+// instead of converting and serializing the whole transaction again.
+class SigHashEngine
+{
+public:
+    enum { SIGHASH_ALL = 0x01 };
+
+    explicit SigHashEngine(const Transaction& tx);
+
+    unsigned int inputCount() const { return inputOffsets_.size(); }
+
+    // The hash to sign for input index with scriptCode as its script and all other input
+    // scripts empty - the same as Transaction::getHashWithAppendedCode on such a copy.
+    // Thread safe once constructed.
+    uchar_vector getHash(unsigned int index, const uchar_vector& scriptCode, uint32_t hashType = SIGHASH_ALL) const;
+
+private:
+    uchar_vector skeleton_;
+    std::vector<size_t> inputOffsets_;
+    std::vector<SHA256_CTX> midstates_;
+};
+
+}
@@ -61,6 +61,33 @@ inline uchar_vector sha256_2(const uchar_vector& data)
     return rval;
 }
 
+// Hashes a buffer in place without copying it into a uchar_vector first
+inline uchar_vector sha256_2_raw(const unsigned char* data, size_t len)
+{
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, data, len);
+    SHA256_Final(hash, &sha256);
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, hash, SHA256_DIGEST_LENGTH);
+    SHA256_Final(hash, &sha256);
+    uchar_vector rval(hash, SHA256_DIGEST_LENGTH);
+    return rval;
+}
+
+// Same as above but writes the 32-byte hash to out
+inline void sha256_2_raw(const unsigned char* data, size_t len, unsigned char* out)
+{
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, data, len);
+    SHA256_Final(out, &sha256);
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, out, SHA256_DIGEST_LENGTH);
+    SHA256_Final(out, &sha256);
+}
+
 inline uchar_vector ripemd160(const uchar_vector& data)
 {
     unsigned char hash[RIPEMD160_DIGEST_LENGTH];
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// hashtypes.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Fixed-size digests held inline, for keys of sets and maps and anywhere else a hash would
+// otherwise be a heap allocated uchar_vector.
+//
+// A FixedHash holds its bytes in the order the hash function put them out, the order getHash()
+// returns. Block and tx hashes are usually passed around reversed, the order CoinCore calls little
+// endian (getHashLittleEndian(), hash()). Tag a constructor argument with LittleEndian() when it is
+// in that order, and read a hash that way through littleEndian().
+
+#pragma once
+
+#include <stdutils/uchar_vector.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Coin
+{
+
+struct LittleEndian { };
+
+template<std::size_t N>
+class LittleEndianView;
+
+template<std::size_t N>
+class FixedHash
+{
+public:
+    static const std::size_t SIZE = N;
+
+    typedef const unsigned char* const_iterator;
+
+    FixedHash() { std::memset(data_, 0, N); }
+    explicit FixedHash(const unsigned char* data) { std::memcpy(data_, data, N); }
+    FixedHash(const unsigned char* data, LittleEndian) { std::reverse_copy(data, data + N, data_); }
+
+    // Implicit so a uchar_vector can be used wherever a FixedHash is expected.
+    FixedHash(const std::vector<unsigned char>& bytes)
+    {
+        checkSize(bytes.size());
+        std::memcpy(data_, &bytes[0], N);
+    }
+
+    FixedHash(const std::vector<unsigned char>& bytes, LittleEndian)
+    {
+        checkSize(bytes.size());
+        std::reverse_copy(bytes.begin(), bytes.end(), data_);
+    }
+
+    // Implicit so a FixedHash can be passed wherever a uchar_vector or bytes_t is expected. This is
+    // the one place a FixedHash allocates.
+    operator uchar_vector() const { return uchar_vector(data_, data_ + N); }
+
+    const unsigned char* data() const { return data_; }
+    unsigned char* data() { return data_; }
+    std::size_t size() const { return N; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + N; }
+    unsigned char operator[](std::size_t i) const { return data_[i]; }
+    unsigned char& operator[](std::size_t i) { return data_[i]; }
+
+    bool isZero() const
+    {
+        for (std::size_t i = 0; i < N; i++) { if (data_[i]) return false; }
+        return true;
+    }
+
+    FixedHash getReverse() const { return FixedHash(data_, LittleEndian()); }
+    LittleEndianView<N> littleEndian() const { return LittleEndianView<N>(data_); }
+
+    std::string getHex() const { return uchar_vector(data_, data_ + N).getHex(); }
+
+    // Digests are uniformly distributed so any word of one is as good a hash code as any other.
+    std::size_t hashCode() const
+    {
+        std::size_t code;
+        std::memcpy(&code, data_, sizeof(code));
+        return code;
+    }
+
+    friend bool operator==(const FixedHash& lhs, const FixedHash& rhs) { return !std::memcmp(lhs.data_, rhs.data_, N); }
+    friend bool operator!=(const FixedHash& lhs, const FixedHash& rhs) { return !(lhs == rhs); }
+    friend bool operator<(const FixedHash& lhs, const FixedHash& rhs) { return std::memcmp(lhs.data_, rhs.data_, N) < 0; }
+
+    // Compare with byte vectors of any size without converting them.
+    friend bool operator==(const FixedHash& lhs, const std::vector<unsigned char>& rhs) { return rhs.size() == N && !std::memcmp(lhs.data_, &rhs[0], N); }
+    friend bool operator==(const std::vector<unsigned char>& lhs, const FixedHash& rhs) { return rhs == lhs; }
+    friend bool operator!=(const FixedHash& lhs, const std::vector<unsigned char>& rhs) { return !(lhs == rhs); }
+    friend bool operator!=(const std::vector<unsigned char>& lhs, const FixedHash& rhs) { return !(rhs == lhs); }
+
+private:
+    static void checkSize(std::size_t size)
+    {
+        if (size != N) throw std::runtime_error("FixedHash - Invalid hash size.");
+    }
+
+    unsigned char data_[N];
+};
+
+// A FixedHash read back to front, without copying it.
+template<std::size_t N>
+class LittleEndianView
+{
+public:
+    typedef std::reverse_iterator<const unsigned char*> const_iterator;
+
+    explicit LittleEndianView(const unsigned char* data) : data_(data) { }
+
+    operator uchar_vector() const { return uchar_vector(begin(), end()); }
+
+    std::size_t size() const { return N; }
+    const_iterator begin() const { return const_iterator(data_ + N); }
+    const_iterator end() const { return const_iterator(data_); }
+    unsigned char operator[](std::size_t i) const { return data_[N - 1 - i]; }
+
+    std::string getHex() const { return uchar_vector(begin(), end()).getHex(); }
+
+    friend bool operator==(const LittleEndianView& lhs, const std::vector<unsigned char>& rhs) { return rhs.size() == N && std::equal(lhs.begin(), lhs.end(), rhs.begin()); }
+    friend bool operator==(const std::vector<unsigned char>& lhs, const LittleEndianView& rhs) { return rhs == lhs; }
+    friend bool operator!=(const LittleEndianView& lhs, const std::vector<unsigned char>& rhs) { return !(lhs == rhs); }
+    friend bool operator!=(const std::vector<unsigned char>& lhs, const LittleEndianView& rhs) { return !(rhs == lhs); }
+
+private:
+    const unsigned char* data_;
+};
+
+}
+
+typedef Coin::FixedHash<32> hash256_t;
+typedef Coin::FixedHash<20> hash160_t;
+
+namespace std
+{
+
+template<std::size_t N>
+struct hash<Coin::FixedHash<N>>
+{
+    std::size_t operator()(const Coin::FixedHash<N>& hash) const { return hash.hashCode(); }
+};
+
+}
@@ -115,7 +115,7 @@ HDKeychain::HDKeychain(const HDKeychain& source)
     child_num_ = source.child_num_;
     chain_code_ = source.chain_code_;
     key_ = source.key_;
-    updatePubkey();
+    pubkey_ = source.pubkey_;
 }
 
 HDKeychain& HDKeychain::operator=(const HDKeychain& rhs)
@@ -128,7 +128,7 @@ HDKeychain& HDKeychain::operator=(const HDKeychain& rhs)
         child_num_ = rhs.child_num_;
         chain_code_ = rhs.chain_code_;
         key_ = rhs.key_;
-        updatePubkey();
+        pubkey_ = rhs.pubkey_;
     }
     return *this;
 }
@@ -351,6 +351,23 @@ std::string HDKeychain::toString() const
     return ss.str();
 }
 
+// Writes through a volatile pointer so the stores can't be optimized away.
+static void secure_zero(bytes_t& data)
+{
+    volatile unsigned char* p = data.data();
+    for (size_t i = 0; i < data.size(); i++) { p[i] = 0; }
+}
+
+void HDKeychain::wipe()
+{
+    secure_zero(key_);
+    secure_zero(chain_code_);
+    key_.clear();
+    chain_code_.clear();
+    pubkey_.clear();
+    valid_ = false;
+}
+
 void HDKeychain::updatePubkey() {
     if (isPrivate()) {
         secp256k1_key curvekey;
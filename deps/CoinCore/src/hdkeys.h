@@ -128,6 +128,9 @@ public:
         return bCompressed ? getChild(i).pubkey() : getChild(i).uncompressed_pubkey();
     }
 
+    // Zeroes the key and chain code and leaves the keychain invalid.
+    void wipe();
+
     static void setVersions(uint32_t priv_version, uint32_t pub_version) { priv_version_ = priv_version; pub_version_ = pub_version; }
 
     std::string toString() const;
@@ -28,8 +28,11 @@
 #include "secp256k1_openssl.h"
 #include "hash.h"
 
+#include <openssl/crypto.h>
+
 #include <string>
 #include <cassert>
+#include <mutex>
 
 #ifdef TRACE_RFC6979
   #include <iostream>
@@ -37,6 +40,34 @@
 
 using namespace CoinCrypto;
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+// OpenSSL before 1.1 can only be used from several threads at once, as the vault does when
+// signing inputs in parallel, after locking callbacks are installed. Install them on load
+// unless the application has already done so.
+namespace
+{
+
+std::mutex* g_opensslLocks = nullptr;
+
+void opensslLockingCallback(int mode, int n, const char* /*file*/, int /*line*/)
+{
+    if (mode & CRYPTO_LOCK) { g_opensslLocks[n].lock(); }
+    else                    { g_opensslLocks[n].unlock(); }
+}
+
+struct OpenSSLThreadSetup
+{
+    OpenSSLThreadSetup()
+    {
+        if (CRYPTO_get_locking_callback()) return;
+        g_opensslLocks = new std::mutex[CRYPTO_num_locks()];
+        CRYPTO_set_locking_callback(opensslLockingCallback);
+    }
+} g_opensslThreadSetup;
+
+}
+#endif
+
 const uchar_vector SECP256K1_FIELD_MOD("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC2F");
 const uchar_vector SECP256K1_GROUP_ORDER("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141");
 const uchar_vector SECP256K1_GROUP_HALFORDER("7FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF5D576E7357A4501DDFE92F46681B20A0");
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256d64.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sha256d64.h"
+
+#include <openssl/sha.h>
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef COINCORE_SHA256D64_X86
+#include <cpuid.h>
+#endif
+
+using namespace Coin;
+
+namespace
+{
+
+typedef void (*impl_t)(unsigned char*, const unsigned char*, std::size_t);
+
+struct Implementation
+{
+    const char* name;
+    impl_t fn;
+};
+
+#ifdef COINCORE_SHA256D64_X86
+struct CpuFeatures
+{
+    bool sse41;
+    bool avx2;
+    bool shani;
+};
+
+CpuFeatures detectCpuFeatures()
+{
+    CpuFeatures features = { false, false, false };
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return features;
+    features.sse41 = (ecx >> 19) & 1;
+
+    // AVX2 also needs the operating system to save the ymm registers.
+    bool avx = false;
+    if (((ecx >> 27) & 1) && ((ecx >> 28) & 1))
+    {
+        uint32_t xcr0, xcr0_high;
+        __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+        avx = (xcr0 & 6) == 6;
+    }
+
+    if (__get_cpuid_max(0, NULL) >= 7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        features.avx2 = avx && ((ebx >> 5) & 1);
+        features.shani = features.sse41 && ((ebx >> 29) & 1);
+    }
+    return features;
+}
+#endif
+
+std::vector<Implementation> availableImplementations()
+{
+    std::vector<Implementation> implementations;
+#ifdef COINCORE_SHA256D64_X86
+    CpuFeatures features = detectCpuFeatures();
+    if (features.shani) { Implementation impl = { "shani", &sha256d64_impl::shani }; implementations.push_back(impl); }
+    if (features.avx2)  { Implementation impl = { "avx2", &sha256d64_impl::avx2 }; implementations.push_back(impl); }
+    if (features.sse41) { Implementation impl = { "sse4.1", &sha256d64_impl::sse41 }; implementations.push_back(impl); }
+#endif
+    Implementation openssl = { "openssl", &sha256d64_impl::openssl };
+    implementations.push_back(openssl);
+    return implementations;
+}
+
+const std::vector<Implementation>& implementations()
+{
+    static const std::vector<Implementation> implementations = availableImplementations();
+    return implementations;
+}
+
+std::atomic<const Implementation*> selected(nullptr);
+
+const Implementation* selectedImplementation()
+{
+    const Implementation* impl = selected.load(std::memory_order_acquire);
+    if (!impl)
+    {
+        // Leave any choice made meanwhile by sha256d64_select alone.
+        impl = &implementations().front();
+        const Implementation* expected = nullptr;
+        if (!selected.compare_exchange_strong(expected, impl)) { impl = expected; }
+    }
+    return impl;
+}
+
+}
+
+void sha256d64_impl::openssl(unsigned char* out, const unsigned char* in, std::size_t count)
+{
+    for (; count > 0; count--, in += 64, out += 32)
+    {
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        SHA256_CTX sha256;
+        SHA256_Init(&sha256);
+        SHA256_Update(&sha256, in, 64);
+        SHA256_Final(hash, &sha256);
+        SHA256_Init(&sha256);
+        SHA256_Update(&sha256, hash, SHA256_DIGEST_LENGTH);
+        SHA256_Final(out, &sha256);
+    }
+}
+
+void Coin::sha256d64(unsigned char* out, const unsigned char* in, std::size_t count)
+{
+    selectedImplementation()->fn(out, in, count);
+}
+
+std::string Coin::sha256d64_implementation()
+{
+    return selectedImplementation()->name;
+}
+
+std::vector<std::string> Coin::sha256d64_implementations()
+{
+    std::vector<std::string> names;
+    for (auto& impl: implementations()) { names.push_back(impl.name); }
+    return names;
+}
+
+bool Coin::sha256d64_select(const std::string& implementation)
+{
+    for (auto& impl: implementations())
+    {
+        if (implementation == impl.name)
+        {
+            selected.store(&impl, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
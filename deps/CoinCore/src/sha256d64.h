@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256d64.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Batch double SHA-256 of 64-byte inputs, which is all a merkle tree ever hashes.
+//
+// On x86 the fastest implementation the processor supports is picked the first time it is needed:
+// SHA extensions, then 8 lanes of AVX2, then 4 lanes of SSE4.1. Elsewhere, and for inputs left
+// over after filling the lanes, OpenSSL hashes one input at a time.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COINCORE_SHA256D64_X86
+#endif
+
+namespace Coin
+{
+
+// Writes the double SHA-256 of each of the count 64-byte inputs at in to consecutive 32-byte
+// digests at out. out may be the same as in, so a merkle tree level can be hashed in place.
+void sha256d64(unsigned char* out, const unsigned char* in, std::size_t count);
+
+// The implementation sha256d64 uses: "shani", "avx2", "sse4.1" or "openssl".
+std::string sha256d64_implementation();
+
+// The implementations this processor can run, fastest first. For tests and benchmarks.
+std::vector<std::string> sha256d64_implementations();
+
+// Makes sha256d64 use the named implementation. Returns false if it cannot run here.
+bool sha256d64_select(const std::string& implementation);
+
+namespace sha256d64_impl
+{
+    void openssl(unsigned char* out, const unsigned char* in, std::size_t count);
+
+#ifdef COINCORE_SHA256D64_X86
+    void sse41(unsigned char* out, const unsigned char* in, std::size_t count);
+    void avx2(unsigned char* out, const unsigned char* in, std::size_t count);
+    void shani(unsigned char* out, const unsigned char* in, std::size_t count);
+#endif
+}
+
+}
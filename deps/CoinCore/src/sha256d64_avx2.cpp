@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256d64_avx2.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// Eight inputs at a time in the lanes of AVX2 registers. Built with -mavx2.
+
+#include "sha256d64.h"
+
+#ifdef COINCORE_SHA256D64_X86
+
+#include "sha256d64_lanes.h"
+
+#include <cstring>
+
+#include <immintrin.h>
+
+using namespace Coin::sha256d64_impl;
+
+namespace
+{
+
+inline uint32_t readBE32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+struct AvxLanes
+{
+    typedef __m256i V;
+    static const std::size_t N = 8;
+
+    static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+    static V xor_(V a, V b) { return _mm256_xor_si256(a, b); }
+    static V and_(V a, V b) { return _mm256_and_si256(a, b); }
+    static V or_(V a, V b) { return _mm256_or_si256(a, b); }
+    static V andnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+    static V shr(V x, int n) { return _mm256_srli_epi32(x, n); }
+    static V shl(V x, int n) { return _mm256_slli_epi32(x, n); }
+    static V set1(uint32_t x) { return _mm256_set1_epi32(x); }
+
+    static V load(const unsigned char* in, int i)
+    {
+        in += 4*i;
+        return _mm256_set_epi32(readBE32(in + 448), readBE32(in + 384), readBE32(in + 320), readBE32(in + 256),
+                                readBE32(in + 192), readBE32(in + 128), readBE32(in + 64), readBE32(in));
+    }
+
+    static void store(unsigned char* out, int i, V x)
+    {
+        // Reverse the bytes of each word, then scatter the words to their digests.
+        x = _mm256_shuffle_epi8(x, _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                                   12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+        uint32_t words[N];
+        _mm256_storeu_si256((V*)words, x);
+        out += 4*i;
+        for (std::size_t j = 0; j < N; j++) { std::memcpy(out + 32*j, &words[j], 4); }
+    }
+};
+
+}
+
+void Coin::sha256d64_impl::avx2(unsigned char* out, const unsigned char* in, std::size_t count)
+{
+    for (; count >= AvxLanes::N; count -= AvxLanes::N, in += 64*AvxLanes::N, out += 32*AvxLanes::N)
+    {
+        Sha256Lanes<AvxLanes>::hash(out, in);
+    }
+    if (count >= 4) { sse41(out, in, count); } // every AVX2 processor has SSE4.1
+    else if (count > 0) { openssl(out, in, count); }
+}
+
+#endif
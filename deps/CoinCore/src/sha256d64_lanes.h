@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256d64_lanes.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Double SHA-256 of several 64-byte inputs at once, one input per lane of a SIMD register.
+// Only included by the implementation files, each of which is built for its own instruction set
+// and supplies a Lanes class with:
+//
+//   typedef ... V;                                   // register of N 32-bit lanes
+//   static const std::size_t N;
+//   static V add(V, V), xor_(V, V), and_(V, V), or_(V, V), andnot(V a, V b); // andnot is ~a & b
+//   static V shr(V, int), shl(V, int), set1(uint32_t);
+//   static V load(const unsigned char* in, int i);   // big endian word i of each of N 64-byte inputs
+//   static void store(unsigned char* out, int i, V); // word i of each of N 32-byte digests
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Coin
+{
+namespace sha256d64_impl
+{
+
+template<class L>
+class Sha256Lanes
+{
+public:
+    typedef typename L::V V;
+
+    // Hashes L::N inputs. All of them are read before any digest is written.
+    static void hash(unsigned char* out, const unsigned char* in)
+    {
+        V w[16];
+        for (int i = 0; i < 16; i++) { w[i] = L::load(in, i); }
+
+        V s[8];
+        for (int i = 0; i < 8; i++) { s[i] = L::set1(iv(i)); }
+        transform(s, w);
+
+        // Padding block for a 64-byte message
+        transformPadding(s);
+
+        // Second hash over the 32-byte digest
+        for (int i = 0; i < 8; i++) { w[i] = s[i]; s[i] = L::set1(iv(i)); }
+        w[8] = L::set1(0x80000000);
+        for (int i = 9; i < 15; i++) { w[i] = L::set1(0); }
+        w[15] = L::set1(256);
+        transform(s, w);
+
+        for (int i = 0; i < 8; i++) { L::store(out, i, s[i]); }
+    }
+
+private:
+    static uint32_t iv(int i)
+    {
+        static const uint32_t IV[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        return IV[i];
+    }
+
+    static uint32_t k(int i)
+    {
+        static const uint32_t K[64] =
+        {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+        return K[i];
+    }
+
+    // The padding block is the same for every 64-byte message, so its expanded message schedule
+    // plus the round constants can be worked out once.
+    struct PaddingSchedule
+    {
+        PaddingSchedule()
+        {
+            uint32_t w[64] = { 0x80000000 };
+            w[15] = 512;
+            for (int i = 16; i < 64; i++)
+            {
+                uint32_t sigma0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t sigma1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + sigma0 + w[i - 7] + sigma1;
+            }
+            for (int i = 0; i < 64; i++) { kw[i] = k(i) + w[i]; }
+        }
+
+        static uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+        uint32_t kw[64];
+    };
+
+    static V rotr(V x, int n) { return L::or_(L::shr(x, n), L::shl(x, 32 - n)); }
+
+    static void round(V& a, V& b, V& c, V& d, V& e, V& f, V& g, V& h, V kw)
+    {
+        V Sigma1 = L::xor_(L::xor_(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+        V ch = L::xor_(L::and_(e, f), L::andnot(e, g));
+        V t1 = L::add(L::add(h, Sigma1), L::add(ch, kw));
+        V Sigma0 = L::xor_(L::xor_(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+        V maj = L::or_(L::and_(a, b), L::and_(c, L::or_(a, b)));
+        V t2 = L::add(Sigma0, maj);
+        h = g; g = f; f = e; e = L::add(d, t1); d = c; c = b; b = a; a = L::add(t1, t2);
+    }
+
+    static void transformPadding(V s[8])
+    {
+        static const PaddingSchedule schedule;
+
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i++) { round(a, b, c, d, e, f, g, h, L::set1(schedule.kw[i])); }
+        s[0] = L::add(s[0], a); s[1] = L::add(s[1], b); s[2] = L::add(s[2], c); s[3] = L::add(s[3], d);
+        s[4] = L::add(s[4], e); s[5] = L::add(s[5], f); s[6] = L::add(s[6], g); s[7] = L::add(s[7], h);
+    }
+
+    static void transform(V s[8], V w[16])
+    {
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i++)
+        {
+            if (i >= 16)
+            {
+                V w15 = w[(i + 1) & 15];
+                V w2 = w[(i + 14) & 15];
+                V sigma0 = L::xor_(L::xor_(rotr(w15, 7), rotr(w15, 18)), L::shr(w15, 3));
+                V sigma1 = L::xor_(L::xor_(rotr(w2, 17), rotr(w2, 19)), L::shr(w2, 10));
+                w[i & 15] = L::add(L::add(w[i & 15], sigma1), L::add(w[(i + 9) & 15], sigma0));
+            }
+            round(a, b, c, d, e, f, g, h, L::add(L::set1(k(i)), w[i & 15]));
+        }
+        s[0] = L::add(s[0], a); s[1] = L::add(s[1], b); s[2] = L::add(s[2], c); s[3] = L::add(s[3], d);
+        s[4] = L::add(s[4], e); s[5] = L::add(s[5], f); s[6] = L::add(s[6], g); s[7] = L::add(s[7], h);
+    }
+};
+
+}
+}
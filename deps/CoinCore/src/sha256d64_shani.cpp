@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256d64_shani.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// One input at a time with the SHA extensions. Built with -msse4.1 -msha.
+
+#include "sha256d64.h"
+
+#ifdef COINCORE_SHA256D64_X86
+
+#include <cstdint>
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace
+{
+
+const uint32_t K[64] __attribute__((aligned(16))) =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// The state is kept as the ABEF and CDGH word pairs the SHA instructions work on.
+struct State
+{
+    __m128i abef;
+    __m128i cdgh;
+};
+
+inline State initialState()
+{
+    // a..h = 6a09e667 bb67ae85 3c6ef372 a54ff53a 510e527f 9b05688c 1f83d9ab 5be0cd19
+    State state;
+    state.abef = _mm_set_epi32(0x6a09e667, 0xbb67ae85, 0x510e527f, 0x9b05688c);
+    state.cdgh = _mm_set_epi32(0x3c6ef372, 0xa54ff53a, 0x1f83d9ab, 0x5be0cd19);
+    return state;
+}
+
+inline void rounds(State& state, __m128i msg, int i)
+{
+    msg = _mm_add_epi32(msg, _mm_load_si128((const __m128i*)(K + 4*i)));
+    state.cdgh = _mm_sha256rnds2_epu32(state.cdgh, state.abef, msg);
+    state.abef = _mm_sha256rnds2_epu32(state.abef, state.cdgh, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+// Compresses one block given as four registers of big endian words already in host order.
+inline void transform(State& state, __m128i w0, __m128i w1, __m128i w2, __m128i w3)
+{
+    State saved = state;
+    __m128i w[4] = { w0, w1, w2, w3 };
+    for (int i = 0; i < 16; i++)
+    {
+        if (i >= 4)
+        {
+            __m128i next = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+            next = _mm_add_epi32(next, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+            w[i & 3] = _mm_sha256msg2_epu32(next, w[(i + 3) & 3]);
+        }
+        rounds(state, w[i & 3], i);
+    }
+    state.abef = _mm_add_epi32(state.abef, saved.abef);
+    state.cdgh = _mm_add_epi32(state.cdgh, saved.cdgh);
+}
+
+// Words a..d and e..h of the digest, in order.
+inline void digestWords(const State& state, __m128i& abcd, __m128i& efgh)
+{
+    // Reversed, the pairs read a, b, e, f and c, d, g, h from the lowest lane up.
+    __m128i abef = _mm_shuffle_epi32(state.abef, 0x1b);
+    __m128i cdgh = _mm_shuffle_epi32(state.cdgh, 0x1b);
+    abcd = _mm_unpacklo_epi64(abef, cdgh);
+    efgh = _mm_unpackhi_epi64(abef, cdgh);
+}
+
+}
+
+void Coin::sha256d64_impl::shani(unsigned char* out, const unsigned char* in, std::size_t count)
+{
+    const __m128i byteswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; count > 0; count--, in += 64, out += 32)
+    {
+        State state = initialState();
+        transform(state,
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), byteswap),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 16)), byteswap),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 32)), byteswap),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 48)), byteswap));
+
+        // Padding block for a 64-byte message
+        transform(state, _mm_set_epi32(0, 0, 0, 0x80000000), zero, zero, _mm_set_epi32(512, 0, 0, 0));
+
+        // Second hash over the 32-byte digest
+        __m128i abcd, efgh;
+        digestWords(state, abcd, efgh);
+        state = initialState();
+        transform(state, abcd, efgh, _mm_set_epi32(0, 0, 0, 0x80000000), _mm_set_epi32(256, 0, 0, 0));
+
+        digestWords(state, abcd, efgh);
+        _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(abcd, byteswap));
+        _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(efgh, byteswap));
+    }
+}
+
+#endif
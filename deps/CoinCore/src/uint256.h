@@ -11,6 +11,7 @@
 #include <inttypes.h>
 #include <string>
 #include <vector>
+#include <stdexcept>
 
 typedef long long  int64;
 typedef unsigned long long  uint64;
@@ -163,6 +164,62 @@ public:
         return *this;
     }
 
+    // Long division by shift and subtract.
+    base_uint& operator/=(const base_uint& b)
+    {
+        base_uint div = b;
+        base_uint num = *this;
+        *this = 0;
+        int num_bits = num.bits();
+        int div_bits = div.bits();
+        if (div_bits == 0)
+            throw std::runtime_error("Division by zero.");
+        if (div_bits > num_bits)
+            return *this;
+        int shift = num_bits - div_bits;
+        div <<= shift;
+        while (shift >= 0)
+        {
+            if (num >= div)
+            {
+                // num -= div without the temporary negation
+                uint64 borrow = 0;
+                for (int i = 0; i < WIDTH; i++)
+                {
+                    uint64 n = (uint64)num.pn[i] - div.pn[i] - borrow;
+                    num.pn[i] = (uint32_t)n;
+                    borrow = (n >> 32) & 1;
+                }
+                pn[shift / 32] |= (1U << (shift & 31));
+            }
+
+            // div >>= 1 in place
+            for (int i = 0; i < WIDTH - 1; i++)
+                div.pn[i] = (div.pn[i] >> 1) | (div.pn[i + 1] << 31);
+            div.pn[WIDTH - 1] >>= 1;
+            shift--;
+        }
+        return *this;
+    }
+
+    // Position of the highest set bit plus one, zero if no bits are set.
+    unsigned int bits() const
+    {
+        for (int pos = WIDTH - 1; pos >= 0; pos--)
+        {
+            if (pn[pos])
+            {
+                for (int nbits = 31; nbits > 0; nbits--)
+                {
+                    if (pn[pos] & (1U << nbits))
+                        return 32 * pos + nbits + 1;
+                }
+                return 32 * pos + 1;
+            }
+        }
+        return 0;
+    }
+
     base_uint& operator+=(uint64 b64)
     {
         base_uint b;
@@ -588,6 +645,29 @@ public:
         else
             *this = 0;
     }
+
+    // Decodes the compact representation of a target used in block headers:
+    // the top byte is the size in bytes and the lower 23 bits the mantissa.
+    uint256& SetCompact(uint32_t nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL)
+    {
+        int nSize = nCompact >> 24;
+        uint32_t nWord = nCompact & 0x007fffff;
+        if (nSize <= 3)
+        {
+            nWord >>= 8 * (3 - nSize);
+            *this = nWord;
+        }
+        else
+        {
+            *this = nWord;
+            *this <<= 8 * (nSize - 3);
+        }
+        if (pfNegative)
+            *pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+        if (pfOverflow)
+            *pfOverflow = nWord != 0 && ((nSize > 34) || (nWord > 0xff && nSize > 33) || (nWord > 0xffff && nSize > 32));
+        return *this;
+    }
 };
 
 inline bool operator==(const uint256& a, uint64 b)                           { return (base_uint256)a == b; }
@@ -602,6 +682,7 @@ inline const uint256 operator&(const base_uint256& a, const base_uint256& b) { r
 inline const uint256 operator|(const base_uint256& a, const base_uint256& b) { return uint256(a) |= b; }
 inline const uint256 operator+(const base_uint256& a, const base_uint256& b) { return uint256(a) += b; }
 inline const uint256 operator-(const base_uint256& a, const base_uint256& b) { return uint256(a) -= b; }
+inline const uint256 operator/(const base_uint256& a, const base_uint256& b) { return uint256(a) /= b; }
 
 inline bool operator<(const base_uint256& a, const uint256& b)          { return (base_uint256)a <  (base_uint256)b; }
 inline bool operator<=(const base_uint256& a, const uint256& b)         { return (base_uint256)a <= (base_uint256)b; }
@@ -614,6 +695,7 @@ inline const uint256 operator&(const base_uint256& a, const uint256& b) { return
 inline const uint256 operator|(const base_uint256& a, const uint256& b) { return (base_uint256)a |  (base_uint256)b; }
 inline const uint256 operator+(const base_uint256& a, const uint256& b) { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const base_uint256& a, const uint256& b) { return (base_uint256)a -  (base_uint256)b; }
+inline const uint256 operator/(const base_uint256& a, const uint256& b) { return (base_uint256)a /  (base_uint256)b; }
 
 inline bool operator<(const uint256& a, const base_uint256& b)          { return (base_uint256)a <  (base_uint256)b; }
 inline bool operator<=(const uint256& a, const base_uint256& b)         { return (base_uint256)a <= (base_uint256)b; }
@@ -626,6 +708,7 @@ inline const uint256 operator&(const uint256& a, const base_uint256& b) { return
 inline const uint256 operator|(const uint256& a, const base_uint256& b) { return (base_uint256)a |  (base_uint256)b; }
 inline const uint256 operator+(const uint256& a, const base_uint256& b) { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const uint256& a, const base_uint256& b) { return (base_uint256)a -  (base_uint256)b; }
+inline const uint256 operator/(const uint256& a, const base_uint256& b) { return (base_uint256)a /  (base_uint256)b; }
 
 inline bool operator<(const uint256& a, const uint256& b)               { return (base_uint256)a <  (base_uint256)b; }
 inline bool operator<=(const uint256& a, const uint256& b)              { return (base_uint256)a <= (base_uint256)b; }
@@ -638,6 +721,7 @@ inline const uint256 operator&(const uint256& a, const uint256& b)      { return
 inline const uint256 operator|(const uint256& a, const uint256& b)      { return (base_uint256)a |  (base_uint256)b; }
 inline const uint256 operator+(const uint256& a, const uint256& b)      { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const uint256& a, const uint256& b)      { return (base_uint256)a -  (base_uint256)b; }
+inline const uint256 operator/(const uint256& a, const uint256& b)      { return (base_uint256)a /  (base_uint256)b; }
 
 
 
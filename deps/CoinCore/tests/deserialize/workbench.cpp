@@ -0,0 +1,172 @@
+// Compares parsing blocks and transactions in place through deserialize() against the
+// original approach of slicing a fresh uchar_vector out for every nested field.
+//
+// Usage: workbench [raw block file]...
+// With no arguments the mainnet genesis block and a synthetic block of typical
+// pay-to-pubkey-hash transactions are used. Raw blocks can be taken from
+// `bitcoin-cli getblock <hash> 0` (after converting from hex) or cut from blk*.dat files.
+
+#include <CoinNodeData.h>
+#include <numericdata.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace Coin;
+using namespace std;
+
+const char* GENESIS_BLOCK_HEX =
+    "0100000000000000000000000000000000000000000000000000000000000000000000003ba3edfd7a7b12b27ac72c3e67768f617fc81bc3888a51323a9fb8aa4b1e5e4a29ab5f49ffff001d1dac2b7c"
+    "01"
+    "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4d04ffff001d0104455468652054696d65732030332f4a616e2f32303039204368616e63656c6c6f72206f6e206272696e6b206f66207365636f6e64206261696c6f757420666f722062616e6b73ffffffff0100f2052a01000000434104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac00000000";
+
+const char* GENESIS_BLOCK_HASH = "000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f";
+
+// The slicing parsers CoinNodeData used before deserialize() was added
+TxIn legacyTxIn(const uchar_vector& bytes)
+{
+    TxIn txIn;
+    uchar_vector hashBytes(bytes.begin(), bytes.begin() + 32);
+    hashBytes.reverse();
+    memcpy(txIn.previousOut.hash, &hashBytes[0], 32);
+    txIn.previousOut.index = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 32, bytes.begin() + 36), LITTLE_ENDIAN_);
+    VarInt scriptLength(uchar_vector(bytes.begin() + 36, bytes.end()));
+    uint pos = scriptLength.getSize() + 36;
+    txIn.scriptSig.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    pos += scriptLength.value;
+    txIn.sequence = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_);
+    return txIn;
+}
+
+TxOut legacyTxOut(const uchar_vector& bytes)
+{
+    TxOut txOut;
+    txOut.value = vch_to_uint<uint64_t>(bytes, LITTLE_ENDIAN_);
+    VarInt scriptLength(uchar_vector(bytes.begin() + 8, bytes.end()));
+    uint pos = scriptLength.getSize() + 8;
+    txOut.scriptPubKey.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    return txOut;
+}
+
+Transaction legacyTransaction(const uchar_vector& bytes)
+{
+    Transaction tx;
+    tx.version = vch_to_uint<uint32_t>(uchar_vector(bytes.begin(), bytes.begin() + 4), LITTLE_ENDIAN_);
+    VarInt count(uchar_vector(bytes.begin() + 4, bytes.end()));
+    uint pos = count.getSize() + 4;
+    for (uint64_t i = 0; i < count.value; i++) {
+        TxIn txIn = legacyTxIn(uchar_vector(bytes.begin() + pos, bytes.end()));
+        tx.addInput(txIn);
+        pos += txIn.getSize();
+    }
+    count.setSerialized(uchar_vector(bytes.begin() + pos, bytes.end()));
+    pos += count.getSize();
+    for (uint64_t i = 0; i < count.value; i++) {
+        TxOut txOut = legacyTxOut(uchar_vector(bytes.begin() + pos, bytes.end()));
+        tx.addOutput(txOut);
+        pos += txOut.getSize();
+    }
+    tx.lockTime = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), LITTLE_ENDIAN_);
+    return tx;
+}
+
+CoinBlock legacyBlock(const uchar_vector& bytes)
+{
+    CoinBlock block;
+    block.blockHeader = CoinBlockHeader(uchar_vector(bytes.begin(), bytes.begin() + MIN_COIN_BLOCK_HEADER_SIZE));
+    uint pos = MIN_COIN_BLOCK_HEADER_SIZE;
+    MerkleTree txMerkleTree;
+    VarInt count(uchar_vector(bytes.begin() + pos, bytes.end())); pos += count.getSize();
+    for (uint i = 0; i < count.value; i++) {
+        Transaction tx = legacyTransaction(uchar_vector(bytes.begin() + pos, bytes.end())); pos += tx.getSize();
+        block.txs.push_back(tx);
+        txMerkleTree.addHash(tx.getHash());
+    }
+    if (block.blockHeader.merkleRoot() != txMerkleTree.getRootLittleEndian()) throw runtime_error("Legacy merkle root mismatch.");
+    return block;
+}
+
+// A block of 2-in 2-out pay-to-pubkey-hash transactions, the most common shape on mainnet
+uchar_vector syntheticBlock(int txCount)
+{
+    CoinBlock block(2, 1400000000, 0x1d00ffff);
+    for (int i = 0; i < txCount; i++)
+    {
+        Transaction tx;
+        for (int j = 0; j < 2; j++)
+        {
+            uchar_vector prevHash = sha256(uint_to_vch<uint32_t>(2 * i + j, LITTLE_ENDIAN_));
+            uchar_vector scriptSig(107, (unsigned char)(i + j));
+            tx.addInput(TxIn(OutPoint(prevHash, j), scriptSig, 0xffffffff));
+
+            uchar_vector scriptPubKey("76a914");
+            scriptPubKey += ripemd160(prevHash);
+            scriptPubKey += uchar_vector("88ac");
+            tx.addOutput(TxOut(100000 * (i + 1), scriptPubKey));
+        }
+        block.addTransaction(tx);
+    }
+    block.updateMerkleRoot();
+    return block.getSerialized();
+}
+
+template<typename Function>
+double nsPerByte(Function parse, const uchar_vector& bytes, int rounds)
+{
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) { parse(bytes); }
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)rounds * bytes.size());
+}
+
+void bench(const string& name, const uchar_vector& bytes)
+{
+    CoinBlock block(bytes);
+    CoinBlock legacy = legacyBlock(bytes);
+    if (block.getSerialized() != bytes || legacy.getSerialized() != bytes) throw runtime_error(name + ": round trip mismatch.");
+
+    int rounds = std::max(10, (int)(20000000 / bytes.size()));
+
+    double legacyBlockNs = nsPerByte([](const uchar_vector& b) { legacyBlock(b); }, bytes, rounds);
+    double blockNs = nsPerByte([](const uchar_vector& b) { CoinBlock block(b); }, bytes, rounds);
+
+    // Transactions on their own, without the merkle root check
+    uchar_vector txBytes = block.txs.back().getSerialized();
+    int txRounds = std::max(1000, (int)(5000000 / txBytes.size()));
+    double legacyTxNs = nsPerByte([](const uchar_vector& b) { legacyTransaction(b); }, txBytes, txRounds);
+    double txNs = nsPerByte([](const uchar_vector& b) { Transaction tx(b); }, txBytes, txRounds);
+
+    cout << name << ": " << bytes.size() << " bytes, " << block.txs.size() << " txs" << endl
+         << "  block  slicing: " << 1000.0 / legacyBlockNs << " MB/s  in place: " << 1000.0 / blockNs << " MB/s" << endl
+         << "  tx     slicing: " << 1000.0 / legacyTxNs << " MB/s  in place: " << 1000.0 / txNs << " MB/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        if (argc > 1)
+        {
+            for (int i = 1; i < argc; i++)
+            {
+                ifstream file(argv[i], ios::binary);
+                if (!file) throw runtime_error(string("Could not open ") + argv[i]);
+                bench(argv[i], uchar_vector(istreambuf_iterator<char>(file), istreambuf_iterator<char>()));
+            }
+        }
+        else
+        {
+            uchar_vector genesis(GENESIS_BLOCK_HEX);
+            if (CoinBlock(genesis).hash().getHex() != GENESIS_BLOCK_HASH) throw runtime_error("Genesis block hash mismatch.");
+            bench("genesis", genesis);
+            bench("synthetic", syntheticBlock(1000));
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
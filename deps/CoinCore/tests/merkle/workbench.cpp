@@ -0,0 +1,82 @@
+// Compares merkle root computation for 1k and 4k transaction blocks using the old recursive
+// pairwise sha256_2 against the in-place batch version on each available sha256d64 engine.
+
+#include <MerkleTree.h>
+#include <random.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+using namespace Coin;
+using namespace std;
+
+const int ROUNDS = 50;
+
+// MerkleTree::getRoot as it used to be
+static uchar_vector recursiveRoot(const vector<uchar_vector>& hashes)
+{
+    if (hashes.size() == 1) return hashes[0];
+
+    vector<uchar_vector> parents;
+    for (size_t i = 0; i < hashes.size(); i += 2)
+    {
+        uchar_vector pairedHashes = hashes[i];
+        pairedHashes += (i + 1 < hashes.size()) ? hashes[i + 1] : hashes[i];
+        parents.push_back(sha256_2(pairedHashes));
+    }
+    return recursiveRoot(parents);
+}
+
+template<typename F>
+static double microsPerRound(F f)
+{
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) { f(); }
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / ROUNDS;
+}
+
+int main()
+{
+    try
+    {
+        const size_t txCounts[] = { 1000, 4000 };
+        for (auto txCount: txCounts)
+        {
+            vector<uchar_vector> txHashes;
+            vector<MerkleLeaf> leaves;
+            for (size_t i = 0; i < txCount; i++)
+            {
+                txHashes.push_back(random_bytes(32));
+                leaves.push_back(MerkleLeaf(txHashes.back(), i % 100 == 0));
+            }
+            MerkleTree tree(txHashes);
+
+            // Make sure every path agrees before timing them
+            uchar_vector root = recursiveRoot(txHashes);
+            for (auto& implementation: sha256d64_implementations())
+            {
+                sha256d64_select(implementation);
+                if (tree.getRoot() != root) throw runtime_error("Merkle root mismatch using " + implementation + ".");
+                if (PartialMerkleTree(leaves).getRoot() != root) throw runtime_error("Partial merkle root mismatch using " + implementation + ".");
+            }
+
+            cout << "txs: " << txCount << " x " << ROUNDS << endl;
+            cout << setw(12) << left << "recursive" << microsPerRound([&]() { recursiveRoot(txHashes); }) << " us/root" << endl;
+            for (auto& implementation: sha256d64_implementations())
+            {
+                sha256d64_select(implementation);
+                cout << setw(12) << left << implementation << microsPerRound([&]() { tree.getRoot(); }) << " us/root"
+                     << ", partial tree: " << microsPerRound([&]() { PartialMerkleTree partialTree(leaves); }) << " us" << endl;
+            }
+            cout << endl;
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
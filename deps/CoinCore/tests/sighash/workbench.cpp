@@ -0,0 +1,113 @@
+// Compares computing the SIGHASH_ALL signing hash of every input by copying and serializing
+// the whole transaction per input against SigHashEngine, for transactions spending
+// 10, 100 and 500 2-of-3 multisig outputs.
+
+#include <SigHash.h>
+#include <numericdata.h>
+
+#include <chrono>
+#include <iostream>
+
+using namespace Coin;
+using namespace std;
+
+const uint32_t SIGHASH_ALL = 1;
+
+Transaction multisigSpend(unsigned int inputCount, uchar_vector& redeemScript)
+{
+    // OP_2 <pubkey> <pubkey> <pubkey> OP_3 OP_CHECKMULTISIG
+    redeemScript = uchar_vector("52");
+    for (int i = 0; i < 3; i++)
+    {
+        redeemScript.push_back(33);
+        redeemScript.push_back(0x02);
+        redeemScript += sha256(uchar_vector(1, i));
+    }
+    redeemScript += uchar_vector("53ae");
+
+    // OP_0 <sig> <sig> <redeemscript>, as an input looks once fully signed
+    uchar_vector scriptSig("00");
+    for (int i = 0; i < 2; i++)
+    {
+        scriptSig.push_back(72);
+        scriptSig += uchar_vector(72, 0x30);
+    }
+    scriptSig.push_back(0x4c);
+    scriptSig.push_back(redeemScript.size());
+    scriptSig += redeemScript;
+
+    Transaction tx;
+    for (unsigned int i = 0; i < inputCount; i++)
+    {
+        tx.addInput(TxIn(OutPoint(sha256(uint_to_vch<uint32_t>(i, LITTLE_ENDIAN_)), i % 4), scriptSig, 0xffffffff));
+    }
+    tx.addOutput(TxOut(100000000, uchar_vector("a914") + ripemd160(sha256(redeemScript)) + uchar_vector("87")));
+    tx.addOutput(TxOut(5000000, uchar_vector("76a914") + ripemd160(sha256(scriptSig)) + uchar_vector("88ac")));
+    return tx;
+}
+
+// What the signers used to do for each input
+vector<uchar_vector> copyingSigHashes(const Transaction& tx, const uchar_vector& scriptCode)
+{
+    vector<uchar_vector> hashes;
+    for (unsigned int i = 0; i < tx.inputs.size(); i++)
+    {
+        Transaction txCopy = tx;
+        for (unsigned int j = 0; j < txCopy.inputs.size(); j++)
+        {
+            if (j == i) { txCopy.inputs[j].scriptSig = scriptCode; }
+            else        { txCopy.inputs[j].scriptSig.clear(); }
+        }
+        hashes.push_back(txCopy.getHashWithAppendedCode(SIGHASH_ALL));
+    }
+    return hashes;
+}
+
+vector<uchar_vector> engineSigHashes(const Transaction& tx, const uchar_vector& scriptCode)
+{
+    SigHashEngine engine(tx);
+    vector<uchar_vector> hashes;
+    for (unsigned int i = 0; i < engine.inputCount(); i++)
+    {
+        hashes.push_back(engine.getHash(i, scriptCode, SIGHASH_ALL));
+    }
+    return hashes;
+}
+
+template<typename Function>
+double msPerTx(Function sigHashes, const Transaction& tx, const uchar_vector& scriptCode, int rounds)
+{
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) { sigHashes(tx, scriptCode); }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / rounds;
+}
+
+int main()
+{
+    try
+    {
+        const unsigned int inputCounts[] = { 10, 100, 500 };
+        for (unsigned int inputCount: inputCounts)
+        {
+            uchar_vector redeemScript;
+            Transaction tx = multisigSpend(inputCount, redeemScript);
+
+            if (copyingSigHashes(tx, redeemScript) != engineSigHashes(tx, redeemScript)) throw runtime_error("Signing hash mismatch.");
+
+            int rounds = std::max(1, (int)(1000 / inputCount));
+            double copyingMs = msPerTx(copyingSigHashes, tx, redeemScript, rounds);
+            double engineMs = msPerTx(engineSigHashes, tx, redeemScript, rounds * 10);
+
+            cout << inputCount << " inputs (" << tx.getSize() << " bytes):" << endl
+                 << "  copy per input: " << copyingMs << " ms/tx" << endl
+                 << "  SigHashEngine:  " << engineMs << " ms/tx" << endl;
+        }
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
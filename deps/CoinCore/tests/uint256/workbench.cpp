@@ -0,0 +1,82 @@
+// Compares the per-header cost of the proof of work check and chain work accumulation
+// using BigInt against the fixed-width uint256 versions.
+
+#include <CoinNodeData.h>
+
+#include <chrono>
+#include <iostream>
+
+using namespace Coin;
+using namespace std;
+
+const int HEADER_COUNT = 2016;
+const int ROUNDS = 50;
+
+static BigInt toBigInt(const uint256& n)
+{
+    return BigInt(vector<unsigned char>(n.begin(), n.end()), true);
+}
+
+int main()
+{
+    try
+    {
+        // A spread of difficulties from regtest down to mainnet-like targets
+        const uint32_t bits[] = { 0x207fffff, 0x1d00ffff, 0x1b0404cb, 0x1a05db8b, 0x18013ce9, 0x170e2632 };
+
+        vector<CoinBlockHeader> headers;
+        for (int i = 0; i < HEADER_COUNT; i++)
+        {
+            CoinBlockHeader header(2, 1231006505 + i, bits[i % (sizeof(bits)/sizeof(bits[0]))], i);
+            header.getPOWHash(); // only time the arithmetic
+            headers.push_back(header);
+        }
+
+        // Make sure both paths agree before timing them
+        for (auto& header: headers)
+        {
+            bool bBigIntValid = BigInt(header.getPOWHashLittleEndian()) <= header.getTarget();
+            if (bBigIntValid != header.checkProofOfWork()) throw runtime_error("Proof of work check mismatch.");
+            if (header.getWork() != toBigInt(header.getWork256())) throw runtime_error("Work mismatch.");
+            if (header.getTarget() != toBigInt(header.getTarget256())) throw runtime_error("Target mismatch.");
+        }
+
+        int valid = 0;
+        BigInt bigIntChainWork(0);
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (auto& header: headers)
+            {
+                if (BigInt(header.getPOWHashLittleEndian()) <= header.getTarget()) valid++;
+                bigIntChainWork = bigIntChainWork + header.getWork();
+            }
+        }
+        double bigIntNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (ROUNDS * HEADER_COUNT);
+
+        uint256 chainWork;
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (auto& header: headers)
+            {
+                if (header.checkProofOfWork()) valid++;
+                chainWork += header.getWork256();
+            }
+        }
+        double uint256Ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (ROUNDS * HEADER_COUNT);
+
+        if (bigIntChainWork != toBigInt(chainWork)) throw runtime_error("Chain work mismatch.");
+
+        cout << "headers: " << HEADER_COUNT << " x " << ROUNDS << " (valid: " << valid / 2 << ")" << endl;
+        cout << "BigInt:  " << bigIntNs << " ns/header" << endl;
+        cout << "uint256: " << uint256Ns << " ns/header" << endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
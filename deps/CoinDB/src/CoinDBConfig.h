@@ -11,6 +11,8 @@
 
 #pragma once
 
+#include "DatabaseTuning.h"
+
 #include <CoinQ/CoinQ_coinparams.h>
 
 #include <string>
@@ -21,6 +23,8 @@
 
 #include <sysutils/filesystem.h>
 
+#include <logger/logger.h>
+
 const std::string DEFAULT_DATA_DIR = "CoinDB";
 const std::string DEFAULT_CONFIG_FILE = "coindb.conf";
 const std::string DEFAULT_NETWORK_NAME = "bitcoin";
@@ -40,6 +44,9 @@ public:
     const std::string&          getDatabasePassword() const { return m_databasePassword; }
     const std::string&          getNetworkName() const { return m_networkName; }
     const CoinQ::CoinParams&    getCoinParams() const { return m_networkSelector.getCoinParams(); }
+    const CoinDB::DatabaseTuning& getDatabaseTuning() const { return m_databaseTuning; }
+    bool                        getUtxoCacheEnabled() const { return m_bUtxoCache; }
+    logger::level_t             getLogLevel() const { return m_logLevel; }
 
 protected:
     boost::program_options::options_description m_options;
@@ -51,10 +58,17 @@ protected:
     std::string m_databasePassword;
     std::string m_networkName;
 
+    std::string m_databaseProfile;
+    CoinDB::DatabaseTuning m_databaseTuning;
+    bool m_bUtxoCache;
+
+    std::string m_logLevelName;
+    logger::level_t m_logLevel;
+
     CoinQ::NetworkSelector m_networkSelector;
 };
 
-inline CoinDBConfig::CoinDBConfig() : m_options("Options")
+inline CoinDBConfig::CoinDBConfig() : m_options("Options"), m_bUtxoCache(false), m_logLevel(logger::trace)
 {
     namespace po = boost::program_options;
 
@@ -65,6 +79,12 @@ inline CoinDBConfig::CoinDBConfig() : m_options("Options")
         ("dbuser", po::value<std::string>(&m_databaseUser), "database user")
         ("dbpasswd", po::value<std::string>(&m_databasePassword), "database password")
         ("network", po::value<std::string>(&m_networkName), "network name (default: bitcoin)")
+        ("dbprofile", po::value<std::string>(&m_databaseProfile), "database tuning profile: default or performance (default: default)")
+        ("dbcache", po::value<unsigned int>(&m_databaseTuning.cacheSizeMiB), "database page cache in MiB (performance profile only, default: 64)")
+        ("dbmmap", po::value<unsigned int>(&m_databaseTuning.mmapSizeMiB), "database memory map size in MiB, 0 to disable (performance profile only, default: 256)")
+        ("dbcheckpoint", po::value<unsigned int>(&m_databaseTuning.checkpointPages), "write-ahead log pages between checkpoints (performance profile only, default: 1000)")
+        ("utxocache", po::value<bool>(&m_bUtxoCache), "keep unspent outputs and balances in memory (default: false)")
+        ("loglevel", po::value<std::string>(&m_logLevelName), "lowest level written to the log: trace, debug, info, warning, error or fatal (default: trace)")
     ;
 }
 
@@ -107,6 +127,10 @@ inline bool CoinDBConfig::parseParams(int argc, char* argv[])
     std::transform(m_networkName.begin(), m_networkName.end(), m_networkName.begin(), ::tolower);
     m_networkSelector.select(m_networkName);
 
+    if (m_vm.count("dbprofile"))    { m_databaseTuning.profile = CoinDB::DatabaseTuning::getProfile(m_databaseProfile); }
+    if (m_vm.count("loglevel") && !logger::parse_level(m_logLevelName, m_logLevel))
+        throw std::runtime_error("Invalid loglevel.");
+
     return true;
 }
 
@@ -13,7 +13,10 @@
 
 #pragma once
 
+#include "DatabaseTuning.h"
+
 #include <string>
+#include <sstream>
 #include <memory>   // std::unique_ptr
 #include <cstdlib>  // std::exit
 #include <iostream>
@@ -30,6 +33,7 @@
 #  include <odb/transaction.hxx>
 #  include <odb/schema-catalog.hxx>
 #  include <odb/sqlite/database.hxx>
+#  include <odb/sqlite/connection-factory.hxx>
 #elif defined(DATABASE_PGSQL)
 #  include <odb/pgsql/database.hxx>
 #elif defined(DATABASE_ORACLE)
@@ -43,6 +47,48 @@
 namespace CoinDB
 {
 
+#if defined(DATABASE_SQLITE)
+// Most SQLite settings only last as long as the connection, so they are applied to
+// every connection the pool opens rather than once to the database.
+inline void applyDatabaseTuning(odb::sqlite::connection& c, const DatabaseTuning& tuning)
+{
+    if (tuning.profile != DatabaseTuning::PERFORMANCE) return;
+
+    std::stringstream ss;
+    c.execute("PRAGMA journal_mode=WAL");
+    c.execute("PRAGMA synchronous=NORMAL");
+    c.execute("PRAGMA temp_store=MEMORY");
+
+    ss << "PRAGMA cache_size=-" << (tuning.cacheSizeMiB * 1024ull);
+    c.execute(ss.str());
+
+    ss.str("");
+    ss << "PRAGMA mmap_size=" << (tuning.mmapSizeMiB * 1048576ull);
+    c.execute(ss.str());
+
+    ss.str("");
+    ss << "PRAGMA wal_autocheckpoint=" << tuning.checkpointPages;
+    c.execute(ss.str());
+}
+
+class TunedConnectionPoolFactory : public odb::sqlite::connection_pool_factory
+{
+public:
+    explicit TunedConnectionPoolFactory(const DatabaseTuning& tuning) : tuning_(tuning) { }
+
+protected:
+    virtual pooled_connection_ptr create()
+    {
+        pooled_connection_ptr c(odb::sqlite::connection_pool_factory::create());
+        applyDatabaseTuning(*c, tuning_);
+        return c;
+    }
+
+private:
+    DatabaseTuning tuning_;
+};
+#endif
+
 inline std::unique_ptr<odb::database>
 open_database (int& argc, char* argv[], bool create = false)
 {
@@ -103,7 +149,7 @@ open_database (int& argc, char* argv[], bool create = false)
 }
 
 inline std::unique_ptr<odb::database>
-openDatabase(const std::string& user, const std::string& passwd, const std::string& dbname, bool create = false)
+openDatabase(const std::string& user, const std::string& passwd, const std::string& dbname, bool create = false, const DatabaseTuning& tuning = DatabaseTuning())
 {
     using namespace odb::core;
 
@@ -112,7 +158,8 @@ openDatabase(const std::string& user, const std::string& passwd, const std::stri
 #elif defined(DATABASE_SQLITE)
     int flags = SQLITE_OPEN_READWRITE;
     if (create) flags |= SQLITE_OPEN_CREATE;
-    std::unique_ptr<database> db(new odb::sqlite::database(dbname, flags, false));
+    odb::details::transfer_ptr<odb::sqlite::connection_factory> factory(new TunedConnectionPoolFactory(tuning));
+    std::unique_ptr<database> db(new odb::sqlite::database(dbname, flags, false, "", factory));
 #endif
 
   // Create the database schema. Due to bugs in SQLite foreign key
@@ -139,4 +186,13 @@ openDatabase(const std::string& user, const std::string& passwd, const std::stri
     return db;
 }
 
+// Folds the write-ahead log back into the database so it is left self-contained.
+inline void checkpointDatabase(odb::database& db)
+{
+#if defined(DATABASE_SQLITE)
+    odb::core::connection_ptr c(db.connection());
+    c->execute("PRAGMA wal_checkpoint(TRUNCATE)");
+#endif
+}
+
 }
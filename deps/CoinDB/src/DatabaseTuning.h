@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// DatabaseTuning.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Storage engine settings applied when a database is opened.
+//
+
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+namespace CoinDB
+{
+
+struct DatabaseTuning
+{
+    // DEFAULT leaves the engine as it comes: rollback journal, synchronous=FULL.
+    // PERFORMANCE switches SQLite to WAL with synchronous=NORMAL, which stays consistent
+    // after a crash but can lose the last few commits on power loss.
+    enum profile_t { DEFAULT, PERFORMANCE };
+
+    DatabaseTuning(profile_t profile_ = DEFAULT, unsigned int cacheSizeMiB_ = 64, unsigned int mmapSizeMiB_ = 256, unsigned int checkpointPages_ = 1000)
+        : profile(profile_), cacheSizeMiB(cacheSizeMiB_), mmapSizeMiB(mmapSizeMiB_), checkpointPages(checkpointPages_) { }
+
+    profile_t       profile;
+    unsigned int    cacheSizeMiB;       // page cache per connection
+    unsigned int    mmapSizeMiB;        // 0 disables memory mapped reads
+    unsigned int    checkpointPages;    // WAL size that triggers an automatic checkpoint
+
+    static profile_t getProfile(const std::string& name)
+    {
+        std::string lowerName = name;
+        std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+        if (lowerName == "default")     return DEFAULT;
+        if (lowerName == "performance") return PERFORMANCE;
+        throw std::runtime_error("Invalid database profile: " + name);
+    }
+
+    static std::string getProfileName(profile_t profile)
+    {
+        return profile == PERFORMANCE ? "performance" : "default";
+    }
+};
+
+}
@@ -0,0 +1,174 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// KeychainCache.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+
+#include "KeychainCache.h"
+
+#include <boost/thread/locks.hpp>
+
+using namespace CoinDB;
+
+bool KeychainCache::Key::operator<(const Key& rhs) const
+{
+    if (keychain_hash != rhs.keychain_hash) return keychain_hash < rhs.keychain_hash;
+    if (is_private != rhs.is_private) return is_private < rhs.is_private;
+    return path < rhs.path;
+}
+
+KeychainCache::KeychainCache(size_t capacity)
+    : m_capacity(capacity)
+{
+}
+
+KeychainCache::~KeychainCache()
+{
+    clear();
+}
+
+size_t KeychainCache::capacity() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_capacity;
+}
+
+void KeychainCache::setCapacity(size_t capacity)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    evict_unwrapped();
+}
+
+size_t KeychainCache::size() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void KeychainCache::clear()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    while (!m_entries.empty()) { erase_unwrapped(m_entries.begin()); }
+}
+
+void KeychainCache::erasePrivate()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto it = m_entries.begin();
+    while (it != m_entries.end())
+    {
+        auto next = std::next(it);
+        if (it->first.is_private) { erase_unwrapped(it); }
+        it = next;
+    }
+}
+
+void KeychainCache::erasePrivate(const bytes_t& keychain_hash)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto it = m_entries.lower_bound(Key(keychain_hash, true, path_t()));
+    while (it != m_entries.end() && it->first.keychain_hash == keychain_hash)
+    {
+        auto next = std::next(it);
+        erase_unwrapped(it);
+        it = next;
+    }
+}
+
+Coin::HDKeychain KeychainCache::derive(const bytes_t& keychain_hash, bool is_private, const path_t& path, const std::function<Coin::HDKeychain()>& make_base)
+{
+    Coin::HDKeychain hdkeychain;
+    size_t cached = 0; // number of path elements covered by the cached key, plus one
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        if (m_capacity > 0)
+        {
+            for (size_t n = path.size() + 1; n > 0; n--)
+            {
+                if (lookup_unwrapped(Key(keychain_hash, is_private, path_t(path.begin(), path.begin() + n - 1)), hdkeychain))
+                {
+                    cached = n;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (cached == path.size() + 1) return hdkeychain;
+
+    // Derive the rest of the path without holding the lock.
+    std::vector<Coin::HDKeychain> derived;
+    derived.reserve(path.size() + 1 - cached);
+    if (cached == 0)
+    {
+        hdkeychain = make_base();
+        derived.push_back(hdkeychain);
+        cached = 1;
+    }
+    for (size_t n = cached - 1; n < path.size(); n++)
+    {
+        hdkeychain = hdkeychain.getChild(path[n]);
+        derived.push_back(hdkeychain);
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        size_t n = path.size() + 1 - derived.size();
+        for (auto& keychain: derived)
+        {
+            insert_unwrapped(Key(keychain_hash, is_private, path_t(path.begin(), path.begin() + n++)), keychain);
+        }
+    }
+
+    for (auto& keychain: derived) { keychain.wipe(); }
+    return hdkeychain;
+}
+
+bool KeychainCache::lookup_unwrapped(const Key& key, Coin::HDKeychain& keychain)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) return false;
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru_pos);
+    keychain = it->second.keychain;
+    return true;
+}
+
+void KeychainCache::insert_unwrapped(const Key& key, const Coin::HDKeychain& keychain)
+{
+    if (m_capacity == 0) return;
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        // Another thread derived it first.
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru_pos);
+        return;
+    }
+
+    m_lru.push_front(key);
+    Entry& entry = m_entries[key];
+    entry.keychain = keychain;
+    entry.lru_pos = m_lru.begin();
+    evict_unwrapped();
+}
+
+void KeychainCache::erase_unwrapped(map_t::iterator it)
+{
+    it->second.keychain.wipe();
+    m_lru.erase(it->second.lru_pos);
+    m_entries.erase(it);
+}
+
+void KeychainCache::evict_unwrapped()
+{
+    while (m_entries.size() > m_capacity)
+    {
+        erase_unwrapped(m_entries.find(m_lru.back()));
+    }
+}
@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// KeychainCache.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Bounded cache of intermediate extended keys derived from stored keychains.
+//
+
+#pragma once
+
+#include <CoinCore/hashtypes.h>
+#include <CoinCore/hdkeys.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include <functional>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace CoinDB
+{
+
+// Entries are keyed by the hash of the keychain they were derived from, whether they hold the
+// private key, and the derivation path from that keychain. Least recently used entries are
+// evicted once the capacity is reached. Evicted and erased entries are wiped before they are
+// freed.
+class KeychainCache
+{
+public:
+    typedef std::vector<uint32_t> path_t;
+
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+    explicit KeychainCache(size_t capacity = DEFAULT_CAPACITY);
+    ~KeychainCache();
+
+    size_t capacity() const;
+    void setCapacity(size_t capacity); // 0 disables the cache
+    size_t size() const;
+
+    void clear();
+    void erasePrivate(); // drops every entry holding a private key
+    void erasePrivate(const bytes_t& keychain_hash);
+
+    // Derives the extended key at path from the keychain with the given hash, reusing the longest
+    // cached prefix and caching every key it computes. make_base is only called if not even the
+    // keychain itself is cached.
+    Coin::HDKeychain derive(const bytes_t& keychain_hash, bool is_private, const path_t& path, const std::function<Coin::HDKeychain()>& make_base);
+
+private:
+    struct Key
+    {
+        Key(const hash160_t& keychain_hash_, bool is_private_, const path_t& path_) : keychain_hash(keychain_hash_), is_private(is_private_), path(path_) { }
+
+        bool operator<(const Key& rhs) const;
+
+        hash160_t keychain_hash;
+        bool is_private;
+        path_t path;
+    };
+
+    typedef std::list<Key> lru_t;
+
+    struct Entry
+    {
+        Coin::HDKeychain keychain;
+        lru_t::iterator lru_pos;
+    };
+
+    typedef std::map<Key, Entry> map_t;
+
+    mutable boost::mutex m_mutex;
+    size_t m_capacity;
+    map_t m_entries;
+    lru_t m_lru; // most recently used at the front
+
+    bool lookup_unwrapped(const Key& key, Coin::HDKeychain& keychain);
+    void insert_unwrapped(const Key& key, const Coin::HDKeychain& keychain);
+    void erase_unwrapped(map_t::iterator it);
+    void evict_unwrapped();
+};
+
+}
@@ -8,6 +8,7 @@
 //
 
 #include "Schema.h"
+#include "KeychainCache.h"
 
 #include <stdutils/stringutils.h>
 
@@ -20,6 +21,8 @@
 
 #include <logger/logger.h>
 
+#include <sysutils/threadpool.h>
+
 // support for boost serialization
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -34,6 +37,23 @@ using namespace CoinDB;
  * class Keychain
  */
 
+static KeychainCache& derivationCache()
+{
+    static KeychainCache cache;
+    return cache;
+}
+
+void Keychain::setDerivationCacheCapacity(size_t capacity)
+{
+    derivationCache().setCapacity(capacity);
+}
+
+void Keychain::clearDerivationCache(bool private_only)
+{
+    if (private_only)   { derivationCache().erasePrivate(); }
+    else                { derivationCache().clear(); }
+}
+
 Keychain::Keychain(const std::string& name, const secure_bytes_t& entropy, const secure_bytes_t& lock_key)
     : name_(name), hidden_(false)
 {
@@ -109,8 +129,9 @@ std::shared_ptr<Keychain> Keychain::child(uint32_t i, bool get_private, const se
     if (get_private)
     {
         if (privkey_.empty()) throw std::runtime_error("Private key is locked.");
-        Coin::HDKeychain hdkeychain(privkey_, chain_code_, child_num_, parent_fp_, depth_);
-        hdkeychain = hdkeychain.getChild(i);
+        Coin::HDKeychain hdkeychain = derivationCache().derive(hash_, true, std::vector<uint32_t>(1, i), [this]() {
+            return Coin::HDKeychain(privkey_, chain_code_, child_num_, parent_fp_, depth_);
+        });
         std::shared_ptr<Keychain> child(new Keychain());
         child->parent_ = get_shared_ptr();
         child->pubkey_ = hdkeychain.pubkey();
@@ -148,12 +169,14 @@ std::shared_ptr<Keychain> Keychain::child(uint32_t i, bool get_private, const se
         child->hash_ = hdkeychain.full_hash();
         child->derivation_path_ = derivation_path_;
         child->derivation_path_.push_back(i);
+        hdkeychain.wipe();
         return child;
     }
     else
     {
-        Coin::HDKeychain hdkeychain(pubkey_, chain_code_, child_num_, parent_fp_, depth_);
-        hdkeychain = hdkeychain.getChild(i);
+        Coin::HDKeychain hdkeychain = derivationCache().derive(hash_, false, std::vector<uint32_t>(1, i), [this]() {
+            return Coin::HDKeychain(pubkey_, chain_code_, child_num_, parent_fp_, depth_);
+        });
         std::shared_ptr<Keychain> child(new Keychain());;
         child->parent_ = get_shared_ptr();
         child->pubkey_ = hdkeychain.pubkey();
@@ -172,6 +195,7 @@ void Keychain::lock() const
 {
     privkey_.clear();
     seed_.clear();
+    derivationCache().erasePrivate(hash_);
 }
 
 void Keychain::unlock(const secure_bytes_t& lock_key) const
@@ -233,17 +257,22 @@ secure_bytes_t Keychain::getSigningPrivateKey(uint32_t i, const std::vector<uint
     if (!isPrivate()) throw std::runtime_error("Missing private key.");
     if (isLocked()) throw std::runtime_error("Private key is locked.");
 
-    // Remove initial zero from privkey if necessary
-    secure_bytes_t stripped_privkey = (privkey_.size() > 32) ? secure_bytes_t(privkey_.begin() + 1, privkey_.end()) : privkey_;
-    Coin::HDKeychain hdkeychain(stripped_privkey, chain_code_, child_num_, parent_fp_, depth_);
-    for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
-    return hdkeychain.getPrivateSigningKey(i);
+    // Only the keys along derivation_path are cached, never the signing key itself.
+    Coin::HDKeychain hdkeychain = derivationCache().derive(hash_, true, derivation_path, [this]() {
+        // Remove initial zero from privkey if necessary
+        secure_bytes_t stripped_privkey = (privkey_.size() > 32) ? secure_bytes_t(privkey_.begin() + 1, privkey_.end()) : privkey_;
+        return Coin::HDKeychain(stripped_privkey, chain_code_, child_num_, parent_fp_, depth_);
+    });
+    secure_bytes_t signingkey = hdkeychain.getPrivateSigningKey(i);
+    hdkeychain.wipe();
+    return signingkey;
 }
 
 bytes_t Keychain::getSigningPublicKey(uint32_t i, bool get_compressed, const std::vector<uint32_t>& derivation_path) const
 {
-    Coin::HDKeychain hdkeychain(pubkey_, chain_code_, child_num_, parent_fp_, depth_);
-    for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
+    Coin::HDKeychain hdkeychain = derivationCache().derive(hash_, false, derivation_path, [this]() {
+        return Coin::HDKeychain(pubkey_, chain_code_, child_num_, parent_fp_, depth_);
+    });
     return hdkeychain.getPublicSigningKey(i, get_compressed);
 }
 
@@ -445,24 +474,17 @@ std::string AccountBin::account_name() const
     return account() ? account()->name() : std::string("@null");
 }
 
-SigningScriptVector AccountBin::generateSigningScripts()
+SigningScriptVector AccountBin::generateSigningScripts(sysutils::ThreadPool* pool)
 {
-    SigningScriptVector signingscripts;
+    script_count_ = next_script_index_ + unused_pool_size();
+    SigningScriptVector signingscripts = createSigningScripts(0, script_count_, pool);
+
+    SigningScript::status_t status = (index_ == CHANGE_INDEX) ? SigningScript::CHANGE : SigningScript::ISSUED;
     for (uint32_t i = 0; i < next_script_index_; i++)
     {
-        std::string label;
         auto it = script_label_map_.find(i);
-        if (it != script_label_map_.end())   { label = it->second; }
-        SigningScript::status_t status = (index_ == CHANGE_INDEX) ? SigningScript::CHANGE : SigningScript::ISSUED;
-        std::shared_ptr<SigningScript> signingscript(new SigningScript(shared_from_this(), i, label, status));
-        signingscripts.push_back(signingscript);
-    }
-
-    script_count_ = next_script_index_ + unused_pool_size();
-    for (uint32_t i = next_script_index_; i < script_count_; i++)
-    {
-        std::shared_ptr<SigningScript> signingscript(new SigningScript(shared_from_this(), i));
-        signingscripts.push_back(signingscript);
+        if (it != script_label_map_.end())   { signingscripts[i]->label(it->second); }
+        signingscripts[i]->status(status);
     }
 
     return signingscripts;
@@ -513,6 +535,28 @@ std::shared_ptr<SigningScript> AccountBin::newSigningScript(const std::string& l
     return signingscript;
 }
 
+SigningScriptVector AccountBin::newSigningScripts(uint32_t count, sysutils::ThreadPool* pool)
+{
+    SigningScriptVector signingscripts = createSigningScripts(script_count_, script_count_ + count, pool);
+    script_count_ += count;
+    return signingscripts;
+}
+
+SigningScriptVector AccountBin::createSigningScripts(uint32_t begin, uint32_t end, sysutils::ThreadPool* pool)
+{
+    SigningScriptVector signingscripts(end > begin ? end - begin : 0);
+    if (signingscripts.empty()) return signingscripts;
+
+    // Once the keychains are loaded, unlabeled scripts only read from the bin so they can be created concurrently.
+    loadKeychains();
+    std::shared_ptr<AccountBin> bin = shared_from_this();
+    auto create = [&](size_t i) { signingscripts[i] = std::shared_ptr<SigningScript>(new SigningScript(bin, begin + i)); };
+    if (pool)   { pool->parallel_for(0, signingscripts.size(), create); }
+    else        { for (size_t i = 0; i < signingscripts.size(); i++) { create(i); } }
+
+    return signingscripts;
+}
+
 void AccountBin::markSigningScriptIssued(uint32_t script_index)
 {
     if (script_index >= next_script_index_)
@@ -751,7 +795,19 @@ bytes_t TxIn::unsigned_script() const
 
 bytes_t TxIn::raw() const
 {
-    return toCoinCore().getSerialized();
+    bytes_t rval;
+    Coin::ByteWriter writer(rval);
+    serializeTo(writer);
+    return rval;
+}
+
+void TxIn::serializeTo(Coin::ByteWriter& writer) const
+{
+    writer.writeReversed(outhash_);
+    writer.writeUint<uint32_t>(outindex_);
+    writer.writeVarInt(script_.size());
+    writer.write(script_);
+    writer.writeUint<uint32_t>(sequence_);
 }
 
 void TxIn::outpoint(std::shared_ptr<TxOut> outpoint)
@@ -872,7 +928,17 @@ Coin::TxOut TxOut::toCoinCore() const
 
 bytes_t TxOut::raw() const
 {
-    return toCoinCore().getSerialized();
+    bytes_t rval;
+    Coin::ByteWriter writer(rval);
+    serializeTo(writer);
+    return rval;
+}
+
+void TxOut::serializeTo(Coin::ByteWriter& writer) const
+{
+    writer.writeUint<uint64_t>(value_);
+    writer.writeVarInt(script_.size());
+    writer.write(script_);
 }
 
 std::string TxOut::toJson() const
@@ -1022,7 +1088,8 @@ bool Tx::updateStatus(status_t status /* = NO_STATUS */)
             status_ = status;
         }
 
-        hash_ = toCoinCore().hash();
+        bytes_t rawtx = raw();
+        hash_ = sha256_2_raw(rawtx.data(), rawtx.size()).getReverse();
         return true;
     }
 
@@ -1061,7 +1128,20 @@ void Tx::blockheader(std::shared_ptr<BlockHeader> blockheader)
 
 bytes_t Tx::raw() const
 {
-    return toCoinCore().getSerialized();
+    bytes_t rval;
+    Coin::ByteWriter writer(rval);
+    serializeTo(writer);
+    return rval;
+}
+
+void Tx::serializeTo(Coin::ByteWriter& writer) const
+{
+    writer.writeUint<uint32_t>(version_);
+    writer.writeVarInt(txins_.size());
+    for (auto& txin: txins_) { txin->serializeTo(writer); }
+    writer.writeVarInt(txouts_.size());
+    for (auto& txout: txouts_) { txout->serializeTo(writer); }
+    writer.writeUint<uint32_t>(locktime_);
 }
 
 void Tx::updateTotals()
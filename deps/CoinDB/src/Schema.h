@@ -33,6 +33,8 @@
 
 #include <logger/logger.h>
 
+namespace sysutils { class ThreadPool; }
+
 #pragma db namespace session
 namespace CoinDB
 {
@@ -55,7 +57,7 @@ typedef odb::nullable<unsigned long> null_id_t;
 ////////////////////
 
 #define SCHEMA_BASE_VERSION 12
-#define SCHEMA_VERSION      17
+#define SCHEMA_VERSION      18
 
 #ifdef ODB_COMPILER
 #pragma db model version(SCHEMA_BASE_VERSION, SCHEMA_VERSION, open)
@@ -253,6 +255,10 @@ public:
 
     void clearPrivateKey();
 
+    // Intermediate keys derived from keychains are shared by all keychain objects in the process.
+    static void setDerivationCacheCapacity(size_t capacity); // 0 disables the cache
+    static void clearDerivationCache(bool private_only = false);
+
 private:
     friend class odb::access;
 
@@ -399,6 +405,7 @@ private:
     std::vector<uint32_t> derivation_path_;
     uint32_t index_;
 
+    #pragma db index
     bytes_t pubkey_;
     bool is_private_;
 };
@@ -445,7 +452,7 @@ public:
     void name(const std::string& name) { name_ = name; }
     std::string name() const { return name_; }
 
-    SigningScriptVector generateSigningScripts(); // generates them anew. expensive, should only be used when creating the AccountBin or when importing.
+    SigningScriptVector generateSigningScripts(sysutils::ThreadPool* pool = nullptr); // generates them anew. expensive, should only be used when creating the AccountBin or when importing.
 
     uint32_t script_count() const { return script_count_; }
     uint32_t next_script_index() const { return next_script_index_; }
@@ -454,6 +461,7 @@ public:
     uint32_t minsigs() const { return minsigs_; }
 
     std::shared_ptr<SigningScript> newSigningScript(const std::string& label = "");
+    SigningScriptVector newSigningScripts(uint32_t count, sysutils::ThreadPool* pool = nullptr); // keys are derived across the pool if given
     void markSigningScriptIssued(uint32_t script_index);
 
     void keychains(const KeychainSet& keychains) { keychains_ = keychains; keychains__ = keychains; } // only used for imported account bins
@@ -472,6 +480,8 @@ private:
     friend class SigningScript;
     void setScriptLabel(uint32_t index, const std::string& label);
 
+    SigningScriptVector createSigningScripts(uint32_t begin, uint32_t end, sysutils::ThreadPool* pool);
+
     void loadKeychains() const;
 
     friend class odb::access;
@@ -841,6 +851,18 @@ private:
     KeyVector keys_;
 
     std::shared_ptr<Contact> contact_;
+
+    // Next unused script in a bin
+    #pragma db index("SigningScript_account_bin_status_index_i") members(account_bin_, status_, index_)
+
+    // MySQL can only index a prefix of a BLOB
+#if defined(DATABASE_MYSQL)
+    #pragma db index("SigningScript_txinscript_i") member(txinscript_, "(64)")
+    #pragma db index("SigningScript_txoutscript_i") member(txoutscript_, "(64)")
+#else
+    #pragma db index("SigningScript_txinscript_i") member(txinscript_)
+    #pragma db index("SigningScript_txoutscript_i") member(txoutscript_)
+#endif
 };
 
 
@@ -971,7 +993,7 @@ private:
     #pragma db id auto
     unsigned long id_;
 
-    #pragma db not_null
+    #pragma db not_null index
     std::shared_ptr<BlockHeader> blockheader_;
 
     uint32_t txcount_;
@@ -984,6 +1006,12 @@ private:
 
     bool txsinserted_;
 
+    // Incomplete blocks and best height
+    #pragma db index("MerkleBlock_txsinserted_blockheader_i") members(txsinserted_, blockheader_)
+
+    // Confirmed transactions are matched on hash
+    #pragma db index("MerkleBlock_hashes_value_i") member(hashes_.value)
+
     friend class boost::serialization::access;
     template<class Archive>
     void save(Archive& ar, const unsigned int /*version*/) const
@@ -1044,6 +1072,7 @@ public:
 
     uint32_t sequence() const { return sequence_; }
     bytes_t raw() const;
+    void serializeTo(Coin::ByteWriter& writer) const;
 
     void tx(std::shared_ptr<Tx> tx) { tx_ = tx; }
     const std::shared_ptr<Tx> tx() const { return tx_.lock(); }
@@ -1075,6 +1104,9 @@ private:
     #pragma db null
     std::weak_ptr<TxOut> outpoint_;
 
+    #pragma db index("TxIn_outhash_outindex_i") members(outhash_, outindex_)
+    #pragma db index("TxIn_tx_txindex_i") members(tx_, txindex_)
+
     friend class boost::serialization::access;
     template<class Archive>
     void serialize(Archive& ar, const unsigned int /*version*/)
@@ -1138,6 +1170,7 @@ public:
     const bytes_t& script() const { return script_; }
 
     bytes_t raw() const;
+    void serializeTo(Coin::ByteWriter& writer) const;
 
     void tx(std::shared_ptr<Tx> tx) { tx_ = tx; }
     const std::shared_ptr<Tx> tx() const { return tx_.lock(); }
@@ -1181,7 +1214,7 @@ private:
     std::weak_ptr<Tx> tx_;
     uint32_t txindex_;
 
-    #pragma db null
+    #pragma db null index
     std::shared_ptr<TxIn> spent_;
 
     #pragma db null
@@ -1203,6 +1236,13 @@ private:
     // Redundant but convenient for view queries.
     status_t status_;
 
+    #pragma db index("TxOut_tx_txindex_i") members(tx_, txindex_)
+
+    // Balances, unspent outputs and history are looked up by account and status. The receiving
+    // index also carries tx and value so balances never have to touch the table.
+    #pragma db index("TxOut_receiving_account_status_i") members(receiving_account_, status_, tx_, value_)
+    #pragma db index("TxOut_sending_account_status_i") members(sending_account_, status_, tx_)
+
     friend class boost::serialization::access;
     template<class Archive>
     void serialize(Archive& ar, const unsigned int /*version*/)
@@ -1267,6 +1307,7 @@ public:
     txouts_t txouts() const { return txouts_; }
     uint32_t locktime() const { return locktime_; }
     bytes_t raw() const;
+    void serializeTo(Coin::ByteWriter& writer) const; // writes straight from the schema fields without building a Coin::Transaction
 
     void timestamp(uint32_t timestamp) { timestamp_ = timestamp; }
     uint32_t timestamp() const { return timestamp_; }
@@ -1318,6 +1359,7 @@ private:
     unsigned long id_;
 
     // hash stays empty until transaction is fully signed.
+    #pragma db index
     bytes_t hash_;
 
     // We'll use the unsigned hash as a unique identifier to avoid malleability issues.
@@ -1339,6 +1381,7 @@ private:
     // Timestamp defaults to 0xffffffff
     uint32_t timestamp_;
 
+    #pragma db index
     status_t status_;
 
     bool conflicting_;
@@ -1348,7 +1391,7 @@ private:
     uint64_t txin_total_;
     uint64_t txout_total_;
 
-    #pragma db null
+    #pragma db null index
     std::shared_ptr<BlockHeader> blockheader_;
 
     #pragma db null
@@ -1825,15 +1868,39 @@ struct TxOutView
     object(TxOut) \
     object(Tx: TxOut::tx_) \
     object(BlockHeader: Tx::blockheader_) \
-    object(Account: TxOut::receiving_account_) \
-    object(AccountBin: TxOut::account_bin_) \
-    object(SigningScript: TxOut::signingscript_)
+    object(Account: TxOut::receiving_account_)
 struct BalanceView
 {
     #pragma db column("sum(" + TxOut::value_ + ")")
     uint64_t balance;
 };
 
+#pragma db view \
+    object(TxOut) \
+    object(Tx: TxOut::tx_) \
+    object(BlockHeader: Tx::blockheader_) \
+    object(Account: TxOut::receiving_account_)
+struct UtxoCacheView
+{
+    #pragma db column(TxOut::id_)
+    unsigned long id;
+
+    #pragma db column(Account::id_)
+    unsigned long account_id;
+
+    #pragma db column(TxOut::value_)
+    uint64_t value;
+
+    #pragma db column(Tx::status_)
+    Tx::status_t tx_status;
+
+    #pragma db column(BlockHeader::id_)
+    unsigned long blockheader_id;
+
+    #pragma db column(BlockHeader::height_)
+    uint32_t height;
+};
+
 #pragma db view \
 	object(MerkleBlock) \
     object(BlockHeader: MerkleBlock::blockheader_) \
@@ -11,6 +11,8 @@
 
 #include <logger/logger.h>
 
+#include <algorithm>
+
 using namespace CoinDB;
 using namespace CoinQ;
 
@@ -36,6 +38,7 @@ const std::string SynchedVault::getStatusString(status_t status)
 // Constructor
 SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
     m_vault(nullptr),
+    m_bUtxoCacheEnabled(false),
     m_status(STOPPED),
     m_bestHeight(0),
     m_syncHeight(0),
@@ -48,7 +51,9 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
     m_bSynching(false),
     m_bBlockTreeSynched(false),
     m_bGotMempool(false),
-    m_bInsertMerkleBlocks(false)
+    m_bInsertMerkleBlocks(false),
+    m_merkleBatchSize(INITIAL_MERKLE_BATCH_SIZE),
+    m_bStopMerkleBatchFlush(false)
 {
     LOGGER(trace) << "SynchedVault::SynchedVault()" << std::endl;
 
@@ -87,6 +92,13 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         LOGGER(trace) << "SynchedVault - connection closed." << std::endl;
         m_bConnected = false;
         m_bSynching = false;
+
+        if (m_vault)
+        {
+            std::lock_guard<std::mutex> lock(m_vaultMutex);
+            if (m_vault) { flushMerkleBatch(); }
+        }
+
         m_notifyPeerDisconnected();
     });
 
@@ -151,6 +163,12 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
     {
         LOGGER(trace) << "SynchedVault - Block sync complete." << std::endl;
 
+        if (m_vault)
+        {
+            std::lock_guard<std::mutex> lock(m_vaultMutex);
+            if (m_vault) { flushMerkleBatch(); }
+        }
+
         if (m_networkSync.connected())
         {
             updateStatus(SYNCHED);
@@ -190,6 +208,9 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         std::lock_guard<std::mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
+        // It might spend outputs of transactions still waiting in the batch.
+        flushMerkleBatch();
+
         try
         {
             m_vault->insertNewTx(cointx);
@@ -214,21 +235,12 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         std::lock_guard<std::mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
-        try
-        {
-            m_vault->insertMerkleTx(chainmerkleblock, cointx, txindex, txcount);
-        }
-        catch (const VaultException& e)
-        {
-            LOGGER(error) << e.what() << std::endl;
-            m_notifyVaultError(e.what(), e.code());
-        } 
-        catch (const std::exception& e)
-        {
-            LOGGER(error) << e.what() << std::endl;
-            m_notifyVaultError(e.what(), -1);
-        } 
-	
+        MerkleBlockUpdate::MatchedTx matchedtx;
+        matchedtx.cointx = std::make_shared<Coin::Transaction>(cointx);
+        matchedtx.txhash = cointx.hash();
+        matchedtx.txindex = txindex;
+        matchedtx.txcount = txcount;
+        batchMerkleBlock(chainmerkleblock).txs.push_back(matchedtx);
     });
 
     m_networkSync.subscribeTxConfirmed([this](const ChainMerkleBlock& chainmerkleblock, const bytes_t& txhash, unsigned int txindex, unsigned int txcount)
@@ -239,20 +251,11 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         std::lock_guard<std::mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
-        try
-        {
-            m_vault->confirmMerkleTx(chainmerkleblock, txhash, txindex, txcount);
-        }
-        catch (const VaultException& e)
-        {
-            LOGGER(error) << e.what() << std::endl;
-            m_notifyVaultError(e.what(), e.code());
-        } 
-        catch (const std::exception& e)
-        {
-            LOGGER(error) << e.what() << std::endl;
-            m_notifyVaultError(e.what(), -1);
-        } 
+        MerkleBlockUpdate::MatchedTx matchedtx;
+        matchedtx.txhash = txhash;
+        matchedtx.txindex = txindex;
+        matchedtx.txcount = txcount;
+        batchMerkleBlock(chainmerkleblock).txs.push_back(matchedtx);
     });
 
     m_networkSync.subscribeMerkleBlock([this](const ChainMerkleBlock& chainMerkleBlock)
@@ -265,22 +268,7 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         if (!m_vault) return;
         if (!m_bInsertMerkleBlocks) return;
 
-        try
-        {
-            std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(chainMerkleBlock));
-	    merkleblock->txsinserted(true);
-            m_vault->insertMerkleBlock(merkleblock);
-        }
-        catch (const VaultException& e)
-        {
-            LOGGER(error) << e.what() << std::endl;
-            m_notifyVaultError(e.what(), e.code());
-        } 
-        catch (const std::exception& e)
-        {
-            LOGGER(error) << e.what() << std::endl;
-            m_notifyVaultError(e.what(), -1);
-        }
+        batchMerkleBlock(chainMerkleBlock);
     });
 
     m_networkSync.subscribeBlockTreeChanged([this]()
@@ -290,6 +278,8 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         m_bBlockTreeSynched = false;
         updateBestHeader(m_networkSync.getBestHeight(), m_networkSync.getBestHash());
     });
+
+    m_merkleBatchFlushThread = std::thread(&SynchedVault::merkleBatchFlushLoop, this);
 }
 
 // Destructor
@@ -298,6 +288,13 @@ SynchedVault::~SynchedVault()
     LOGGER(trace) << "SynchedVault::~SynchedVault()" << std::endl;
     stopSync();
     closeVault();
+
+    {
+        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        m_bStopMerkleBatchFlush = true;
+    }
+    m_merkleBatchStartedCond.notify_one();
+    m_merkleBatchFlushThread.join();
 }
 
 // Block tree operations
@@ -323,12 +320,14 @@ void SynchedVault::openVault(const std::string& dbuser, const std::string& dbpas
 
     {
         std::lock_guard<std::mutex> lock(m_vaultMutex);
+        if (m_vault) { flushMerkleBatch(); }
         m_notifyVaultClosed();
         if (m_vault) delete m_vault;
         m_vault = new Vault;
+        m_vault->setUtxoCacheEnabled(m_bUtxoCacheEnabled);
         try
         {
-            m_vault->open(dbuser, dbpasswd, dbname, bCreate, version, network, migrate);
+            m_vault->open(dbuser, dbpasswd, dbname, bCreate, version, network, migrate, m_databaseTuning);
         }
         catch (const std::exception& e)
         {
@@ -375,6 +374,7 @@ void SynchedVault::closeVault()
 
         m_bInsertMerkleBlocks = false;
         m_networkSync.stopSynchingBlocks();
+        flushMerkleBatch();
         delete m_vault;
         m_vault = nullptr;
     }
@@ -415,6 +415,7 @@ void SynchedVault::suspendBlockUpdates()
     if (!m_bInsertMerkleBlocks) return;
     std::lock_guard<std::mutex> lock(m_vaultMutex);
     m_bInsertMerkleBlocks = false;
+    flushMerkleBatch();
 }
 
 void SynchedVault::syncBlocks()
@@ -427,6 +428,9 @@ void SynchedVault::syncBlocks()
     std::lock_guard<std::mutex> lock(m_vaultMutex);
     if (!m_vault) throw std::runtime_error("No vault is open.");
 
+    // The locator must reflect everything we have received.
+    flushMerkleBatch();
+
     uint32_t startTime = m_vault->getMaxFirstBlockTimestamp();
     if (startTime == 0)
     {
@@ -555,9 +559,138 @@ void SynchedVault::insertFakeMerkleBlock(unsigned int nExtraLeaves)
 
     lock.unlock();
     m_networkSync.insertMerkleBlock(coinmerkleblock, cointxs);
+
+    lock.lock();
+    if (m_vault) { flushMerkleBatch(); }
 }
 
 
+// Merkle block batching
+MerkleBlockUpdate& SynchedVault::batchMerkleBlock(const ChainMerkleBlock& chainmerkleblock)
+{
+    if (!m_merkleBatch.empty() && m_merkleBatch.back().merkleblock.hash() == chainmerkleblock.hash()) return m_merkleBatch.back();
+
+    // Only whole blocks are written so a batch is closed when the next block begins.
+    if (m_merkleBatch.size() >= m_merkleBatchSize ||
+        (!m_merkleBatch.empty() && std::chrono::steady_clock::now() - m_merkleBatchStarted > std::chrono::milliseconds(MERKLE_BATCH_MAX_DELAY_MS)))
+    {
+        flushMerkleBatch();
+    }
+
+    if (m_merkleBatch.empty())
+    {
+        m_merkleBatchStarted = std::chrono::steady_clock::now();
+        m_merkleBatchStartedCond.notify_one();
+    }
+
+    MerkleBlockUpdate update;
+    update.merkleblock = chainmerkleblock;
+    m_merkleBatch.push_back(update);
+    return m_merkleBatch.back();
+}
+
+void SynchedVault::flushMerkleBatch()
+{
+    if (m_merkleBatch.empty()) return;
+
+    std::vector<MerkleBlockUpdate> batch;
+    batch.swap(m_merkleBatch);
+
+    LOGGER(trace) << "SynchedVault::flushMerkleBatch() - writing " << batch.size() << " merkle blocks." << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        m_vault->insertMerkleBlocks(batch);
+    }
+    catch (const std::exception& e)
+    {
+        // Nothing was written. Go one event at a time so only the offending ones are lost, as before batching.
+        LOGGER(debug) << "SynchedVault::flushMerkleBatch() - " << e.what() << " Retrying one block at a time." << std::endl;
+        for (auto& update: batch) { insertMerkleBlockUpdate(update); }
+        return;
+    }
+
+    // Aim for the target write time, moving halfway there each batch to smooth out noise.
+    double msPerBlock = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / batch.size();
+    double targetSize = msPerBlock > 0.0 ? std::min<double>(MERKLE_BATCH_TARGET_MS / msPerBlock, MAX_MERKLE_BATCH_SIZE) : MAX_MERKLE_BATCH_SIZE;
+    m_merkleBatchSize = std::max<std::size_t>(1, (m_merkleBatchSize + (std::size_t)targetSize) / 2);
+}
+
+// Writes batches that are still open MERKLE_BATCH_MAX_DELAY_MS after they started, such as when a peer stalls mid sync.
+void SynchedVault::merkleBatchFlushLoop()
+{
+    std::unique_lock<std::mutex> lock(m_vaultMutex);
+    while (!m_bStopMerkleBatchFlush)
+    {
+        if (m_merkleBatch.empty())
+        {
+            m_merkleBatchStartedCond.wait(lock);
+            continue;
+        }
+
+        auto deadline = m_merkleBatchStarted + std::chrono::milliseconds(MERKLE_BATCH_MAX_DELAY_MS);
+        if (std::chrono::steady_clock::now() < deadline)
+        {
+            m_merkleBatchStartedCond.wait_until(lock, deadline);
+            continue;
+        }
+
+        if (m_vault)
+        {
+            LOGGER(trace) << "SynchedVault - merkle batch held for " << MERKLE_BATCH_MAX_DELAY_MS << " ms. Flushing." << std::endl;
+            flushMerkleBatch();
+        }
+        else
+        {
+            m_merkleBatch.clear();
+        }
+    }
+}
+
+void SynchedVault::insertMerkleBlockUpdate(const MerkleBlockUpdate& update)
+{
+    if (update.txs.empty())
+    {
+        try
+        {
+            std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(update.merkleblock));
+            merkleblock->txsinserted(true);
+            m_vault->insertMerkleBlock(merkleblock);
+        }
+        catch (const VaultException& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(e.what(), e.code());
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(e.what(), -1);
+        }
+        return;
+    }
+
+    for (auto& matchedtx: update.txs)
+    {
+        try
+        {
+            if (matchedtx.cointx)   { m_vault->insertMerkleTx(update.merkleblock, *matchedtx.cointx, matchedtx.txindex, matchedtx.txcount); }
+            else                    { m_vault->confirmMerkleTx(update.merkleblock, matchedtx.txhash, matchedtx.txindex, matchedtx.txcount); }
+        }
+        catch (const VaultException& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(e.what(), e.code());
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(e.what(), -1);
+        }
+    }
+}
+
 // Event subscriptions
 void SynchedVault::clearAllSlots()
 {
@@ -15,7 +15,10 @@
 
 #include <CoinQ/CoinQ_netsync.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 namespace CoinDB
 {
@@ -45,6 +48,10 @@ public:
     void openVault(const std::string& dbname, bool bCreate = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     void openVault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool bCreate = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     void closeVault();
+    void setDatabaseTuning(const DatabaseTuning& tuning) { m_databaseTuning = tuning; } // applies to vaults opened afterwards
+    const DatabaseTuning& getDatabaseTuning() const { return m_databaseTuning; }
+    void setUtxoCacheEnabled(bool bEnabled) { m_bUtxoCacheEnabled = bEnabled; } // applies to vaults opened afterwards
+    bool isUtxoCacheEnabled() const { return m_bUtxoCacheEnabled; }
     bool isVaultOpen() const { return (m_vault != nullptr); }
     Vault* getVault() const { return m_vault; }
 
@@ -111,6 +118,8 @@ private:
 
     mutable std::mutex          m_vaultMutex;
     Vault*                      m_vault;
+    DatabaseTuning              m_databaseTuning;
+    bool                        m_bUtxoCacheEnabled;
 
     status_t                    m_status;
     void                        updateStatus(status_t newStatus);
@@ -140,6 +149,25 @@ private:
 
     bool                        m_bInsertMerkleBlocks;
 
+    // During block sync merkle blocks and their transactions are written to the vault in batches,
+    // each in a single database transaction. The batch size follows the measured write time so a
+    // batch takes about MERKLE_BATCH_TARGET_MS, and a batch is never held longer than MERKLE_BATCH_MAX_DELAY_MS:
+    // if no further block arrives to close it, the flush thread writes it.
+    enum { MERKLE_BATCH_TARGET_MS = 250, MERKLE_BATCH_MAX_DELAY_MS = 2000, MAX_MERKLE_BATCH_SIZE = 1000, INITIAL_MERKLE_BATCH_SIZE = 16 };
+    std::vector<MerkleBlockUpdate>          m_merkleBatch;
+    std::chrono::steady_clock::time_point   m_merkleBatchStarted;
+    std::size_t                             m_merkleBatchSize;
+
+    std::thread                             m_merkleBatchFlushThread;
+    std::condition_variable                 m_merkleBatchStartedCond;
+    bool                                    m_bStopMerkleBatchFlush;
+    void                                    merkleBatchFlushLoop();
+
+    // These must be called with m_vaultMutex held.
+    MerkleBlockUpdate&          batchMerkleBlock(const ChainMerkleBlock& chainmerkleblock);
+    void                        flushMerkleBatch();
+    void                        insertMerkleBlockUpdate(const MerkleBlockUpdate& update);
+
     // Vault state events
     VaultSignal                 m_notifyVaultOpened;
     VoidSignal                  m_notifyVaultClosed;
@@ -0,0 +1,384 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// UtxoCache.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+
+#include "UtxoCache.h"
+
+#include <logger/logger.h>
+
+using namespace CoinDB;
+
+UtxoCache::UtxoCache()
+    : m_bEnabled(false), m_bLoaded(false), m_generation(0), m_bBestHeightValid(false), m_bestHeight(0), m_bStagedBestHeight(false), m_bStagedAccountNames(false), m_transaction(nullptr)
+{
+}
+
+UtxoCache::~UtxoCache()
+{
+    if (m_transaction) { m_transaction->callback_unregister(this); }
+}
+
+bool UtxoCache::isEnabled() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_bEnabled;
+}
+
+void UtxoCache::setEnabled(bool enabled)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_bEnabled = enabled;
+    clear_unwrapped();
+}
+
+void UtxoCache::clear()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    clear_unwrapped();
+}
+
+void UtxoCache::invalidate()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_bLoaded = false;
+}
+
+uint64_t UtxoCache::generation() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_generation;
+}
+
+bool UtxoCache::isLoaded() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_bLoaded;
+}
+
+bool UtxoCache::load(const utxo_map_t& utxos, uint32_t best_height, uint64_t generation)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled || generation != m_generation) return false;
+
+    clear_unwrapped();
+    for (auto& item: utxos) { insert_unwrapped(item.first, item.second); }
+    m_bestHeight = best_height;
+    m_bBestHeightValid = true;
+    m_bLoaded = true;
+    return true;
+}
+
+std::set<unsigned long> UtxoCache::getStaleAccounts() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_staleAccounts;
+}
+
+bool UtxoCache::isAccountStale(unsigned long account_id) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_staleAccounts.count(account_id) != 0;
+}
+
+bool UtxoCache::loadAccount(unsigned long account_id, const utxo_map_t& utxos, uint64_t generation)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled || !m_bLoaded || generation != m_generation) return false;
+
+    eraseAccount_unwrapped(account_id);
+    for (auto& item: utxos)
+    {
+        if (item.second.account_id == account_id) { insert_unwrapped(item.first, item.second); }
+    }
+    m_staleAccounts.erase(account_id);
+    return true;
+}
+
+bool UtxoCache::getBestHeight(uint32_t& best_height) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bBestHeightValid) return false;
+    best_height = m_bestHeight;
+    return true;
+}
+
+bool UtxoCache::setBestHeight(uint32_t best_height, uint64_t generation)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled || generation != m_generation) return false;
+    m_bestHeight = best_height;
+    m_bBestHeightValid = true;
+    return true;
+}
+
+bool UtxoCache::getAccountId(const std::string& account_name, unsigned long& account_id) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    auto it = m_accountIds.find(account_name);
+    if (it == m_accountIds.end()) return false;
+    account_id = it->second;
+    return true;
+}
+
+bool UtxoCache::setAccountId(const std::string& account_name, unsigned long account_id, uint64_t generation)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled || generation != m_generation) return false;
+    m_accountIds[account_name] = account_id;
+    return true;
+}
+
+bool UtxoCache::getBalance(unsigned long account_id, uint32_t min_confirmations, const std::vector<Tx::status_t>& tx_statuses, uint64_t& balance) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!isAccountCurrent_unwrapped(account_id) || !m_bBestHeightValid) return false;
+
+    balance = 0;
+    if (min_confirmations > m_bestHeight) return true;
+
+    auto account_it = m_accounts.find(account_id);
+    if (account_it == m_accounts.end()) return true;
+
+    // Outputs deeper than max_height are all counted, so only the last few blocks need subtracting.
+    uint32_t max_height = m_bestHeight + 1 - min_confirmations;
+    for (auto tx_status: tx_statuses)
+    {
+        auto totals_it = account_it->second.totals.find(tx_status);
+        if (totals_it == account_it->second.totals.end()) continue;
+
+        const StatusTotals& totals = totals_it->second;
+        if (min_confirmations == 0)
+        {
+            balance += totals.unconfirmed + totals.confirmed;
+            continue;
+        }
+
+        balance += totals.confirmed;
+        for (auto it = totals.heights.rbegin(); it != totals.heights.rend() && it->first > max_height; ++it) { balance -= it->second; }
+    }
+    return true;
+}
+
+bool UtxoCache::getUnspent(unsigned long account_id, uint32_t min_confirmations, utxo_map_t& utxos) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!isAccountCurrent_unwrapped(account_id) || !m_bBestHeightValid) return false;
+
+    utxos.clear();
+    if (min_confirmations > 0 && min_confirmations > m_bestHeight) return true;
+
+    auto account_it = m_accounts.find(account_id);
+    if (account_it == m_accounts.end()) return true;
+
+    uint32_t max_height = m_bestHeight + 1 - min_confirmations;
+    for (auto txout_id: account_it->second.txouts)
+    {
+        const Utxo& utxo = m_utxos.at(txout_id);
+        if (utxo.tx_status <= Tx::UNSIGNED) continue;
+        if (min_confirmations > 0 && (!utxo.confirmed || utxo.height > max_height)) continue;
+        utxos[txout_id] = utxo;
+    }
+    return true;
+}
+
+UtxoCache::utxo_map_t UtxoCache::getUtxos() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_utxos;
+}
+
+void UtxoCache::stageTx(std::shared_ptr<Tx> tx)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled) return;
+
+    registerCallback();
+    for (auto& txout: tx->txouts()) { m_stagedTxOuts.push_back(StagedTxOut(txout, tx, false)); }
+    for (auto& txin: tx->txins())
+    {
+        std::shared_ptr<TxOut> outpoint = txin->outpoint();
+        if (outpoint) { m_stagedTxOuts.push_back(StagedTxOut(outpoint, outpoint->tx(), false)); }
+    }
+}
+
+void UtxoCache::stageTxDeleted(std::shared_ptr<Tx> tx)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled) return;
+
+    registerCallback();
+    for (auto& txout: tx->txouts()) { m_stagedTxOuts.push_back(StagedTxOut(txout, tx, true)); }
+}
+
+void UtxoCache::stageTxOut(std::shared_ptr<TxOut> txout)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled) return;
+
+    registerCallback();
+    m_stagedTxOuts.push_back(StagedTxOut(txout, txout->tx(), false));
+}
+
+void UtxoCache::stageBestHeight()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled) return;
+
+    registerCallback();
+    m_bStagedBestHeight = true;
+}
+
+void UtxoCache::stageAccountNames()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_bEnabled) return;
+
+    registerCallback();
+    m_bStagedAccountNames = true;
+}
+
+void UtxoCache::registerCallback()
+{
+    if (m_transaction) return;
+
+    // ODB resets m_transaction once the transaction is finalized.
+    odb::transaction& t = odb::transaction::current();
+    t.callback_register(&UtxoCache::transactionEvent, this, odb::transaction::event_all, 0, &m_transaction);
+    m_transaction = &t;
+}
+
+void UtxoCache::transactionEvent(unsigned short event, void* key, unsigned long long /*data*/)
+{
+    UtxoCache* cache = static_cast<UtxoCache*>(key);
+    if (event == odb::transaction::event_commit)    { cache->commitStaged(); }
+    else                                            { cache->discardStaged(); }
+}
+
+void UtxoCache::commitStaged()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_transaction = nullptr;
+    m_generation++;
+
+    try
+    {
+        if (m_bLoaded)
+        {
+            for (auto& staged: m_stagedTxOuts) { apply_unwrapped(staged); }
+        }
+        if (m_bStagedBestHeight) { m_bBestHeightValid = false; }
+        if (m_bStagedAccountNames) { m_accountIds.clear(); }
+    }
+    catch (const std::exception& e)
+    {
+        // Callbacks must not throw. Start over from the database instead.
+        LOGGER(error) << "UtxoCache::commitStaged() - " << e.what() << std::endl;
+        m_bLoaded = false;
+    }
+
+    m_stagedTxOuts.clear();
+    m_bStagedBestHeight = false;
+    m_bStagedAccountNames = false;
+}
+
+void UtxoCache::discardStaged()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_transaction = nullptr;
+    m_stagedTxOuts.clear();
+    m_bStagedBestHeight = false;
+    m_bStagedAccountNames = false;
+}
+
+void UtxoCache::clear_unwrapped()
+{
+    m_bLoaded = false;
+    m_utxos.clear();
+    m_accounts.clear();
+    m_staleAccounts.clear();
+    m_bBestHeightValid = false;
+    m_accountIds.clear();
+}
+
+void UtxoCache::insert_unwrapped(unsigned long txout_id, const Utxo& utxo)
+{
+    m_utxos[txout_id] = utxo;
+
+    AccountUtxos& account = m_accounts[utxo.account_id];
+    account.txouts.insert(txout_id);
+
+    StatusTotals& totals = account.totals[utxo.tx_status];
+    if (utxo.confirmed)
+    {
+        totals.confirmed += utxo.value;
+        totals.heights[utxo.height] += utxo.value;
+    }
+    else
+    {
+        totals.unconfirmed += utxo.value;
+    }
+}
+
+void UtxoCache::erase_unwrapped(unsigned long txout_id)
+{
+    auto utxo_it = m_utxos.find(txout_id);
+    if (utxo_it == m_utxos.end()) return;
+
+    const Utxo& utxo = utxo_it->second;
+    AccountUtxos& account = m_accounts[utxo.account_id];
+    account.txouts.erase(txout_id);
+
+    StatusTotals& totals = account.totals[utxo.tx_status];
+    if (utxo.confirmed)
+    {
+        totals.confirmed -= utxo.value;
+        auto height_it = totals.heights.find(utxo.height);
+        height_it->second -= utxo.value;
+        if (height_it->second == 0) { totals.heights.erase(height_it); }
+    }
+    else
+    {
+        totals.unconfirmed -= utxo.value;
+    }
+
+    m_utxos.erase(utxo_it);
+}
+
+void UtxoCache::eraseAccount_unwrapped(unsigned long account_id)
+{
+    auto account_it = m_accounts.find(account_id);
+    if (account_it == m_accounts.end()) return;
+
+    for (auto txout_id: account_it->second.txouts) { m_utxos.erase(txout_id); }
+    m_accounts.erase(account_it);
+}
+
+void UtxoCache::apply_unwrapped(const StagedTxOut& staged)
+{
+    const TxOut& txout = *staged.txout;
+    erase_unwrapped(txout.id());
+    if (staged.deleted) return;
+
+    std::shared_ptr<Account> account = txout.receiving_account();
+    if (!account || txout.status() != TxOut::UNSPENT) return;
+
+    if (!staged.tx)
+    {
+        // Without the transaction we don't know its status or height.
+        m_staleAccounts.insert(account->id());
+        return;
+    }
+
+    std::shared_ptr<BlockHeader> blockheader = staged.tx->blockheader();
+    insert_unwrapped(txout.id(), Utxo(account->id(), txout.value(), staged.tx->status(), (bool)blockheader, blockheader ? blockheader->height() : 0));
+}
+
+bool UtxoCache::isAccountCurrent_unwrapped(unsigned long account_id) const
+{
+    return m_bEnabled && m_bLoaded && !m_staleAccounts.count(account_id);
+}
@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// UtxoCache.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// In-memory copy of the unspent outputs of each account, with balances totaled
+// by transaction status and block height.
+//
+
+#pragma once
+
+#include "Schema.h"
+
+#include <odb/transaction.hxx>
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+
+namespace CoinDB
+{
+
+// The vault stages every change to its transactions as it writes them. The changes are applied
+// when the database transaction commits and dropped if it rolls back, so the cache only ever
+// reflects committed state. Anything the cache can't work out from the staged objects marks the
+// account for reloading from the database.
+//
+// Every successful commit bumps the generation. A reload passes in the generation it read
+// before its first query and is refused if a commit got in since, as it may have missed it.
+class UtxoCache
+{
+public:
+    struct Utxo
+    {
+        Utxo() : account_id(0), value(0), tx_status(Tx::NO_STATUS), confirmed(false), height(0) { }
+        Utxo(unsigned long account_id_, uint64_t value_, Tx::status_t tx_status_, bool confirmed_, uint32_t height_)
+            : account_id(account_id_), value(value_), tx_status(tx_status_), confirmed(confirmed_), height(height_) { }
+
+        bool operator==(const Utxo& rhs) const { return account_id == rhs.account_id && value == rhs.value && tx_status == rhs.tx_status && confirmed == rhs.confirmed && height == rhs.height; }
+        bool operator!=(const Utxo& rhs) const { return !(*this == rhs); }
+
+        unsigned long   account_id;
+        uint64_t        value;
+        Tx::status_t    tx_status;
+        bool            confirmed;
+        uint32_t        height;         // 0 if unconfirmed
+    };
+
+    typedef std::map<unsigned long, Utxo> utxo_map_t; // keyed by txout id
+
+    UtxoCache();
+    ~UtxoCache();
+
+    bool isEnabled() const;
+    void setEnabled(bool enabled); // either way the cache is emptied
+    void clear();
+    void invalidate(); // forces a full reload
+
+    uint64_t generation() const;
+
+    // Loading from the database. Each returns false if the generation has moved.
+    bool isLoaded() const;
+    bool load(const utxo_map_t& utxos, uint32_t best_height, uint64_t generation);
+
+    std::set<unsigned long> getStaleAccounts() const;
+    bool isAccountStale(unsigned long account_id) const;
+    bool loadAccount(unsigned long account_id, const utxo_map_t& utxos, uint64_t generation);
+
+    bool getBestHeight(uint32_t& best_height) const;
+    bool setBestHeight(uint32_t best_height, uint64_t generation);
+
+    bool getAccountId(const std::string& account_name, unsigned long& account_id) const;
+    bool setAccountId(const std::string& account_name, unsigned long account_id, uint64_t generation);
+
+    // Queries return false if the cache can't answer for the account right now.
+    bool getBalance(unsigned long account_id, uint32_t min_confirmations, const std::vector<Tx::status_t>& tx_statuses, uint64_t& balance) const;
+    bool getUnspent(unsigned long account_id, uint32_t min_confirmations, utxo_map_t& utxos) const; // only from signed transactions
+    utxo_map_t getUtxos() const;
+
+    // Staging. Must be called inside the database transaction that makes the change.
+    void stageTx(std::shared_ptr<Tx> tx);           // inserted or updated, including the outpoints it spends
+    void stageTxDeleted(std::shared_ptr<Tx> tx);
+    void stageTxOut(std::shared_ptr<TxOut> txout);
+    void stageBestHeight();                         // merkle blocks were inserted or deleted
+    void stageAccountNames();                       // accounts were renamed
+
+private:
+    struct StatusTotals
+    {
+        StatusTotals() : unconfirmed(0), confirmed(0) { }
+
+        uint64_t unconfirmed;
+        uint64_t confirmed;
+        std::map<uint32_t, uint64_t> heights; // confirmed value by block height
+    };
+
+    struct AccountUtxos
+    {
+        std::set<unsigned long> txouts;
+        std::map<Tx::status_t, StatusTotals> totals;
+    };
+
+    // A txout and the transaction it belongs to, held from when it was staged.
+    struct StagedTxOut
+    {
+        StagedTxOut(std::shared_ptr<TxOut> txout_, std::shared_ptr<Tx> tx_, bool deleted_) : txout(txout_), tx(tx_), deleted(deleted_) { }
+
+        std::shared_ptr<TxOut> txout;
+        std::shared_ptr<Tx> tx;
+        bool deleted;
+    };
+
+    mutable boost::mutex m_mutex;
+
+    bool m_bEnabled;
+    bool m_bLoaded;
+    uint64_t m_generation;
+
+    utxo_map_t m_utxos;
+    std::map<unsigned long, AccountUtxos> m_accounts;
+    std::set<unsigned long> m_staleAccounts;
+
+    bool m_bBestHeightValid;
+    uint32_t m_bestHeight;
+
+    std::map<std::string, unsigned long> m_accountIds;
+
+    std::vector<StagedTxOut> m_stagedTxOuts;
+    bool m_bStagedBestHeight;
+    bool m_bStagedAccountNames;
+    odb::transaction* m_transaction; // the transaction our callback is registered with
+
+    void registerCallback();
+    static void transactionEvent(unsigned short event, void* key, unsigned long long data);
+    void commitStaged();
+    void discardStaged();
+
+    void clear_unwrapped();
+    void insert_unwrapped(unsigned long txout_id, const Utxo& utxo);
+    void erase_unwrapped(unsigned long txout_id);
+    void eraseAccount_unwrapped(unsigned long account_id);
+    void apply_unwrapped(const StagedTxOut& staged);
+    bool isAccountCurrent_unwrapped(unsigned long account_id) const;
+};
+
+}
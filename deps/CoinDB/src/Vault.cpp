@@ -27,10 +27,12 @@
 #include <odb/session.hxx>
 
 #include <CoinCore/hash.h>
+#include <CoinCore/hashtypes.h>
 #include <CoinCore/aes.h>
 #include <CoinCore/MerkleTree.h>
 #include <CoinCore/secp256k1_openssl.h>
 #include <CoinCore/BigInt.h>
+#include <CoinCore/SigHash.h>
 
 #include <logger/logger.h>
 
@@ -39,6 +41,8 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace CoinDB;
 
@@ -222,11 +226,18 @@ void Vault::open(int argc, char** argv, bool create, uint32_t version, const std
             t.commit();
         }
     }
+
+    if (utxoCache_.isEnabled())
+    {
+        if (!t.finalized()) t.commit();
+        odb::core::transaction cache_t(db_->begin());
+        loadUtxoCache_unwrapped(utxoCache_.generation());
+    }
 }
 
-void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate)
+void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate, const DatabaseTuning& tuning)
 {
-    LOGGER(trace) << "Vault::open(" << dbuser << ", ..., " << dbname << ", " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
+    LOGGER(trace) << "Vault::open(" << dbuser << ", ..., " << dbname << ", " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ", " << DatabaseTuning::getProfileName(tuning.profile) << ")" << std::endl;
 
     name_ = dbname;
 
@@ -234,7 +245,8 @@ void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const s
 
     try
     {
-        db_ = openDatabase(dbuser, dbpasswd, dbname, create);
+        db_ = openDatabase(dbuser, dbpasswd, dbname, create, tuning);
+        databaseTuning_ = tuning;
     }
     catch (const std::exception& e)
     {
@@ -302,6 +314,13 @@ void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const s
         }
 
     }
+
+    if (utxoCache_.isEnabled())
+    {
+        if (!t.finalized()) t.commit();
+        odb::core::transaction cache_t(db_->begin());
+        loadUtxoCache_unwrapped(utxoCache_.generation());
+    }
 }
 
 void Vault::close()
@@ -310,9 +329,135 @@ void Vault::close()
 
     if (!db_) return;
     boost::lock_guard<boost::mutex> lock(mutex);
+    if (databaseTuning_.profile == DatabaseTuning::PERFORMANCE)
+    {
+        try
+        {
+            checkpointDatabase(*db_);
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << "Vault::close() - checkpoint failed: " << e.what() << std::endl;
+        }
+    }
+    utxoCache_.clear();
+    Keychain::clearDerivationCache();
     db_.reset();
 }
 
+void Vault::setTracer(odb::tracer* tracer)
+{
+    LOGGER(trace) << "Vault::setTracer()" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (!db_) throw std::runtime_error("Vault::setTracer() - database is not open.");
+    db_->tracer(tracer);
+}
+
+void Vault::setUtxoCacheEnabled(bool enabled)
+{
+    LOGGER(trace) << "Vault::setUtxoCacheEnabled(" << (enabled ? "true" : "false") << ")" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    utxoCache_.setEnabled(enabled);
+    if (!enabled || !db_) return;
+
+    odb::core::transaction t(db_->begin());
+    loadUtxoCache_unwrapped(utxoCache_.generation());
+}
+
+std::vector<std::string> Vault::verifyUtxoCache() const
+{
+    LOGGER(trace) << "Vault::verifyUtxoCache()" << std::endl;
+
+    // Hold off writers so the cache and the database can't move apart while we compare.
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (!utxoCache_.isEnabled()) throw std::runtime_error("Vault::verifyUtxoCache() - cache is not enabled.");
+
+    odb::core::transaction t(db_->begin());
+    uint64_t generation = utxoCache_.generation();
+
+    std::vector<std::string> discrepancies;
+    if (!utxoCache_.isLoaded())
+    {
+        discrepancies.push_back("Cache was not loaded.");
+        if (!loadUtxoCache_unwrapped(generation)) throw std::runtime_error("Vault::verifyUtxoCache() - cache could not be loaded.");
+    }
+
+    for (auto account_id: utxoCache_.getStaleAccounts())
+    {
+        std::stringstream ss;
+        ss << "Account " << account_id << " was marked for reloading.";
+        discrepancies.push_back(ss.str());
+    }
+
+    UtxoCache::utxo_map_t db_utxos;
+    getUtxoCacheEntries_unwrapped(0, db_utxos);
+    UtxoCache::utxo_map_t cached_utxos = utxoCache_.getUtxos();
+
+    for (auto& item: db_utxos)
+    {
+        auto it = cached_utxos.find(item.first);
+        std::stringstream ss;
+        if (it == cached_utxos.end())
+        {
+            ss << "TxOut " << item.first << " is unspent but missing from the cache.";
+            discrepancies.push_back(ss.str());
+        }
+        else if (it->second != item.second)
+        {
+            const UtxoCache::Utxo& cached = it->second;
+            const UtxoCache::Utxo& stored = item.second;
+            ss << "TxOut " << item.first << " differs. cache: account " << cached.account_id << ", value " << cached.value << ", tx status " << cached.tx_status << ", height " << cached.height
+               << " database: account " << stored.account_id << ", value " << stored.value << ", tx status " << stored.tx_status << ", height " << stored.height;
+            discrepancies.push_back(ss.str());
+        }
+    }
+
+    for (auto& item: cached_utxos)
+    {
+        if (db_utxos.count(item.first)) continue;
+        std::stringstream ss;
+        ss << "TxOut " << item.first << " is in the cache but is not unspent.";
+        discrepancies.push_back(ss.str());
+    }
+
+    uint32_t cached_best_height;
+    uint32_t best_height = getBestHeight_unwrapped();
+    if (utxoCache_.getBestHeight(cached_best_height) && cached_best_height != best_height)
+    {
+        std::stringstream ss;
+        ss << "Best height is " << best_height << " but the cache has " << cached_best_height << ".";
+        discrepancies.push_back(ss.str());
+    }
+
+    // Bring the cache up to date, then check its totals against the balance query.
+    if (!utxoCache_.load(db_utxos, best_height, generation)) throw std::runtime_error("Vault::verifyUtxoCache() - cache could not be reloaded.");
+
+    std::vector<Tx::status_t> tx_statuses = Tx::getStatusFlags(Tx::ALL);
+    for (auto& account: db_->query<Account>())
+    {
+        for (uint32_t min_confirmations = 0; min_confirmations <= 1; min_confirmations++)
+        {
+            typedef odb::query<BalanceView> query_t;
+            query_t query(query_t::Account::id == account.id() && query_t::TxOut::status == TxOut::UNSPENT && query_t::Tx::status.in_range(tx_statuses.begin(), tx_statuses.end()));
+            if (min_confirmations > 0) { query = (query && query_t::BlockHeader::height <= best_height + 1 - min_confirmations); }
+            odb::result<BalanceView> r(db_->query<BalanceView>(query));
+            uint64_t balance = (min_confirmations > best_height || r.empty()) ? 0 : r.begin()->balance;
+
+            uint64_t cached_balance = 0;
+            if (!utxoCache_.getBalance(account.id(), min_confirmations, tx_statuses, cached_balance) || cached_balance != balance)
+            {
+                std::stringstream ss;
+                ss << "Account " << account.name() << " has balance " << balance << " with " << min_confirmations << " confirmation(s) but the cache totals " << cached_balance << ".";
+                discrepancies.push_back(ss.str());
+            }
+        }
+    }
+
+    return discrepancies;
+}
+
 uint32_t Vault::getSchemaVersion() const
 {
     LOGGER(trace) << "Vault::getSchemaVersion()" << std::endl;
@@ -1128,6 +1273,7 @@ void Vault::lockAllKeychains()
 
     boost::lock_guard<boost::mutex> lock(mutex);
     mapPrivateKeyUnlock.clear();
+    Keychain::clearDerivationCache(true);
     for (auto& item: mapPrivateKeyUnlock)
     {
         notifyKeychainLocked(item.first);
@@ -1140,6 +1286,7 @@ void Vault::lockKeychain(const std::string& keychain_name)
 
     boost::lock_guard<boost::mutex> lock(mutex);
     mapPrivateKeyUnlock.erase(keychain_name);
+    Keychain::clearDerivationCache(true);
     notifyKeychainLocked(keychain_name);
 }
 
@@ -1364,12 +1511,7 @@ std::shared_ptr<Account> Vault::importAccount_unwrapped(boost::archive::text_iar
         bin->makeImport();
         db_->persist(bin);
 
-        SigningScriptVector scripts = bin->generateSigningScripts();
-        for (auto& script: scripts)
-        {
-            for (auto& key: script->keys()) { db_->persist(key); }
-            db_->persist(script);
-        }
+        persistSigningScripts_unwrapped(bin->generateSigningScripts(&workerPool));
 
         db_->update(bin);
     } 
@@ -1468,16 +1610,8 @@ void Vault::newAccount(const std::string& account_name, unsigned int minsigs, co
     std::shared_ptr<AccountBin> defaultAccountBin = account->addBin(DEFAULT_BIN_NAME);
     db_->persist(defaultAccountBin);
 
-    for (uint32_t i = 0; i < unused_pool_size; i++)
-    {
-        std::shared_ptr<SigningScript> changeSigningScript = changeAccountBin->newSigningScript();
-        for (auto& key: changeSigningScript->keys()) { db_->persist(key); } 
-        db_->persist(changeSigningScript);
-
-        std::shared_ptr<SigningScript> defaultSigningScript = defaultAccountBin->newSigningScript();
-        for (auto& key: defaultSigningScript->keys()) { db_->persist(key); }
-        db_->persist(defaultSigningScript);
-    }
+    persistSigningScripts_unwrapped(changeAccountBin->newSigningScripts(unused_pool_size, &workerPool));
+    persistSigningScripts_unwrapped(defaultAccountBin->newSigningScripts(unused_pool_size, &workerPool));
     db_->update(changeAccountBin);
     db_->update(defaultAccountBin);
     db_->update(account);
@@ -1506,6 +1640,7 @@ void Vault::renameAccount(const std::string& old_name, const std::string& new_na
     account->name(new_name);
 
     db_->update(account);
+    utxoCache_.stageAccountNames();
     t.commit();
 }
 
@@ -1538,7 +1673,11 @@ std::vector<TxOutView> Vault::getUnspentTxOutViews(const std::string& account_na
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
+    uint64_t cache_generation = utxoCache_.generation();
     std::shared_ptr<Account> account = getAccount_unwrapped(account_name);
+
+    std::vector<TxOutView> utxoviews;
+    if (getCachedUnspentTxOutViews_unwrapped(account->id(), min_confirmations, cache_generation, utxoviews)) return utxoviews;
     return getUnspentTxOutViews_unwrapped(account, min_confirmations);
 }
 
@@ -1560,6 +1699,95 @@ std::vector<TxOutView> Vault::getUnspentTxOutViews_unwrapped(std::shared_ptr<Acc
     return utxoviews;
 }
 
+bool Vault::loadUtxoCache_unwrapped(uint64_t generation) const
+{
+    UtxoCache::utxo_map_t utxos;
+    getUtxoCacheEntries_unwrapped(0, utxos);
+    if (!utxoCache_.load(utxos, getBestHeight_unwrapped(), generation)) return false;
+
+    LOGGER(debug) << "Vault::loadUtxoCache_unwrapped - loaded " << utxos.size() << " unspent outputs." << std::endl;
+    return true;
+}
+
+// Reloads whatever the cache has lost track of that the account's queries need.
+bool Vault::refreshUtxoCache_unwrapped(unsigned long account_id, uint64_t generation) const
+{
+    if (!utxoCache_.isEnabled()) return false;
+    if (!utxoCache_.isLoaded() && !loadUtxoCache_unwrapped(generation)) return false;
+
+    if (utxoCache_.isAccountStale(account_id))
+    {
+        UtxoCache::utxo_map_t utxos;
+        getUtxoCacheEntries_unwrapped(account_id, utxos);
+        if (!utxoCache_.loadAccount(account_id, utxos, generation)) return false;
+    }
+
+    uint32_t best_height;
+    if (!utxoCache_.getBestHeight(best_height) && !utxoCache_.setBestHeight(getBestHeight_unwrapped(), generation)) return false;
+
+    return true;
+}
+
+bool Vault::getUtxoCacheAccountId_unwrapped(const std::string& account_name, uint64_t generation, unsigned long& account_id) const
+{
+    if (utxoCache_.getAccountId(account_name, account_id)) return true;
+
+    odb::result<Account> r(db_->query<Account>(odb::query<Account>::name == account_name));
+    if (r.empty()) return false;
+
+    account_id = r.begin().load()->id();
+    utxoCache_.setAccountId(account_name, account_id, generation);
+    return true;
+}
+
+bool Vault::getCachedUnspentTxOutViews_unwrapped(unsigned long account_id, uint32_t min_confirmations, uint64_t generation, std::vector<TxOutView>& utxoviews) const
+{
+    UtxoCache::utxo_map_t utxos;
+    if (!refreshUtxoCache_unwrapped(account_id, generation) || !utxoCache_.getUnspent(account_id, min_confirmations, utxos)) return false;
+
+    std::vector<unsigned long> txout_ids;
+    for (auto& item: utxos) { txout_ids.push_back(item.first); }
+    getTxOutViewsById_unwrapped(txout_ids, utxoviews);
+    if (utxoviews.size() != txout_ids.size())
+    {
+        LOGGER(error) << "Vault::getCachedUnspentTxOutViews_unwrapped - cache has " << txout_ids.size() << " unspent outputs for account " << account_id << " but only " << utxoviews.size() << " were found. Reloading cache." << std::endl;
+        utxoCache_.invalidate();
+        utxoviews.clear();
+        return false;
+    }
+
+    std::sort(utxoviews.begin(), utxoviews.end(), [](const TxOutView& a, const TxOutView& b) { return a.value > b.value; });
+    return true;
+}
+
+void Vault::getUtxoCacheEntries_unwrapped(unsigned long account_id, UtxoCache::utxo_map_t& utxos) const
+{
+    typedef odb::query<UtxoCacheView> query_t;
+    query_t query(query_t::TxOut::status == TxOut::UNSPENT);
+    if (account_id)     { query = (query && query_t::TxOut::receiving_account == account_id); }
+    else                { query = (query && query_t::TxOut::receiving_account.is_not_null()); }
+
+    odb::result<UtxoCacheView> r(db_->query<UtxoCacheView>(query));
+    for (auto& view: r)
+    {
+        utxos[view.id] = UtxoCache::Utxo(view.account_id, view.value, view.tx_status, view.blockheader_id != 0, view.blockheader_id != 0 ? view.height : 0);
+    }
+}
+
+// Loads the views in batches that stay within the database's parameter limit.
+void Vault::getTxOutViewsById_unwrapped(const std::vector<unsigned long>& txout_ids, std::vector<TxOutView>& utxoviews) const
+{
+    typedef odb::query<TxOutView> query_t;
+    const std::size_t MAX_TXOUT_QUERY_SIZE = 500;
+    for (std::size_t i = 0; i < txout_ids.size(); i += MAX_TXOUT_QUERY_SIZE)
+    {
+        auto begin = txout_ids.begin() + i;
+        auto end = txout_ids.begin() + std::min(i + MAX_TXOUT_QUERY_SIZE, txout_ids.size());
+        odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(query_t::TxOut::id.in_range(begin, end)));
+        for (auto& utxoview: utxoview_r) { utxoviews.push_back(utxoview); }
+    }
+}
+
 AccountInfo Vault::getAccountInfo(const std::string& account_name) const
 {
     LOGGER(trace) << "Vault::getAccountInfo(" << account_name << ")" << std::endl;
@@ -1598,6 +1826,16 @@ uint64_t Vault::getAccountBalance(const std::string& account_name, unsigned int
     boost::lock_guard<boost::mutex> lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
+    if (utxoCache_.isEnabled())
+    {
+        uint64_t generation = utxoCache_.generation();
+        unsigned long account_id;
+        uint64_t balance;
+        if (getUtxoCacheAccountId_unwrapped(account_name, generation, account_id) &&
+            refreshUtxoCache_unwrapped(account_id, generation) &&
+            utxoCache_.getBalance(account_id, min_confirmations, tx_statuses, balance)) return balance;
+    }
+
     typedef odb::query<BalanceView> query_t;
     query_t query(query_t::Account::name == account_name && query_t::TxOut::status == TxOut::UNSPENT && query_t::Tx::status.in_range(tx_statuses.begin(), tx_statuses.end()));
     if (min_confirmations > 0)
@@ -1639,12 +1877,7 @@ std::shared_ptr<AccountBin> Vault::addAccountBin(const std::string& account_name
     std::shared_ptr<AccountBin> bin = account->addBin(bin_name);
     db_->persist(bin);
 
-    for (uint32_t i = 0; i < account->unused_pool_size(); i++)
-    {
-        std::shared_ptr<SigningScript> script = bin->newSigningScript();
-        for (auto& key: script->keys()) { db_->persist(key); }
-        db_->persist(script);
-    }
+    persistSigningScripts_unwrapped(bin->newSigningScripts(account->unused_pool_size(), &workerPool));
     db_->update(bin);
     db_->update(account);
     t.commit();
@@ -1744,12 +1977,11 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
     {
         count_result = db_->query<ScriptCountView>();
         uint32_t count = count_result.empty() ? 0 : count_result.begin().load()->count;
-        for (uint32_t i = count + 1; i < index; i++)
+        if (index > count + 1)
         {
-            std::shared_ptr<SigningScript> script = bin->newSigningScript();
-            script->status(SigningScript::ISSUED);
-            for (auto& key: script->keys()) { db_->persist(key); }
-            db_->persist(script); 
+            SigningScriptVector scripts = bin->newSigningScripts(index - count - 1, &workerPool);
+            for (auto& script: scripts) { script->status(SigningScript::ISSUED); }
+            persistSigningScripts_unwrapped(scripts);
         }
     }
 
@@ -1758,13 +1990,19 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
     uint32_t count = count_result.empty() ? 0 : count_result.begin().load()->count;
 
     uint32_t unused_pool_size = bin->account() ? bin->account()->unused_pool_size() : DEFAULT_UNUSED_POOL_SIZE;
-    for (uint32_t i = count; i < unused_pool_size; i++)
+    if (unused_pool_size > count) { persistSigningScripts_unwrapped(bin->newSigningScripts(unused_pool_size - count, &workerPool)); }
+    db_->update(bin);
+}
+
+void Vault::persistSigningScripts_unwrapped(const SigningScriptVector& scripts)
+{
+    // Each object type goes through its own prepared insert back to back. ODB only offers
+    // multi-row persist for Oracle and SQL Server, so this is as close to a bulk insert as we get.
+    for (auto& script: scripts)
     {
-        std::shared_ptr<SigningScript> script = bin->newSigningScript();
         for (auto& key: script->keys()) { db_->persist(key); }
-        db_->persist(script); 
-    } 
-    db_->update(bin);
+    }
+    for (auto& script: scripts) { db_->persist(script); }
 }
 
 std::vector<SigningScriptView> Vault::getSigningScriptViews(const std::string& account_name, const std::string& bin_name, int flags) const
@@ -1795,14 +2033,27 @@ std::vector<TxOutView> Vault::getTxOutViews(const std::string& account_name, con
 {
     LOGGER(trace) << "Vault::getTxOutViews(" << account_name << ", " << bin_name << ", " << TxOut::getRoleString(role_flags) << ", " << TxOut::getStatusString(txout_status_flags) << ", " << ", " << Tx::getStatusString(tx_status_flags) << ")" << std::endl;
 
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    std::vector<TxOutView> views;
+
     typedef odb::query<TxOutView> query_t;
     query_t query(query_t::receiving_account::id != 0 || query_t::sending_account::id != 0);
     if (!account_name.empty())
     {
-        query_t role_query(1 == 1);
-        if (role_flags & TxOut::ROLE_SENDER)    role_query = (role_query && (query_t::sending_account::name == account_name));
-        if (role_flags & TxOut::ROLE_RECEIVER)  role_query = (role_query || (query_t::receiving_account::name == account_name));
-        query = query && role_query;
+        odb::result<Account> account_r(db_->query<Account>(odb::query<Account>::name == account_name));
+        if (account_r.empty()) return views;
+        unsigned long account_id = account_r.begin()->id();
+
+        // Compare the txout columns rather than the joined account names so each role is an index lookup.
+        query_t sender_query(query_t::TxOut::sending_account == account_id);
+        query_t receiver_query(query_t::TxOut::receiving_account == account_id);
+        if ((role_flags & TxOut::ROLE_BOTH) == TxOut::ROLE_BOTH)    query = (query && (sender_query || receiver_query));
+        else if (role_flags & TxOut::ROLE_SENDER)                   query = (query && sender_query);
+        else if (role_flags & TxOut::ROLE_RECEIVER)                 query = (query && receiver_query);
+        else                                                        return views;
     }
     if (!bin_name.empty())                      query = (query && query_t::AccountBin::name == bin_name);
     if (hide_change)                            query = (query && (query_t::TxOut::account_bin.is_null() || query_t::AccountBin::name != CHANGE_BIN_NAME));
@@ -1818,11 +2069,6 @@ std::vector<TxOutView> Vault::getTxOutViews(const std::string& account_name, con
 
     query += "ORDER BY" + query_t::BlockHeader::height + "DESC," + query_t::Tx::timestamp + "DESC," + query_t::Tx::id + "DESC";
 
-#if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
-#endif
-    odb::core::transaction t(db_->begin());
-    std::vector<TxOutView> views;
     odb::result<TxOutView> r(db_->query<TxOutView>(query));
     for (auto& view: r)
     {
@@ -1975,19 +2221,9 @@ std::shared_ptr<AccountBin> Vault::importAccountBin_unwrapped(const std::string&
     db_->persist(bin);
 
     unsigned int next_script_index = bin->next_script_index();
-    for (unsigned int i = 0; i < next_script_index; i++)
-    {
-        std::shared_ptr<SigningScript> script = bin->newSigningScript();
-        script->status(SigningScript::ISSUED);
-        for (auto& key: script->keys()) { db_->persist(key); }
-        db_->persist(script);
-    }
-    for (unsigned int i = 0; i < DEFAULT_UNUSED_POOL_SIZE; i++)
-    {
-        std::shared_ptr<SigningScript> script = bin->newSigningScript();
-        for (auto& key: script->keys()) { db_->persist(key); }
-        db_->persist(script);
-    }
+    SigningScriptVector scripts = bin->newSigningScripts(next_script_index + DEFAULT_UNUSED_POOL_SIZE, &workerPool);
+    for (unsigned int i = 0; i < next_script_index; i++) { scripts[i]->status(SigningScript::ISSUED); }
+    persistSigningScripts_unwrapped(scripts);
     db_->update(bin);
     
     return bin;
@@ -2341,30 +2577,44 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
             if (!updated) return nullptr;
 
             updateConfirmations_unwrapped(stored_tx);
-            signalQueue.push(notifyTxUpdated.bind(stored_tx));
+            queueTxUpdated(stored_tx);
             return stored_tx;
         }
 
         // If we get here it means we've either never seen this transaction before or it doesn't affect our accounts.
 
-        std::set<std::shared_ptr<Tx>> conflicting_txs;
-        std::set<std::shared_ptr<TxIn>> updated_txins;
-        std::set<std::shared_ptr<TxOut>> updated_txouts;
-        std::set<std::shared_ptr<Tx>> updated_txs;
+        // Resolve all outpoints up front, in batches that stay within the database's parameter limit
+        const std::size_t MAX_OUTPOINT_QUERY_SIZE = 500;
+        txins_t txins = tx->txins();
+        txouts_t txouts = tx->txouts();
 
-        // Check inputs
-        bool sent_from_vault = false; // whether any of the inputs belong to vault
-        std::shared_ptr<Account> sending_account;
+        std::unordered_set<hash256_t> outhash_set;
+        for (auto& txin: txins) { outhash_set.insert(txin->outhash()); }
+        std::vector<bytes_t> outhashes(outhash_set.begin(), outhash_set.end());
+        std::unordered_map<hash256_t, std::shared_ptr<Tx>> spent_txs;
+        for (std::size_t i = 0; i < outhashes.size(); i += MAX_OUTPOINT_QUERY_SIZE)
+        {
+            auto begin = outhashes.begin() + i;
+            auto end = outhashes.begin() + std::min(i + MAX_OUTPOINT_QUERY_SIZE, outhashes.size());
+            odb::result<Tx> spent_tx_r(db_->query<Tx>(odb::query<Tx>::hash.in_range(begin, end)));
+            for (auto it = spent_tx_r.begin(); it != spent_tx_r.end(); ++it)
+            {
+                std::shared_ptr<Tx> spent_tx(it.load());
+                spent_txs.insert(std::make_pair(hash256_t(spent_tx->hash()), spent_tx));
+            }
+        }
 
-        for (auto& txin: tx->txins())
+        // The script each input spends: the outpoint's script if we have it, otherwise the one implied by a p2sh multisig txinscript.
+        txouts_t outpoints;
+        std::vector<bytes_t> spent_scripts;
+        std::set<bytes_t> script_set;
+        for (auto& txin: txins)
         {
-            // Check if inputs connect
-            tx_r = db_->query<Tx>(odb::query<Tx>::hash == txin->outhash());
-            if (tx_r.empty())
+            std::shared_ptr<TxOut> outpoint;
+            bytes_t txoutscript;
+            auto spent_it = spent_txs.find(txin->outhash());
+            if (spent_it == spent_txs.end())
             {
-                // The txinscript is in one of our accounts but we don't have the outpoint, 
-                txin->outpoint(nullptr);
-                bytes_t txoutscript;
                 try
                 {
                     CoinQ::Script::Script script(txin->script());
@@ -2374,31 +2624,55 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
                 {
                     // TODO: handle errors
                 }
-                if (!txoutscript.empty())
-                {
-                    odb::result<SigningScript> script_r(db_->query<SigningScript>(odb::query<SigningScript>::txoutscript == txoutscript));
-                    if (!script_r.empty())
-                    {
-                        sent_from_vault = true;
-                        if (!sending_account)
-                        {
-                            // Assuming all inputs belong to the same account
-                            // TODO: Allow coin mixing
-                            std::shared_ptr<SigningScript> script(script_r.begin().load());
-                            sending_account = script->account();
-                        }
-                    }
-                }
             }
             else
             {
-                std::shared_ptr<Tx> spent_tx(tx_r.begin().load());
-                txouts_t outpoints = spent_tx->txouts();
+                txouts_t spent_txouts = spent_it->second->txouts();
                 uint32_t outindex = txin->outindex();
-                if (outpoints.size() <= outindex) throw std::runtime_error("Vault::insertTx_unwrapped - outpoint out of range.");
-                std::shared_ptr<TxOut>& outpoint = outpoints[outindex];
-                txin->outpoint(outpoint);
+                if (spent_txouts.size() <= outindex) throw std::runtime_error("Vault::insertTx_unwrapped - outpoint out of range.");
+                outpoint = spent_txouts[outindex];
+                txoutscript = outpoint->script();
+            }
+
+            outpoints.push_back(outpoint);
+            spent_scripts.push_back(txoutscript);
+            if (!txoutscript.empty()) { script_set.insert(txoutscript); }
+        }
+        for (auto& txout: txouts) { script_set.insert(txout->script()); }
+
+        // Look up the signing scripts for both inputs and outputs in one pass
+        std::vector<bytes_t> scripts(script_set.begin(), script_set.end());
+        std::map<bytes_t, std::shared_ptr<SigningScript>> signingscripts;
+        for (std::size_t i = 0; i < scripts.size(); i += MAX_OUTPOINT_QUERY_SIZE)
+        {
+            auto begin = scripts.begin() + i;
+            auto end = scripts.begin() + std::min(i + MAX_OUTPOINT_QUERY_SIZE, scripts.size());
+            odb::result<SigningScript> script_r(db_->query<SigningScript>(odb::query<SigningScript>::txoutscript.in_range(begin, end)));
+            for (auto it = script_r.begin(); it != script_r.end(); ++it)
+            {
+                std::shared_ptr<SigningScript> script(it.load());
+                signingscripts.insert(std::make_pair(script->txoutscript(), script));
+            }
+        }
+
+        std::set<std::shared_ptr<Tx>> conflicting_txs;
+        std::set<std::shared_ptr<TxIn>> updated_txins;
+        std::set<std::shared_ptr<TxOut>> updated_txouts;
+        std::set<std::shared_ptr<Tx>> updated_txs;
+
+        // Check inputs
+        bool sent_from_vault = false; // whether any of the inputs belong to vault
+        std::shared_ptr<Account> sending_account;
 
+        for (std::size_t i = 0; i < txins.size(); i++)
+        {
+            std::shared_ptr<TxIn>& txin = txins[i];
+            std::shared_ptr<TxOut>& outpoint = outpoints[i];
+
+            // The txinscript may be in one of our accounts even if we don't have the outpoint
+            txin->outpoint(outpoint);
+            if (outpoint)
+            {
                 // Check for double spend, track conflicted transaction so we can update status if necessary later.
                 std::shared_ptr<TxIn> conflict_txin = outpoint->spent();
                 if (conflict_txin)
@@ -2406,39 +2680,54 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
                     LOGGER(debug) << "Vault::insertTx_unwrapped - Discovered conflicting transaction. Double spend. hash: " << uchar_vector(conflict_txin->tx()->hash()).getHex() << std::endl;
                     conflicting_txs.insert(conflict_txin->tx());
                 } 
+            }
 
-                // Was this transaction signed using one of our accounts?
-                odb::result<SigningScript> script_r(db_->query<SigningScript>(odb::query<SigningScript>::txoutscript == outpoint->script()));
-                if (!script_r.empty())
-                {
-                    sent_from_vault = true;
-                    outpoint->spent(txin);
-                    updated_txouts.insert(outpoint);
-                    if (!sending_account)
-                    {
-                        // Assuming all inputs belong to the same account
-                        // TODO: Allow coin mixing
-                        std::shared_ptr<SigningScript> script(script_r.begin().load());
-                        sending_account = script->account();
-                    }
-                }
+            // Was this transaction signed using one of our accounts?
+            if (spent_scripts[i].empty()) continue;
+            auto script_it = signingscripts.find(spent_scripts[i]);
+            if (script_it == signingscripts.end()) continue;
+
+            sent_from_vault = true;
+            if (outpoint)
+            {
+                outpoint->spent(txin);
+                updated_txouts.insert(outpoint);
+            }
+            if (!sending_account)
+            {
+                // Assuming all inputs belong to the same account
+                // TODO: Allow coin mixing
+                sending_account = script_it->second->account();
             }
         }
 
         // Check outputs
         bool sent_to_vault = false; // whether any of the outputs are spendable by accounts in vault
-        for (auto& txout: tx->txouts())
+        bool pool_refilled = false; // refills can issue scripts that later outputs pay to
+        bool spending_txins_loaded = false;
+        std::map<uint32_t, std::shared_ptr<TxIn>> spending_txins;
+        for (auto& txout: txouts)
         {
             // Assume all inputs sent from same account.
             // TODO: Allow coin mixing.
             if (sending_account) { txout->sending_account(sending_account); }
 
-            odb::result<SigningScript> script_r(db_->query<SigningScript>(odb::query<SigningScript>::txoutscript == txout->script()));
-            if (!script_r.empty())
+            std::shared_ptr<SigningScript> script;
+            auto script_it = signingscripts.find(txout->script());
+            if (script_it != signingscripts.end())
+            {
+                script = script_it->second;
+            }
+            else if (pool_refilled)
+            {
+                odb::result<SigningScript> script_r(db_->query<SigningScript>(odb::query<SigningScript>::txoutscript == txout->script()));
+                if (!script_r.empty()) { script = script_r.begin().load(); }
+            }
+
+            if (script)
             {
                 // This output is spendable from an account in the vault
                 sent_to_vault = true;
-                std::shared_ptr<SigningScript> script(script_r.begin().load());
                 txout->signingscript(script);
 
                 // Update the signing script and txout status
@@ -2455,6 +2744,7 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
                     }
                     db_->update(script);
                     refillAccountBinPool_unwrapped(script->account_bin());
+                    pool_refilled = true;
                     break;
 
                 case SigningScript::ISSUED:
@@ -2467,11 +2757,22 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
                 }
 
                 // Check if the output has already been spent (transactions inserted out of order)
-                odb::result<TxIn> txin_r(db_->query<TxIn>(odb::query<TxIn>::outhash == tx->hash() && odb::query<TxIn>::outindex == txout->txindex()));
-                if (!txin_r.empty())
+                if (!spending_txins_loaded)
+                {
+                    odb::result<TxIn> txin_r(db_->query<TxIn>(odb::query<TxIn>::outhash == tx->hash()));
+                    for (auto it = txin_r.begin(); it != txin_r.end(); ++it)
+                    {
+                        std::shared_ptr<TxIn> txin(it.load());
+                        spending_txins.insert(std::make_pair(txin->outindex(), txin));
+                    }
+                    spending_txins_loaded = true;
+                }
+
+                auto txin_it = spending_txins.find(txout->txindex());
+                if (txin_it != spending_txins.end())
                 {
                     LOGGER(debug) << "Vault::insertTx_unwrapped - out of order insertion." << std::endl;
-                    std::shared_ptr<TxIn> txin(txin_r.begin().load());
+                    std::shared_ptr<TxIn> txin(txin_it->second);
                     if (!txin->tx()) throw std::runtime_error("Tx is null for txin.");
                     txout->spent(txin);
                     txin->outpoint(txout); // We now have the outpoint. TODO: deal with conflicts.
@@ -2496,7 +2797,7 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
                 {
                     conflicting_tx->conflicting(true);
                     db_->update(conflicting_tx);
-                    signalQueue.push(notifyTxUpdated.bind(conflicting_tx));
+                    queueTxUpdated(conflicting_tx);
                     //notifyTxUpdated(conflicting_tx);
                 }
             }
@@ -2518,6 +2819,7 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
             for (auto& tx:          updated_txs)    { db_->update(tx);          }
 
             if (tx->status() >= Tx::SENT) updateConfirmations_unwrapped(tx);
+            utxoCache_.stageTx(tx);
             signalQueue.push(notifyTxInserted.bind(tx));
             //notifyTxInserted(tx);
             return tx;
@@ -2595,7 +2897,7 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
                 stored_tx->updateStatus(tx->status());
                 stored_tx->blockheader(blockheader);
                 db_->update(stored_tx);
-                signalQueue.push(notifyTxUpdated.bind(stored_tx));
+                queueTxUpdated(stored_tx);
                 return stored_tx; 
             }
             return nullptr;
@@ -2697,6 +2999,7 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
             for (auto& txout:   updated_txouts)         { db_->update(txout);                   }
             for (auto& tx:      updated_txs)            { tx->updateTotals(); db_->update(tx);  }
 
+            utxoCache_.stageTx(tx);
             signalQueue.push(notifyTxInserted.bind(tx));
             return tx;
         }
@@ -2731,6 +3034,8 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
 {
     try
     {
+        utxoCache_.stageBestHeight();
+
         bytes_t blockhash = chainmerkleblock.hash();
         bytes_t txhash = cointx.hash();
 
@@ -2767,7 +3072,7 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                         std::shared_ptr<Tx> tx(it.load());
                         tx->blockheader(nullptr);
                         db_->update(tx);
-                        signalQueue.push(notifyTxUpdated.bind(tx));
+                        queueTxUpdated(tx);
                     }
                 }
 
@@ -2804,7 +3109,7 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                 tx->status(Tx::CONFIRMED);
                 tx->conflicting(false);
                 db_->update(tx);
-                signalQueue.push(notifyTxUpdated.bind(tx));
+                queueTxUpdated(tx);
             }
             else
             {
@@ -2841,7 +3146,7 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                     tx->status(Tx::CONFIRMED);
                     tx->conflicting(false);
                     db_->update(tx);
-                    signalQueue.push(notifyTxUpdated.bind(tx));
+                    queueTxUpdated(tx);
                 }
             } 
         }
@@ -2897,6 +3202,8 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
 {
     try
     {
+        utxoCache_.stageBestHeight();
+
         bytes_t blockhash = chainmerkleblock.hash();
 
         // Instantiate merkleblock
@@ -2932,7 +3239,7 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
                         std::shared_ptr<Tx> tx(it.load());
                         tx->status(Tx::PROPAGATED);
                         db_->update(tx);
-                        signalQueue.push(notifyTxUpdated.bind(tx));
+                        queueTxUpdated(tx);
                     }
                 }
 
@@ -2968,7 +3275,7 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
             tx->status(Tx::CONFIRMED);
             tx->conflicting(false);
             db_->update(tx);
-            signalQueue.push(notifyTxUpdated.bind(tx));
+            queueTxUpdated(tx);
         }
 
         if (txindex + 1 == txcount)
@@ -3172,12 +3479,45 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, u
     // TODO; Better coin selection heuristics
     if (input_total < desired_total)
     {
-        query_t query(base_query);
-        if (!coin_ids.empty()) { query = (query && !query_t::TxOut::id.in_range(coin_ids.begin(), coin_ids.end())); }
-        odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(query));
         std::vector<TxOutView> utxoviews;
-        for (auto& utxoview: utxoview_r) { utxoviews.push_back(utxoview); }
-        std::random_shuffle(utxoviews.begin(), utxoviews.end(), [](int i) { return std::rand() % i; });
+        UtxoCache::utxo_map_t utxos;
+        if (refreshUtxoCache_unwrapped(account->id(), utxoCache_.generation()) && utxoCache_.getUnspent(account->id(), min_confirmations, utxos))
+        {
+            // The cache knows the values, so only the outputs we pick need loading.
+            std::vector<std::pair<unsigned long, uint64_t>> candidates;
+            std::set<unsigned long> supplied_ids(coin_ids.begin(), coin_ids.end());
+            for (auto& item: utxos)
+            {
+                if (!supplied_ids.count(item.first)) { candidates.push_back(std::make_pair(item.first, item.second.value)); }
+            }
+            std::random_shuffle(candidates.begin(), candidates.end(), [](int i) { return std::rand() % i; });
+
+            std::vector<unsigned long> picked_ids;
+            uint64_t picked_total = input_total;
+            for (auto& candidate: candidates)
+            {
+                if (picked_total >= desired_total) break;
+                picked_ids.push_back(candidate.first);
+                picked_total += candidate.second;
+            }
+
+            getTxOutViewsById_unwrapped(picked_ids, utxoviews);
+            if (utxoviews.size() != picked_ids.size())
+            {
+                LOGGER(error) << "Vault::createTx_unwrapped - cache picked " << picked_ids.size() << " unspent outputs but only " << utxoviews.size() << " were found. Reloading cache." << std::endl;
+                utxoCache_.invalidate();
+                utxoviews.clear();
+            }
+        }
+
+        if (utxoviews.empty())
+        {
+            query_t query(base_query);
+            if (!coin_ids.empty()) { query = (query && !query_t::TxOut::id.in_range(coin_ids.begin(), coin_ids.end())); }
+            odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(query));
+            for (auto& utxoview: utxoview_r) { utxoviews.push_back(utxoview); }
+            std::random_shuffle(utxoviews.begin(), utxoviews.end(), [](int i) { return std::rand() % i; });
+        }
 
         for (auto& utxoview: utxoviews)
         {
@@ -3398,6 +3738,7 @@ void Vault::updateTx_unwrapped(std::shared_ptr<Tx> tx)
     for (auto& txin: tx->txins()) { db_->update(txin); }
     for (auto& txout: tx->txouts()) { db_->update(txout); }
     db_->update(tx); 
+    utxoCache_.stageTx(tx);
 }
 
 void Vault::deleteTx(const bytes_t& tx_hash)
@@ -3450,6 +3791,7 @@ void Vault::deleteTx_unwrapped(std::shared_ptr<Tx> tx)
                 std::shared_ptr<TxOut> txout(txout_r.begin().load());
                 txout->spent(nullptr);
                 db_->update(txout);
+                utxoCache_.stageTxOut(txout);
             }
             db_->erase(txin);
         }
@@ -3464,6 +3806,7 @@ void Vault::deleteTx_unwrapped(std::shared_ptr<Tx> tx)
 
         // delete tx
         db_->erase(tx);
+        utxoCache_.stageTxDeleted(tx);
         signalQueue.push(notifyTxDeleted.bind(tx));
     }
     catch (...)
@@ -3664,63 +4007,141 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
     if (!keychain_names.empty())
         privkey_query = privkey_query && odb::query<Key>::root_keychain->name.in_range(keychain_names.begin(), keychain_names.end());
 
-    KeychainSet keychains_signed;
+    struct InputSigning
+    {
+        InputSigning(std::shared_ptr<TxIn> txin_, const Script& script_) : txin(txin_), script(script_), sigsneeded(script_.sigsneeded()), bHaveKeys(false) { }
 
-    unsigned int sigsadded = 0;
+        std::shared_ptr<TxIn> txin;
+        Script script;
+        unsigned int sigsneeded;
+        bool bHaveKeys;
+        std::vector<std::shared_ptr<Key>> keys;
+        std::vector<bytes_t> signatures;
+        bytes_t signingHash;
+    };
+
+    // Find the inputs that still need signatures and the pubkeys they are waiting on
+    std::vector<InputSigning> inputs;
+    std::set<bytes_t> missing_pubkeys;
     for (auto& txin: tx->txins())
     {
         Script script(txin->script());
-        unsigned int sigsneeded = script.sigsneeded();
-        if (sigsneeded == 0) continue;
+        if (script.sigsneeded() == 0) continue;
 
         std::vector<bytes_t> pubkeys = script.missingsigs();
         if (pubkeys.empty()) continue;
 
-        odb::result<Key> key_r(db_->query<Key>(privkey_query && odb::query<Key>::pubkey.in_range(pubkeys.begin(), pubkeys.end())));
-        if (key_r.empty()) continue;
+        inputs.push_back(InputSigning(txin, script));
+        missing_pubkeys.insert(pubkeys.begin(), pubkeys.end());
+    }
 
-        // Prepare the inputs for hashing
-        Coin::Transaction coin_tx = tx->toCoinCore();
-        unsigned int i = 0;
-        for (auto& coin_input: coin_tx.inputs)
+    // Look up the keys for all inputs up front, in batches that stay within the database's parameter limit
+    const std::size_t MAX_KEY_QUERY_SIZE = 500;
+    std::vector<std::shared_ptr<Key>> keys;
+    std::map<bytes_t, std::vector<std::size_t>> key_indices;
+    std::vector<bytes_t> pubkeys(missing_pubkeys.begin(), missing_pubkeys.end());
+    for (std::size_t i = 0; i < pubkeys.size(); i += MAX_KEY_QUERY_SIZE)
+    {
+        auto begin = pubkeys.begin() + i;
+        auto end = pubkeys.begin() + std::min(i + MAX_KEY_QUERY_SIZE, pubkeys.size());
+        odb::result<Key> key_r(db_->query<Key>(privkey_query && odb::query<Key>::pubkey.in_range(begin, end)));
+        for (auto it = key_r.begin(); it != key_r.end(); ++it)
         {
-            if (i++ == txin->txindex()) { coin_input.scriptSig = script.txinscript(Script::SIGN); }
-            else                        { coin_input.scriptSig.clear(); }
+            std::shared_ptr<Key> key(it.load());
+            key_indices[key->pubkey()].push_back(keys.size());
+            keys.push_back(key);
         }
+    }
 
-        // Compute hash to sign
-        bytes_t signingHash = coin_tx.getHashWithAppendedCode(SIGHASH_ALL);
-        LOGGER(debug) << "Vault::signTx_unwrapped - computed signing hash " << uchar_vector(signingHash).getHex() << " for input " << txin->txindex() << std::endl;
+    // Pick the keys each input will be signed with. Unlocking touches shared keychain state so it stays on this thread.
+    std::map<std::shared_ptr<Keychain>, bool> keychains_unlocked;
+    for (auto& input: inputs)
+    {
+        std::vector<std::size_t> candidates;
+        for (auto& pubkey: input.script.missingsigs())
+        {
+            auto it = key_indices.find(pubkey);
+            if (it != key_indices.end()) { candidates.insert(candidates.end(), it->second.begin(), it->second.end()); }
+        }
+        if (candidates.empty()) continue;
+        std::sort(candidates.begin(), candidates.end());
 
-        for (auto& key: key_r)
+        input.bHaveKeys = true;
+        unsigned int sigsneeded = input.sigsneeded;
+        for (auto k: candidates)
         {
-            if (!tryUnlockKeychain_unwrapped(key.root_keychain()))
+            std::shared_ptr<Key> key = keys[k];
+            std::shared_ptr<Keychain> keychain = key->root_keychain();
+            auto it = keychains_unlocked.find(keychain);
+            if (it == keychains_unlocked.end()) { it = keychains_unlocked.insert(std::make_pair(keychain, tryUnlockKeychain_unwrapped(keychain))).first; }
+            if (!it->second)
             {
-                LOGGER(debug) << "Vault::signTx_unwrapped - private key locked for keychain " << key.root_keychain()->name() << std::endl;
+                LOGGER(debug) << "Vault::signTx_unwrapped - private key locked for keychain " << keychain->name() << std::endl;
                 continue;
             }
 
-            LOGGER(debug) << "Vault::signTx_unwrapped - SIGNING INPUT " << txin->txindex() << " WITH KEYCHAIN " << key.root_keychain()->name() << std::endl;        
-            secure_bytes_t privkey = key.try_privkey();
+            LOGGER(debug) << "Vault::signTx_unwrapped - SIGNING INPUT " << input.txin->txindex() << " WITH KEYCHAIN " << keychain->name() << std::endl;        
+            input.keys.push_back(key);
+            if (--sigsneeded == 0) break;
+        }
+    }
+
+    // Hash and sign the inputs in parallel. Results are stored per input, and if several inputs fail
+    // the error from the first of them is reported, just as if they had been signed in order.
+    Coin::SigHashEngine sigHashEngine(tx->toCoinCore());
+    std::vector<std::exception_ptr> errors(inputs.size());
+    workerPool.parallel_for(0, inputs.size(), [&](std::size_t i) {
+        InputSigning& input = inputs[i];
+        if (input.keys.empty()) return;
+
+        try
+        {
+            input.signingHash = sigHashEngine.getHash(input.txin->txindex(), input.script.txinscript(Script::SIGN), SIGHASH_ALL);
+            for (auto& key: input.keys)
+            {
+                secure_bytes_t privkey = key->try_privkey();
+
+                // TODO: Better exception handling with secp256kl_key class
+                secp256k1_key signingKey;
+                signingKey.setPrivKey(privkey);
 
-            // TODO: Better exception handling with secp256kl_key class
-            secp256k1_key signingKey;
-            signingKey.setPrivKey(privkey);
+                // Try checking both compressed and uncompressed pubkeys
+                if (signingKey.getPubKey() != key->pubkey() && signingKey.getPubKey(false) != key->pubkey()) throw KeychainInvalidPrivateKeyException(key->root_keychain()->name(), key->pubkey());
 
-            // Try checking both compressed and uncompressed pubkeys
-            if (signingKey.getPubKey() != key.pubkey() && signingKey.getPubKey(false) != key.pubkey()) throw KeychainInvalidPrivateKeyException(key.root_keychain()->name(), key.pubkey());
+                bytes_t signature = secp256k1_sign(signingKey, input.signingHash);
+                signature.push_back(SIGHASH_ALL);
+                input.signatures.push_back(signature);
+            }
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    });
+    for (auto& error: errors) { if (error) std::rethrow_exception(error); }
 
-            bytes_t signature = secp256k1_sign(signingKey, signingHash);
-            signature.push_back(SIGHASH_ALL);
-            script.addSig(key.pubkey(), signature);
-            LOGGER(debug) << "Vault::signTx_unwrapped - PUBLIC KEY: " << uchar_vector(key.pubkey()).getHex() << " SIGNATURE: " << uchar_vector(signature).getHex() << std::endl;
-            keychains_signed.insert(key.root_keychain());
+    KeychainSet keychains_signed;
+    unsigned int sigsadded = 0;
+    for (auto& input: inputs)
+    {
+        if (!input.bHaveKeys) continue;
+
+        if (!input.keys.empty())
+        {
+            LOGGER(debug) << "Vault::signTx_unwrapped - computed signing hash " << uchar_vector(input.signingHash).getHex() << " for input " << input.txin->txindex() << std::endl;
+        }
+
+        for (std::size_t k = 0; k < input.keys.size(); k++)
+        {
+            std::shared_ptr<Key>& key = input.keys[k];
+            input.script.addSig(key->pubkey(), input.signatures[k]);
+            LOGGER(debug) << "Vault::signTx_unwrapped - PUBLIC KEY: " << uchar_vector(key->pubkey()).getHex() << " SIGNATURE: " << uchar_vector(input.signatures[k]).getHex() << std::endl;
+            keychains_signed.insert(key->root_keychain());
             sigsadded++;
-            sigsneeded--;
-            if (sigsneeded == 0) break;
+            input.sigsneeded--;
         }
 
-        txin->script(script.txinscript(sigsneeded ? Script::EDIT : Script::BROADCAST));
+        input.txin->script(input.script.txinscript(input.sigsneeded ? Script::EDIT : Script::BROADCAST));
     }
 
     keychain_names.clear();
@@ -4115,6 +4536,8 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
 {
     try
     {
+        utxoCache_.stageBestHeight();
+
         auto& new_blockheader = merkleblock->blockheader();
         std::string new_blockheader_hash = uchar_vector(new_blockheader->hash()).getHex();
 
@@ -4200,7 +4623,7 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
             tx.blockheader(new_blockheader);
             db_->update(tx);
             confirmations_updated = true;
-            signalQueue.push(notifyTxUpdated.bind(std::make_shared<Tx>(tx)));
+            queueTxUpdated(std::make_shared<Tx>(tx));
         }
 
         if (confirmations_updated)
@@ -4217,6 +4640,52 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
     }
 }
 
+void Vault::insertMerkleBlocks(const std::vector<MerkleBlockUpdate>& updates)
+{
+    LOGGER(trace) << "Vault::insertMerkleBlocks(" << updates.size() << " blocks)" << std::endl;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        odb::core::session s;
+        try
+        {
+            odb::core::transaction t(db_->begin());
+            for (auto& update: updates) { insertMerkleBlockUpdate_unwrapped(update); }
+            t.commit();
+        }
+        catch (...)
+        {
+            signalQueue.clear();
+            throw;
+        }
+    }
+
+    signalQueue.flush();
+}
+
+void Vault::insertMerkleBlockUpdate_unwrapped(const MerkleBlockUpdate& update)
+{
+    if (update.txs.empty())
+    {
+        std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(update.merkleblock));
+        merkleblock->txsinserted(true);
+        insertMerkleBlock_unwrapped(merkleblock);
+        return;
+    }
+
+    for (auto& matchedtx: update.txs)
+    {
+        if (matchedtx.cointx)   { insertMerkleTx_unwrapped(update.merkleblock, *matchedtx.cointx, matchedtx.txindex, matchedtx.txcount); }
+        else                    { confirmMerkleTx_unwrapped(update.merkleblock, matchedtx.txhash, matchedtx.txindex, matchedtx.txcount); }
+    }
+}
+
+void Vault::queueTxUpdated(std::shared_ptr<Tx> tx)
+{
+    utxoCache_.stageTx(tx);
+    signalQueue.push(Signals::SignalQueue::Key(&notifyTxUpdated, tx->id()), notifyTxUpdated.bind(tx));
+}
+
 unsigned int Vault::deleteMerkleBlock(const bytes_t& hash)
 {
     return 0;
@@ -4243,6 +4712,7 @@ unsigned int Vault::deleteMerkleBlock_unwrapped(uint32_t height)
 {
     try
     {
+        utxoCache_.stageBestHeight();
 
     /*
         unsigned int count = 0;
@@ -4256,7 +4726,7 @@ unsigned int Vault::deleteMerkleBlock_unwrapped(uint32_t height)
             {
                 tx->blockheader(nullptr);
                 db_->update(tx);
-                signalQueue.push(notifyTxUpdated.bind(tx));
+                queueTxUpdated(tx);
             }
 
             std::shared_ptr<MerkleBlock> merkleblock(db_->find<MerkleBlock>(view.merkleblock_id));
@@ -4287,7 +4757,7 @@ unsigned int Vault::deleteMerkleBlock_unwrapped(uint32_t height)
     //            LOGGER(debug) << "Vault::deleteMerkleBlock_unwrapped - unconfirming transaction. hash: " << uchar_vector(tx.hash()).getHex() << std::endl;
                 tx.blockheader(nullptr);
                 db_->update(tx);
-                signalQueue.push(notifyTxUpdated.bind(std::make_shared<Tx>(tx)));
+                queueTxUpdated(std::make_shared<Tx>(tx));
                 //notifyTxUpdated(std::make_shared<Tx>(tx));
             }
 
@@ -4331,7 +4801,7 @@ unsigned int Vault::updateConfirmations_unwrapped(std::shared_ptr<Tx> tx)
 
             tx->blockheader(blockheader);
             db_->update(tx);
-            signalQueue.push(notifyTxUpdated.bind(tx));
+            queueTxUpdated(tx);
             count++;
             LOGGER(debug) << "Vault::updateConfirmations_unwrapped - transaction " << uchar_vector(tx->hash()).getHex() << " confirmed in block " << uchar_vector(tx->blockheader()->hash()).getHex() << " height: " << tx->blockheader()->height() << std::endl;
         }
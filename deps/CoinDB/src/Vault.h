@@ -13,6 +13,8 @@
 #include "VaultExceptions.h"
 #include "SigningRequest.h"
 #include "SignatureInfo.h"
+#include "DatabaseTuning.h"
+#include "UtxoCache.h"
 
 #include <Signals/Signals.h>
 #include <Signals/SignalQueue.h>
@@ -23,6 +25,8 @@
 
 #include <boost/thread.hpp>
 
+#include <sysutils/threadpool.h>
+
 // support for boost serialization
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -41,6 +45,22 @@ typedef Signals::Signal<std::shared_ptr<MerkleBlock>, const std::string& /*descr
 
 typedef Signals::Signal<std::shared_ptr<MerkleBlock>, bytes_t> TxConfirmationErrorSignal;
 
+// A merkle block received during block sync and its matched transactions in block order.
+// Transactions already in our mempool are given by hash alone and only get confirmed.
+struct MerkleBlockUpdate
+{
+    struct MatchedTx
+    {
+        std::shared_ptr<Coin::Transaction> cointx;  // null if only the hash is known
+        bytes_t txhash;
+        unsigned int txindex;
+        unsigned int txcount;
+    };
+
+    ChainMerkleBlock merkleblock;
+    std::vector<MatchedTx> txs;
+};
+
 class Vault
 {
 public:
@@ -63,8 +83,14 @@ public:
     // GLOBAL OPERATIONS //
     ///////////////////////
     void                                    open(int argc, char** argv, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
-    void                                    open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
+    void                                    open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false, const DatabaseTuning& tuning = DatabaseTuning());
     void                                    close();
+    void                                    setTracer(odb::tracer* tracer); // Every statement the vault issues is passed to the tracer. Pass nullptr to stop tracing.
+
+    // Keeps unspent outputs and balances in memory. Loaded when the vault opens, or right away if it is open already.
+    void                                    setUtxoCacheEnabled(bool enabled);
+    bool                                    isUtxoCacheEnabled() const { return utxoCache_.isEnabled(); }
+    std::vector<std::string>                verifyUtxoCache() const; // Compares the cache to the database. Returns the discrepancies found.
 
     const std::string&                      getName() const { return name_; }
     uint32_t                                getSchemaVersion() const;
@@ -213,6 +239,7 @@ public:
     std::shared_ptr<BlockHeader>            getBlockHeader(uint32_t height) const;
     std::shared_ptr<BlockHeader>            getBestBlockHeader() const;
     std::shared_ptr<MerkleBlock>            insertMerkleBlock(std::shared_ptr<MerkleBlock> merkleblock);
+    void                                    insertMerkleBlocks(const std::vector<MerkleBlockUpdate>& updates); // All or nothing, in a single database transaction.
     unsigned int                            deleteMerkleBlock(const bytes_t& hash);
     unsigned int                            deleteMerkleBlock(uint32_t height);
     void                                    exportMerkleBlocks(const std::string& filepath) const;
@@ -247,6 +274,10 @@ public:
 
     Signals::Connection subscribeTxConfirmationError(TxConfirmationErrorSignal::Slot slot) { return notifyTxConfirmationError.connect(slot); }
 
+    // Events are queued while the vault is locked and delivered once it is released.
+    Signals::SignalQueue::Stats getSignalQueueStats() const { return signalQueue.stats(); }
+    void setSignalCoalescing(bool coalescing) { signalQueue.setCoalescing(coalescing); }
+
     void clearAllSlots()
     {
         notifyKeychainUnlocked.clear();
@@ -325,12 +356,24 @@ protected:
 
     std::vector<TxOutView>                  getUnspentTxOutViews_unwrapped(std::shared_ptr<Account> account, uint32_t min_confirmations = 0) const;
 
+    ////////////////
+    // UTXO CACHE //
+    ////////////////
+    // Pass the cache generation read before the transaction's first query. The following return false if the cache can't be used.
+    bool                                    loadUtxoCache_unwrapped(uint64_t generation) const;
+    bool                                    refreshUtxoCache_unwrapped(unsigned long account_id, uint64_t generation) const;
+    bool                                    getUtxoCacheAccountId_unwrapped(const std::string& account_name, uint64_t generation, unsigned long& account_id) const;
+    bool                                    getCachedUnspentTxOutViews_unwrapped(unsigned long account_id, uint32_t min_confirmations, uint64_t generation, std::vector<TxOutView>& utxoviews) const;
+    void                                    getUtxoCacheEntries_unwrapped(unsigned long account_id, UtxoCache::utxo_map_t& utxos) const; // account_id = 0 for all accounts
+    void                                    getTxOutViewsById_unwrapped(const std::vector<unsigned long>& txout_ids, std::vector<TxOutView>& utxoviews) const;
+
     ////////////////////////////
     // ACCOUNT BIN OPERATIONS //
     ////////////////////////////
     std::shared_ptr<AccountBin>             getAccountBin_unwrapped(const std::string& account_name, const std::string& bin_name) const;
     std::shared_ptr<SigningScript>          issueAccountBinSigningScript_unwrapped(std::shared_ptr<AccountBin> account_bin, const std::string& label = "", uint32_t index = 0);
     void                                    refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint32_t index = 0);
+    void                                    persistSigningScripts_unwrapped(const SigningScriptVector& scripts);
     void                                    exportAccountBin_unwrapped(const std::shared_ptr<AccountBin> account_bin, const std::string& export_name, const std::string& filepath) const;
     std::shared_ptr<AccountBin>             importAccountBin_unwrapped(const std::string& filepath); 
 
@@ -377,6 +420,7 @@ protected:
     std::shared_ptr<BlockHeader>            getBlockHeader_unwrapped(uint32_t height) const;
     std::shared_ptr<BlockHeader>            getBestBlockHeader_unwrapped() const;
     std::shared_ptr<MerkleBlock>            insertMerkleBlock_unwrapped(std::shared_ptr<MerkleBlock> merkleblock);
+    void                                    insertMerkleBlockUpdate_unwrapped(const MerkleBlockUpdate& update);
     unsigned int                            deleteMerkleBlock_unwrapped(std::shared_ptr<MerkleBlock> merkleblock);
     unsigned int                            deleteMerkleBlock_unwrapped(uint32_t height);
     unsigned int                            updateConfirmations_unwrapped(std::shared_ptr<Tx> tx = nullptr); // If parameter is null, updates all unconfirmed transactions.
@@ -396,6 +440,9 @@ protected:
     /////////////
     Signals::SignalQueue                    signalQueue;
 
+    // Updates are keyed by transaction so each flush reports a transaction once, in its final state.
+    void                                    queueTxUpdated(std::shared_ptr<Tx> tx);
+
     KeychainUnlockedSignal                  notifyKeychainUnlocked;
     KeychainLockedSignal                    notifyKeychainLocked;
 
@@ -413,8 +460,13 @@ private:
     mutable boost::mutex mutex;
     std::shared_ptr<odb::core::database> db_;
     std::string name_;
+    DatabaseTuning databaseTuning_;
+    mutable UtxoCache utxoCache_;
 
     mutable std::map<std::string, secure_bytes_t> mapPrivateKeyUnlock;
+
+    // Spreads the EC work of signing a transaction's inputs and deriving script keys across cores
+    sysutils::ThreadPool workerPool;
 };
 
 }
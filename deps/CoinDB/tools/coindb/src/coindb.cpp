@@ -88,6 +88,20 @@ cli::result_t cmd_migrate(const cli::params_t& params)
     return "Schema is already current.";
 }
 
+cli::result_t cmd_checkutxocache(const cli::params_t& params)
+{
+    Vault vault;
+    vault.setUtxoCacheEnabled(true);
+    vault.open(g_dbuser, g_dbpasswd, params[0], false);
+    vector<string> discrepancies = vault.verifyUtxoCache();
+    if (discrepancies.empty()) return "UTXO cache matches the database.";
+
+    stringstream ss;
+    ss << discrepancies.size() << " discrepancies found:";
+    for (auto& discrepancy: discrepancies) { ss << endl << "  " << discrepancy; }
+    return ss.str();
+}
+
 cli::result_t cmd_exportvault(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -1311,6 +1325,11 @@ int main(int argc, char* argv[])
         "migrate",
         "migrate schema version",
         command::params(1, "db file")));
+    shell.add(command(
+        &cmd_checkutxocache,
+        "checkutxocache",
+        "load the unspent output cache and check it against the database",
+        command::params(1, "db file")));
     shell.add(command(
         &cmd_exportvault,
         "exportvault",
@@ -1697,7 +1716,7 @@ int main(int argc, char* argv[])
         g_dbpasswd = config.getDatabasePassword();
         string logfile = config.getDataDir() + "/coindb.log";
 
-        INIT_LOGGER(logfile.c_str());
+        logger::init_logger(logfile.c_str(), config.getLogLevel());
 
         return shell.exec(argc, argv);
     }
@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// dbaudit.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Records every statement the vault issues and runs EXPLAIN QUERY PLAN on each
+// of them, flagging the ones that scan a whole table.
+//
+
+#include <Vault.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/MerkleTree.h>
+#include <CoinCore/random.h>
+
+#include <logger/logger.h>
+
+#include <odb/tracer.hxx>
+
+#if defined(DATABASE_SQLITE)
+#include <sqlite3.h>
+#endif
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+using namespace CoinDB;
+using namespace std;
+
+const uint32_t FIRST_BLOCK_TIMESTAMP = 1000000;
+const unsigned int TXS_PER_BLOCK = 10;
+const unsigned int SCRIPT_COUNT = 100;
+
+// Collects distinct statements along with the vault call that first issued them.
+class StatementRecorder : public odb::tracer
+{
+public:
+    void call(const string& name) { m_call = name; }
+
+    virtual void execute(odb::connection& /*c*/, const char* statement)
+    {
+        string text(statement);
+        if (m_calls.count(text)) return;
+        m_calls[text] = m_call;
+        m_statements.push_back(text);
+    }
+
+    const vector<string>& statements() const { return m_statements; }
+    const string& caller(const string& statement) const { return m_calls.at(statement); }
+
+private:
+    string m_call;
+    vector<string> m_statements;
+    map<string, string> m_calls;
+};
+
+// Fills a new vault with txCount transactions paying to one account, confirmed TXS_PER_BLOCK to a block.
+void populate(Vault& vault, StatementRecorder& recorder, unsigned int txCount)
+{
+    recorder.call("newKeychain");
+    vault.newKeychain("audit", secure_random_bytes(32));
+
+    recorder.call("newAccount");
+    vault.newAccount("audit", 1, vector<string>(1, "audit"));
+
+    recorder.call("issueSigningScript");
+    vector<bytes_t> scripts;
+    for (unsigned int i = 0; i < SCRIPT_COUNT; i++) { scripts.push_back(vault.issueSigningScript("audit")->txoutscript()); }
+
+    recorder.call("insertTx");
+    vector<uchar_vector> txhashes;
+    for (unsigned int i = 0; i < txCount; i++)
+    {
+        Coin::Transaction coin_tx;
+        coin_tx.addInput(Coin::TxIn(Coin::OutPoint(uchar_vector(random_bytes(32)), 0), uchar_vector(), 0xffffffff));
+        coin_tx.addOutput(Coin::TxOut(100000 + i, scripts[i % scripts.size()]));
+
+        std::shared_ptr<Tx> tx(new Tx());
+        tx->set(coin_tx, time(NULL), Tx::PROPAGATED);
+        tx = vault.insertTx(tx);
+        if (!tx) throw runtime_error("Transaction was not inserted.");
+        txhashes.push_back(tx->hash());
+
+        if ((i + 1) % 10000 == 0) { cout << "  " << (i + 1) << " transactions" << endl; }
+    }
+
+    recorder.call("insertMerkleBlock");
+    bytes_t prevhash(32, 0);
+    unsigned int blockCount = (txCount + TXS_PER_BLOCK - 1) / TXS_PER_BLOCK;
+    for (unsigned int i = 0; i < blockCount; i++)
+    {
+        vector<uchar_vector> blocktxhashes(txhashes.begin() + i * TXS_PER_BLOCK, txhashes.begin() + min((i + 1) * TXS_PER_BLOCK, txCount));
+        Coin::MerkleBlock coinmerkleblock(Coin::randomPartialMerkleTree(blocktxhashes, blocktxhashes.size()), 2, prevhash, FIRST_BLOCK_TIMESTAMP + i * 600, 0x1d00ffff, i);
+
+        std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock());
+        merkleblock->fromCoinCore(coinmerkleblock, i + 1);
+        if (!vault.insertMerkleBlock(merkleblock)) throw runtime_error("Merkle block was not inserted.");
+        prevhash = merkleblock->blockheader()->hash();
+    }
+}
+
+// Read-only calls, so an existing vault can be audited without changing it.
+void exercise(Vault& vault, StatementRecorder& recorder)
+{
+    recorder.call("getBestHeight");             vault.getBestHeight();
+    recorder.call("getHorizonHeight");          vault.getHorizonHeight();
+    recorder.call("getLocatorHashes");          vault.getLocatorHashes();
+    recorder.call("getIncompleteBlockHashes");  vault.getIncompleteBlockHashes();
+    recorder.call("getBloomFilter");            vault.getBloomFilter(0.001, 0, 0);
+    recorder.call("getRootKeychainViews");      vault.getRootKeychainViews();
+    recorder.call("getAllAccountBinViews");     vault.getAllAccountBinViews();
+    recorder.call("getTxViews");                vault.getTxViews(Tx::ALL, 0, 100);
+    recorder.call("getTxs");                    txs_t txs = vault.getTxs(Tx::ALL, 0, 100);
+    recorder.call("getTxOutViews");             vault.getTxOutViews();
+
+    for (auto& tx: txs)
+    {
+        recorder.call("getTx");                 vault.getTx(tx->unsigned_hash());
+        recorder.call("getTxConfirmations");    vault.getTxConfirmations(tx);
+        if (tx->txouts().empty()) continue;
+        recorder.call("getTxOut");              vault.getTxOut(tx->hash(), 0);
+        recorder.call("getSigningScript");
+        try { vault.getSigningScript(tx->txouts()[0]->script()); } catch (const exception&) { }
+    }
+
+    recorder.call("getAllAccountInfo");
+    vector<AccountInfo> accounts = vault.getAllAccountInfo();
+    for (auto& account: accounts)
+    {
+        const string& name = account.name();
+        recorder.call("getAccountBalance");         vault.getAccountBalance(name, 0); vault.getAccountBalance(name, 1);
+        recorder.call("getUnspentTxOutViews");      vault.getUnspentTxOutViews(name, 0); vault.getUnspentTxOutViews(name, 1);
+        recorder.call("getTxOutViews");             vault.getTxOutViews(name);
+        recorder.call("getSigningScriptViews");     vault.getSigningScriptViews(name);
+        recorder.call("getSerializedUnsignedTxs");  vault.getSerializedUnsignedTxs(name);
+    }
+}
+
+#if defined(DATABASE_SQLITE)
+// Returns the number of statements whose plan contains a full table scan.
+unsigned int explain(const string& dbname, const StatementRecorder& recorder)
+{
+    sqlite3* db;
+    if (sqlite3_open_v2(dbname.c_str(), &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+        throw runtime_error(string("Could not open ") + dbname + ": " + sqlite3_errmsg(db));
+
+    unsigned int flagged = 0;
+    unsigned int explained = 0;
+    for (auto& statement: recorder.statements())
+    {
+        string verb = statement.substr(0, statement.find(' '));
+        if (verb != "SELECT" && verb != "UPDATE" && verb != "DELETE") continue;
+
+        sqlite3_stmt* stmt;
+        string query = "EXPLAIN QUERY PLAN " + statement;
+        if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+        {
+            cerr << "Error: " << sqlite3_errmsg(db) << endl << "  " << statement << endl;
+            continue;
+        }
+
+        vector<string> plan;
+        bool bScan = false;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            string detail(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)));
+            if (detail.compare(0, 5, "SCAN ") == 0 && detail.find("CONSTANT ROW") == string::npos) { bScan = true; }
+            plan.push_back(detail);
+        }
+        sqlite3_finalize(stmt);
+
+        explained++;
+        if (!bScan) continue;
+
+        flagged++;
+        cout << "FULL SCAN in " << recorder.caller(statement) << ":" << endl
+             << "  " << statement << endl;
+        for (auto& detail: plan) { cout << "    " << detail << endl; }
+        cout << endl;
+    }
+
+    sqlite3_close(db);
+    cout << explained << " statements explained, " << flagged << " with full scans." << endl;
+    return flagged;
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+#if !defined(DATABASE_SQLITE)
+    cerr << "Error: " << argv[0] << " only supports SQLite." << endl;
+    return -1;
+#else
+    if (argc < 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <db file> [tx count]" << endl
+             << "# Audits an existing vault, or creates one with the given number of transactions." << endl;
+        return -1;
+    }
+
+    string dbname = argv[1];
+    unsigned int txCount = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+    bool bCreate = (txCount > 0);
+    if (bCreate && boost::filesystem::exists(dbname))
+    {
+        cerr << "Error: " << dbname << " already exists." << endl;
+        return -1;
+    }
+
+    INIT_LOGGER("dbaudit.log");
+
+    try
+    {
+        StatementRecorder recorder;
+        {
+            Vault vault;
+            vault.open("", "", dbname, bCreate, SCHEMA_VERSION, bCreate ? "bitcoin" : "", false, DatabaseTuning(bCreate ? DatabaseTuning::PERFORMANCE : DatabaseTuning::DEFAULT));
+            vault.setTracer(&recorder);
+            if (bCreate)
+            {
+                cout << "Creating " << dbname << " with " << txCount << " transactions..." << endl;
+                populate(vault, recorder, txCount);
+            }
+            exercise(vault, recorder);
+            vault.setTracer(nullptr);
+        }
+
+        return explain(dbname, recorder) > 0 ? 1 : 0;
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+#endif
+}
@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// dbbench.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Measures vault write throughput under each database tuning profile.
+//
+
+#include <Vault.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/MerkleTree.h>
+#include <CoinCore/random.h>
+
+#include <logger/logger.h>
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+using namespace CoinDB;
+using namespace std;
+
+const unsigned int DEFAULT_TX_COUNT = 2000;
+const unsigned int DEFAULT_TXS_PER_BLOCK = 10;
+const unsigned int SCRIPT_COUNT = 20;
+const uint32_t FIRST_BLOCK_TIMESTAMP = 1000000;
+
+struct BenchResult
+{
+    double txsPerSecond;
+    double blocksPerSecond;
+};
+
+double secondsSince(const chrono::steady_clock::time_point& start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void removeDatabase(const string& dbname)
+{
+    boost::filesystem::remove(dbname);
+    boost::filesystem::remove(dbname + "-wal");
+    boost::filesystem::remove(dbname + "-shm");
+    boost::filesystem::remove(dbname + "-journal");
+}
+
+BenchResult runBench(const string& dbname, const DatabaseTuning& tuning, unsigned int txCount, unsigned int txsPerBlock)
+{
+    removeDatabase(dbname);
+
+    Vault vault;
+    vault.open("", "", dbname, true, SCHEMA_VERSION, "bitcoin", false, tuning);
+    vault.newKeychain("bench", secure_random_bytes(32));
+    vault.newAccount("bench", 1, vector<string>(1, "bench"));
+
+    vector<bytes_t> scripts;
+    for (unsigned int i = 0; i < SCRIPT_COUNT; i++) { scripts.push_back(vault.issueSigningScript("bench")->txoutscript()); }
+
+    // Every transaction spends an outpoint we don't know about into one of our scripts
+    // so each one is stored, and each is its own database transaction.
+    vector<uchar_vector> txhashes;
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < txCount; i++)
+    {
+        Coin::Transaction coin_tx;
+        coin_tx.addInput(Coin::TxIn(Coin::OutPoint(uchar_vector(random_bytes(32)), 0), uchar_vector(), 0xffffffff));
+        coin_tx.addOutput(Coin::TxOut(100000 + i, scripts[i % scripts.size()]));
+
+        std::shared_ptr<Tx> tx(new Tx());
+        tx->set(coin_tx, time(NULL), Tx::PROPAGATED);
+        tx = vault.insertTx(tx);
+        if (!tx) throw runtime_error("Transaction was not inserted.");
+        txhashes.push_back(tx->hash());
+    }
+
+    BenchResult result;
+    result.txsPerSecond = txCount / secondsSince(start);
+
+    // Confirm the transactions a block at a time, chaining each block to the last.
+    unsigned int blockCount = (txCount + txsPerBlock - 1) / txsPerBlock;
+    bytes_t prevhash(32, 0);
+    start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < blockCount; i++)
+    {
+        vector<uchar_vector> blocktxhashes(txhashes.begin() + i * txsPerBlock, txhashes.begin() + min((i + 1) * txsPerBlock, txCount));
+        Coin::MerkleBlock coinmerkleblock(Coin::randomPartialMerkleTree(blocktxhashes, blocktxhashes.size()), 2, prevhash, FIRST_BLOCK_TIMESTAMP + i * 600, 0x1d00ffff, i);
+
+        std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock());
+        merkleblock->fromCoinCore(coinmerkleblock, i + 1);
+        if (!vault.insertMerkleBlock(merkleblock)) throw runtime_error("Merkle block was not inserted.");
+        prevhash = merkleblock->blockheader()->hash();
+    }
+    result.blocksPerSecond = blockCount / secondsSince(start);
+
+    vault.close();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <db directory> [tx count = " << DEFAULT_TX_COUNT << "] [txs per block = " << DEFAULT_TXS_PER_BLOCK << "]" << endl;
+        return -1;
+    }
+
+    string dir = argv[1];
+    unsigned int txCount = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_TX_COUNT;
+    unsigned int txsPerBlock = argc > 3 ? strtoul(argv[3], NULL, 0) : DEFAULT_TXS_PER_BLOCK;
+    if (txCount == 0 || txsPerBlock == 0)
+    {
+        cerr << "Error: counts must be positive." << endl;
+        return -1;
+    }
+
+    INIT_LOGGER((dir + "/dbbench.log").c_str());
+
+    vector<DatabaseTuning::profile_t> profiles;
+    profiles.push_back(DatabaseTuning::DEFAULT);
+    profiles.push_back(DatabaseTuning::PERFORMANCE);
+
+    cout << txCount << " transactions, " << txsPerBlock << " per block" << endl << endl
+         << left << setw(14) << "profile" << right << setw(12) << "insertTx/s" << setw(20) << "insertMerkleBlock/s" << endl;
+
+    try
+    {
+        for (auto profile: profiles)
+        {
+            string name = DatabaseTuning::getProfileName(profile);
+            string dbname = dir + "/dbbench-" + name + ".db";
+            BenchResult result = runBench(dbname, DatabaseTuning(profile), txCount, txsPerBlock);
+            removeDatabase(dbname);
+
+            cout << left << setw(14) << name << right << fixed << setprecision(1)
+                 << setw(12) << result.txsPerSecond << setw(20) << result.blocksPerSecond << endl;
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// poolbench.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Measures how long it takes to create accounts with large signing script pools.
+//
+
+#include <Vault.h>
+
+#include <CoinCore/random.h>
+
+#include <logger/logger.h>
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+using namespace CoinDB;
+using namespace std;
+
+const uint32_t DEFAULT_MAX_POOL_SIZE = 10000;
+
+double secondsSince(const chrono::steady_clock::time_point& start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void removeDatabase(const string& dbname)
+{
+    boost::filesystem::remove(dbname);
+    boost::filesystem::remove(dbname + "-wal");
+    boost::filesystem::remove(dbname + "-shm");
+    boost::filesystem::remove(dbname + "-journal");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <db directory> [max pool size = " << DEFAULT_MAX_POOL_SIZE << "]" << endl;
+        return -1;
+    }
+
+    string dir = argv[1];
+    uint32_t maxPoolSize = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_MAX_POOL_SIZE;
+
+    INIT_LOGGER((dir + "/poolbench.log").c_str());
+
+    vector<uint32_t> poolSizes;
+    for (uint32_t poolSize = 100; poolSize <= maxPoolSize; poolSize *= 10) { poolSizes.push_back(poolSize); }
+    if (poolSizes.empty())
+    {
+        cerr << "Error: max pool size must be at least 100." << endl;
+        return -1;
+    }
+
+    // minsigs, keychains
+    vector<pair<unsigned int, unsigned int>> policies;
+    policies.push_back(make_pair(2, 3));
+    policies.push_back(make_pair(5, 7));
+
+    cout << "Each account gets a change bin and a default bin, so it has twice the pool size in scripts." << endl << endl
+         << right << setw(8) << "policy" << setw(10) << "pool" << setw(12) << "scripts" << setw(14) << "ms" << setw(14) << "us/script" << endl;
+
+    string dbname = dir + "/poolbench.db";
+    try
+    {
+        removeDatabase(dbname);
+        {
+            Vault vault;
+            vault.open("", "", dbname, true, SCHEMA_VERSION, "bitcoin", false);
+
+            unsigned int accountCount = 0;
+            for (auto& policy: policies)
+            {
+                stringstream policyName;
+                policyName << policy.first << "-of-" << policy.second;
+
+                for (auto poolSize: poolSizes)
+                {
+                    stringstream accountName;
+                    accountName << "bench" << accountCount++;
+
+                    // Accounts are identified by their keychains, so each one gets its own.
+                    vector<string> keychainNames;
+                    for (unsigned int i = 0; i < policy.second; i++)
+                    {
+                        stringstream keychainName;
+                        keychainName << accountName.str() << "_" << i;
+                        vault.newKeychain(keychainName.str(), secure_random_bytes(32));
+                        keychainNames.push_back(keychainName.str());
+                    }
+
+                    auto start = chrono::steady_clock::now();
+                    vault.newAccount(accountName.str(), policy.first, keychainNames, poolSize);
+                    double seconds = secondsSince(start);
+
+                    uint32_t scriptCount = 2 * poolSize;
+                    cout << right << setw(8) << policyName.str() << setw(10) << poolSize << setw(12) << scriptCount << fixed << setprecision(2)
+                         << setw(14) << seconds * 1000
+                         << setw(14) << seconds * 1000000 / scriptCount << endl;
+                }
+            }
+        }
+
+        removeDatabase(dbname);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -166,7 +166,7 @@ int main(int argc, char* argv[])
     string port = argc > 4 ? argv[4] : coinParams.default_port();
 
     string logfile = config.getDataDir() + "/syncdb.log";    
-    INIT_LOGGER(logfile.c_str());
+    logger::init_logger(logfile.c_str(), config.getLogLevel());
 
     string blocktreefile = config.getDataDir() + "/" + coinParams.network_name() + "_headers.dat";
 
@@ -182,6 +182,8 @@ int main(int argc, char* argv[])
     {
         cout << "Opening coin database " << dbname << endl;
         LOGGER(info) << "Opening coin database " << dbname << endl;
+        synchedVault.setDatabaseTuning(config.getDatabaseTuning());
+        synchedVault.setUtxoCacheEnabled(config.getUtxoCacheEnabled());
         synchedVault.openVault(config.getDatabaseUser(), config.getDatabasePassword(), dbname);
 
         cout << "Loading block tree " << blocktreefile << "..." << endl;
@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// txbench.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Measures insertTx for transactions spending many of the vault's outputs at once.
+//
+
+#include <Vault.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/random.h>
+
+#include <logger/logger.h>
+
+#include <odb/tracer.hxx>
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+using namespace CoinDB;
+using namespace std;
+
+const unsigned int DEFAULT_ROUNDS = 20;
+const unsigned int SCRIPT_COUNT = 20;
+
+// Counts the statements the vault sends to the database.
+class StatementCounter : public odb::tracer
+{
+public:
+    StatementCounter() : m_count(0) { }
+
+    virtual void execute(odb::connection& /*c*/, const char* /*statement*/) { m_count++; }
+
+    void reset() { m_count = 0; }
+    unsigned long count() const { return m_count; }
+
+private:
+    unsigned long m_count;
+};
+
+double secondsSince(const chrono::steady_clock::time_point& start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void removeDatabase(const string& dbname)
+{
+    boost::filesystem::remove(dbname);
+    boost::filesystem::remove(dbname + "-wal");
+    boost::filesystem::remove(dbname + "-shm");
+    boost::filesystem::remove(dbname + "-journal");
+}
+
+// Pays inputCount new outputs to our scripts and returns the transaction that did so.
+uchar_vector fund(Vault& vault, const vector<bytes_t>& scripts, unsigned int inputCount)
+{
+    Coin::Transaction coin_tx;
+    coin_tx.addInput(Coin::TxIn(Coin::OutPoint(uchar_vector(random_bytes(32)), 0), uchar_vector(), 0xffffffff));
+    for (unsigned int i = 0; i < inputCount; i++) { coin_tx.addOutput(Coin::TxOut(100000 + i, scripts[i % scripts.size()])); }
+
+    std::shared_ptr<Tx> tx(new Tx());
+    tx->set(coin_tx, time(NULL), Tx::PROPAGATED);
+    tx = vault.insertTx(tx);
+    if (!tx) throw runtime_error("Funding transaction was not inserted.");
+    return tx->hash();
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <db directory> [rounds = " << DEFAULT_ROUNDS << "] [utxo cache = false]" << endl;
+        return -1;
+    }
+
+    string dir = argv[1];
+    unsigned int rounds = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_ROUNDS;
+    bool bUtxoCache = argc > 3 && string(argv[3]) == "true";
+    if (rounds == 0)
+    {
+        cerr << "Error: rounds must be positive." << endl;
+        return -1;
+    }
+
+    INIT_LOGGER((dir + "/txbench.log").c_str());
+
+    vector<unsigned int> inputCounts;
+    inputCounts.push_back(1);
+    inputCounts.push_back(50);
+    inputCounts.push_back(500);
+
+    cout << rounds << " transactions per size" << endl << endl
+         << right << setw(8) << "inputs" << setw(14) << "ms/tx" << setw(14) << "us/input" << setw(16) << "statements/tx" << endl;
+
+    string dbname = dir + "/txbench.db";
+    try
+    {
+        removeDatabase(dbname);
+
+        StatementCounter counter;
+        {
+            Vault vault;
+            vault.setUtxoCacheEnabled(bUtxoCache);
+            vault.open("", "", dbname, true, SCHEMA_VERSION, "bitcoin", false);
+            vault.newKeychain("bench", secure_random_bytes(32));
+            vault.newAccount("bench", 1, vector<string>(1, "bench"));
+
+            vector<bytes_t> scripts;
+            for (unsigned int i = 0; i < SCRIPT_COUNT; i++) { scripts.push_back(vault.issueSigningScript("bench")->txoutscript()); }
+
+            // The spends pay out to a script the vault doesn't know so only their inputs are ours.
+            bytes_t foreignscript = uchar_vector("76a914") + random_bytes(20) + uchar_vector("88ac");
+
+            for (auto inputCount: inputCounts)
+            {
+                double seconds = 0.0;
+                counter.reset();
+                for (unsigned int r = 0; r < rounds; r++)
+                {
+                    uchar_vector fundhash = fund(vault, scripts, inputCount);
+
+                    Coin::Transaction coin_tx;
+                    for (unsigned int i = 0; i < inputCount; i++) { coin_tx.addInput(Coin::TxIn(Coin::OutPoint(fundhash, i), uchar_vector(), 0xffffffff)); }
+                    coin_tx.addOutput(Coin::TxOut(inputCount * 100000, foreignscript));
+
+                    std::shared_ptr<Tx> tx(new Tx());
+                    tx->set(coin_tx, time(NULL), Tx::PROPAGATED);
+
+                    vault.setTracer(&counter);
+                    auto start = chrono::steady_clock::now();
+                    tx = vault.insertTx(tx);
+                    seconds += secondsSince(start);
+                    vault.setTracer(nullptr);
+
+                    if (!tx) throw runtime_error("Spending transaction was not inserted.");
+                }
+
+                cout << right << setw(8) << inputCount << fixed << setprecision(2)
+                     << setw(14) << seconds * 1000 / rounds
+                     << setw(14) << seconds * 1000000 / (rounds * inputCount)
+                     << setw(16) << setprecision(1) << (double)counter.count() / rounds << endl;
+            }
+
+            if (bUtxoCache)
+            {
+                // The cache was kept up to date by every insert above.
+                vector<string> discrepancies = vault.verifyUtxoCache();
+                for (auto& discrepancy: discrepancies) { cerr << discrepancy << endl; }
+                if (!discrepancies.empty()) throw runtime_error("UTXO cache does not match the database.");
+            }
+        }
+
+        removeDatabase(dbname);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
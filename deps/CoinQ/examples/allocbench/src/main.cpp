@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// header sync allocation benchmark
+//
+// main.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+// Runs the block tree calls a header sync makes on a synthetic chain and counts the heap
+// allocations each step makes per header: inserting headers messages and asking for the next
+// locator, checking a sync peer's headers against the tree, and looking up the headers block
+// sync requests.
+
+#include <CoinQ_blocks.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace CoinQ;
+using namespace std;
+
+const int DEFAULT_HEADER_COUNT = 20000;
+const int HEADERS_PER_MESSAGE = 2000;
+
+static atomic<uint64_t> g_allocations(0);
+
+// Every replaceable form is replaced so that whatever form the compiler picks for a delete
+// expression frees memory from the matching new. The free is kept out of line so that it is not
+// inlined into callers, where the compiler would see memory from operator new passed to free().
+static void* countedAlloc(size_t size) noexcept
+{
+    g_allocations++;
+    return malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) static void countedFree(void* p) noexcept
+{
+    free(p);
+}
+
+void* operator new(size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return countedAlloc(size); }
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { countedFree(p); }
+
+vector<Coin::CoinBlockHeader> syntheticChain(int headerCount)
+{
+    vector<Coin::CoinBlockHeader> headers;
+    headers.reserve(headerCount + 1);
+    headers.push_back(Coin::CoinBlockHeader(1, 1231006505, 0x1d00ffff, 0));
+    for (int i = 1; i <= headerCount; i++)
+    {
+        headers.push_back(Coin::CoinBlockHeader(2, 1231006505 + i * 600, 0x1d00ffff, i, headers.back().hash(), g_zero32bytes));
+    }
+
+    // Headers arrive already hashed by the headers message handler.
+    for (auto& header: headers) { header.hash(); }
+    return headers;
+}
+
+template<typename Function>
+void report(const string& step, int headerCount, Function f)
+{
+    uint64_t start = g_allocations.load();
+    f();
+    uint64_t allocations = g_allocations.load() - start;
+    cout << step << allocations << " (" << (double)allocations / headerCount << " per header)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        int headerCount = argc > 1 ? atoi(argv[1]) : DEFAULT_HEADER_COUNT;
+        if (headerCount < 1) throw runtime_error("Invalid header count.");
+
+        vector<Coin::CoinBlockHeader> headers = syntheticChain(headerCount);
+
+        CoinQBlockTreeMem tree(false, false);
+        tree.setGenesisBlock(headers[0]);
+
+        cout << "Headers: " << headerCount << endl;
+
+        report("Insert and locate:   ", headerCount, [&]()
+        {
+            for (int i = 1; i <= headerCount; i += HEADERS_PER_MESSAGE)
+            {
+                int end = min(i + HEADERS_PER_MESSAGE, headerCount + 1);
+                for (int j = i; j < end; j++) { tree.insertHeader(headers[j], false); }
+                vector<uchar_vector> locatorHashes = tree.getLocatorHashes(-1);
+                if (headers[end - 1].hash() != locatorHashes[0]) throw runtime_error("Tip mismatch.");
+            }
+        });
+
+        report("Check peer headers:  ", headerCount, [&]()
+        {
+            for (int i = 1; i <= headerCount; i++)
+            {
+                if (!tree.hasHeader(headers[i].hash()) || !tree.getHeader(headers[i].hash()).inBestChain) throw runtime_error("Header not in best chain.");
+            }
+        });
+
+        report("Request blocks:      ", headerCount, [&]()
+        {
+            for (int i = 1; i <= headerCount; i++)
+            {
+                uchar_vector hash = tree.getHeader(i).hash();
+                if (tree.getConfirmations(hash) != headerCount - i + 1) throw runtime_error("Wrong confirmations.");
+            }
+        });
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
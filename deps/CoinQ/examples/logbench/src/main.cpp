@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// logging overhead benchmark
+//
+// main.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+// Replays a header sync of a synthetic chain, inserting each header into a block tree and logging
+// it at trace level the way block sync logs every merkle block it synchronizes, plus the line
+// NetworkSync logs for each headers message. Runs with the logger at trace and again at info and
+// reports headers per second and log bytes for each. Build with CXX_FLAGS=-DLOGGER_INFO to measure
+// the same run with trace and debug lines compiled out.
+
+#include <CoinQ_blocks.h>
+
+#include <logger/logger.h>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <iostream>
+
+using namespace CoinQ;
+using namespace std;
+
+const int DEFAULT_HEADER_COUNT = 200000;
+const int HEADERS_PER_MESSAGE = 2000;
+const int RUNS = 3;
+
+vector<Coin::CoinBlockHeader> syntheticChain(int headerCount)
+{
+    vector<Coin::CoinBlockHeader> headers;
+    headers.reserve(headerCount);
+    headers.push_back(Coin::CoinBlockHeader(1, 1231006505, 0x1d00ffff));
+    for (int i = 1; i < headerCount; i++)
+    {
+        headers.push_back(Coin::CoinBlockHeader(2, 1231006505 + i * 600, 0x1d00ffff, i, headers.back().hash()));
+    }
+
+    // NetworkSync hashes each headers message before inserting it.
+    for (auto& header: headers) { header.hash(); }
+    return headers;
+}
+
+double syncHeaders(const vector<Coin::CoinBlockHeader>& headers)
+{
+    auto start = chrono::steady_clock::now();
+    CoinQBlockTreeMem blockTree(false, false);
+    blockTree.setGenesisBlock(headers[0]);
+    for (size_t i = 1; i < headers.size(); i += HEADERS_PER_MESSAGE)
+    {
+        size_t end = min(i + HEADERS_PER_MESSAGE, headers.size());
+        for (size_t j = i; j < end; j++)
+        {
+            if (!blockTree.insertHeader(headers[j], false)) throw runtime_error("Header was not inserted.");
+            LOGGER(trace) << "Synchronizing header: " << headers[j].hash().getHex() << " height: " << j << endl;
+        }
+        LOGGER(trace) << "Processed " << (end - i) << " headers. mBestHeight: " << blockTree.getBestHeight() << " mTotalWork: " << blockTree.getTotalWork().getDec() << endl;
+    }
+    logger::flush();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (blockTree.getBestHeight() + 1 != (int)headers.size()) throw runtime_error("Header count mismatch.");
+    return headers.size() / seconds;
+}
+
+// Best of several runs, and the bytes each run logs.
+double headersPerSecond(const vector<Coin::CoinBlockHeader>& headers, logger::level_t level, const string& logfile, uintmax_t& logBytes)
+{
+    logger::set_level(level);
+
+    double best = 0;
+    for (int i = 0; i < RUNS; i++)
+    {
+        uintmax_t before = boost::filesystem::file_size(logfile);
+        best = max(best, syncHeaders(headers));
+        logBytes = boost::filesystem::file_size(logfile) - before;
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <directory> [header count = " << DEFAULT_HEADER_COUNT << "]" << endl;
+        return -1;
+    }
+
+    string dir = argv[1];
+    int headerCount = argc > 2 ? strtol(argv[2], NULL, 0) : DEFAULT_HEADER_COUNT;
+    if (headerCount < 1)
+    {
+        cerr << "Error: header count must be positive." << endl;
+        return -1;
+    }
+
+    string logfile = dir + "/logbench.log";
+
+    try
+    {
+        boost::filesystem::remove(logfile);
+        logger::init_logger(logfile.c_str(), logger::info);
+
+        vector<Coin::CoinBlockHeader> headers = syntheticChain(headerCount);
+
+        uintmax_t traceBytes, infoBytes;
+        double traceRate = headersPerSecond(headers, logger::trace, logfile, traceBytes);
+        double infoRate = headersPerSecond(headers, logger::info, logfile, infoBytes);
+
+        cout << "Headers:          " << headerCount << endl
+             << "Level trace:      " << traceRate << " headers/s, " << traceBytes << " log bytes" << endl
+             << "Level info:       " << infoRate << " headers/s, " << infoBytes << " log bytes" << endl;
+
+        logger::shutdown_logger();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,442 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// multi-peer block sync harness
+//
+// main.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+// Serves a synthetic chain from fake nodes on localhost and syncs it with NetworkSync,
+// first from a single peer and then from several peers where one of them is slow, stalls
+// or is on a fork. Checks that every block is reported exactly once and in height order,
+// and prints how long each sync took along with the per-peer scheduler stats.
+
+#include <CoinQ_netsync.h>
+#include <CoinQ_receivebuffer.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/MerkleTree.h>
+#include <CoinCore/hash.h>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+
+#include <unistd.h>
+
+using namespace CoinQ;
+using namespace CoinQ::Network;
+using namespace std;
+
+typedef std::chrono::steady_clock clock_type;
+using boost::asio::ip::tcp;
+
+const uint32_t MAGIC = 0xdab5bffa;
+const uint32_t PROTOCOL_VERSION = 70002;
+const uint32_t EASY_BITS = 0x207fffff;
+
+struct FakeChain
+{
+    std::vector<Coin::CoinBlockHeader> headers;
+    std::vector<Coin::Transaction> txs;             // txs[0] is unused
+    std::vector<Coin::MerkleBlock> merkleBlocks;    // merkleBlocks[0] is unused
+    std::map<uchar_vector, int> heights;
+
+    int find(const uchar_vector& hash) const
+    {
+        auto it = heights.find(hash);
+        if (it == heights.end()) { it = heights.find(hash.getReverse()); }
+        return it == heights.end() ? -1 : it->second;
+    }
+
+    void add(const Coin::CoinBlockHeader& header, const Coin::Transaction& tx, const Coin::MerkleBlock& merkleBlock)
+    {
+        heights[header.hash()] = headers.size();
+        headers.push_back(header);
+        txs.push_back(tx);
+        merkleBlocks.push_back(merkleBlock);
+    }
+};
+
+Coin::CoinBlockHeader mine(const uchar_vector& prevHash, const uchar_vector& merkleRoot, uint32_t timestamp)
+{
+    Coin::CoinBlockHeader header(2, timestamp, EASY_BITS, 0, prevHash, merkleRoot);
+    while (!header.checkProofOfWork()) { header.incrementNonce(); }
+    return header;
+}
+
+Coin::CoinBlockHeader genesisHeader()
+{
+    return mine(uchar_vector(32, 0), uchar_vector(32, 0), 1296688602);
+}
+
+// One transaction per block. Blocks from forkHeight on differ from the base chain.
+FakeChain buildChain(int height, const FakeChain* base = nullptr, int forkHeight = 0)
+{
+    FakeChain chain;
+    chain.add(genesisHeader(), Coin::Transaction(), Coin::MerkleBlock());
+
+    for (int h = 1; h <= height; h++)
+    {
+        if (base && h < forkHeight)
+        {
+            chain.add(base->headers[h], base->txs[h], base->merkleBlocks[h]);
+            continue;
+        }
+
+        Coin::Transaction tx;
+        uchar_vector scriptSig = uint_to_vch((uint32_t)h, LITTLE_ENDIAN_);
+        if (base) { scriptSig.push_back(0xff); }
+        tx.inputs.push_back(Coin::TxIn(Coin::OutPoint(uchar_vector(32, 0), 0xffffffff), scriptSig, 0xffffffff));
+        tx.outputs.push_back(Coin::TxOut(5000000000ull, uchar_vector("51")));
+
+        Coin::PartialMerkleTree tree(std::vector<Coin::MerkleLeaf>(1, Coin::MerkleLeaf(tx.getHash(), true)));
+        Coin::CoinBlockHeader header = mine(chain.headers.back().hash(), tree.getRootLittleEndian(), chain.headers.back().timestamp() + 600);
+        if (header.merkleRoot() != tx.hash()) throw runtime_error("Merkle root mismatch.");
+
+        chain.add(header, tx, Coin::MerkleBlock(header, tree.getNTxs(), tree.getMerkleHashesVector(), tree.getFlags()));
+    }
+
+    return chain;
+}
+
+struct NodeBehavior
+{
+    std::string label;
+    const FakeChain* chain;
+    std::chrono::microseconds latency;      // added to every getdata
+    std::chrono::microseconds perBlock;     // time to serve each block
+    int stallAfter;                         // stop answering getdata after this many blocks, -1 for never
+};
+
+// Serves a single connection from its own thread. Replies are queued with the time they
+// are due so latency and bandwidth can be simulated without blocking the reader.
+class FakeNode
+{
+public:
+    explicit FakeNode(const NodeBehavior& behavior) :
+        m_behavior(behavior),
+        m_acceptor(m_io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+        m_socket(m_io),
+        m_timer(m_io),
+        m_framer(MAGIC),
+        m_bWriting(false),
+        m_served(0),
+        m_busyUntil(clock_type::now())
+    {
+        m_acceptor.async_accept(m_socket, [this](const boost::system::error_code& ec)
+        {
+            if (ec) return;
+            m_socket.set_option(tcp::no_delay(true));
+            doRead();
+        });
+        m_thread = boost::thread([this]() { m_io.run(); });
+    }
+
+    ~FakeNode()
+    {
+        m_io.stop();
+        m_thread.join();
+    }
+
+    std::string port() const { return std::to_string(m_acceptor.local_endpoint().port()); }
+
+private:
+    NodeBehavior m_behavior;
+    boost::asio::io_service m_io;
+    tcp::acceptor m_acceptor;
+    tcp::socket m_socket;
+    boost::asio::steady_timer m_timer;
+    MessageFramer m_framer;
+    boost::thread m_thread;
+
+    std::deque<std::pair<clock_type::time_point, uchar_vector>> m_scheduled;
+    std::deque<uchar_vector> m_writeQueue;
+    bool m_bWriting;
+    int m_served;
+    clock_type::time_point m_busyUntil;
+
+    void doRead()
+    {
+        size_t minBytes = m_framer.minReadBytes();
+        unsigned char* p = m_framer.buffer().prepare(minBytes);
+        boost::asio::async_read(m_socket, boost::asio::buffer(p, m_framer.buffer().available()), boost::asio::transfer_at_least(minBytes),
+            [this](const boost::system::error_code& ec, std::size_t bytesRead)
+        {
+            if (ec) return;
+            m_framer.buffer().commit(bytesRead);
+            const unsigned char* payload;
+            while (m_framer.next(payload))
+            {
+                handle(m_framer.header(), uchar_vector(payload, payload + m_framer.header().length));
+                m_framer.pop();
+            }
+            doRead();
+        });
+    }
+
+    void handle(const Coin::MessageHeader& header, const uchar_vector& payload)
+    {
+        std::string command = header.command;
+        clock_type::time_point now = clock_type::now();
+
+        if (command == "version")
+        {
+            const unsigned char ipv6[16] = { 0 };
+            Coin::NetworkAddress addr(1, ipv6, 0);
+            Coin::VersionMessage version(PROTOCOL_VERSION, 1, time(NULL), addr, addr, 1, "/fakenode/", m_behavior.chain->headers.size() - 1, false);
+            send(version, now);
+            Coin::VerackMessage verack;
+            send(verack, now);
+        }
+        else if (command == "ping")
+        {
+            Coin::PingMessage ping;
+            ping.setSerialized(payload);
+            Coin::PongMessage pong(ping.nonce);
+            send(pong, now);
+        }
+        else if (command == "getheaders")
+        {
+            Coin::GetHeadersMessage getHeaders;
+            getHeaders.setSerialized(payload);
+            int start = 0;
+            for (auto& hash: getHeaders.blockLocatorHashes)
+            {
+                int height = m_behavior.chain->find(hash);
+                if (height >= 0) { start = height; break; }
+            }
+
+            Coin::HeadersMessage headers;
+            for (int h = start + 1; h < (int)m_behavior.chain->headers.size() && headers.headers.size() < 2000; h++)
+            {
+                headers.headers.push_back(m_behavior.chain->headers[h]);
+            }
+            send(headers, now);
+        }
+        else if (command == "getdata")
+        {
+            Coin::GetDataMessage getData;
+            getData.setSerialized(payload);
+
+            clock_type::time_point due = std::max(now + m_behavior.latency, m_busyUntil);
+            for (auto& item: getData.items)
+            {
+                int height = m_behavior.chain->find(uchar_vector(item.hash, item.hash + 32));
+                if (height <= 0) continue;
+                if (m_behavior.stallAfter >= 0 && m_served >= m_behavior.stallAfter) continue;
+                m_served++;
+
+                due += m_behavior.perBlock;
+                if (item.itemType == MSG_FILTERED_BLOCK)
+                {
+                    Coin::MerkleBlock merkleBlock(m_behavior.chain->merkleBlocks[height]);
+                    send(merkleBlock, due);
+                    Coin::Transaction tx(m_behavior.chain->txs[height]);
+                    send(tx, due);
+                }
+                else if (item.itemType == MSG_BLOCK)
+                {
+                    Coin::CoinBlock block(m_behavior.chain->headers[height], std::vector<Coin::Transaction>(1, m_behavior.chain->txs[height]));
+                    send(block, due);
+                }
+            }
+            m_busyUntil = due;
+        }
+    }
+
+    void send(Coin::CoinNodeStructure& payload, clock_type::time_point due)
+    {
+        uchar_vector data = Coin::CoinNodeMessage(MAGIC, &payload).getSerialized();
+
+        // Keep the schedule sorted, later sends of equal time go after earlier ones.
+        auto it = m_scheduled.end();
+        while (it != m_scheduled.begin() && (it - 1)->first > due) { --it; }
+        bool bNewFront = (it == m_scheduled.begin());
+        m_scheduled.insert(it, std::make_pair(due, data));
+        if (bNewFront) { armTimer(); }
+    }
+
+    void armTimer()
+    {
+        if (m_scheduled.empty()) return;
+        m_timer.expires_at(m_scheduled.front().first);
+        m_timer.async_wait([this](const boost::system::error_code& ec)
+        {
+            if (ec) return;
+            clock_type::time_point now = clock_type::now();
+            while (!m_scheduled.empty() && m_scheduled.front().first <= now)
+            {
+                m_writeQueue.push_back(m_scheduled.front().second);
+                m_scheduled.pop_front();
+            }
+            doWrite();
+            armTimer();
+        });
+    }
+
+    void doWrite()
+    {
+        if (m_bWriting || m_writeQueue.empty()) return;
+        m_bWriting = true;
+        boost::asio::async_write(m_socket, boost::asio::buffer(m_writeQueue.front()), [this](const boost::system::error_code& ec, std::size_t)
+        {
+            m_bWriting = false;
+            if (ec) return;
+            m_writeQueue.pop_front();
+            doWrite();
+        });
+    }
+};
+
+struct Scenario
+{
+    std::string name;
+    unsigned int window;
+    std::vector<NodeBehavior> nodes;    // the first one is the primary peer
+};
+
+template<typename Predicate>
+bool waitFor(Predicate predicate, std::chrono::seconds timeout)
+{
+    clock_type::time_point deadline = clock_type::now() + timeout;
+    while (!predicate())
+    {
+        if (clock_type::now() > deadline) return false;
+        usleep(10000);
+    }
+    return true;
+}
+
+bool runScenario(const CoinParams& params, const FakeChain& chain, const Scenario& scenario)
+{
+    cout << endl << scenario.name << endl << std::string(scenario.name.size(), '-') << endl;
+
+    const std::string blockTreeFile = "multisync_headers.dat";
+    std::remove(blockTreeFile.c_str());
+    std::remove((blockTreeFile + ".idx").c_str());
+
+    std::vector<std::unique_ptr<FakeNode>> nodes;
+    for (auto& behavior: scenario.nodes) { nodes.emplace_back(new FakeNode(behavior)); }
+
+    NetworkSync sync(params, false);
+    sync.loadHeaders(blockTreeFile, true);
+    sync.setFilteredBlockWindow(scenario.window);
+
+    std::atomic<bool> bHeadersSynched(false);
+    std::atomic<bool> bBlocksSynched(false);
+    std::atomic<int> lastHeight(0);
+    std::atomic<int> errors(0);
+
+    sync.subscribeHeadersSynched([&]() { bHeadersSynched = true; });
+    sync.subscribeBlocksSynched([&]() { bBlocksSynched = true; });
+    sync.subscribeStatus([&](const std::string& status) { cout << "  status: " << status << endl; });
+    sync.subscribeMerkleTx([&](const ChainMerkleBlock& merkleBlock, const Coin::Transaction& tx, unsigned int, unsigned int)
+    {
+        int expected = lastHeight + 1;
+        if (merkleBlock.height != expected || tx.hash() != chain.txs[expected].hash())
+        {
+            if (errors++ < 5) { cout << "  out of order: got height " << merkleBlock.height << ", expected " << expected << endl; }
+            return;
+        }
+        lastHeight = expected;
+    });
+
+    sync.start("127.0.0.1", nodes[0]->port());
+    if (!waitFor([&]() { return bHeadersSynched.load(); }, std::chrono::seconds(30)))
+    {
+        cout << "  FAILED: headers never synched." << endl;
+        return false;
+    }
+
+    for (size_t i = 1; i < nodes.size(); i++) { sync.addSyncPeer("127.0.0.1", nodes[i]->port()); }
+
+    clock_type::time_point begin = clock_type::now();
+    sync.syncBlocks(1);
+
+    int tip = chain.headers.size() - 1;
+    bool bDone = waitFor([&]() { return bBlocksSynched.load() && lastHeight == tip; }, std::chrono::seconds(120));
+    double elapsed = std::chrono::duration<double>(clock_type::now() - begin).count();
+
+    std::map<std::string, BlockScheduler::PeerStats> stats = sync.getSyncPeerStats();
+    sync.stop();
+
+    cout << "  synched " << lastHeight << " of " << tip << " blocks in " << elapsed << " s (" << (lastHeight / elapsed) << " blocks/s)" << endl;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        std::string peerName = "127.0.0.1:" + nodes[i]->port();
+        auto it = stats.find(peerName);
+        cout << "  " << scenario.nodes[i].label << " (" << peerName << "): ";
+        if (it == stats.end())
+        {
+            cout << "not used" << endl;
+            continue;
+        }
+        cout << "delivered " << it->second.delivered << ", stalls " << it->second.stalls
+             << ", latency " << (it->second.latency * 1000.0) << " ms, throughput " << it->second.throughput << " blocks/s" << endl;
+    }
+
+    bool bOk = bDone && errors == 0;
+    cout << "  " << (bOk ? "OK" : "FAILED") << endl;
+    return bOk;
+}
+
+int main(int argc, char* argv[])
+{
+    int height = (argc > 1) ? strtol(argv[1], NULL, 0) : 1000;
+    if (height < 10)
+    {
+        cerr << "# Usage: " << argv[0] << " [chain height >= 10]" << endl;
+        return -1;
+    }
+
+    try
+    {
+        Coin::CoinBlockHeader::setHashFunc(&sha256_2);
+        Coin::CoinBlockHeader::setPOWHashFunc(&sha256_2);
+
+        cout << "Building a chain of " << height << " blocks..." << endl;
+        FakeChain chain = buildChain(height);
+        FakeChain fork = buildChain(height, &chain, height / 2);
+
+        CoinParams params(MAGIC, PROTOCOL_VERSION, "18444", 0x6f, 0xc4, "multisync", "multisync", 100000000, "TST", 21000000, 1000,
+                          &sha256_2, &sha256_2, chain.headers[0]);
+
+        using std::chrono::milliseconds;
+        using std::chrono::microseconds;
+        NodeBehavior normal { "normal", &chain, milliseconds(10), microseconds(500), -1 };
+        NodeBehavior slow   { "slow", &chain, milliseconds(10), milliseconds(8), -1 };
+        NodeBehavior stalls { "stalls", &chain, milliseconds(10), microseconds(500), 40 };
+        NodeBehavior forked { "forked", &fork, milliseconds(10), microseconds(500), -1 };
+
+        std::vector<Scenario> scenarios = {
+            { "one peer, one block at a time", 1, { normal } },
+            { "one peer, window of 32", 32, { normal } },
+            { "three peers", 32, { normal, normal, normal } },
+            { "three peers, one slow", 32, { normal, normal, slow } },
+            { "three peers, one stalls", 32, { normal, normal, stalls } },
+            { "three peers, one on a fork", 32, { normal, normal, forked } }
+        };
+
+        bool bOk = true;
+        for (auto& scenario: scenarios) { bOk = runScenario(params, chain, scenario) && bOk; }
+
+        std::remove("multisync_headers.dat");
+        std::remove("multisync_headers.dat.idx");
+        return bOk ? 0 : 1;
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+}
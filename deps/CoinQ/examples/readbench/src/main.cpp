@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// peer receive path benchmark
+//
+// main.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+// Replays a captured message stream (or a synthetic one full of headers messages) through
+// the old append-and-reassign framing and through MessageFramer, in socket-sized pieces,
+// and reports the throughput of each.
+
+#include <CoinQ_receivebuffer.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/numericdata.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace CoinQ;
+using namespace std;
+
+const uint32_t MAGIC = 0xd9b4bef9;
+const size_t SEGMENT_SIZE = 1460;
+
+uchar_vector syntheticStream()
+{
+    uchar_vector stream;
+    for (int m = 0; m < 20; m++)
+    {
+        Coin::HeadersMessage headersMessage;
+        for (int i = 0; i < 2000; i++)
+        {
+            headersMessage.headers.push_back(Coin::CoinBlockHeader(2, 1231006505 + m * 2000 + i, 0x1d00ffff, i));
+        }
+        stream += Coin::CoinNodeMessage(MAGIC, &headersMessage).getSerialized();
+
+        Coin::PingMessage pingMessage;
+        stream += Coin::CoinNodeMessage(MAGIC, &pingMessage).getSerialized();
+    }
+    return stream;
+}
+
+// What Peer::do_read used to do with every read
+size_t legacyFraming(const uchar_vector& stream)
+{
+    const uchar_vector magic = uint_to_vch(MAGIC, LITTLE_ENDIAN_);
+    unsigned char read_buffer[SEGMENT_SIZE];
+    uchar_vector read_message;
+    size_t count = 0;
+
+    for (size_t pos = 0; pos < stream.size(); pos += SEGMENT_SIZE)
+    {
+        size_t bytes_read = std::min(SEGMENT_SIZE, stream.size() - pos);
+        std::copy(stream.begin() + pos, stream.begin() + pos + bytes_read, read_buffer);
+        read_message += uchar_vector(read_buffer, bytes_read);
+
+        while (read_message.size() >= MIN_MESSAGE_HEADER_SIZE)
+        {
+            uchar_vector::iterator it = std::search(read_message.begin(), read_message.end(), magic.begin(), magic.end());
+            if (it == read_message.end()) { read_message.clear(); break; }
+
+            read_message.assign(it, read_message.end());
+            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE) break;
+
+            unsigned int payloadSize = vch_to_uint<uint32_t>(uchar_vector(read_message.begin() + 16, read_message.begin() + 20), LITTLE_ENDIAN_);
+            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE + payloadSize) break;
+
+            Coin::CoinNodeMessage peerMessage(read_message);
+            if (!peerMessage.isChecksumValid()) throw runtime_error("Invalid checksum.");
+            count++;
+
+            read_message.assign(read_message.begin() + MIN_MESSAGE_HEADER_SIZE + payloadSize, read_message.end());
+        }
+    }
+    return count;
+}
+
+size_t framerFraming(const uchar_vector& stream)
+{
+    MessageFramer framer(MAGIC);
+    size_t count = 0;
+
+    size_t pos = 0;
+    while (pos < stream.size())
+    {
+        unsigned char* read_ptr = framer.buffer().prepare(framer.minReadBytes());
+        size_t bytes_read = std::min(std::min(SEGMENT_SIZE, framer.buffer().available()), stream.size() - pos);
+        std::copy(stream.begin() + pos, stream.begin() + pos + bytes_read, read_ptr);
+        framer.buffer().commit(bytes_read);
+        pos += bytes_read;
+
+        const unsigned char* payload;
+        while (framer.next(payload))
+        {
+            if (!framer.header().isChecksumValid(payload)) throw runtime_error("Invalid checksum.");
+            Coin::CoinNodeMessage peerMessage(framer.header(), payload);
+            count++;
+            framer.pop();
+        }
+    }
+    return count;
+}
+
+template<typename Function>
+double megabytesPerSecond(Function framing, const uchar_vector& stream, size_t& count)
+{
+    auto start = chrono::steady_clock::now();
+    count = framing(stream);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stream.size() / seconds / 1000000.0;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        uchar_vector stream;
+        if (argc > 1)
+        {
+            ifstream file(argv[1], ios::binary);
+            if (!file) throw runtime_error("Could not open stream file.");
+            stream.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        }
+        else
+        {
+            stream = syntheticStream();
+        }
+
+        cout << "Stream size: " << stream.size() << " bytes in " << SEGMENT_SIZE << " byte reads" << endl;
+
+        size_t legacyCount, framerCount;
+        double legacyRate = megabytesPerSecond(legacyFraming, stream, legacyCount);
+        double framerRate = megabytesPerSecond(framerFraming, stream, framerCount);
+        if (legacyCount != framerCount) throw runtime_error("Message count mismatch.");
+
+        cout << "Messages:       " << framerCount << endl
+             << "Legacy framing: " << legacyRate << " MB/s" << endl
+             << "MessageFramer:  " << framerRate << " MB/s" << endl;
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -10,116 +10,366 @@
 
 #include <logger/logger.h>
 
+#include <cstdio>
+#include <algorithm>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
 using namespace CoinQ;
 
-bool CoinQBlockTreeMem::setBestChain(ChainHeader& header)
+const uint64_t BLOCKTREE_RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
+
+// Forces buffered writes down to the disk.
+static void syncFile(FILE* f)
 {
-    if (header.inBestChain) return false;
+    if (fflush(f) != 0) throw BlockTreeFileWriteFailureException();
+#ifndef _WIN32
+    if (fsync(fileno(f)) != 0) throw BlockTreeFileSyncFailureException();
+#else
+    if (_commit(_fileno(f)) != 0) throw BlockTreeFileSyncFailureException();
+#endif
+}
 
-    // Retrace back to earliest best block
-    std::stack<ChainHeader*> newBestChain;
-    ChainHeader* pParent = &header;
-    while (!pParent->inBestChain)
+// The journal holds the length of the blocktree file as of the last completed flush.
+// Anything past it was not synced and is discarded on the next load.
+static std::string journalFilename(const std::string& filename)
+{
+    return filename + ".journal";
+}
+
+static void writeJournal(const std::string& filename, uint64_t committedLength)
+{
+    FILE* f = fopen(journalFilename(filename).c_str(), "wb");
+    if (!f) throw BlockTreeJournalWriteFailureException();
+
+    unsigned char buf[8];
+    for (int i = 0; i < 8; i++) { buf[i] = (committedLength >> (8 * i)) & 0xff; }
+
+    bool bWritten = (fwrite(buf, 1, 8, f) == 8);
+    try
     {
-        newBestChain.push(pParent);
-        pParent = &mHeaderHashMap.at(pParent->prevBlockHash());
+        if (bWritten) syncFile(f);
     }
-
-    for (auto it = pParent->childHashes.begin(); it != pParent->childHashes.end(); ++it)
+    catch (...)
     {
-        ChainHeader& child = mHeaderHashMap.at(*it);
-        if (child.inBestChain)
-        {
-            unsetBestChain(child);
-            break;
-        }
+        fclose(f);
+        throw;
     }
+    fclose(f);
+    if (!bWritten) throw BlockTreeJournalWriteFailureException();
+}
 
-    // First set these so we have the most current info.
-    mBestHeight = header.height;
-    mTotalWork = header.chainWork;
+static bool readJournal(const std::string& filename, uint64_t& committedLength);
 
-    // Pop back up stack and make this the best chain
-    int count = 0;
-    while (!newBestChain.empty())
+// Index file layout:
+//   header: magic "CQBI" | version (4) | record count (4) | record size (4) | checksum (8)
+//   record: serialized header (80) | hash (32) | chain work, big endian (32) | height (4) | reserved (4)
+// All integers are little endian. The checksum covers all records and can be extended as records are appended.
+const uint32_t BLOCKTREE_INDEX_VERSION = 1;
+const uint64_t BLOCKTREE_INDEX_HEADER_SIZE = 24;
+const uint64_t BLOCKTREE_INDEX_RECORD_SIZE = 152;
+const uint64_t BLOCKTREE_INDEX_CHECKSUM_SEED = 0xcbf29ce484222325ull;
+const unsigned char BLOCKTREE_INDEX_MAGIC[] = { 'C', 'Q', 'B', 'I' };
+
+static std::string indexFilename(const std::string& filename)
+{
+    return filename + ".idx";
+}
+
+static void writeUInt32(unsigned char* buf, uint32_t n)
+{
+    for (int i = 0; i < 4; i++) { buf[i] = (n >> (8 * i)) & 0xff; }
+}
+
+static void writeUInt64(unsigned char* buf, uint64_t n)
+{
+    for (int i = 0; i < 8; i++) { buf[i] = (n >> (8 * i)) & 0xff; }
+}
+
+static uint32_t readUInt32(const unsigned char* buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint64_t readUInt64(const unsigned char* buf)
+{
+    return (uint64_t)readUInt32(buf) | ((uint64_t)readUInt32(buf + 4) << 32);
+}
+
+// Not cryptographic - only meant to catch torn writes and disk corruption. len must be a multiple of 8.
+static uint64_t extendIndexChecksum(uint64_t checksum, const unsigned char* data, uint64_t len)
+{
+    for (uint64_t i = 0; i < len; i += 8)
     {
-        ChainHeader* pChild = newBestChain.top();
-        pChild->inBestChain = true;
-        mHeaderHeightMap[pChild->height] = pChild;
-        if (count == 0) notifyReorg(*pChild);
-        notifyAddBestChain(*pChild);
-        newBestChain.pop();
-        count++;
+        checksum ^= readUInt64(data + i);
+        checksum = (checksum << 23) | (checksum >> 41);
+        checksum *= 0x100000001b3ull;
     }
+    return checksum;
+}
 
-    pHead = &header;
+static void serializeIndexHeader(unsigned char* buf, uint32_t count, uint64_t checksum)
+{
+    memcpy(buf, BLOCKTREE_INDEX_MAGIC, 4);
+    writeUInt32(buf + 4, BLOCKTREE_INDEX_VERSION);
+    writeUInt32(buf + 8, count);
+    writeUInt32(buf + 12, BLOCKTREE_INDEX_RECORD_SIZE);
+    writeUInt64(buf + 16, checksum);
+}
 
+// Returns false if the index header is missing or not one we understand.
+static bool readIndexHeader(const unsigned char* buf, uint32_t& count, uint64_t& checksum)
+{
+    if (memcmp(buf, BLOCKTREE_INDEX_MAGIC, 4)) return false;
+    if (readUInt32(buf + 4) != BLOCKTREE_INDEX_VERSION) return false;
+    if (readUInt32(buf + 12) != BLOCKTREE_INDEX_RECORD_SIZE) return false;
+    count = readUInt32(buf + 8);
+    checksum = readUInt64(buf + 16);
     return true;
 }
 
-bool CoinQBlockTreeMem::unsetBestChain(ChainHeader& header)
+static bool readIndexHeader(const std::string& filename, uint32_t& count, uint64_t& checksum)
 {
-    if (!header.inBestChain) return false;
+    FILE* f = fopen(indexFilename(filename).c_str(), "rb");
+    if (!f) return false;
+
+    unsigned char buf[BLOCKTREE_INDEX_HEADER_SIZE];
+    bool bRead = (fread(buf, 1, BLOCKTREE_INDEX_HEADER_SIZE, f) == BLOCKTREE_INDEX_HEADER_SIZE);
+    fclose(f);
+    return bRead && readIndexHeader(buf, count, checksum);
+}
 
-    if (header.height == 0) throw std::runtime_error("Cannot remove genesis block from best chain.");
+// Length of the blocktree file as of the last completed flush.
+static uint64_t committedFileLength(const std::string& filename)
+{
+    uint64_t length = boost::filesystem::file_size(boost::filesystem::path(filename));
+    uint64_t committedLength;
+    if (readJournal(filename, committedLength) && committedLength < length) return committedLength;
+    return length;
+}
 
-    ChainHeader* pParent = &mHeaderHashMap.at(header.prevBlockHash());
-    if (pParent->inBestChain)
+static bool readJournal(const std::string& filename, uint64_t& committedLength)
+{
+    boost::filesystem::path p(journalFilename(filename));
+    if (!boost::filesystem::exists(p) || boost::filesystem::file_size(p) != 8) return false;
+
+    FILE* f = fopen(journalFilename(filename).c_str(), "rb");
+    if (!f) return false;
+
+    unsigned char buf[8];
+    bool bRead = (fread(buf, 1, 8, f) == 8);
+    fclose(f);
+    if (!bRead) return false;
+
+    committedLength = 0;
+    for (int i = 7; i >= 0; i--) { committedLength = (committedLength << 8) | buf[i]; }
+    return true;
+}
+
+static BigInt toBigInt(const uint256& n)
+{
+    return BigInt(std::vector<unsigned char>(n.begin(), n.end()), true);
+}
+
+// Hashes are uniformly distributed, so the first bytes of the hash make a good table position.
+static inline size_t hashSlot(const unsigned char* hash, size_t mask)
+{
+    uint64_t n;
+    memcpy(&n, hash, sizeof(n));
+    return (size_t)n & mask;
+}
+
+int CoinQBlockTreeMem::findNode(const unsigned char* hash) const
+{
+    if (mHashIndex.empty()) return -1;
+
+    size_t mask = mHashIndex.size() - 1;
+    for (size_t slot = hashSlot(hash, mask);; slot = (slot + 1) & mask)
     {
-        mBestHeight = pParent->height;
-        mTotalWork = pParent->chainWork;
+        uint32_t entry = mHashIndex[slot];
+        if (entry == 0) return -1;
+        if (!memcmp(mNodes[entry - 1].hash.data(), hash, 32)) return entry - 1;
     }
-    header.inBestChain = false;
-    notifyRemoveBestChain(header);
+}
+
+void CoinQBlockTreeMem::indexNode(uint32_t index)
+{
+    size_t mask = mHashIndex.size() - 1;
+    size_t slot = hashSlot(mNodes[index].hash.data(), mask);
+    while (mHashIndex[slot] != 0) { slot = (slot + 1) & mask; }
+    mHashIndex[slot] = index + 1;
+}
+
+void CoinQBlockTreeMem::rebuildHashIndex(size_t minSize)
+{
+    size_t size = 1024;
+    while (size < 2 * minSize) { size <<= 1; }
+
+    mHashIndex.assign(size, 0);
+    for (uint32_t i = 0; i < mNodes.size(); i++) { indexNode(i); }
+}
 
-    pParent = &header;
-    while (pParent->childHashes.size() != 0)
+uint32_t CoinQBlockTreeMem::addNode(const HeaderNode& node)
+{
+    mNodes.push_back(node);
+    if (2 * mNodes.size() > mHashIndex.size())
     {
-        for (auto it = pParent->childHashes.begin(); it != pParent->childHashes.end(); ++it)
-        {
-            ChainHeader* pChild = &mHeaderHashMap.at(*it);
-            if (pChild->inBestChain)
-            {
-                pParent = pChild;
-                mHeaderHeightMap.erase(pChild->height);
-                pChild->inBestChain = false;
-                notifyRemoveBestChain(*pChild);
-                break;
-            }
-        }
+        rebuildHashIndex(mNodes.size());
+    }
+    else
+    {
+        indexNode(mNodes.size() - 1);
+    }
+    return mNodes.size() - 1;
+}
+
+ChainHeader CoinQBlockTreeMem::toChainHeader(const HeaderNode& node) const
+{
+    ChainHeader header;
+    header.setSerialized(uchar_vector(node.header, node.header + MIN_COIN_BLOCK_HEADER_SIZE));
+    header.setTrustedHash(node.hash);
+    header.inBestChain = node.inBestChain;
+    header.height = node.height;
+    header.chainWork = toBigInt(node.chainWork);
+    return header;
+}
+
+static void writeChainWork(const uint256& chainWork, unsigned char* buf)
+{
+    // big endian
+    for (int i = 0; i < 32; i++) { buf[i] = chainWork.begin()[31 - i]; }
+}
+
+static uint256 readChainWork(const unsigned char* buf)
+{
+    std::vector<unsigned char> bytes(buf, buf + 32);
+    std::reverse(bytes.begin(), bytes.end());
+    return uint256(bytes);
+}
+
+// File records are the serialized header followed by the first four bytes of its hash.
+void CoinQBlockTreeMem::serializeFileRecord(int height, unsigned char* record) const
+{
+    const HeaderNode& node = mNodes[mBestChain[height]];
+    memcpy(record, node.header, MIN_COIN_BLOCK_HEADER_SIZE);
+    for (int i = 0; i < 4; i++) { record[MIN_COIN_BLOCK_HEADER_SIZE + i] = node.hash[31 - i]; }
+}
+
+void CoinQBlockTreeMem::serializeIndexRecord(int height, unsigned char* record) const
+{
+    const HeaderNode& node = mNodes[mBestChain[height]];
+    memcpy(record, node.header, MIN_COIN_BLOCK_HEADER_SIZE);
+    for (int i = 0; i < 32; i++) { record[80 + i] = node.hash[31 - i]; }
+    writeChainWork(node.chainWork, record + 112);
+    writeUInt32(record + 144, height);
+    writeUInt32(record + 148, 0);
+}
+
+void CoinQBlockTreeMem::pushBestChain(uint32_t index)
+{
+    uint32_t maxTimestamp = mBestChain.empty() ? 0 : std::max(mBestChainMaxTimestamp.back(), mNodes[index].timestamp());
+    mBestChain.push_back(index);
+    mBestChainMaxTimestamp.push_back(maxTimestamp);
+}
+
+void CoinQBlockTreeMem::resizeBestChain(size_t size)
+{
+    mBestChain.resize(size);
+    mBestChainMaxTimestamp.resize(size);
+}
+
+bool CoinQBlockTreeMem::setBestChain(uint32_t index)
+{
+    if (mNodes[index].inBestChain) return false;
+
+    // Retrace back to earliest best block
+    std::vector<uint32_t> newBestChain;
+    int i = index;
+    while (!mNodes[i].inBestChain)
+    {
+        newBestChain.push_back(i);
+        i = mNodes[i].parent;
     }
+
+    unsetBestChain(mNodes[i].height + 1);
+
+    // Pop back up stack and make this the best chain
+    for (auto it = newBestChain.rbegin(); it != newBestChain.rend(); ++it)
+    {
+        mNodes[*it].inBestChain = true;
+        pushBestChain(*it);
+    }
+
+    // Notify only once the best chain is consistent so subscribers can query the tree.
+    const HeaderNode& forkChild = mNodes[newBestChain.back()];
+    if (mFileHeight >= forkChild.height) { mFileHeight = forkChild.height - 1; }
+    notifyReorg(toChainHeader(forkChild));
+    if (!notifyAddBestChain.empty())
+    {
+        for (auto it = newBestChain.rbegin(); it != newBestChain.rend(); ++it) { notifyAddBestChain(toChainHeader(mNodes[*it])); }
+    }
+
     return true;
 }
 
+// Removes all headers at or above height from the best chain.
+void CoinQBlockTreeMem::unsetBestChain(int height)
+{
+    if ((int)mBestChain.size() <= height) return;
+
+    if (height == 0) throw std::runtime_error("Cannot remove genesis block from best chain.");
+    if (mFileHeight >= height) { mFileHeight = height - 1; }
+
+    std::vector<uint32_t> removed(mBestChain.begin() + height, mBestChain.end());
+    resizeBestChain(height);
+    for (auto index: removed) { mNodes[index].inBestChain = false; }
+
+    if (!notifyRemoveBestChain.empty())
+    {
+        for (auto index: removed) { notifyRemoveBestChain(toChainHeader(mNodes[index])); }
+    }
+}
+
 void CoinQBlockTreeMem::setGenesisBlock(const Coin::CoinBlockHeader& header)
 {
-    if (mHeaderHashMap.size() != 0) throw std::runtime_error("Tree is not empty.");
+    if (!mNodes.empty()) throw std::runtime_error("Tree is not empty.");
 
     bFlushed = false;
-    uchar_vector hash = header.hash();
-    ChainHeader& genesisHeader = mHeaderHashMap[hash] = header;
-    mHeaderHeightMap[0] = &genesisHeader;
-    genesisHeader.height = 0;
-    genesisHeader.inBestChain = true;
-    genesisHeader.chainWork = genesisHeader.getWork();
-    mBestHeight = 0;
-    mTotalWork = genesisHeader.chainWork;
-    pHead = &genesisHeader;
+    HeaderNode node;
+    uchar_vector headerBytes = header.getSerialized();
+    memcpy(node.header, &headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
+    node.hash = header.getHash();
+    node.chainWork = header.getWork256();
+    node.height = 0;
+    node.parent = -1;
+    node.inBestChain = true;
+
+    pushBestChain(addNode(node));
     notifyInsert(header);
     notifyAddBestChain(header);
 }
 
 bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool bCheckProofOfWork, bool bReplaceTip)
 {
-    if (mHeaderHashMap.size() == 0) throw std::runtime_error("No genesis block.");
+    if (mNodes.empty()) throw std::runtime_error("No genesis block.");
 
-    uchar_vector headerHash = header.hash();
-    if (hasHeader(headerHash)) return false;
+    HeaderNode node;
+    node.hash = header.getHash();
+    if (findNode(node.hash.data()) != -1) return false;
 
-    header_hash_map_t::iterator it = mHeaderHashMap.find(header.prevBlockHash());
-    if (it == mHeaderHashMap.end()) throw std::runtime_error("Parent not found.");
+    uchar_vector headerBytes = header.getSerialized();
+    memcpy(node.header, &headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
 
-    ChainHeader& parent = it->second;
+    // The previous block hash is serialized in the same byte order as our hashes.
+    node.parent = findNode(node.header + 4);
+    if (node.parent == -1) throw std::runtime_error("Parent not found.");
 
     // TODO: Check version, compute work required.
 
@@ -129,17 +379,20 @@ bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool b
     }*/
 
     // Check proof of work
-    if (bCheckProofOfWork && BigInt(header.getPOWHashLittleEndian()) > header.getTarget()) throw std::runtime_error("Header hash is too big.");
+    if (bCheckProofOfWork && !header.checkProofOfWork()) throw std::runtime_error("Header hash is too big.");
 
-    ChainHeader& chainHeader = mHeaderHashMap[headerHash] = header;
-    chainHeader.height = parent.height + 1;
-    chainHeader.chainWork = parent.chainWork + chainHeader.getWork();
-    parent.childHashes.insert(headerHash);
-    notifyInsert(chainHeader);
+    const HeaderNode& parent = mNodes[node.parent];
+    node.height = parent.height + 1;
+    node.chainWork = parent.chainWork + header.getWork256();
+    node.inBestChain = false;
 
-    if ((bReplaceTip && chainHeader.chainWork >= mTotalWork) || chainHeader.chainWork > mTotalWork)
+    uint32_t index = addNode(node);
+    if (!notifyInsert.empty()) { notifyInsert(toChainHeader(mNodes[index])); }
+
+    const uint256& totalWork = mNodes[mBestChain.back()].chainWork;
+    if ((bReplaceTip && node.chainWork >= totalWork) || node.chainWork > totalWork)
     {
-        setBestChain(chainHeader);
+        setBestChain(index);
     }
 
     bFlushed = false;
@@ -148,103 +401,134 @@ bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool b
 
 bool CoinQBlockTreeMem::deleteHeader(const uchar_vector& hash)
 {
-    header_hash_map_t::iterator it = mHeaderHashMap.find(hash);
-    if (it == mHeaderHashMap.end()) return false;
+    if (hash.size() != 32) return false;
 
-    ChainHeader& header = it->second;
-    unsetBestChain(header);
-    header_hash_map_t::iterator itParent = mHeaderHashMap.find(header.hash());
-    if (itParent == mHeaderHashMap.end()) throw std::runtime_error("Critical error: parent for block not found.");
+    hash256_t rawHash(hash, Coin::LittleEndian());
+    int index = findNode(rawHash.data());
+    if (index == -1) return false;
+    if (index == 0) throw std::runtime_error("Cannot remove genesis block from best chain.");
 
-    // Recurse through children
-    for (auto itChild = header.childHashes.begin(); itChild != header.childHashes.end(); ++itChild) { deleteHeader(*itChild); }
+    if (mNodes[index].inBestChain) { unsetBestChain(mNodes[index].height); }
+
+    // Children always follow their parents so a single pass finds all descendants.
+    std::vector<bool> deleted(mNodes.size(), false);
+    deleted[index] = true;
+    for (size_t i = index + 1; i < mNodes.size(); i++)
+    {
+        if (deleted[mNodes[i].parent]) { deleted[i] = true; }
+    }
 
     // TODO: Find new best chain if this header was in best chain.
 
-    // Remove header
-    ChainHeader& parent = itParent->second;
-    unsigned int nErased = parent.childHashes.erase(hash);
-    assert(nErased == 1);
-    notifyDelete(header);
-    mHeaderHashMap.erase(hash);
+    // Remove headers, remapping the indices of those that remain.
+    std::vector<int> newIndices(mNodes.size(), -1);
+    size_t n = 0;
+    for (size_t i = 0; i < mNodes.size(); i++)
+    {
+        if (deleted[i])
+        {
+            if (!notifyDelete.empty()) { notifyDelete(toChainHeader(mNodes[i])); }
+            continue;
+        }
+
+        newIndices[i] = n;
+        mNodes[n] = mNodes[i];
+        if (mNodes[n].parent != -1) { mNodes[n].parent = newIndices[mNodes[n].parent]; }
+        n++;
+    }
+    mNodes.resize(n);
+    for (auto& i: mBestChain) { i = newIndices[i]; }
+    rebuildHashIndex(mNodes.size());
+
     bFlushed = false;
     return true;
 }
 
 bool CoinQBlockTreeMem::hasHeader(const uchar_vector& hash) const
 {
-    return (mHeaderHashMap.find(hash) != mHeaderHashMap.end());
+    if (hash.size() != 32) return false;
+
+    hash256_t rawHash(hash, Coin::LittleEndian());
+    return (findNode(rawHash.data()) != -1);
 }
 
-const ChainHeader& CoinQBlockTreeMem::getHeader(const uchar_vector& hash) const
+ChainHeader CoinQBlockTreeMem::getHeader(const uchar_vector& hash) const
 {
-    header_hash_map_t::const_iterator it = mHeaderHashMap.find(hash);
-    if (it == mHeaderHashMap.end()) throw std::runtime_error("Not found.");
+    if (hash.size() != 32) throw std::runtime_error("Not found.");
 
-    return it->second;
+    hash256_t rawHash(hash, Coin::LittleEndian());
+    int index = findNode(rawHash.data());
+    if (index == -1) throw std::runtime_error("Not found.");
+
+    return toChainHeader(mNodes[index]);
 }
 
-const ChainHeader& CoinQBlockTreeMem::getHeader(int height) const
+ChainHeader CoinQBlockTreeMem::getHeader(int height) const
 {
-    if (mHeaderHeightMap.size() > 0)
-    {
-        if (height < 0) height += mBestHeight + 1;
-        if (height >= 0)
-        {
-            header_height_map_t::const_iterator it = mHeaderHeightMap.find((unsigned int)height);
-            if (it != mHeaderHeightMap.end()) return *it->second;
-        }
-    }
+    if (height < 0) height += mBestChain.size();
+    if (height < 0 || height >= (int)mBestChain.size()) throw std::runtime_error("Not found.");
 
-    throw std::runtime_error("Not found.");
+    return toChainHeader(mNodes[mBestChain[height]]);
 }
 
-const ChainHeader& CoinQBlockTreeMem::getTip() const
+ChainHeader CoinQBlockTreeMem::getTip() const
 {
-    if (!pHead) throw std::runtime_error("Tree is empty.");
+    if (mBestChain.empty()) throw std::runtime_error("Tree is empty.");
 
-    return *pHead;
+    return toChainHeader(mNodes[mBestChain.back()]);
 }
 
 int CoinQBlockTreeMem::getTipHeight() const
 {
-    if (!pHead) throw std::runtime_error("Tree is empty.");
+    if (mBestChain.empty()) throw std::runtime_error("Tree is empty.");
 
-    return pHead->height;
+    return mBestChain.size() - 1;
 }
 
-const ChainHeader& CoinQBlockTreeMem::getHeaderBefore(uint32_t timestamp) const
+ChainHeader CoinQBlockTreeMem::getHeaderBefore(uint32_t timestamp) const
 {
-    if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
+    if (mBestChain.empty()) throw std::runtime_error("Tree is empty.");
 
-    int i;
-    for (i = 1; i <= mBestHeight; i++)
-    {
-        ChainHeader* header = mHeaderHeightMap.at(i);
-        if (header->timestamp() > timestamp) break; 
-    }
+    // The first block with a later timestamp is also the first where the running maximum passes it.
+    auto it = std::upper_bound(mBestChainMaxTimestamp.begin() + 1, mBestChainMaxTimestamp.end(), timestamp);
+    return toChainHeader(mNodes[mBestChain[it - mBestChainMaxTimestamp.begin() - 1]]);
+}
 
-    return *mHeaderHeightMap.at(i - 1);
+uchar_vector CoinQBlockTreeMem::getBestHash() const
+{
+    if (mBestChain.empty()) throw std::runtime_error("Not found.");
+
+    const HeaderNode& tip = mNodes[mBestChain.back()];
+    return tip.hash.littleEndian();
+}
+
+BigInt CoinQBlockTreeMem::getTotalWork() const
+{
+    if (mBestChain.empty()) return 0;
+
+    return toBigInt(mNodes[mBestChain.back()].chainWork);
 }
 
 std::vector<uchar_vector> CoinQBlockTreeMem::getLocatorHashes(int maxSize = -1) const
 {
     std::vector<uchar_vector> locatorHashes;
 
-    if (mBestHeight == -1)
+    int bestHeight = getBestHeight();
+    if (bestHeight == -1)
     {
         locatorHashes.push_back(g_zero32bytes);
         return locatorHashes;
     }
 
-    if (maxSize < 0) maxSize = mBestHeight + 1;
+    if (maxSize < 0) maxSize = bestHeight + 1;
 
-    int i = mBestHeight;
+    int i = bestHeight;
     int n = 0;
     int step = 1;
     while ((i >= 0) && (n < maxSize))
     {
-        locatorHashes.push_back(mHeaderHeightMap.at(i)->hash());
+        const HeaderNode& node = mNodes[mBestChain[i]];
+        locatorHashes.push_back(node.hash.littleEndian());
         i -= step;
         n++;
         if (n > 10) step *= 2;
@@ -254,10 +538,13 @@ std::vector<uchar_vector> CoinQBlockTreeMem::getLocatorHashes(int maxSize = -1)
 
 int CoinQBlockTreeMem::getConfirmations(const uchar_vector& hash) const
 {
-    header_hash_map_t::const_iterator it = mHeaderHashMap.find(hash);
-    if (it == mHeaderHashMap.end() || !it->second.inBestChain) return 0;
+    if (hash.size() != 32) return 0;
+
+    hash256_t rawHash(hash, Coin::LittleEndian());
+    int index = findNode(rawHash.data());
+    if (index == -1 || !mNodes[index].inBestChain) return 0;
 
-    return mBestHeight - it->second.height + 1;
+    return getBestHeight() - mNodes[index].height + 1;
 }
 
 void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckProofOfWork, CoinQBlockTreeMem::callback_t callback)
@@ -267,7 +554,17 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
 
     if (!boost::filesystem::is_regular_file(p)) throw BlockTreeInvalidFileTypeException();
 
-    const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
+    // Discard any records appended after the last completed flush
+    uint64_t committedLength;
+    if (readJournal(filename, committedLength) && boost::filesystem::file_size(p) > committedLength)
+    {
+        LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - truncating uncommitted records from " << boost::filesystem::file_size(p) << " to " << committedLength << " bytes." << std::endl;
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(p, committedLength, ec);
+        if (!!ec) throw BlockTreeFileWriteFailureException();
+    }
+
+    const unsigned int RECORD_SIZE = BLOCKTREE_RECORD_SIZE;
     if (boost::filesystem::file_size(p) % RECORD_SIZE != 0) throw BlockTreeInvalidFileLengthException();
 
 #ifndef _WIN32
@@ -301,7 +598,7 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
 
             try
             {
-                if (mBestHeight >= 0)
+                if (getBestHeight() >= 0)
                 {
                     insertHeader(header, bCheckProofOfWork);
                     if (count % 10000 == 0)
@@ -332,45 +629,386 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
         if (pos != nbytesread) throw BlockTreeUnexpectedEndOfFileException();
     }
 
+    // Everything we just loaded is already on disk. If there is no index to match, let the next flush build one.
+    mFileName = filename;
+    mFileHeight = getBestHeight();
+    uint32_t indexCount;
+    uint64_t indexChecksum;
+    bFlushed = readIndexHeader(filename, indexCount, indexChecksum) && (int)indexCount == getBestHeight() + 1;
+
     if (callback) callback(*this); // No need to interrupt since we're done.
 }
 
 void CoinQBlockTreeMem::flushToFile(const std::string& filename)
 {
-    if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
+    if (getBestHeight() == -1) throw std::runtime_error("Tree is empty.");
 
-    boost::filesystem::path swapfile(filename + ".swp");
-    //if (boost::filesystem::exists(swapfile)) throw BlockTreeSwapfileAlreadyExistsException();
+    boost::filesystem::path p(filename);
+    int fileHeight = -1;
+    if (filename != mFileName || mFileHeight < 0 || !boost::filesystem::exists(p) ||
+        boost::filesystem::file_size(p) < (uint64_t)(mFileHeight + 1) * BLOCKTREE_RECORD_SIZE)
+    {
+        rewriteFile(filename);
+    }
+    else
+    {
+        fileHeight = mFileHeight;
+        appendToFile(filename);
+    }
 
+    // The index is only an accelerator for loading - failing to update it must not fail the flush.
+    try
     {
-#ifndef _WIN32
-        std::ofstream fs(swapfile.native(), std::ios::binary | std::ios::trunc);
-#else
-        std::ofstream fs(filename + ".swp", std::ios::binary | std::ios::trunc);
-#endif
+        uint32_t indexCount;
+        uint64_t indexChecksum;
+        if (fileHeight >= 0 && readIndexHeader(filename, indexCount, indexChecksum) && (int)indexCount == fileHeight + 1)
+        {
+            appendToIndex(filename, fileHeight + 1);
+        }
+        else
+        {
+            rewriteIndex(filename);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "CoinQBlockTreeMem::flushToFile() - failed to update index: " << e.what() << std::endl;
+        removeIndex(filename);
+    }
 
-        uchar_vector headerBytes, hash;
+    bFlushed = true;
+}
 
-        for (int i = 0; i <= mBestHeight; i++)
-        {
-            ChainHeader* pHeader = mHeaderHeightMap.at(i);
+void CoinQBlockTreeMem::rewriteFile(const std::string& filename)
+{
+    LOGGER(trace) << "CoinQBlockTreeMem::rewriteFile(" << filename << ") - writing " << (getBestHeight() + 1) << " headers." << std::endl;
 
-            headerBytes = pHeader->getSerialized();
-            hash = pHeader->hash();
+    std::string swapfilename = filename + ".swp";
+    boost::filesystem::path swapfile(swapfilename);
+    //if (boost::filesystem::exists(swapfile)) throw BlockTreeSwapfileAlreadyExistsException();
 
-            fs.write((const char*)&headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
-            if (fs.bad()) throw BlockTreeFileWriteFailureException();
+    {
+        FILE* f = fopen(swapfilename.c_str(), "wb");
+        if (!f) throw BlockTreeFileWriteFailureException();
 
-            fs.write((const char*)&hash[0], 4);
-            if (fs.bad()) throw BlockTreeFileWriteFailureException();
+        try
+        {
+            unsigned char record[BLOCKTREE_RECORD_SIZE];
+            for (int i = 0; i <= getBestHeight(); i++)
+            {
+                serializeFileRecord(i, record);
+                if (fwrite(record, 1, BLOCKTREE_RECORD_SIZE, f) != BLOCKTREE_RECORD_SIZE) throw BlockTreeFileWriteFailureException();
+            }
+
+            syncFile(f);
+        }
+        catch (...)
+        {
+            fclose(f);
+            throw;
         }
+        fclose(f);
     }
 
+    // The old journal describes the old file - drop it before replacing the file.
     boost::system::error_code ec;
+    boost::filesystem::remove(boost::filesystem::path(journalFilename(filename)), ec);
+
     boost::filesystem::path p(filename);
     boost::filesystem::rename(swapfile, p, ec);
     if (!!ec) throw std::runtime_error(ec.message());
 
+    writeJournal(filename, (uint64_t)(getBestHeight() + 1) * BLOCKTREE_RECORD_SIZE);
+
+    mFileName = filename;
+    mFileHeight = getBestHeight();
+}
+
+void CoinQBlockTreeMem::appendToFile(const std::string& filename)
+{
+    boost::filesystem::path p(filename);
+    uint64_t committedLength = (uint64_t)(mFileHeight + 1) * BLOCKTREE_RECORD_SIZE;
+    if (boost::filesystem::file_size(p) > committedLength)
+    {
+        // Reorg - journal the fork point before truncating the orphaned suffix.
+        LOGGER(trace) << "CoinQBlockTreeMem::appendToFile(" << filename << ") - truncating to height " << mFileHeight << "." << std::endl;
+        writeJournal(filename, committedLength);
+
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(p, committedLength, ec);
+        if (!!ec) throw BlockTreeFileWriteFailureException();
+    }
+
+    if (mFileHeight == getBestHeight()) return;
+
+    LOGGER(trace) << "CoinQBlockTreeMem::appendToFile(" << filename << ") - appending headers " << (mFileHeight + 1) << " - " << getBestHeight() << "." << std::endl;
+
+    FILE* f = fopen(filename.c_str(), "ab");
+    if (!f) throw BlockTreeFileWriteFailureException();
+
+    try
+    {
+        const unsigned int BATCH_SIZE = 64;
+        unsigned char buf[BLOCKTREE_RECORD_SIZE * BATCH_SIZE];
+        unsigned int pos = 0;
+
+        for (int i = mFileHeight + 1; i <= getBestHeight(); i++)
+        {
+            serializeFileRecord(i, &buf[pos]);
+            pos += BLOCKTREE_RECORD_SIZE;
+
+            if (pos == sizeof(buf) || i == getBestHeight())
+            {
+                if (fwrite(buf, 1, pos, f) != pos) throw BlockTreeFileWriteFailureException();
+                pos = 0;
+            }
+        }
+
+        syncFile(f);
+    }
+    catch (...)
+    {
+        fclose(f);
+        throw;
+    }
+    fclose(f);
+
+    writeJournal(filename, (uint64_t)(getBestHeight() + 1) * BLOCKTREE_RECORD_SIZE);
+    mFileHeight = getBestHeight();
+}
+
+void CoinQBlockTreeMem::rewriteIndex(const std::string& filename)
+{
+    LOGGER(trace) << "CoinQBlockTreeMem::rewriteIndex(" << filename << ") - writing " << (getBestHeight() + 1) << " records." << std::endl;
+
+    // Write to a new file and rename it into place so that a background revalidation
+    // still mapping the old index never sees it shrink.
+    std::string swapfilename = indexFilename(filename) + ".swp";
+
+    FILE* f = fopen(swapfilename.c_str(), "wb");
+    if (!f) throw BlockTreeFileWriteFailureException();
+
+    try
+    {
+        unsigned char header[BLOCKTREE_INDEX_HEADER_SIZE];
+        serializeIndexHeader(header, 0, 0);
+        if (fwrite(header, 1, BLOCKTREE_INDEX_HEADER_SIZE, f) != BLOCKTREE_INDEX_HEADER_SIZE) throw BlockTreeFileWriteFailureException();
+
+        uint64_t checksum = BLOCKTREE_INDEX_CHECKSUM_SEED;
+        unsigned char record[BLOCKTREE_INDEX_RECORD_SIZE];
+        for (int i = 0; i <= getBestHeight(); i++)
+        {
+            serializeIndexRecord(i, record);
+            checksum = extendIndexChecksum(checksum, record, BLOCKTREE_INDEX_RECORD_SIZE);
+            if (fwrite(record, 1, BLOCKTREE_INDEX_RECORD_SIZE, f) != BLOCKTREE_INDEX_RECORD_SIZE) throw BlockTreeFileWriteFailureException();
+        }
+
+        serializeIndexHeader(header, getBestHeight() + 1, checksum);
+        if (fseek(f, 0, SEEK_SET) != 0) throw BlockTreeFileWriteFailureException();
+        if (fwrite(header, 1, BLOCKTREE_INDEX_HEADER_SIZE, f) != BLOCKTREE_INDEX_HEADER_SIZE) throw BlockTreeFileWriteFailureException();
+        syncFile(f);
+    }
+    catch (...)
+    {
+        fclose(f);
+        throw;
+    }
+    fclose(f);
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(boost::filesystem::path(swapfilename), boost::filesystem::path(indexFilename(filename)), ec);
+    if (!!ec) throw std::runtime_error(ec.message());
+}
+
+void CoinQBlockTreeMem::appendToIndex(const std::string& filename, int startHeight)
+{
+    if (startHeight > getBestHeight()) return;
+
+    uint32_t count;
+    uint64_t checksum;
+    if (!readIndexHeader(filename, count, checksum) || (int)count != startHeight) throw std::runtime_error("Blocktree index does not match blocktree file.");
+
+    FILE* f = fopen(indexFilename(filename).c_str(), "r+b");
+    if (!f) throw BlockTreeFileWriteFailureException();
+
+    try
+    {
+        // Records past the count in the header were never committed, so write over them.
+        if (fseek(f, BLOCKTREE_INDEX_HEADER_SIZE + (uint64_t)count * BLOCKTREE_INDEX_RECORD_SIZE, SEEK_SET) != 0) throw BlockTreeFileWriteFailureException();
+
+        unsigned char record[BLOCKTREE_INDEX_RECORD_SIZE];
+        for (int i = startHeight; i <= getBestHeight(); i++)
+        {
+            serializeIndexRecord(i, record);
+            checksum = extendIndexChecksum(checksum, record, BLOCKTREE_INDEX_RECORD_SIZE);
+            if (fwrite(record, 1, BLOCKTREE_INDEX_RECORD_SIZE, f) != BLOCKTREE_INDEX_RECORD_SIZE) throw BlockTreeFileWriteFailureException();
+        }
+        syncFile(f);
+
+        // Commit the new records
+        unsigned char header[BLOCKTREE_INDEX_HEADER_SIZE];
+        serializeIndexHeader(header, getBestHeight() + 1, checksum);
+        if (fseek(f, 0, SEEK_SET) != 0) throw BlockTreeFileWriteFailureException();
+        if (fwrite(header, 1, BLOCKTREE_INDEX_HEADER_SIZE, f) != BLOCKTREE_INDEX_HEADER_SIZE) throw BlockTreeFileWriteFailureException();
+        syncFile(f);
+    }
+    catch (...)
+    {
+        fclose(f);
+        throw;
+    }
+    fclose(f);
+}
+
+void CoinQBlockTreeMem::removeIndex(const std::string& filename)
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(boost::filesystem::path(indexFilename(filename)), ec);
+}
+
+bool CoinQBlockTreeMem::loadFromIndex(const std::string& filename, CoinQBlockTreeMem::callback_t callback)
+{
+    using namespace boost::interprocess;
+
+    boost::filesystem::path p(filename);
+    boost::filesystem::path indexPath(indexFilename(filename));
+    if (!boost::filesystem::is_regular_file(p) || !boost::filesystem::is_regular_file(indexPath)) return false;
+
+    uint64_t fileLength = committedFileLength(filename);
+    if (fileLength == 0 || fileLength % BLOCKTREE_RECORD_SIZE != 0) return false;
+    uint64_t fileCount = fileLength / BLOCKTREE_RECORD_SIZE;
+
+    uint64_t indexLength = boost::filesystem::file_size(indexPath);
+    if (indexLength < BLOCKTREE_INDEX_HEADER_SIZE + fileCount * BLOCKTREE_INDEX_RECORD_SIZE) return false;
+
+    file_mapping mapping;
+    mapped_region region;
+    try
+    {
+        file_mapping(indexPath.string().c_str(), read_only).swap(mapping);
+        mapped_region(mapping, read_only, 0, BLOCKTREE_INDEX_HEADER_SIZE + fileCount * BLOCKTREE_INDEX_RECORD_SIZE).swap(region);
+    }
+    catch (const interprocess_exception& e)
+    {
+        LOGGER(debug) << "CoinQBlockTreeMem::loadFromIndex() - could not map index: " << e.what() << std::endl;
+        return false;
+    }
+
+    const unsigned char* data = (const unsigned char*)region.get_address();
+    const unsigned char* records = data + BLOCKTREE_INDEX_HEADER_SIZE;
+
+    uint32_t count;
+    uint64_t checksum;
+    if (!readIndexHeader(data, count, checksum) || count != fileCount) return false;
+    if (extendIndexChecksum(BLOCKTREE_INDEX_CHECKSUM_SEED, records, count * BLOCKTREE_INDEX_RECORD_SIZE) != checksum)
+    {
+        LOGGER(debug) << "CoinQBlockTreeMem::loadFromIndex() - index checksum mismatch." << std::endl;
+        return false;
+    }
+
+    // Make sure the index tip is the blocktree file tip
+    {
+#ifndef _WIN32
+        std::ifstream fs(p.native(), std::ios::binary);
+#else
+        std::ifstream fs(filename, std::ios::binary);
+#endif
+        char tip[MIN_COIN_BLOCK_HEADER_SIZE];
+        fs.seekg(fileLength - BLOCKTREE_RECORD_SIZE);
+        fs.read(tip, MIN_COIN_BLOCK_HEADER_SIZE);
+        if (!fs || memcmp(tip, records + (count - 1) * BLOCKTREE_INDEX_RECORD_SIZE, MIN_COIN_BLOCK_HEADER_SIZE)) return false;
+    }
+
+    clear();
+    mNodes.reserve(count);
+    mBestChain.reserve(count);
+    mBestChainMaxTimestamp.reserve(count);
+    rebuildHashIndex(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const unsigned char* record = records + (uint64_t)i * BLOCKTREE_INDEX_RECORD_SIZE;
+
+        HeaderNode node;
+        memcpy(node.header, record, MIN_COIN_BLOCK_HEADER_SIZE);
+        node.hash = hash256_t(record + 80, Coin::LittleEndian());
+        node.chainWork = readChainWork(record + 112);
+        node.height = readUInt32(record + 144);
+        node.parent = (int)i - 1;
+        node.inBestChain = true;
+
+        if (node.height != (int)i || (i > 0 && memcmp(node.header + 4, mNodes[i - 1].hash.data(), 32)))
+        {
+            LOGGER(debug) << "CoinQBlockTreeMem::loadFromIndex() - index is inconsistent at height " << i << "." << std::endl;
+            clear();
+            return false;
+        }
+
+        pushBestChain(addNode(node));
+
+        if (!notifyInsert.empty() || !notifyAddBestChain.empty())
+        {
+            ChainHeader header = toChainHeader(mNodes[i]);
+            notifyInsert(header);
+            notifyAddBestChain(header);
+        }
+
+        if (i % 10000 == 0)
+        {
+            if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
+            LOGGER(debug) << "CoinQBlockTreeMem::loadFromIndex() - header hash: " << uchar_vector(record + 80, record + 112).getHex() << " height: " << i << std::endl;
+        }
+    }
+
+    mFileName = filename;
+    mFileHeight = getBestHeight();
     bFlushed = true;
+
+    if (callback) callback(*this); // No need to interrupt since we're done.
+    return true;
 }
 
+int CoinQBlockTreeMem::revalidateIndex(const std::string& filename, bool bCheckProofOfWork, std::function<bool()> keepGoing)
+{
+    using namespace boost::interprocess;
+
+    // Map the whole file and read the header from the mapping so that the count and the records
+    // come from the same file even if rewriteIndex renames a new index into place meanwhile.
+    file_mapping mapping;
+    mapped_region region;
+    try
+    {
+        file_mapping(indexFilename(filename).c_str(), read_only).swap(mapping);
+        mapped_region(mapping, read_only).swap(region);
+    }
+    catch (const interprocess_exception& e)
+    {
+        LOGGER(debug) << "CoinQBlockTreeMem::revalidateIndex() - could not map index: " << e.what() << std::endl;
+        return -1;
+    }
+
+    const unsigned char* data = (const unsigned char*)region.get_address();
+    const unsigned char* records = data + BLOCKTREE_INDEX_HEADER_SIZE;
+
+    // Records appended after this point were validated on insertion.
+    uint32_t count;
+    uint64_t checksum;
+    if (region.get_size() < BLOCKTREE_INDEX_HEADER_SIZE || !readIndexHeader(data, count, checksum)) return -1;
+    if (region.get_size() < BLOCKTREE_INDEX_HEADER_SIZE + (uint64_t)count * BLOCKTREE_INDEX_RECORD_SIZE)
+    {
+        LOGGER(debug) << "CoinQBlockTreeMem::revalidateIndex() - index is shorter than its header count." << std::endl;
+        return -1;
+    }
+
+    Coin::CoinBlockHeader header;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (keepGoing && i % 1000 == 0 && !keepGoing()) break;
+
+        const unsigned char* record = records + (uint64_t)i * BLOCKTREE_INDEX_RECORD_SIZE;
+        header.setSerialized(uchar_vector(record, record + MIN_COIN_BLOCK_HEADER_SIZE));
+        if (memcmp(&header.hash()[0], record + 80, 32)) return i;
+        if (bCheckProofOfWork && i > 0 && !header.checkProofOfWork()) return i;
+    }
+
+    return -1;
+}
@@ -13,6 +13,7 @@
 #include "CoinQ_slots.h"
 
 #include <CoinCore/CoinNodeData.h>
+#include <CoinCore/hashtypes.h>
 
 #include <set>
 #include <map>
@@ -24,14 +25,12 @@
 
 #include <boost/filesystem.hpp>
 
-// TODO: Create subclass for childHashes
 class ChainHeader : public Coin::CoinBlockHeader
 {
 public:
     bool inBestChain;
     int height;
     BigInt chainWork; // total work for the chain with this header as its leaf
-    std::set<uchar_vector> childHashes;
 
     ChainHeader() : Coin::CoinBlockHeader(), inBestChain(false), height(-1), chainWork(0) { }
     ChainHeader(const Coin::CoinBlockHeader& header, bool _inBestChain = false, int _height = -1, const BigInt& _chainWork = 0) : Coin::CoinBlockHeader(header), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
@@ -41,8 +40,15 @@ public:
     bool operator==(const ChainHeader& rhs) const { return ((getHash() == rhs.getHash()) && (inBestChain == rhs.inBestChain) && (height == rhs.height) && (chainWork == rhs.chainWork)); }
     bool operator!=(const ChainHeader& rhs) const { return !(*this == rhs); }
 
-    void clear() { inBestChain = false; height = -1; chainWork = 0; childHashes.clear(); }
+    void clear() { inBestChain = false; height = -1; chainWork = 0; }
 
+    // Sets the cached hash without rehashing the header. Only use with hashes from a trusted source.
+    void setTrustedHash(const hash256_t& hash)
+    {
+        hash_.assign(hash.begin(), hash.end());
+        hashLittleEndian_.assign(hash.littleEndian().begin(), hash.littleEndian().end());
+        isHashSet_ = true;
+    }
 };
 
 
@@ -105,14 +111,15 @@ public:
     // returns true if header removed, false if header unknown
     virtual bool deleteHeader(const uchar_vector& hash) = 0;
  
+    // Headers are returned by value so implementations are free to store them compactly.
     virtual bool hasHeader(const uchar_vector& hash) const = 0;
-    virtual const ChainHeader& getHeader(const uchar_vector& hash) const = 0;
-    virtual const ChainHeader& getHeader(int height) const = 0; // Use -1 to get top block
-    virtual const ChainHeader& getTip() const = 0;
+    virtual ChainHeader getHeader(const uchar_vector& hash) const = 0;
+    virtual ChainHeader getHeader(int height) const = 0; // Use -1 to get top block
+    virtual ChainHeader getTip() const = 0;
     virtual int getTipHeight() const = 0;
-    virtual const ChainHeader& getHeaderBefore(uint32_t timestamp) const = 0;
+    virtual ChainHeader getHeaderBefore(uint32_t timestamp) const = 0;
 
-    virtual const uchar_vector& getBestHash() const = 0;
+    virtual uchar_vector getBestHash() const = 0;
     virtual int getBestHeight() const = 0;
     virtual BigInt getTotalWork() const = 0;
 
@@ -127,16 +134,42 @@ class CoinQBlockTreeMem : public ICoinQBlockTree
 private:
     bool bFlushed;
 
-    typedef std::map<uchar_vector, ChainHeader> header_hash_map_t;
-    header_hash_map_t mHeaderHashMap;
+    // Every header we know about, including those not in the best chain, is kept in a fixed-size node.
+    // A parent is always inserted before its children so parent < index for every node but the genesis.
+    struct HeaderNode
+    {
+        unsigned char header[MIN_COIN_BLOCK_HEADER_SIZE];   // serialized header
+        hash256_t hash;                                     // in serialized byte order, i.e. reverse of hash()
+        uint256 chainWork;
+        int height;
+        int parent;
+        bool inBestChain;
 
-    typedef std::map<unsigned int, ChainHeader*> header_height_map_t;
-    header_height_map_t mHeaderHeightMap;
+        uint32_t timestamp() const { return (uint32_t)header[68] | ((uint32_t)header[69] << 8) | ((uint32_t)header[70] << 16) | ((uint32_t)header[71] << 24); }
+    };
 
-    int mBestHeight;
-    BigInt mTotalWork;
+    std::vector<HeaderNode> mNodes;
 
-    ChainHeader* pHead;    
+    // Node indices of the best chain by height
+    std::vector<uint32_t> mBestChain;
+
+    // Latest timestamp in the best chain from height 1 up to each height. Timestamps are not
+    // monotonic but these are, so getHeaderBefore can binary search them. Entry 0 is unused.
+    std::vector<uint32_t> mBestChainMaxTimestamp;
+
+    void pushBestChain(uint32_t index);
+    void resizeBestChain(size_t size);
+
+    // Open addressed hash table of node index + 1 keyed by node hash, 0 marks an empty slot.
+    // The size is a power of two kept at least twice the number of nodes.
+    std::vector<uint32_t> mHashIndex;
+
+    int findNode(const unsigned char* hash) const;
+    void indexNode(uint32_t index);
+    void rebuildHashIndex(size_t minSize);
+    uint32_t addNode(const HeaderNode& node);
+
+    ChainHeader toChainHeader(const HeaderNode& node) const;
 
     bool bCheckTimestamp;
     bool bCheckProofOfWork;
@@ -147,15 +180,30 @@ private:
     CoinQSignal<const ChainHeader&> notifyDelete;
     CoinQSignal<const ChainHeader&> notifyReorg;
 
+    // The blocktree file is an append-only log of best chain records. mFileHeight is the
+    // highest height whose record in mFileName is known to match the current best chain.
+    std::string mFileName;
+    int mFileHeight;
+
+    void rewriteFile(const std::string& filename);
+    void appendToFile(const std::string& filename);
+
+    // The index mirrors the blocktree file, adding each header's hash, height and chain work.
+    void rewriteIndex(const std::string& filename);
+    void appendToIndex(const std::string& filename, int startHeight);
+
+    void serializeFileRecord(int height, unsigned char* record) const;
+    void serializeIndexRecord(int height, unsigned char* record) const;
+
 protected:
-    bool setBestChain(ChainHeader& header);
-    bool unsetBestChain(ChainHeader& header);
+    bool setBestChain(uint32_t index);
+    void unsetBestChain(int height);
 
 public:
     CoinQBlockTreeMem(bool _bCheckTimestamp = true, bool _bCheckProofOfWork = true)
-        : bFlushed(true), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { }
+        : bFlushed(true), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork), mFileHeight(-1) { }
     CoinQBlockTreeMem(const Coin::CoinBlockHeader& header, bool _bCheckTimestamp = true, bool _bCheckProofOfWork = true)
-        : bFlushed(true), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { setGenesisBlock(header); }
+        : bFlushed(true), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork), mFileHeight(-1) { setGenesisBlock(header); }
 
     void subscribeAddBestChain(chain_header_slot_t slot) { notifyAddBestChain.connect(slot); }
     void subscribeRemoveBestChain(chain_header_slot_t slot) { notifyRemoveBestChain.connect(slot); }
@@ -170,29 +218,42 @@ public:
     void clearReorg() { notifyReorg.clear();; }
 
     void setGenesisBlock(const Coin::CoinBlockHeader& header);
-    bool isEmpty() const { return pHead == nullptr; }
+    bool isEmpty() const { return mBestChain.empty(); }
     bool insertHeader(const Coin::CoinBlockHeader& header, bool bCheckProofOfWork = true, bool bReplaceTip = false);
     bool deleteHeader(const uchar_vector& hash);
 
     bool hasHeader(const uchar_vector& hash) const;
-    const ChainHeader& getHeader(const uchar_vector& hash) const;
-    const ChainHeader& getHeader(int height) const;
-    const ChainHeader& getTip() const;
+    ChainHeader getHeader(const uchar_vector& hash) const;
+    ChainHeader getHeader(int height) const;
+    ChainHeader getTip() const;
     int getTipHeight() const;
-    const ChainHeader& getHeaderBefore(uint32_t timestamp) const;
+    ChainHeader getHeaderBefore(uint32_t timestamp) const;
 
-    const uchar_vector& getBestHash() const { return getHeader(-1).hash(); }
-    int getBestHeight() const { return mBestHeight; }
-    BigInt getTotalWork() const { return mTotalWork; }
+    uchar_vector getBestHash() const;
+    int getBestHeight() const { return (int)mBestChain.size() - 1; }
+    BigInt getTotalWork() const;
 
     std::vector<uchar_vector> getLocatorHashes(int maxSize) const;
 
     int getConfirmations(const uchar_vector& hash) const;
-    void clear() { mHeaderHashMap.clear(); mHeaderHeightMap.clear(); mBestHeight = -1; mTotalWork = 0; pHead = NULL; }
+    void clear() { mNodes.clear(); mBestChain.clear(); mBestChainMaxTimestamp.clear(); mHashIndex.clear(); mFileName.clear(); mFileHeight = -1; }
 
     typedef std::function<bool(const CoinQBlockTreeMem&)> callback_t;
     void loadFromFile(const std::string& filename, bool bCheckProofOfWork = true, callback_t callback = nullptr); 
 
+    // Loads the best chain from the index kept alongside filename, trusting its precomputed hashes,
+    // heights and chain work once the index checksum and its agreement with the blocktree file are checked.
+    // Returns false if there is no usable index, in which case loadFromFile should be used instead.
+    bool loadFromIndex(const std::string& filename, callback_t callback = nullptr);
+
+    // Rehashes every header in the index and optionally checks its proof of work.
+    // Meant to run in the background after loadFromIndex.
+    // Returns the height of the first invalid header or -1 if none was found before keepGoing returned false.
+    static int revalidateIndex(const std::string& filename, bool bCheckProofOfWork, std::function<bool()> keepGoing = nullptr);
+    static void removeIndex(const std::string& filename);
+
+    // Only appends records added to the best chain since the last flush, truncating any orphaned suffix first.
+    // The whole file is rewritten only the first time we flush to a file we did not load from.
     void flushToFile(const std::string& filename);
 
     bool flushed() const { return bFlushed; }
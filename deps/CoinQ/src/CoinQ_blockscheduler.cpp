@@ -0,0 +1,212 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_blockscheduler.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#include "CoinQ_blockscheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace CoinQ::Network;
+
+namespace
+{
+    // Weight kept by past measurements on each new delivery
+    const double THROUGHPUT_DECAY = 0.9;
+    const double LATENCY_DECAY = 0.8;
+
+    // A request is overdue once it has waited this many times the typical latency
+    const double STALL_FACTOR = 4.0;
+
+    double seconds(BlockScheduler::clock_t::duration d) { return std::chrono::duration<double>(d).count(); }
+}
+
+BlockScheduler::BlockScheduler(unsigned int windowPerPeer, std::chrono::milliseconds minStallTimeout) :
+    m_windowPerPeer(windowPerPeer > 0 ? windowPerPeer : 1),
+    m_minStallTimeout(minStallTimeout),
+    m_nextHeight(0)
+{
+}
+
+void BlockScheduler::reset(int startHeight)
+{
+    m_nextHeight = startHeight;
+    m_retryHeights.clear();
+    for (auto& peer: m_peers) { peer.second.requests.clear(); }
+}
+
+void BlockScheduler::addPeer(const std::string& peer)
+{
+    m_peers.insert(std::make_pair(peer, PeerState()));
+}
+
+void BlockScheduler::removePeer(const std::string& peer)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end()) return;
+
+    for (auto& request: it->second.requests) { m_retryHeights.insert(request.first); }
+    m_peers.erase(it);
+}
+
+std::vector<int> BlockScheduler::assign(const std::string& peer, int maxHeight, time_point_t now)
+{
+    std::vector<int> heights;
+
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end()) return heights;
+
+    PeerState& state = it->second;
+    unsigned int peerWindow = window(state);
+    if (!state.requests.empty() && state.requests.size() > peerWindow / 2) return heights;
+    if (state.requests.empty()) { state.lastEvent = now; }
+
+    while (state.requests.size() < peerWindow)
+    {
+        int height;
+        if (!m_retryHeights.empty() && *m_retryHeights.begin() <= maxHeight)
+        {
+            height = *m_retryHeights.begin();
+            m_retryHeights.erase(m_retryHeights.begin());
+        }
+        else if (m_nextHeight <= maxHeight)
+        {
+            height = m_nextHeight++;
+        }
+        else
+        {
+            break;
+        }
+
+        state.requests[height] = now;
+        heights.push_back(height);
+    }
+
+    return heights;
+}
+
+bool BlockScheduler::delivered(const std::string& peer, int height, time_point_t now)
+{
+    auto deliverer = m_peers.find(peer);
+
+    bool bOutstanding = (m_retryHeights.erase(height) != 0);
+    for (auto& owner: m_peers)
+    {
+        PeerState& state = owner.second;
+        auto request = state.requests.find(height);
+        if (request == state.requests.end()) continue;
+
+        bOutstanding = true;
+        if (owner.first == peer)
+        {
+            double latency = seconds(now - request->second);
+            state.latency = state.delivered == 0 ? latency : LATENCY_DECAY * state.latency + (1.0 - LATENCY_DECAY) * latency;
+            state.decayedBusy = THROUGHPUT_DECAY * state.decayedBusy + seconds(now - state.lastEvent);
+            state.decayedCount = THROUGHPUT_DECAY * state.decayedCount + 1.0;
+            state.lastEvent = now;
+        }
+        state.requests.erase(request);
+    }
+
+    if (!bOutstanding) return false;
+
+    if (deliverer != m_peers.end())
+    {
+        deliverer->second.delivered++;
+        deliverer->second.bStalled = false;
+    }
+    return true;
+}
+
+std::vector<std::string> BlockScheduler::checkStalls(time_point_t now)
+{
+    double totalLatency = 0.0;
+    unsigned int measured = 0;
+    for (auto& peer: m_peers)
+    {
+        if (peer.second.delivered == 0) continue;
+        totalLatency += peer.second.latency;
+        measured++;
+    }
+
+    double timeout = std::chrono::duration<double>(m_minStallTimeout).count();
+    if (measured > 0) { timeout = std::max(timeout, STALL_FACTOR * totalLatency / measured); }
+
+    std::vector<std::string> stalledPeers;
+    for (auto& peer: m_peers)
+    {
+        PeerState& state = peer.second;
+        if (state.requests.empty()) continue;
+
+        // The peer answers in order, so if its oldest request is overdue so is everything after it.
+        time_point_t oldest = now;
+        for (auto& request: state.requests) { oldest = std::min(oldest, request.second); }
+        if (seconds(now - oldest) <= timeout) continue;
+
+        for (auto& request: state.requests) { m_retryHeights.insert(request.first); }
+        state.requests.clear();
+        state.stalls++;
+        state.bStalled = true;
+        state.decayedCount *= 0.5;
+        stalledPeers.push_back(peer.first);
+    }
+
+    return stalledPeers;
+}
+
+BlockScheduler::PeerStats BlockScheduler::getStats(const std::string& peer) const
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end()) throw std::runtime_error("BlockScheduler::getStats() - unknown peer.");
+
+    const PeerState& state = it->second;
+    PeerStats stats;
+    stats.inFlight = state.requests.size();
+    stats.window = window(state);
+    stats.delivered = state.delivered;
+    stats.stalls = state.stalls;
+    stats.latency = state.latency;
+    stats.throughput = state.throughput();
+    stats.bStalled = state.bStalled;
+    return stats;
+}
+
+std::map<std::string, BlockScheduler::PeerStats> BlockScheduler::getStats() const
+{
+    std::map<std::string, PeerStats> stats;
+    for (auto& peer: m_peers) { stats[peer.first] = getStats(peer.first); }
+    return stats;
+}
+
+unsigned int BlockScheduler::inFlight() const
+{
+    unsigned int count = 0;
+    for (auto& peer: m_peers) { count += peer.second.requests.size(); }
+    return count;
+}
+
+unsigned int BlockScheduler::window(const PeerState& state) const
+{
+    // A stalled peer is on probation until it delivers again.
+    if (state.bStalled) return 1;
+
+    double totalThroughput = 0.0;
+    unsigned int measured = 0;
+    for (auto& peer: m_peers)
+    {
+        if (peer.second.bStalled || peer.second.delivered == 0) continue;
+        totalThroughput += peer.second.throughput();
+        measured++;
+    }
+
+    // Until we know better every peer gets the same share.
+    if (state.delivered == 0 || totalThroughput <= 0.0) return m_windowPerPeer;
+
+    double share = state.throughput() / totalThroughput * m_windowPerPeer * measured;
+    return std::min(std::max((unsigned int)std::ceil(share), 1u), 2 * m_windowPerPeer);
+}
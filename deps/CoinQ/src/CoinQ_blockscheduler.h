@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_blockscheduler.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace CoinQ
+{
+    namespace Network
+    {
+
+// Decides which peer downloads which block heights when several peers share a block sync.
+// Each peer gets a window of outstanding requests sized by its share of the measured
+// throughput, so a slow peer holds on to few heights. Requests that wait too long are
+// taken back and handed to the other peers.
+class BlockScheduler
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+    typedef clock_t::time_point time_point_t;
+
+    struct PeerStats
+    {
+        unsigned int inFlight;
+        unsigned int window;
+        unsigned int delivered;
+        unsigned int stalls;
+        double latency;         // seconds from request to delivery, smoothed
+        double throughput;      // blocks per second while requests are outstanding, smoothed
+        bool bStalled;
+    };
+
+    explicit BlockScheduler(unsigned int windowPerPeer = 32, std::chrono::milliseconds minStallTimeout = std::chrono::seconds(10));
+
+    void setWindowPerPeer(unsigned int windowPerPeer) { m_windowPerPeer = windowPerPeer > 0 ? windowPerPeer : 1; }
+    unsigned int getWindowPerPeer() const { return m_windowPerPeer; }
+
+    // Forgets all outstanding requests. Heights are handed out again starting at startHeight.
+    void reset(int startHeight);
+
+    void addPeer(const std::string& peer);
+    void removePeer(const std::string& peer);   // its outstanding heights go back to the pool
+    bool hasPeer(const std::string& peer) const { return m_peers.count(peer) != 0; }
+    std::size_t peerCount() const { return m_peers.size(); }
+
+    // Heights the peer should request now, lowest first, none above maxHeight. To keep getdata
+    // messages batched nothing is handed out until at least half the peer's window is free.
+    std::vector<int> assign(const std::string& peer, int maxHeight, time_point_t now = clock_t::now());
+
+    // Returns false if the height is not outstanding with any peer, in which case it was delivered
+    // already or never requested. A late delivery of a height that was taken back still counts.
+    bool delivered(const std::string& peer, int height, time_point_t now = clock_t::now());
+
+    // Takes back requests that have been outstanding too long and returns the peers they were with.
+    std::vector<std::string> checkStalls(time_point_t now = clock_t::now());
+
+    PeerStats getStats(const std::string& peer) const;
+    std::map<std::string, PeerStats> getStats() const;
+
+    unsigned int inFlight() const;
+
+private:
+    struct PeerState
+    {
+        PeerState() : delivered(0), stalls(0), latency(0.0), decayedCount(0.0), decayedBusy(0.0), bStalled(false) { }
+
+        std::map<int, time_point_t> requests;
+        time_point_t lastEvent;
+        unsigned int delivered;
+        unsigned int stalls;
+        double latency;
+        double decayedCount;
+        double decayedBusy;
+        bool bStalled;
+
+        double throughput() const { return decayedBusy > 0.0 ? decayedCount / decayedBusy : 0.0; }
+    };
+
+    typedef std::map<std::string, PeerState> peer_map_t;
+
+    unsigned int m_windowPerPeer;
+    std::chrono::milliseconds m_minStallTimeout;
+
+    int m_nextHeight;
+    std::set<int> m_retryHeights;
+    peer_map_t m_peers;
+
+    unsigned int window(const PeerState& state) const;
+};
+
+    }
+}
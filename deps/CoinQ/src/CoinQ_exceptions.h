@@ -30,7 +30,9 @@ enum ErrorCodes
     BLOCKTREE_CHECKSUM_ERROR,
     BLOCKTREE_LOAD_INTERRUPTED,
     BLOCKTREE_UNEXPECTED_END_OF_FILE,
-    BLOCKTREE_SWAPFILE_ALREADY_EXISTS
+    BLOCKTREE_SWAPFILE_ALREADY_EXISTS,
+    BLOCKTREE_FILE_SYNC_FAILURE,
+    BLOCKTREE_JOURNAL_WRITE_FAILURE
 };
 
 // NETWORK SELECTOR EXCEPTIONS
@@ -130,5 +132,17 @@ public:
     explicit BlockTreeSwapfileAlreadyExistsException() : BlockTreeException("Blocktree swapfile already exists.", BLOCKTREE_SWAPFILE_ALREADY_EXISTS) { }
 };
 
+class BlockTreeFileSyncFailureException : public BlockTreeException
+{
+public:
+    explicit BlockTreeFileSyncFailureException() : BlockTreeException("Blocktree file sync failure.", BLOCKTREE_FILE_SYNC_FAILURE) { }
+};
+
+class BlockTreeJournalWriteFailureException : public BlockTreeException
+{
+public:
+    explicit BlockTreeJournalWriteFailureException() : BlockTreeException("Blocktree journal write failure.", BLOCKTREE_JOURNAL_WRITE_FAILURE) { }
+};
+
 }
 
@@ -31,7 +31,11 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
     m_bConnected(false),
     m_peer(m_ioService),
     m_bFlushingToFile(false),
+    m_bRevalidatingIndex(false),
     m_bHeadersSynched(false),
+    m_blockScheduler(DEFAULT_FILTERED_BLOCK_WINDOW),
+    m_nextMerkleBlockHeight(0),
+    m_stallTimer(m_ioService),
     m_bMissingTxs(false)
 {
     // Select hash functions
@@ -58,8 +62,13 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 */
 
     // Subscribe peer handlers
-    m_peer.subscribeOpen([&](CoinQ::Peer& /*peer*/)
+    m_peer.subscribeOpen([&](CoinQ::Peer& peer)
     {
+        {
+            boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+            m_blockScheduler.addPeer(peer.name());
+        }
+
         m_bConnected = true;
         notifyOpen();
         try
@@ -128,16 +137,19 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
         if (!getData.items.empty()) { m_peer.send(getData); }
     });
 
-    m_peer.subscribeTx([&](CoinQ::Peer& /*peer*/, const Coin::Transaction& tx)
+    m_peer.subscribeTx([&](CoinQ::Peer& peer, const Coin::Transaction& tx)
     {
         LOGGER(trace) << "Received transaction: " << tx.hash().getHex() << endl;
 
         boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
-        if (m_currentMerkleTxHashes.empty())
+        if (bufferMerkleTx(peer.name(), tx)) return;
+
+        // While a sync peer's block is current our peer's transactions can only be mempool transactions.
+        if (m_currentMerkleTxHashes.empty() || m_currentMerkleBlockPeer != peer.name())
         {
             {
                 boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                m_mempoolTxs.insert(tx.hash());
+                m_mempoolTxs.insert(tx.getHash());
             }
 
             syncLock.unlock();
@@ -160,12 +172,25 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
             if (headersMessage.headers.size() > 0)
             {
                 notifySynchingHeaders();
+
+                // The proof of work hash dominates insertion, especially for scrypt and X11 coins.
+                // Compute it for the whole message in parallel so only linkage and chain work are done serially.
+                const std::vector<Coin::CoinBlockHeader>& headers = headersMessage.headers;
+                std::vector<char> validProofOfWork(headers.size());
+                m_headerHashPool.parallel_for(0, headers.size(), [&](size_t i)
+                {
+                    headers[i].getHash();
+                    validProofOfWork[i] = headers[i].checkProofOfWork();
+                });
+
                 boost::unique_lock<boost::mutex> fileFlushLock(m_fileFlushMutex);
-                for (auto& item: headersMessage.headers)
+                for (size_t i = 0; i < headers.size(); i++)
                 {
+                    const Coin::CoinBlockHeader& item = headers[i];
                     try
                     {
-                        if (m_blockTree.insertHeader(item)) { m_bHeadersSynched = false; }
+                        // Only recheck the headers that failed so the tree reports them as usual.
+                        if (m_blockTree.insertHeader(item, !validProofOfWork[i])) { m_bHeadersSynched = false; }
                     }
                     catch (const std::exception& e)
                     {
@@ -177,6 +202,10 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
                         throw e;
                     }
                 }
+                fileFlushLock.unlock();
+
+                // Flushing only appends the new headers so we can afford to do it for every batch.
+                m_fileFlushCond.notify_one();
 
                 LOGGER(trace)   << "Processed " << headersMessage.headers.size() << " headers."
                                 << " mBestHeight: " << m_blockTree.getBestHeight()
@@ -238,7 +267,7 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
             {
                 if (m_currentMerkleTxHashes.empty()) break; // We got all our transactions.
 
-                if (tx.hash() == m_currentMerkleTxHashes.front())
+                if (tx.getHash() == m_currentMerkleTxHashes.front())
                 {
                     LOGGER(trace) << "New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << tx.hash().getHex() << endl;
 
@@ -247,7 +276,7 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 
                     {
                         boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                        m_mempoolTxs.erase(tx.hash());
+                        m_mempoolTxs.erase(tx.getHash());
                     }
                 }
             }
@@ -260,27 +289,15 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 
             m_bMissingTxs = false;
 
-            // Once the queue is empty, if we're at the tip signal completion of block sync.
-            uchar_vector currentMerkleBlockHash = m_currentMerkleBlock.hash();
-            const ChainHeader& chainTip = m_blockTree.getTip();
-            if (chainTip.hash() == currentMerkleBlockHash)
-            {
-                LOGGER(trace) << "Block sync detected from block handler." << endl;
-                m_lastRequestedMerkleBlockHash.clear();
-                m_lastSynchedMerkleBlockHash = currentMerkleBlockHash;
-                syncLock.unlock();
-                notifyBlocksSynched();
-                return;
-            }
-
-            // Ask for the next block
-            const ChainHeader& nextHeader = m_blockTree.getHeader(m_currentMerkleBlock.height + 1);
-            m_lastRequestedMerkleBlockHash = nextHeader.hash();
-            LOGGER(trace) << "Asking for filtered block from block handler: " << m_lastRequestedMerkleBlockHash.getHex() << std::endl;
-            
+            // Move on to the next block, or signal completion of block sync if we're at the tip.
             try
             {
-                m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
+                if (advanceMerkleBlockSync())
+                {
+                    LOGGER(trace) << "Block sync detected from block handler." << endl;
+                    syncLock.unlock();
+                    notifyBlocksSynched();
+                }
             }
             catch (const exception& e)
             {
@@ -332,41 +349,24 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
             }
 
             boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
-            if (merkleBlockHash == m_lastRequestedMerkleBlockHash)
+            if (m_requestedMerkleBlocks.count(merkleBlock.blockHeader.getHash()))
             {
-                // It's the block we requested - sync it and continue requesting the next until we're at the tip
-                const ChainHeader& merkleHeader = m_blockTree.getHeader(merkleBlockHash);
-                syncMerkleBlock(ChainMerkleBlock(merkleBlock, true, merkleHeader.height, merkleHeader.chainWork), merkleTree);
-
-                if (!m_currentMerkleTxHashes.empty()) return; // We need to wait for some transactions
-
-                if (merkleBlockHash == chainTipHash)
-                {
-                    // We're at the tip
-                    LOGGER(trace) << "Block sync detected from merkle block handler." << endl;
-                    m_lastRequestedMerkleBlockHash.clear();
-                    m_lastSynchedMerkleBlockHash = chainTipHash;
-                    syncLock.unlock();
-                    notifyBlocksSynched();
-                }
-                else
+                // It's a block we requested - sync it in height order and keep the request windows full until we're at the tip
+                try
                 {
-                    // Ask for the next block
-                    const ChainHeader& nextHeader = m_blockTree.getHeader(merkleHeader.height + 1);
-                    m_lastRequestedMerkleBlockHash = nextHeader.hash();
-                    LOGGER(trace) << "Asking for filtered block (2) " << m_lastRequestedMerkleBlockHash.getHex() << endl;
-    
-                    try
-                    {
-                        m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
-                    }
-                    catch (const exception& e)
+                    if (syncRequestedMerkleBlock(m_peer.name(), merkleBlock, merkleTree))
                     {
+                        LOGGER(trace) << "Block sync detected from merkle block handler." << endl;
                         syncLock.unlock();
-                        // TODO: propagate code
-                        notifyConnectionError(e.what(), -1);
+                        notifyBlocksSynched();
                     }
                 }
+                catch (const exception& e)
+                {
+                    syncLock.unlock();
+                    // TODO: propagate code
+                    notifyConnectionError(e.what(), -1);
+                }
             }
             else if ((merkleBlock.prevBlockHash() == chainTipHash) ||
                 (merkleBlock.prevBlockHash() == chainTip.prevBlockHash() && merkleBlock.getWork() > chainTip.getWork()))
@@ -389,7 +389,8 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
                     // We were synched prior to this block - we need to process this merkle block and we'll be synched again
                     notifySynchingBlocks();
                     const ChainHeader& merkleHeader = m_blockTree.getHeader(merkleBlockHash);
-                    syncMerkleBlock(ChainMerkleBlock(merkleBlock, true, merkleHeader.height, merkleHeader.chainWork), merkleTree);
+                    m_currentMerkleBlockPeer = m_peer.name();
+                    syncMerkleBlock(ChainMerkleBlock(merkleBlock, true, merkleHeader.height, merkleHeader.chainWork), merkleTree.getTxHashes());
                     if (m_currentMerkleTxHashes.empty())
                     {
                         m_lastSynchedMerkleBlockHash = m_blockTree.getTip().hash();
@@ -429,6 +430,7 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 NetworkSync::~NetworkSync()
 {
     stop();
+    stopIndexRevalidationThread();
 }
 
 void NetworkSync::setCoinParams(const CoinQ::CoinParams& coinParams)
@@ -442,12 +444,21 @@ void NetworkSync::setCoinParams(const CoinQ::CoinParams& coinParams)
 
 void NetworkSync::loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork, CoinQBlockTreeMem::callback_t callback)
 {
+    stopIndexRevalidationThread();
     stopFileFlushThread();
     m_blockTreeFile = blockTreeFile;
 
     try
     {
-        m_blockTree.loadFromFile(blockTreeFile, bCheckProofOfWork, callback);
+        if (m_blockTree.loadFromIndex(blockTreeFile, callback))
+        {
+            // The index was trusted so go back and check it while we get on with synching.
+            startIndexRevalidationThread(bCheckProofOfWork);
+        }
+        else
+        {
+            m_blockTree.loadFromFile(blockTreeFile, bCheckProofOfWork, callback);
+        }
 
         std::stringstream status;
         status << "Best Height: " << m_blockTree.getBestHeight() << " / " << "Total Work: " << m_blockTree.getTotalWork().getDec();
@@ -473,7 +484,7 @@ int NetworkSync::getBestHeight() const
     return m_blockTree.getBestHeight();
 }
 
-const bytes_t& NetworkSync::getBestHash() const
+bytes_t NetworkSync::getBestHash() const
 {
     return m_blockTree.getBestHash();
 }
@@ -488,14 +499,18 @@ void NetworkSync::syncBlocks(const std::vector<bytes_t>& locatorHashes, uint32_t
 
     boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
 
-    const ChainHeader* pMostRecentHeader = nullptr;
+    ChainHeader mostRecentHeader;
+    bool bFoundMostRecentHeader = false;
     for (auto& hash: locatorHashes)
     {
         try
         {
-            pMostRecentHeader = &m_blockTree.getHeader(hash);
-            if (pMostRecentHeader && pMostRecentHeader->inBestChain) break;
-            pMostRecentHeader = nullptr;
+            mostRecentHeader = m_blockTree.getHeader(hash);
+            if (mostRecentHeader.inBestChain)
+            {
+                bFoundMostRecentHeader = true;
+                break;
+            }
         }
         catch (const std::exception& e)
         {
@@ -506,17 +521,17 @@ void NetworkSync::syncBlocks(const std::vector<bytes_t>& locatorHashes, uint32_t
     }
 
 
-    if (pMostRecentHeader)
+    if (bFoundMostRecentHeader)
     {
-        if (m_blockTree.getTipHeight() == pMostRecentHeader->height)
+        if (m_blockTree.getTipHeight() == mostRecentHeader.height)
         {
-            m_lastSynchedMerkleBlockHash = pMostRecentHeader->hash();
+            m_lastSynchedMerkleBlockHash = mostRecentHeader.hash();
             notifyBlocksSynched();
             return;
         } 
         else
         {
-            startHeight = pMostRecentHeader->height + 1;
+            startHeight = mostRecentHeader.height + 1;
         }
     }
     else
@@ -536,19 +551,233 @@ void NetworkSync::syncBlocks(int startHeight)
 void NetworkSync::do_syncBlocks(int startHeight)
 {
     m_lastSynchedMerkleBlockHash.clear();
+    clearMerkleBlockWindow();
+    while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
+    m_bMissingTxs = false;
+    m_nextMerkleBlockHeight = startHeight;
+    m_blockScheduler.reset(startHeight);
     m_lastRequestedMerkleBlockHash = m_blockTree.getHeader(startHeight).hash();
 
-    LOGGER(trace) "Resynching blocks " << startHeight << " - " << m_blockTree.getTipHeight() << endl;
+    LOGGER(trace) << "Resynching blocks " << startHeight << " - " << m_blockTree.getTipHeight() << endl;
     notifySynchingBlocks();
 
-    LOGGER(trace) << "Asking for filtered block (3) " << m_lastRequestedMerkleBlockHash.getHex() << endl;
-    m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
+    // Sync peers that were behind us when they connected might have caught up by now.
+    for (auto& peer: m_syncPeers)
+    {
+        if (!m_blockScheduler.hasPeer(peer->name())) { peer->getHeaders(m_blockTree.getLocatorHashes(-1)); }
+    }
+
+    requestMerkleBlocks();
+    startStallTimer();
+}
+
+void NetworkSync::requestMerkleBlocks()
+{
+    // Keep whatever is buffered or in flight within one window per peer of the next block to process.
+    int peerCount = std::max<int>(m_blockScheduler.peerCount(), 1);
+    int maxHeight = std::min(m_blockTree.getTipHeight(), m_nextMerkleBlockHeight + (int)m_blockScheduler.getWindowPerPeer() * peerCount - 1);
+
+    requestMerkleBlocks(m_peer, maxHeight);
+    for (auto& peer: m_syncPeers) { requestMerkleBlocks(*peer, maxHeight); }
+}
+
+void NetworkSync::requestMerkleBlocks(CoinQ::Peer& peer, int maxHeight)
+{
+    std::vector<int> heights = m_blockScheduler.assign(peer.name(), maxHeight);
+    if (heights.empty()) return;
+
+    hashvector_t hashes;
+    for (int height: heights)
+    {
+        m_lastRequestedMerkleBlockHash = m_blockTree.getHeader(height).hash();
+        m_requestedMerkleBlocks[hash256_t(m_lastRequestedMerkleBlockHash, Coin::LittleEndian())] = height;
+        hashes.push_back(m_lastRequestedMerkleBlockHash);
+    }
+
+    LOGGER(trace) << "Asking " << peer.name() << " for " << hashes.size() << " filtered blocks from height " << heights.front() << endl;
+    peer.getFilteredBlocks(hashes);
+}
+
+void NetworkSync::clearMerkleBlockWindow()
+{
+    m_lastRequestedMerkleBlockHash.clear();
+    m_requestedMerkleBlocks.clear();
+    m_bufferedMerkleBlocks.clear();
+    m_bufferingMerkleBlockHeights.clear();
+}
+
+// Reclaims block requests from peers that have stopped delivering and hands them to the others.
+void NetworkSync::startStallTimer()
+{
+    m_stallTimer.expires_from_now(boost::posix_time::seconds(1));
+    m_stallTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec == boost::asio::error::operation_aborted) return;
+
+        // The primary peer is kept on probation but sync peers that stall are dropped.
+        // They must be stopped without the lock since their close handler takes it.
+        std::vector<std::shared_ptr<CoinQ::Peer>> stalledPeers;
+        {
+            boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+            if (!m_bConnected || m_lastRequestedMerkleBlockHash.empty()) return;
+
+            for (auto& peerName: m_blockScheduler.checkStalls())
+            {
+                LOGGER(debug) << "NetworkSync - " << peerName << " stalled during block sync. Reassigning its blocks." << endl;
+                for (auto& peer: m_syncPeers)
+                {
+                    if (peer->name() == peerName) { stalledPeers.push_back(peer); }
+                }
+            }
+
+            try
+            {
+                requestMerkleBlocks();
+            }
+            catch (const exception& e)
+            {
+                LOGGER(error) << "NetworkSync stall timer - " << e.what() << endl;
+            }
+
+            startStallTimer();
+        }
+
+        for (auto& peer: stalledPeers)
+        {
+            notifyStatus(std::string("Sync peer ") + peer->name() + " stalled. Disconnecting.");
+            peer->stop();
+        }
+    });
+}
+
+// Called with m_syncMutex held for a merkle block we asked some peer for.
+// Returns true if block sync is complete.
+bool NetworkSync::syncRequestedMerkleBlock(const std::string& peerName, const Coin::MerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree)
+{
+    const uchar_vector& merkleBlockHash = merkleBlock.hash();
+    auto requested = m_requestedMerkleBlocks.find(merkleBlock.blockHeader.getHash());
+    if (requested == m_requestedMerkleBlocks.end()) return false;
+
+    int height = requested->second;
+    m_requestedMerkleBlocks.erase(requested);
+    if (!m_blockScheduler.delivered(peerName, height)) return false;
+
+    // Any transactions for this peer's previous merkle block have arrived by now.
+    m_bufferingMerkleBlockHeights.erase(peerName);
+
+    const ChainHeader& merkleHeader = m_blockTree.getHeader(merkleBlockHash);
+    ChainMerkleBlock chainMerkleBlock(merkleBlock, true, merkleHeader.height, merkleHeader.chainWork);
+    if (height != m_nextMerkleBlockHeight || !m_currentMerkleTxHashes.empty())
+    {
+        LOGGER(trace) << "Buffering merkle block " << merkleBlockHash.getHex() << " height: " << height << " from " << peerName << endl;
+        BufferedMerkleBlock& buffered = m_bufferedMerkleBlocks[height];
+        buffered.merkleBlock = chainMerkleBlock;
+        buffered.reversedTxHashes = merkleTree.getTxHashes();
+        for (auto& reversedTxHash: buffered.reversedTxHashes) { buffered.txHashes.insert(reversedTxHash); }
+        if (!buffered.txHashes.empty()) { m_bufferingMerkleBlockHeights[peerName] = height; }
+
+        if (m_currentMerkleTxHashes.empty() || peerName != m_currentMerkleBlockPeer) return false; // An earlier block is still in flight
+
+        // The peer has moved on so whatever the current block still lacks is not coming as a tx message.
+        processMempoolConfirmations();
+        if (!m_currentMerkleTxHashes.empty())
+        {
+            requestCurrentBlock();
+            return false;
+        }
+    }
+    else
+    {
+        m_currentMerkleBlockPeer = peerName;
+        syncMerkleBlock(chainMerkleBlock, merkleTree.getTxHashes());
+        if (!m_currentMerkleTxHashes.empty()) return false; // We need to wait for some transactions
+    }
+
+    return advanceMerkleBlockSync();
+}
+
+// Called with m_syncMutex held. Keeps transactions that follow a merkle block which arrived ahead of its turn.
+bool NetworkSync::bufferMerkleTx(const std::string& peerName, const Coin::Transaction& tx)
+{
+    auto buffering = m_bufferingMerkleBlockHeights.find(peerName);
+    if (buffering == m_bufferingMerkleBlockHeights.end()) return false;
+
+    auto buffered = m_bufferedMerkleBlocks.find(buffering->second);
+    if (buffered == m_bufferedMerkleBlocks.end() || !buffered->second.txHashes.count(tx.getHash())) return false;
+
+    buffered->second.txs.push_back(tx);
+    return true;
+}
+
+// Called with m_syncMutex held once the current merkle block has all its transactions. Hands out
+// any buffered blocks that are now next in line and refills the request windows.
+// Returns true if the current block is the tip, in which case block sync is complete.
+bool NetworkSync::advanceMerkleBlockSync()
+{
+    while (m_currentMerkleTxHashes.empty())
+    {
+        uchar_vector currentMerkleBlockHash = m_currentMerkleBlock.hash();
+        if (m_blockTree.getTip().hash() == currentMerkleBlockHash)
+        {
+            clearMerkleBlockWindow();
+            m_blockScheduler.reset(m_currentMerkleBlock.height + 1);
+            m_lastSynchedMerkleBlockHash = currentMerkleBlockHash;
+            return true;
+        }
+
+        m_nextMerkleBlockHeight = m_currentMerkleBlock.height + 1;
+
+        auto it = m_bufferedMerkleBlocks.find(m_nextMerkleBlockHeight);
+        if (it == m_bufferedMerkleBlocks.end())
+        {
+            requestMerkleBlocks();
+            return false;
+        }
+
+        BufferedMerkleBlock buffered = std::move(it->second);
+        m_bufferedMerkleBlocks.erase(it);
+
+        // Unless the peer that sent it is still sending its transactions they are all here.
+        bool bTxsComplete = true;
+        m_currentMerkleBlockPeer.clear();
+        for (auto& buffering: m_bufferingMerkleBlockHeights)
+        {
+            if (buffering.second != m_nextMerkleBlockHeight) continue;
+            bTxsComplete = false;
+            m_currentMerkleBlockPeer = buffering.first;
+            m_bufferingMerkleBlockHeights.erase(buffering.first);
+            break;
+        }
+
+        if (!m_blockTree.getHeader(buffered.merkleBlock.hash()).inBestChain)
+        {
+            // A reorg happened while the block was in flight - request everything from here again.
+            LOGGER(trace) << "Discarding merkle block window after reorg at height " << m_nextMerkleBlockHeight << endl;
+            m_requestedMerkleBlocks.clear();
+            m_bufferedMerkleBlocks.clear();
+            m_bufferingMerkleBlockHeights.clear();
+            m_blockScheduler.reset(m_nextMerkleBlockHeight);
+            requestMerkleBlocks();
+            return false;
+        }
+
+        syncMerkleBlock(buffered.merkleBlock, buffered.reversedTxHashes);
+        for (auto& tx: buffered.txs)
+        {
+            if (!processMerkleTx(tx)) break;
+        }
+
+        if (bTxsComplete && !m_currentMerkleTxHashes.empty()) { requestCurrentBlock(); }
+    }
+
+    requestMerkleBlocks();
+    return false;
 }
 
 void NetworkSync::stopSynchingBlocks(bool bClearFilter)
 {
     boost::lock_guard<boost::mutex> lock(m_syncMutex);
-    m_lastRequestedMerkleBlockHash.clear();
+    clearMerkleBlockWindow();
     m_lastSynchedMerkleBlockHash.clear();
     if (bClearFilter) { clearBloomFilter(); }
 }
@@ -556,14 +785,14 @@ void NetworkSync::stopSynchingBlocks(bool bClearFilter)
 void NetworkSync::addToMempool(const uchar_vector& txHash)
 {
     boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-    m_mempoolTxs.insert(txHash);
+    m_mempoolTxs.insert(hash256_t(txHash, Coin::LittleEndian()));
 }
 
 void NetworkSync::insertTx(const Coin::Transaction& tx)
 {
     {
         boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-        m_mempoolTxs.insert(tx.hash());
+        m_mempoolTxs.insert(tx.getHash());
     }
 
     notifyNewTx(tx);
@@ -599,7 +828,7 @@ void NetworkSync::insertMerkleBlock(const Coin::MerkleBlock& merkleBlock, const
 
             {
                 boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                m_mempoolTxs.erase(tx.hash());
+                m_mempoolTxs.erase(tx.getHash());
             }
         }
     }
@@ -624,6 +853,9 @@ void NetworkSync::start(const std::string& host, const std::string& port)
         LOGGER(trace) << "Starting peer " << host << ":" << port_ << "..." << endl;
         m_peer.start();
         LOGGER(trace) << "Peer started." << endl;
+
+        boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+        for (auto& peer: m_syncPeers) { peer->start(); }
     }
 
     notifyStarted();
@@ -645,18 +877,194 @@ void NetworkSync::stop()
 
         m_bConnected = false;
         m_peer.stop();
+
+        // Their close handlers take the sync lock.
+        std::vector<std::shared_ptr<CoinQ::Peer>> syncPeers;
+        {
+            boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+            syncPeers = m_syncPeers;
+        }
+        for (auto& peer: syncPeers) { peer->stop(); }
+
         stopIOServiceThread();
         stopFileFlushThread();
+        m_stallTimer.cancel();
 
         m_bStarted = false;
         m_bHeadersSynched = false;
-        m_lastRequestedMerkleBlockHash.clear();
+        m_blockScheduler.removePeer(m_peer.name());
+        clearMerkleBlockWindow();
         while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
     }
 
     notifyStopped();
 }
 
+void NetworkSync::setFilteredBlockWindow(unsigned int window)
+{
+    boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+    m_blockScheduler.setWindowPerPeer(window);
+}
+
+unsigned int NetworkSync::getFilteredBlockWindow() const
+{
+    boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+    return m_blockScheduler.getWindowPerPeer();
+}
+
+void NetworkSync::addSyncPeer(const std::string& host, const std::string& port)
+{
+    std::string port_ = port.empty() ? m_coinParams.default_port() : port;
+    std::shared_ptr<CoinQ::Peer> syncPeer(new CoinQ::Peer(m_ioService));
+    syncPeer->set(host, port_, m_coinParams.magic_bytes(), m_coinParams.protocol_version(), "Wallet v0.1", 0, false);
+
+    syncPeer->subscribeOpen([this](CoinQ::Peer& peer)
+    {
+        LOGGER(trace) << "Sync peer " << peer.name() << " connection opened." << endl;
+        try
+        {
+            if (m_bloomFilter.isSet())
+            {
+                Coin::FilterLoadMessage filterLoad(m_bloomFilter.getNHashFuncs(), m_bloomFilter.getNTweak(), m_bloomFilter.getNFlags(), m_bloomFilter.getFilter());
+                peer.send(filterLoad);
+            }
+
+            // Its answer tells us whether it agrees with our best chain.
+            peer.getHeaders(m_blockTree.getLocatorHashes(-1));
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << "NetworkSync - sync peer open handler - " << e.what() << std::endl;
+        }
+    });
+
+    syncPeer->subscribeHeaders([this](CoinQ::Peer& peer, const Coin::HeadersMessage& headersMessage)
+    {
+        checkSyncPeerHeaders(peer, headersMessage);
+    });
+
+    syncPeer->subscribeMerkleBlock([this](CoinQ::Peer& peer, const Coin::MerkleBlock& merkleBlock)
+    {
+        if (!m_bConnected) return;
+
+        try
+        {
+            // Constructing the partial tree will validate the merkle root - throws exception if invalid.
+            Coin::PartialMerkleTree merkleTree(merkleBlock.merkleTree());
+
+            boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
+            if (syncRequestedMerkleBlock(peer.name(), merkleBlock, merkleTree))
+            {
+                LOGGER(trace) << "Block sync detected from sync peer " << peer.name() << "." << endl;
+                syncLock.unlock();
+                notifyBlocksSynched();
+            }
+        }
+        catch (const exception& e)
+        {
+            LOGGER(error) << "NetworkSync - sync peer " << peer.name() << " merkle block error: " << e.what() << std::endl;
+        }
+    });
+
+    syncPeer->subscribeTx([this](CoinQ::Peer& peer, const Coin::Transaction& tx)
+    {
+        boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
+        if (bufferMerkleTx(peer.name(), tx)) return;
+
+        // Sync peers do not relay, so anything else belongs to the block they sent last.
+        if (m_currentMerkleTxHashes.empty() || m_bMissingTxs || m_currentMerkleBlockPeer != peer.name()) return;
+        syncLock.unlock();
+        processBlockTx(tx);
+    });
+
+    syncPeer->subscribeClose([this](CoinQ::Peer& peer)
+    {
+        removeSyncPeer(peer);
+    });
+
+    {
+        boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+        for (auto& peer: m_syncPeers)
+        {
+            if (peer->name() == syncPeer->name()) throw runtime_error("NetworkSync::addSyncPeer() - peer already added.");
+        }
+        m_syncPeers.push_back(syncPeer);
+    }
+
+    LOGGER(trace) << "Added sync peer " << syncPeer->name() << endl;
+    if (m_bStarted) { syncPeer->start(); }
+}
+
+std::map<std::string, BlockScheduler::PeerStats> NetworkSync::getSyncPeerStats() const
+{
+    boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+    return m_blockScheduler.getStats();
+}
+
+void NetworkSync::checkSyncPeerHeaders(CoinQ::Peer& peer, const Coin::HeadersMessage& headersMessage)
+{
+    // The peer answers our locator with the headers following the last block we have in common.
+    // It agrees with our best chain if the first header we don't have builds on our tip.
+    const std::vector<Coin::CoinBlockHeader>& headers = headersMessage.headers;
+    size_t i = 0;
+    while (i < headers.size() && m_blockTree.hasHeader(headers[i].hash()) && m_blockTree.getHeader(headers[i].hash()).inBestChain) { i++; }
+
+    if (!headers.empty() && i == headers.size())
+    {
+        // It has yet to see our tip. We check again when the next block sync starts.
+        LOGGER(debug) << "Sync peer " << peer.name() << " is behind our best chain." << endl;
+        return;
+    }
+
+    if (i < headers.size() && headers[i].prevBlockHash() != m_blockTree.getTip().hash())
+    {
+        std::stringstream status;
+        status << "Sync peer " << peer.name() << " is on a different chain. Disconnecting.";
+        LOGGER(error) << status.str() << endl;
+        notifyStatus(status.str());
+        peer.stop();
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+    if (m_blockScheduler.hasPeer(peer.name())) return;
+
+    LOGGER(trace) << "Sync peer " << peer.name() << " agrees with our best chain." << endl;
+    m_blockScheduler.addPeer(peer.name());
+    if (m_lastRequestedMerkleBlockHash.empty()) return;
+
+    try
+    {
+        requestMerkleBlocks();
+    }
+    catch (const exception& e)
+    {
+        LOGGER(error) << "NetworkSync - sync peer headers handler - " << e.what() << endl;
+    }
+}
+
+void NetworkSync::removeSyncPeer(CoinQ::Peer& peer)
+{
+    boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+    if (!m_blockScheduler.hasPeer(peer.name())) return;
+
+    LOGGER(trace) << "Sync peer " << peer.name() << " closed." << endl;
+    m_blockScheduler.removePeer(peer.name());
+    m_bufferingMerkleBlockHeights.erase(peer.name());
+    if (!m_bConnected || m_lastRequestedMerkleBlockHash.empty()) return;
+
+    // Whatever it still owed us goes to the remaining peers.
+    try
+    {
+        if (m_currentMerkleBlockPeer == peer.name() && !m_currentMerkleTxHashes.empty()) { requestCurrentBlock(); }
+        requestMerkleBlocks();
+    }
+    catch (const exception& e)
+    {
+        LOGGER(error) << "NetworkSync - sync peer close handler - " << e.what() << endl;
+    }
+}
+
 void NetworkSync::sendTx(Coin::Transaction& tx)
 {
     m_peer.send(tx); 
@@ -691,6 +1099,7 @@ void NetworkSync::setBloomFilter(const Coin::BloomFilter& bloomFilter)
     LOGGER(trace) << "Sending new bloom filter to peer." << endl;
     Coin::FilterLoadMessage filterLoad(m_bloomFilter.getNHashFuncs(), m_bloomFilter.getNTweak(), m_bloomFilter.getNFlags(), m_bloomFilter.getFilter());
     m_peer.send(filterLoad);
+    for (auto& peer: m_syncPeers) { peer->send(filterLoad); }
 }
 
 void NetworkSync::clearBloomFilter()
@@ -698,6 +1107,7 @@ void NetworkSync::clearBloomFilter()
     LOGGER(trace) << "Clearing bloom filter." << endl;
     Coin::FilterClearMessage filterClear;
     m_peer.send(filterClear);
+    for (auto& peer: m_syncPeers) { peer->send(filterClear); }
 }
 
 void NetworkSync::startIOServiceThread()
@@ -790,15 +1200,136 @@ void NetworkSync::fileFlushLoop()
     }
 }
 
-void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree)
+void NetworkSync::startIndexRevalidationThread(bool bCheckProofOfWork)
+{
+    if (m_bRevalidatingIndex) throw std::runtime_error("NetworkSync - index revalidation thread already started.");
+    boost::unique_lock<boost::mutex> lock(m_revalidateIndexMutex);
+    if (m_bRevalidatingIndex) throw std::runtime_error("NetworkSync - index revalidation thread already started.");
+
+    LOGGER(trace) << "Starting index revalidation thread..." << endl;
+    m_bRevalidatingIndex = true;
+    m_revalidateIndexThread = boost::thread(&NetworkSync::revalidateIndex, this, bCheckProofOfWork);
+}
+
+void NetworkSync::stopIndexRevalidationThread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_revalidateIndexMutex);
+        m_bRevalidatingIndex = false;
+    }
+
+    if (m_revalidateIndexThread.joinable())
+    {
+        m_revalidateIndexThread.join();
+        LOGGER(trace) << "Index revalidation thread stopped." << endl;
+    }
+}
+
+void NetworkSync::revalidateIndex(bool bCheckProofOfWork)
+{
+    int badHeight;
+    try
+    {
+        badHeight = CoinQBlockTreeMem::revalidateIndex(m_blockTreeFile, bCheckProofOfWork, [this]()
+        {
+            boost::unique_lock<boost::mutex> lock(m_revalidateIndexMutex);
+            return m_bRevalidatingIndex;
+        });
+    }
+    catch (const exception& e)
+    {
+        LOGGER(error) << "Blocktree index revalidation error: " << e.what() << endl;
+        return;
+    }
+
+    if (badHeight < 0)
+    {
+        LOGGER(trace) << "Blocktree index revalidation finished." << endl;
+        return;
+    }
+
+    std::stringstream err;
+    err << "Blocktree index failed revalidation at height " << badHeight << ". Reloading blocktree file..."; // TODO: localization
+    LOGGER(error) << err.str() << endl;
+    notifyBlockTreeError(err.str(), -1);
+
+    // The peer handlers read the tree without a lock, so the reload is queued behind them on the
+    // io service rather than done here. If sync is not running it happens once sync starts.
+    std::string blockTreeFile = m_blockTreeFile;
+    m_ioService.post([this, blockTreeFile, bCheckProofOfWork]() { reloadBlockTree(blockTreeFile, bCheckProofOfWork); });
+}
+
+void NetworkSync::reloadBlockTree(const std::string& blockTreeFile, bool bCheckProofOfWork)
+{
+    // A later loadHeaders already replaced the tree we were going to reload.
+    if (blockTreeFile != m_blockTreeFile) return;
+
+    LOGGER(trace) << "NetworkSync::reloadBlockTree(" << blockTreeFile << ")" << endl;
+
+    // The io service thread covers the peer handlers. The sync lock also keeps out block sync
+    // calls made from other threads.
+    std::string error;
+    {
+        boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+
+        // Requested and buffered merkle blocks refer to heights in the old tree. Block sync restarts
+        // once headers are synched again.
+        clearMerkleBlockWindow();
+        while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
+
+        // The tree we loaded cannot be trusted. Drop the index and do a full load from the blocktree file.
+        boost::lock_guard<boost::mutex> fileFlushLock(m_fileFlushMutex);
+        CoinQBlockTreeMem::removeIndex(blockTreeFile);
+        try
+        {
+            m_blockTree.loadFromFile(blockTreeFile, bCheckProofOfWork);
+        }
+        catch (const exception& e)
+        {
+            error = e.what();
+            m_blockTree.clear();
+            m_blockTree.setGenesisBlock(m_coinParams.genesis_block());
+        }
+    }
+
+    if (!error.empty())
+    {
+        LOGGER(error) << "NetworkSync::reloadBlockTree() - " << error << endl;
+        notifyBlockTreeError(error, -1);
+    }
+
+    m_bHeadersSynched = false;
+    notifyBlockTreeChanged();
+    notifyAddBestChain(m_blockTree.getHeader(-1));
+
+    if (!m_bConnected) return;
+
+    // Fetch whatever the reloaded tree is missing.
+    std::vector<std::shared_ptr<CoinQ::Peer>> syncPeers;
+    {
+        boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
+        syncPeers = m_syncPeers;
+    }
+
+    try
+    {
+        m_peer.getHeaders(m_blockTree.getLocatorHashes(-1));
+        for (auto& peer: syncPeers) { peer->getHeaders(m_blockTree.getLocatorHashes(-1)); }
+    }
+    catch (const exception& e)
+    {
+        LOGGER(error) << "NetworkSync::reloadBlockTree() - " << e.what() << endl;
+    }
+}
+
+void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const std::list<uchar_vector>& reversedTxHashes)
 {
     LOGGER(trace) << "Synchronizing merkle block: " << merkleBlock.hash().getHex() << " height: " << merkleBlock.height << endl;
 
     while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
+    m_currentMerkleBlock = merkleBlock;
 
     // The byte order of the tx hashes must be reversed when moving between merkle trees and the block chain
-    const std::list<uchar_vector>& reversedTxHashes = merkleTree.getTxHashes();
-
     if (reversedTxHashes.empty())
     {
         notifyMerkleBlock(merkleBlock);
@@ -807,15 +1338,14 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
 
     m_currentMerkleTxCount = reversedTxHashes.size();
     int i = 0;
-    for (auto& reversedTxHash: merkleTree.getTxHashes())
+    for (auto& reversedTxHash: reversedTxHashes)
     {
-        uchar_vector txHash = reversedTxHash.getReverse();
+        hash256_t txHash(reversedTxHash);
         m_currentMerkleTxHashes.push(txHash);
-        LOGGER(trace) << "  Added tx to queue (" << ++i << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
+        LOGGER(trace) << "  Added tx to queue (" << ++i << " of " << m_currentMerkleTxCount << "): " << txHash.littleEndian().getHex() << endl;
     }
     
     // Set up merkle confirmation state
-    m_currentMerkleBlock = merkleBlock;
     m_currentMerkleTxIndex = 0;
 
     // Confirm any transactions already in our mempool before letting tx handler do anything
@@ -824,70 +1354,23 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
 
 void NetworkSync::processBlockTx(const Coin::Transaction& tx)
 {
-    string txHashHex = tx.hash().getHex();
-    LOGGER(trace) << "NetworkSync::processBlockTx(" << txHashHex << ")" << endl;
+    LOGGER(trace) << "NetworkSync::processBlockTx(" << tx.hash().getHex() << ")" << endl;
     try
     {
         boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
 
-        // Notify of confirmations of previously received transactions as well as the current one
-        processMempoolConfirmations();
-        if (!m_currentMerkleTxHashes.empty())
+        try
         {
-            if (tx.hash() == m_currentMerkleTxHashes.front())
-            {
-                LOGGER(trace) << "NetworkSync::processBlockTx - New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHashHex << endl;
-                notifyMerkleTx(m_currentMerkleBlock, tx, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
-                m_currentMerkleTxHashes.pop();
-            }
-            else if ((!m_lastRequestedMerkleBlockHash.empty()) && (m_lastRequestedBlockHash != m_lastRequestedMerkleBlockHash))
-            {
-                m_bMissingTxs = true;
-                m_lastRequestedBlockHash = m_lastRequestedMerkleBlockHash;
-                LOGGER(trace) << "We are missing some transactions in the mempool - perhaps due to reorg." << endl;
-                LOGGER(trace) << "Asking for block " << m_lastRequestedBlockHash.getHex() << endl;
-                try
-                {
-                    m_peer.getBlock(m_lastRequestedBlockHash);
-                    LOGGER(debug) << "Got block " << m_lastRequestedBlockHash.getHex() << endl;
-                }
-                catch (const exception& e)
-                {
-                    m_lastRequestedBlockHash.clear();
-                    // TODO: Propagate code
-                    syncLock.unlock();
-                    notifyConnectionError(e.what(), -1);
-                }
+            if (!processMerkleTx(tx) || !m_currentMerkleTxHashes.empty()) return; // we're still missing transactions
 
-                return;
+            // Once the queue is empty, move on to the next block or signal completion of block sync if we're at the tip.
+            if (advanceMerkleBlockSync())
+            {
+                LOGGER(trace) << "Block sync detected from tx handler." << endl;
+                syncLock.unlock();
+                notifyBlocksSynched();
             }
         }
-        processMempoolConfirmations();
-
-        if (!m_currentMerkleTxHashes.empty()) return; // we're still missing transactions
-
-        // Once the queue is empty, if we're at the tip signal completion of block sync.
-        uchar_vector currentMerkleBlockHash = m_currentMerkleBlock.hash();
-        const ChainHeader& chainTip = m_blockTree.getTip();
-        if (chainTip.hash() == currentMerkleBlockHash)
-        {
-            LOGGER(trace) << "Block sync detected from tx handler." << endl;
-            m_lastRequestedMerkleBlockHash.clear();
-            m_lastSynchedMerkleBlockHash = currentMerkleBlockHash;
-            syncLock.unlock();
-            notifyBlocksSynched();
-            return;
-        }
-
-        // Ask for the next block
-        const ChainHeader& nextHeader = m_blockTree.getHeader(m_currentMerkleBlock.height + 1);
-        m_lastRequestedMerkleBlockHash = nextHeader.hash();
-        LOGGER(trace) << "Asking for filtered block (1) " << m_lastRequestedMerkleBlockHash.getHex() << std::endl;
-        
-        try
-        {
-            m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
-        }
         catch (const exception& e)
         {
             // TODO: Propagate code
@@ -903,16 +1386,61 @@ void NetworkSync::processBlockTx(const Coin::Transaction& tx)
     }
 }
 
+// Matches a transaction against the current merkle block. Returns false if it was not the one we
+// expected and we had to ask for the whole block instead. Must be called with m_syncMutex held.
+bool NetworkSync::processMerkleTx(const Coin::Transaction& tx)
+{
+    // Notify of confirmations of previously received transactions as well as the current one
+    processMempoolConfirmations();
+    if (!m_currentMerkleTxHashes.empty())
+    {
+        if (tx.getHash() == m_currentMerkleTxHashes.front())
+        {
+            LOGGER(trace) << "NetworkSync::processMerkleTx - New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << tx.hash().getHex() << endl;
+            notifyMerkleTx(m_currentMerkleBlock, tx, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
+            m_currentMerkleTxHashes.pop();
+        }
+        else if (!m_lastRequestedMerkleBlockHash.empty() && m_lastRequestedBlockHash != m_currentMerkleBlock.hash())
+        {
+            LOGGER(trace) << "We are missing some transactions in the mempool - perhaps due to reorg." << endl;
+            requestCurrentBlock();
+            return false;
+        }
+    }
+    processMempoolConfirmations();
+    return true;
+}
+
+// Falls back to the full block when transactions of the current merkle block did not arrive.
+void NetworkSync::requestCurrentBlock()
+{
+    if (m_bMissingTxs) return;
+
+    m_bMissingTxs = true;
+    m_lastRequestedBlockHash = m_currentMerkleBlock.hash();
+    LOGGER(trace) << "Asking for block " << m_lastRequestedBlockHash.getHex() << endl;
+    try
+    {
+        m_peer.getBlock(m_lastRequestedBlockHash);
+    }
+    catch (const exception& e)
+    {
+        m_bMissingTxs = false;
+        m_lastRequestedBlockHash.clear();
+        throw;
+    }
+}
+
 void NetworkSync::processMempoolConfirmations()
 {
     boost::unique_lock<boost::mutex> mempoolLock(m_mempoolMutex);
     LOGGER(trace) << "Confirming " << m_currentMerkleTxHashes.size() << " merkle block transactions from " << m_mempoolTxs.size() << " mempool transactions..." << endl;
     while (!m_currentMerkleTxHashes.empty() && m_mempoolTxs.count(m_currentMerkleTxHashes.front()))
     {
-        const uchar_vector& txHash = m_currentMerkleTxHashes.front();
-        LOGGER(trace) << "  Confirming tx (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
+        const hash256_t& txHash = m_currentMerkleTxHashes.front();
+        LOGGER(trace) << "  Confirming tx (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHash.littleEndian().getHex() << endl;
         mempoolLock.unlock();
-        notifyTxConfirmed(m_currentMerkleBlock, txHash, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
+        notifyTxConfirmed(m_currentMerkleBlock, txHash.littleEndian(), m_currentMerkleTxIndex++, m_currentMerkleTxCount);
 
         mempoolLock.lock();
         m_mempoolTxs.erase(txHash);
@@ -16,18 +16,28 @@
 #include "CoinQ_blocks.h"
 #include "CoinQ_filter.h"
 
+#include "CoinQ_blockscheduler.h"
 #include "CoinQ_signals.h"
 #include "CoinQ_slots.h"
 
 #include <boost/thread.hpp>
 
+#include <sysutils/threadpool.h>
+
 #include "CoinQ_typedefs.h"
 #include "CoinQ_coinparams.h"
 
 #include <CoinCore/typedefs.h>
 #include <CoinCore/BloomFilter.h>
+#include <CoinCore/hashtypes.h>
 
 #include <queue>
+#include <map>
+#include <set>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 typedef Coin::Transaction coin_tx_t;
 typedef ChainHeader chain_header_t;
@@ -50,6 +60,9 @@ typedef std::function<void(const ChainMerkleBlock&, const bytes_t& /*txhash*/ ,
 class NetworkSync
 {
 public:
+    // Filtered blocks each peer is asked for ahead of the one being processed during block sync
+    enum { DEFAULT_FILTERED_BLOCK_WINDOW = 32 };
+
     NetworkSync(const CoinQ::CoinParams& coinParams = CoinQ::getBitcoinParams(), bool bCheckProofOfWork = false);
     ~NetworkSync();
 
@@ -58,14 +71,19 @@ public:
 
     void enableCheckProofOfWork(bool bCheckProofOfWork = true) { m_bCheckProofOfWork = bCheckProofOfWork; }
 
+    // Takes effect on the next request. A window of 1 fetches one block per round trip.
+    // With several peers this is the starting share of each, which then follows its measured throughput.
+    void setFilteredBlockWindow(unsigned int window);
+    unsigned int getFilteredBlockWindow() const;
+
     void loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork = true, CoinQBlockTreeMem::callback_t callback = nullptr);
     bool headersSynched() const { return m_bHeadersSynched; }
     int getBestHeight() const;
-    const bytes_t& getBestHash() const;
-    const ChainHeader& getBestHeader() const { return m_blockTree.getHeader(-1); }
-    const ChainHeader& getHeader(const bytes_t& hash) const { return m_blockTree.getHeader(hash); }
-    const ChainHeader& getHeader(int height) const { return m_blockTree.getHeader(height); }
-    const ChainHeader& getHeaderBefore(uint32_t timestamp) const { return m_blockTree.getHeaderBefore(timestamp); }
+    bytes_t getBestHash() const;
+    ChainHeader getBestHeader() const { return m_blockTree.getHeader(-1); }
+    ChainHeader getHeader(const bytes_t& hash) const { return m_blockTree.getHeader(hash); }
+    ChainHeader getHeader(int height) const { return m_blockTree.getHeader(height); }
+    ChainHeader getHeaderBefore(uint32_t timestamp) const { return m_blockTree.getHeaderBefore(timestamp); }
 
 /*
     void start();
@@ -77,6 +95,11 @@ public:
     void stop();
     bool connected() const { return m_bConnected; }
 
+    // Extra peers that share the block download during block sync. Each one's headers are checked
+    // against our best chain when it connects and it is only given blocks if they agree.
+    void addSyncPeer(const std::string& host, const std::string& port = "");
+    std::map<std::string, BlockScheduler::PeerStats> getSyncPeerStats() const;
+
     void setBloomFilter(const Coin::BloomFilter& bloomFilter);
     void clearBloomFilter();
 
@@ -146,6 +169,10 @@ private:
     bool m_bConnected;
     CoinQ::Peer m_peer;
 
+    std::vector<std::shared_ptr<CoinQ::Peer>> m_syncPeers;
+    void checkSyncPeerHeaders(CoinQ::Peer& peer, const Coin::HeadersMessage& headersMessage);
+    void removeSyncPeer(CoinQ::Peer& peer);
+
     bool m_bFlushingToFile;
     boost::mutex m_fileFlushMutex;
     boost::condition_variable m_fileFlushCond;
@@ -154,6 +181,19 @@ private:
     void stopFileFlushThread();
     void fileFlushLoop();
 
+    bool m_bRevalidatingIndex;
+    boost::mutex m_revalidateIndexMutex;
+    boost::thread m_revalidateIndexThread;
+    void startIndexRevalidationThread(bool bCheckProofOfWork);
+    void stopIndexRevalidationThread();
+    void revalidateIndex(bool bCheckProofOfWork);
+
+    // Runs on the io service thread so that no peer handler sees the tree while it is rebuilt.
+    void reloadBlockTree(const std::string& blockTreeFile, bool bCheckProofOfWork);
+
+    // Hashes each headers message across cores before the headers are inserted one by one
+    sysutils::ThreadPool m_headerHashPool;
+
     mutable boost::mutex m_syncMutex;
     std::string m_blockTreeFile;
     CoinQBlockTreeMem m_blockTree;
@@ -166,21 +206,51 @@ private:
 
     void do_syncBlocks(int startHeight);
 
+    // Block sync keeps a window of filtered block requests in flight with each peer. A peer answers
+    // them in order, each merkle block followed by its transactions, but anything that arrives before
+    // its turn is held here so subscribers still see blocks in height order.
+    struct BufferedMerkleBlock
+    {
+        ChainMerkleBlock merkleBlock;
+        std::list<uchar_vector> reversedTxHashes;
+        std::unordered_set<hash256_t> txHashes;
+        std::vector<Coin::Transaction> txs;
+    };
+
+    BlockScheduler m_blockScheduler;
+    int m_nextMerkleBlockHeight;
+    std::unordered_map<hash256_t, int> m_requestedMerkleBlocks;
+    std::map<int, BufferedMerkleBlock> m_bufferedMerkleBlocks;
+    std::map<std::string, int> m_bufferingMerkleBlockHeights;  // peer name -> height its txs are for
+    std::string m_currentMerkleBlockPeer;
+
+    boost::asio::deadline_timer m_stallTimer;
+    void startStallTimer();
+
+    void requestMerkleBlocks();
+    void requestMerkleBlocks(CoinQ::Peer& peer, int maxHeight);
+    void clearMerkleBlockWindow();
+    bool syncRequestedMerkleBlock(const std::string& peerName, const Coin::MerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree);
+    bool bufferMerkleTx(const std::string& peerName, const Coin::Transaction& tx);
+    bool advanceMerkleBlockSync();
+
     Coin::BloomFilter m_bloomFilter;
 
     void initBlockFilter();
 
     // Merkle block state
     mutable boost::mutex m_mempoolMutex;
-    std::set<bytes_t> m_mempoolTxs;
+    std::unordered_set<hash256_t> m_mempoolTxs;
     ChainMerkleBlock m_currentMerkleBlock;
-    std::queue<bytes_t> m_currentMerkleTxHashes;
+    std::queue<hash256_t> m_currentMerkleTxHashes;
     unsigned int m_currentMerkleTxIndex;
     unsigned int m_currentMerkleTxCount;
     bool m_bMissingTxs;
 
-    void syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree);
+    void syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const std::list<uchar_vector>& reversedTxHashes);
     void processBlockTx(const Coin::Transaction& tx);
+    bool processMerkleTx(const Coin::Transaction& tx);
+    void requestCurrentBlock();
     void processMempoolConfirmations();
 
     // Sync signals
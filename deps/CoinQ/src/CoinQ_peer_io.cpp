@@ -47,9 +47,10 @@ void Peer::do_handshake()
 
 void Peer::do_read()
 {
+    std::size_t min_read_bytes = read_framer.minReadBytes();
+    unsigned char* read_ptr = read_framer.buffer().prepare(min_read_bytes);
     LOGGER(trace) << "Peer::do_read() - waiting for " << min_read_bytes << " bytes..." << endl;
-    boost::asio::async_read(socket_, boost::asio::buffer(read_buffer, READ_BUFFER_SIZE),
-        //boost::asio::transfer_at_least(MIN_MESSAGE_HEADER_SIZE),
+    boost::asio::async_read(socket_, boost::asio::buffer(read_ptr, read_framer.buffer().available()),
         boost::asio::transfer_at_least(min_read_bytes),
     strand_.wrap([this](const boost::system::error_code& ec, std::size_t bytes_read) {
         if (!bRunning) return;
@@ -58,7 +59,7 @@ void Peer::do_read()
         {
             if (ec == boost::asio::error::operation_aborted) return;
 
-            read_message.clear();
+            read_framer.clear();
             do_stop();
 
             stringstream err;
@@ -68,56 +69,32 @@ void Peer::do_read()
             return;
         }
 
-        read_message += uchar_vector(read_buffer, bytes_read);
+        read_framer.buffer().commit(bytes_read);
 
         while (true)
         {
-            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE)
-            {
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE - read_message.size();
-                break;
-            }
-
-            // Find the first occurrence of the magic bytes, discard anything before it.
-            // If magic bytes are not found, read new buffer. 
-            // TODO: detect misbehaving node and disconnect.
-            uchar_vector::iterator it = std::search(read_message.begin(), read_message.end(), magic_bytes_vector_.begin(), magic_bytes_vector_.end());
-            if (it == read_message.end())
+            const unsigned char* payload;
+            try
             {
-                read_message.clear();
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
-                break;
+                if (!read_framer.next(payload)) break;
             }
-
-            read_message.assign(it, read_message.end());
-            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE)
+            catch (const std::exception& e)
             {
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE - read_message.size();
-                break;
+                std::stringstream err;
+                err << "Message framing error: " << e.what();
+                LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
+                notifyProtocolError(*this, err.str(), -1);
+                continue;
             }
 
-            // Get command
-            unsigned char command[13];
-            command[12] = 0;
-            uchar_vector(read_message.begin() + 4, read_message.begin() + 16).copyToArray(command);
-            LOGGER(debug) << "Peer read handler - command: " << command << endl;
-
-            // Get payload size
-            unsigned int payloadSize = vch_to_uint<uint32_t>(uchar_vector(read_message.begin() + 16, read_message.begin() + 20), LITTLE_ENDIAN_);
-            LOGGER(debug) << "Peer read handler - payload size: " << payloadSize << endl;
-            LOGGER(debug) << "Peer read handler - read_message size: " << read_message.size() << endl;
-
-            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE  + payloadSize)
-            {
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE + payloadSize - read_message.size();
-                break;
-            }
+            const Coin::MessageHeader& header = read_framer.header();
+            LOGGER(debug) << "Peer read handler - command: " << std::string(header.command, strnlen(header.command, 12)) << " payload size: " << header.length << endl;
 
             try
             {
-                Coin::CoinNodeMessage peerMessage(read_message);
+                if (!header.isChecksumValid(payload)) throw std::runtime_error("Invalid checksum.");
 
-                if (!peerMessage.isChecksumValid()) throw std::runtime_error("Invalid checksum.");
+                Coin::CoinNodeMessage peerMessage(header, payload);
 
                 std::string command = peerMessage.getCommand();
                 if (command == "verack") {
@@ -210,11 +187,10 @@ void Peer::do_read()
                 err << "Message decode error: " << e.what();
                 LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
                 notifyProtocolError(*this, err.str(), -1);
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
             }
 
-            read_message.assign(read_message.begin() + MIN_MESSAGE_HEADER_SIZE + payloadSize, read_message.end());
-            LOGGER(debug) << "Peer read handler - remaining message bytes: " << read_message.size() << endl;
+            read_framer.pop();
+            LOGGER(debug) << "Peer read handler - remaining message bytes: " << read_framer.buffer().size() << endl;
         }
 
         do_read();
@@ -311,8 +287,7 @@ void Peer::start()
     bRunning = true;
     bHandshakeComplete = false;
     bWriteReady = false;
-    read_message.clear();
-    min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
+    read_framer.clear();
 
     tcp::resolver::query query(host_, port_);
 
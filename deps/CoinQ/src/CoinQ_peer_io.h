@@ -10,6 +10,7 @@
 
 #include "CoinQ_signals.h"
 #include "CoinQ_slots.h"
+#include "CoinQ_receivebuffer.h"
 
 #include <CoinCore/typedefs.h>
 #include <CoinCore/numericdata.h>
@@ -71,9 +72,9 @@ public:
         user_agent_(user_agent),
         start_height_(start_height),
         relay_(relay),
-        bRunning(false)
+        bRunning(false),
+        read_framer(magic_bytes, READ_BUFFER_SIZE)
     {
-        magic_bytes_vector_ = uint_to_vch(magic_bytes_, LITTLE_ENDIAN_);
     }
 
     ~Peer() { stop(); }
@@ -89,7 +90,7 @@ public:
         start_height_ = start_height;
         relay_ = relay;
 
-        magic_bytes_vector_ = uint_to_vch(magic_bytes_, LITTLE_ENDIAN_);
+        read_framer.setMagic(magic_bytes_);
     }
 
     void subscribeMessage(peer_message_slot_t slot) { notifyMessage.connect(slot); }
@@ -198,6 +199,30 @@ public:
         send(getData);
     }
 
+    // The peer answers in order with each merkle block followed by its matching transactions.
+    void getFilteredBlocks(const hashvector_t& hashes)
+    {
+        using namespace Coin;
+
+        if (hashes.empty()) return;
+        Inventory inv;
+        for (auto& hash: hashes)
+        {
+            if (hash.size() != 32)
+            {
+                std::stringstream err;
+                err << "Invalid block hash requested: " << uchar_vector(hash).getHex();
+                LOGGER(error) << "Peer::getFilteredBlocks() - " << err.str() << std::endl;
+                notifyProtocolError(*this, err.str(), -1);
+                return;
+            }
+
+            inv.addItem(InventoryItem(MSG_FILTERED_BLOCK, hash));
+        }
+        GetDataMessage getData(inv);
+        send(getData);
+    }
+
     void getHeaders(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop = g_zero32bytes)
     {
         for (auto& hash: locatorHashes)
@@ -292,7 +317,6 @@ private:
     std::string port_;
 
     uint32_t magic_bytes_;
-    uchar_vector magic_bytes_vector_;
     uint32_t protocol_version_;
 
     std::string user_agent_;
@@ -327,11 +351,10 @@ private:
 
     CoinQSignal<Peer&>                                  notifyTimeout;
 
+    // Socket reads go straight into the framer's buffer, at least this many bytes at a time
     static const unsigned int READ_BUFFER_SIZE = 262144;
-    unsigned char read_buffer[READ_BUFFER_SIZE];
-    std::size_t min_read_bytes;
+    MessageFramer read_framer;
 
-    uchar_vector read_message;
     uchar_vector write_message;
     std::queue<boost::shared_ptr<uchar_vector>> sendQueue;
     boost::mutex sendMutex;
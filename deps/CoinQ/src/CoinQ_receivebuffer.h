@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_receivebuffer.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#pragma once
+
+#include <CoinCore/CoinNodeData.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace CoinQ {
+
+// Largest payload we accept before treating the header as garbage
+const uint32_t MAX_MESSAGE_PAYLOAD_SIZE = 0x02000000;
+
+// Contiguous receive buffer that sockets read into directly. Consumed bytes are only
+// reclaimed when room is needed at the back, so every byte is moved at most once per
+// message rather than on every read, and a full message is always contiguous.
+class ReceiveBuffer
+{
+public:
+    explicit ReceiveBuffer(size_t chunkSize = 262144) : chunkSize_(chunkSize), begin_(0), end_(0) { }
+
+    const unsigned char* data() const { return buffer_.empty() ? nullptr : &buffer_[begin_]; }
+    size_t size() const { return end_ - begin_; }
+
+    // Returns where to write at least minBytes more bytes. The writable space is available().
+    unsigned char* prepare(size_t minBytes)
+    {
+        minBytes = std::max(minBytes, chunkSize_);
+        if (buffer_.size() - end_ < minBytes)
+        {
+            if (begin_ > 0)
+            {
+                std::copy(buffer_.begin() + begin_, buffer_.begin() + end_, buffer_.begin());
+                end_ -= begin_;
+                begin_ = 0;
+            }
+            if (buffer_.size() - end_ < minBytes) { buffer_.resize(end_ + minBytes); }
+        }
+        else if (begin_ == end_ && buffer_.size() > 4 * chunkSize_)
+        {
+            // Give back the memory used for an unusually large message.
+            std::vector<unsigned char>(chunkSize_).swap(buffer_);
+            begin_ = end_ = 0;
+        }
+        return &buffer_[end_];
+    }
+
+    size_t available() const { return buffer_.size() - end_; }
+
+    // Marks n bytes written to the pointer returned by prepare() as received.
+    void commit(size_t n) { end_ += std::min(n, available()); }
+
+    // Drops n bytes from the front.
+    void consume(size_t n)
+    {
+        begin_ += std::min(n, size());
+        if (begin_ == end_) { begin_ = end_ = 0; }
+    }
+
+    // Does not release memory so that it is safe to call while a read into the buffer is pending.
+    void clear() { begin_ = end_ = 0; }
+
+private:
+    std::vector<unsigned char> buffer_;
+    size_t chunkSize_;
+    size_t begin_;
+    size_t end_;
+};
+
+// Splits a received byte stream into messages. Each message header is parsed once, when
+// the first 24 bytes arrive, and the payload is handed out in place once it is complete.
+class MessageFramer
+{
+public:
+    explicit MessageFramer(uint32_t magic = 0, size_t chunkSize = 262144) : buffer_(chunkSize), bHaveHeader_(false) { setMagic(magic); }
+
+    void setMagic(uint32_t magic)
+    {
+        for (int i = 0; i < MAGIC_SIZE; i++) { magic_[i] = (magic >> (8 * i)) & 0xff; }
+        clear();
+    }
+
+    void clear() { buffer_.clear(); bHaveHeader_ = false; }
+
+    ReceiveBuffer& buffer() { return buffer_; }
+
+    // Fewest bytes that must arrive before next() can make progress.
+    size_t minReadBytes() const
+    {
+        size_t needed = bHaveHeader_ ? MIN_MESSAGE_HEADER_SIZE + header_.length : MIN_MESSAGE_HEADER_SIZE;
+        return needed > buffer_.size() ? needed - buffer_.size() : 1;
+    }
+
+    // Returns true once a complete message is buffered, setting payload to its first byte.
+    // The header and payload stay valid until pop() is called.
+    // Throws if a header announces an oversized payload - the header is skipped so we can keep reading.
+    bool next(const unsigned char*& payload)
+    {
+        if (!bHaveHeader_)
+        {
+            if (!findMagic() || buffer_.size() < MIN_MESSAGE_HEADER_SIZE) return false;
+
+            header_.setSerialized(uchar_vector(buffer_.data(), buffer_.data() + MIN_MESSAGE_HEADER_SIZE));
+            if (header_.length > MAX_MESSAGE_PAYLOAD_SIZE)
+            {
+                buffer_.consume(MAGIC_SIZE);
+                throw std::runtime_error("Message payload too large.");
+            }
+            bHaveHeader_ = true;
+        }
+
+        if (buffer_.size() < MIN_MESSAGE_HEADER_SIZE + header_.length) return false;
+
+        payload = buffer_.data() + MIN_MESSAGE_HEADER_SIZE;
+        return true;
+    }
+
+    const Coin::MessageHeader& header() const { return header_; }
+
+    void pop()
+    {
+        if (!bHaveHeader_) return;
+        buffer_.consume(MIN_MESSAGE_HEADER_SIZE + header_.length);
+        bHaveHeader_ = false;
+    }
+
+private:
+    enum { MAGIC_SIZE = 4 };
+
+    ReceiveBuffer buffer_;
+    unsigned char magic_[MAGIC_SIZE];
+    Coin::MessageHeader header_;
+    bool bHaveHeader_;
+
+    // Discards anything before the magic bytes. If they are not found we keep the last
+    // few bytes in case the magic bytes straddle two reads.
+    // TODO: detect misbehaving node and disconnect.
+    bool findMagic()
+    {
+        const unsigned char* begin = buffer_.data();
+        const unsigned char* end = begin + buffer_.size();
+        const unsigned char* it = std::search(begin, end, magic_, magic_ + MAGIC_SIZE);
+        if (it == end)
+        {
+            if (buffer_.size() >= MAGIC_SIZE) { buffer_.consume(buffer_.size() - MAGIC_SIZE + 1); }
+            return false;
+        }
+        buffer_.consume(it - begin);
+        return true;
+    }
+};
+
+}
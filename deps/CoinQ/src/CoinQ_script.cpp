@@ -10,6 +10,7 @@
 
 #include <CoinCore/Base58Check.h>
 #include <CoinCore/secp256k1_openssl.h>
+#include <CoinCore/SigHash.h>
 
 using namespace CoinCrypto;
 
@@ -527,7 +528,7 @@ void Signer::setTx(const Coin::Transaction& tx, bool clearinvalidsigs)
     tx_ = tx;
     tx_.clearScriptSigs();
 
-    Coin::Transaction txCopy = tx_;
+    Coin::SigHashEngine sigHashEngine(tx_);
 
     scripts_.clear();
     unsigned int i = 0;
@@ -536,9 +537,7 @@ void Signer::setTx(const Coin::Transaction& tx, bool clearinvalidsigs)
         bytes_t signinghash;
         {
             Script script(txin.scriptSig);
-            txCopy.inputs[i].scriptSig = script.txinscript(Script::SIGN);
-            signinghash = txCopy.getHashWithAppendedCode(SIGHASH_ALL);
-            txCopy.inputs[i].scriptSig.clear();
+            signinghash = sigHashEngine.getHash(i, script.txinscript(Script::SIGN), SIGHASH_ALL);
         }
         {
             Script script(txin.scriptSig, signinghash, clearinvalidsigs);
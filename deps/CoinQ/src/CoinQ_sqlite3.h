@@ -57,6 +57,7 @@ public:
     bool hasHeader(const uchar_vector& hash) const { return false; }
     ChainHeader getHeader(const uchar_vector& hash) const { return ChainHeader(); }
     ChainHeader getHeader(int height) const { return ChainHeader(); } // Use -1 to get top block
+    ChainHeader getHeaderBefore(uint32_t timestamp) const { return ChainHeader(); }
 
     int getBestHeight() const;
     BigInt getTotalWork() const;
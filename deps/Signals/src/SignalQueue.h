@@ -1,6 +1,6 @@
 ///////////////////////////////////////////////////////////////////////////////
 //
-// SignalQueue.h 
+// SignalQueue.h
 //
 // Copyright (c) 2012-2014 Eric Lombrozo
 //
@@ -9,48 +9,369 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <queue>
+#include <iterator>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace Signals
 {
 
+// Any number of threads may push while one thread at a time flushes. Pushes go into a fixed-size
+// ring and never block: when the ring is full they spill into an overflow list under a mutex and
+// are counted in the statistics. Each event is delivered once, in push order for any one producer.
+//
+// Events pushed with a key are coalesced: if the same key is pushed more than once before a flush
+// delivers it, only the last of those events is delivered, at the position of that last push.
+//
+// flush() takes nothing the producers need, so producers keep pushing while callbacks run. If
+// another thread (or a callback on this thread) is already flushing, flush() returns at once and
+// the flush in progress delivers the new events before it finishes.
 class SignalQueue
 {
 public:
+    struct Key
+    {
+        Key(const void* channel_ = nullptr, uint64_t id_ = 0) : channel(channel_), id(id_) { }
+        bool operator==(const Key& rhs) const { return channel == rhs.channel && id == rhs.id; }
+
+        const void* channel; // usually the signal the event is emitted on
+        uint64_t id;
+    };
+
+    struct Stats
+    {
+        uint64_t pushed;
+        uint64_t overflowed;        // pushes that found the ring full
+        uint64_t coalesced;         // events superseded by a later push with the same key
+        uint64_t discarded;         // events dropped by clear()
+        uint64_t delivered;
+        uint64_t flushes;
+        uint64_t contended_flushes; // flushes left to a flush already in progress
+        uint64_t high_water;        // most events ever waiting at once
+    };
+
+    static const std::size_t DEFAULT_CAPACITY = 1024;
+
+    explicit SignalQueue(std::size_t capacity = DEFAULT_CAPACITY);
+
     void push(std::function<void()> f);
+    void push(const Key& key, std::function<void()> f);
     void flush();
-    void clear();
+    void clear(); // drops every event pushed so far that has not been delivered
+
+    void setCoalescing(bool coalescing) { coalescing_ = coalescing; }
+    bool getCoalescing() const { return coalescing_; }
+
+    std::size_t capacity() const { return mask_ + 1; }
+    bool empty() const;
+    Stats stats() const;
+    void resetStats();
 
 private:
-    std::mutex mutex_;
-    std::queue<std::function<void()>> queue_;
+    struct Event
+    {
+        Event() : ticket(0), keyed(false), superseded(false) { }
+
+        uint64_t ticket;
+        Key key;
+        bool keyed;
+        bool superseded;
+        std::function<void()> f;
+    };
+
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        Event event;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const
+        {
+            return std::hash<const void*>()(key.channel) ^ (std::hash<uint64_t>()(key.id) * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+    SignalQueue(const SignalQueue&);
+    SignalQueue& operator=(const SignalQueue&);
+
+    void enqueue(Event&& event);
+    void deliver();
+    void consumed(uint64_t count) { consumed_.fetch_add(count); }
+
+    std::vector<Cell> cells_;
+    std::size_t mask_;
+    std::atomic<std::size_t> enqueuePos_;
+    std::atomic<std::size_t> dequeuePos_;
+
+    std::atomic<uint64_t> ticket_;      // also the number of events pushed
+    std::atomic<uint64_t> consumed_;    // delivered, coalesced or discarded
+    std::atomic<uint64_t> discardBelow_;
+
+    std::mutex overflowMutex_;
+    std::vector<Event> overflow_;
+    std::atomic<std::size_t> overflowSize_;
+
+    // Only touched by the thread holding flushing_.
+    std::atomic<bool> flushing_;
+    std::vector<Event> batch_;
+    std::size_t batchPos_;
+    std::unordered_map<Key, std::size_t, KeyHash> lastByKey_;
+
+    std::atomic<bool> coalescing_;
+
+    std::atomic<uint64_t> overflowed_;
+    std::atomic<uint64_t> coalesced_;
+    std::atomic<uint64_t> discarded_;
+    std::atomic<uint64_t> delivered_;
+    std::atomic<uint64_t> flushes_;
+    std::atomic<uint64_t> contendedFlushes_;
+    std::atomic<uint64_t> highWater_;
+    uint64_t pushedBase_;
 };
 
+inline SignalQueue::SignalQueue(std::size_t capacity)
+    : enqueuePos_(0), dequeuePos_(0), ticket_(0), consumed_(0), discardBelow_(0), overflowSize_(0), flushing_(false), batchPos_(0), coalescing_(true),
+      overflowed_(0), coalesced_(0), discarded_(0), delivered_(0), flushes_(0), contendedFlushes_(0), highWater_(0), pushedBase_(0)
+{
+    std::size_t size = 2;
+    while (size < capacity) { size <<= 1; }
+    mask_ = size - 1;
+
+    std::vector<Cell> cells(size);
+    cells_.swap(cells);
+    for (std::size_t i = 0; i < size; i++) { cells_[i].sequence.store(i, std::memory_order_relaxed); }
+}
+
 inline void SignalQueue::push(std::function<void()> f)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push(f);
+    Event event;
+    event.f = std::move(f);
+    enqueue(std::move(event));
+}
+
+inline void SignalQueue::push(const Key& key, std::function<void()> f)
+{
+    Event event;
+    event.key = key;
+    event.keyed = true;
+    event.f = std::move(f);
+    enqueue(std::move(event));
+}
+
+inline void SignalQueue::enqueue(Event&& event)
+{
+    event.ticket = ticket_.fetch_add(1);
+
+    uint64_t consumed = consumed_.load(std::memory_order_relaxed);
+    if (event.ticket >= consumed)
+    {
+        uint64_t waiting = event.ticket + 1 - consumed;
+        uint64_t highWater = highWater_.load(std::memory_order_relaxed);
+        while (waiting > highWater && !highWater_.compare_exchange_weak(highWater, waiting, std::memory_order_relaxed));
+    }
+
+    // Claim a cell by advancing enqueuePos_ when the cell's sequence says the consumer is done with it.
+    std::size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell& cell = cells_[pos & mask_];
+        std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1)) { break; }
+        }
+        else if (diff < 0)
+        {
+            // The ring is full.
+            overflowed_.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(overflowMutex_);
+            overflow_.push_back(std::move(event));
+            overflowSize_.store(overflow_.size());
+            return;
+        }
+        else
+        {
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    Cell& cell = cells_[pos & mask_];
+    cell.event = std::move(event);
+    cell.sequence.store(pos + 1, std::memory_order_release);
 }
 
 inline void SignalQueue::flush()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    while (!queue_.empty())
+    flushes_.fetch_add(1, std::memory_order_relaxed);
+    do
+    {
+        if (flushing_.exchange(true))
+        {
+            contendedFlushes_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        try
+        {
+            deliver();
+        }
+        catch (...)
+        {
+            flushing_.store(false);
+            throw;
+        }
+        flushing_.store(false);
+
+        // Anything pushed after deliver() looked at the queue but before flushing_ was released was
+        // left to us by the flushes that gave up.
+    } while (!empty());
+}
+
+// Must be called by the thread holding flushing_.
+inline void SignalQueue::deliver()
+{
+    // Events left over from a callback that threw are older than anything still queued.
+    if (batchPos_ == batch_.size())
+    {
+        batch_.clear();
+        batchPos_ = 0;
+    }
+    std::size_t begin = batch_.size();
+
+    // Take the overflow before the ring. An event can only reach the overflow after every earlier
+    // event from the same producer has claimed its cell, so those cells are all below the ring
+    // position read afterwards.
+    bool overflowed = false;
+    if (overflowSize_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        for (auto& event: overflow_) { batch_.push_back(std::move(event)); }
+        overflow_.clear();
+        overflowSize_.store(0);
+        overflowed = true;
+    }
+
+    std::size_t end = enqueuePos_.load();
+    std::size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    for (; pos != end; ++pos)
+    {
+        Cell& cell = cells_[pos & mask_];
+
+        // The cell is claimed but its producer might still be storing the event.
+        while (cell.sequence.load(std::memory_order_acquire) != pos + 1) { std::this_thread::yield(); }
+
+        batch_.push_back(std::move(cell.event));
+        cell.event.f = nullptr;
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+    }
+    dequeuePos_.store(pos);
+
+    if (overflowed)
+    {
+        std::stable_sort(batch_.begin() + begin, batch_.end(), [](const Event& a, const Event& b) { return a.ticket < b.ticket; });
+    }
+
+    if (coalescing_)
+    {
+        lastByKey_.clear();
+        for (std::size_t i = batchPos_; i < batch_.size(); i++)
+        {
+            Event& event = batch_[i];
+            if (!event.keyed || event.superseded) continue;
+
+            auto it = lastByKey_.find(event.key);
+            if (it == lastByKey_.end())
+            {
+                lastByKey_.insert(std::make_pair(event.key, i));
+            }
+            else
+            {
+                batch_[it->second].superseded = true;
+                it->second = i;
+            }
+        }
+    }
+
+    while (batchPos_ < batch_.size())
     {
-        queue_.front()();
-        queue_.pop();
-    } 
+        Event event(std::move(batch_[batchPos_++]));
+        consumed(1);
+        if (event.ticket < discardBelow_.load())
+        {
+            discarded_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (event.superseded)
+        {
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            delivered_.fetch_add(1, std::memory_order_relaxed);
+            event.f();
+        }
+    }
 }
 
 inline void SignalQueue::clear()
 {
-    std::queue<std::function<void()>> empty;
+    uint64_t ticket = ticket_.load();
+    uint64_t discardBelow = discardBelow_.load();
+    while (ticket > discardBelow && !discardBelow_.compare_exchange_weak(discardBelow, ticket));
+
+    // Events still in the ring are dropped when they are next flushed. The overflow can go now.
+    std::vector<Event> dropped;
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::swap(queue_, empty);
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        auto it = std::stable_partition(overflow_.begin(), overflow_.end(), [&](const Event& event) { return event.ticket >= ticket; });
+        std::move(it, overflow_.end(), std::back_inserter(dropped));
+        overflow_.erase(it, overflow_.end());
+        overflowSize_.store(overflow_.size());
     }
+    consumed(dropped.size());
+    discarded_.fetch_add(dropped.size(), std::memory_order_relaxed);
+}
+
+inline bool SignalQueue::empty() const
+{
+    return enqueuePos_.load() == dequeuePos_.load() && overflowSize_.load() == 0;
+}
+
+inline SignalQueue::Stats SignalQueue::stats() const
+{
+    Stats stats;
+    stats.pushed = ticket_.load() - pushedBase_;
+    stats.overflowed = overflowed_.load();
+    stats.coalesced = coalesced_.load();
+    stats.discarded = discarded_.load();
+    stats.delivered = delivered_.load();
+    stats.flushes = flushes_.load();
+    stats.contended_flushes = contendedFlushes_.load();
+    stats.high_water = highWater_.load();
+    return stats;
+}
+
+// Not synchronized with concurrent pushes; counts taken meanwhile may be off by those pushes.
+inline void SignalQueue::resetStats()
+{
+    pushedBase_ = ticket_.load();
+    overflowed_.store(0);
+    coalesced_.store(0);
+    discarded_.store(0);
+    delivered_.store(0);
+    flushes_.store(0);
+    contendedFlushes_.store(0);
+    highWater_.store(0);
 }
 
 }
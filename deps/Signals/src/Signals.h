@@ -1,6 +1,6 @@
 ///////////////////////////////////////////////////////////////////////////////
 //
-// Signals.h 
+// Signals.h
 //
 // Copyright (c) 2012-2014 Eric Lombrozo
 //
@@ -9,16 +9,24 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <set>
-#include <map>
 #include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace Signals
 {
 
 typedef uint64_t Connection;
 
+// Slots are kept in an immutable list that connect, disconnect and clear replace under a mutex.
+// Emitting only loads the current list and counts itself in and out, so it takes no lock,
+// allocates nothing, and slots may connect, disconnect or emit the same signal reentrantly.
+// Replaced lists are freed once no emission is in progress. A slot disconnected while another
+// thread is emitting may still be called by that emission.
 template<typename... Values>
 class Signal
 {
@@ -42,23 +50,34 @@ public:
         ss << "next_: " << next_ << std::endl << "available_:";
         for (auto n: available_) ss << " " << n;
         ss << std::endl << "slots_:";
-        for (auto& slot: slots_) ss << " " << slot.first;
+        const SlotList* slots = slots_.load();
+        if (slots) { for (auto& slot: *slots) ss << " " << slot.first; }
         ss << std::endl;
-        return ss.str(); 
+        return ss.str();
     }
 #endif
 
 private:
+    typedef std::vector<std::pair<Connection, Slot>> SlotList; // ordered by connection
+
+    Signal(const Signal&);
+    Signal& operator=(const Signal&);
+
     void exec(Values... values) const;
+    void replace(SlotList* slots);
+    void reclaim();
 
-    mutable std::mutex mutex_;
+    std::mutex mutex_; // serializes changes to the slot list
     Connection next_;
     std::set<Connection> available_;
-    std::map<Connection, Slot> slots_;
+
+    std::atomic<const SlotList*> slots_; // null when there are no slots
+    mutable std::atomic<unsigned int> emitting_;
+    std::vector<const SlotList*> retired_;
 };
 
 template<typename... Values>
-inline Signal<Values...>::Signal() : next_(0)
+inline Signal<Values...>::Signal() : next_(0), slots_(nullptr), emitting_(0)
 {
 }
 
@@ -66,6 +85,9 @@ template<typename... Values>
 inline Signal<Values...>::~Signal()
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    while (emitting_.load() > 0) { std::this_thread::yield(); }
+    delete slots_.load();
+    for (auto slots: retired_) { delete slots; }
 }
 
 template<typename... Values>
@@ -83,7 +105,13 @@ inline Connection Signal<Values...>::connect(Slot slot)
         connection = *it;
         available_.erase(it);
     }
-    slots_.insert(std::pair<Connection, Slot>(connection, slot));
+
+    const SlotList* current = slots_.load();
+    SlotList* slots = current ? new SlotList(*current) : new SlotList();
+    auto pos = slots->begin();
+    while (pos != slots->end() && pos->first < connection) { ++pos; }
+    slots->insert(pos, std::make_pair(connection, std::move(slot)));
+    replace(slots);
     return connection;
 }
 
@@ -91,10 +119,21 @@ template<typename... Values>
 inline bool Signal<Values...>::disconnect(Connection connection)
 {
     std::lock_guard<std::mutex> lock(mutex_);
-    const auto& it = slots_.find(connection);
-    if (it == slots_.end()) return false;
+    const SlotList* current = slots_.load();
+    if (!current) return false;
+
+    auto it = current->begin();
+    while (it != current->end() && it->first != connection) { ++it; }
+    if (it == current->end()) return false;
 
-    slots_.erase(it);
+    SlotList* slots = nullptr;
+    if (current->size() > 1)
+    {
+        slots = new SlotList();
+        slots->reserve(current->size() - 1);
+        for (auto& slot: *current) { if (slot.first != connection) slots->push_back(slot); }
+    }
+    replace(slots);
     available_.insert(connection);
 
     // remove contiguous available connections from end
@@ -108,7 +147,7 @@ template<typename... Values>
 inline void Signal<Values...>::clear()
 {
     std::lock_guard<std::mutex> lock(mutex_);
-    slots_.clear();
+    replace(nullptr);
     available_.clear();
     next_ = 0;
 }
@@ -116,121 +155,55 @@ inline void Signal<Values...>::clear()
 template<typename... Values>
 inline void Signal<Values...>::exec(Values... values) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto slot: slots_) slot.second(values...); 
-}
+    if (!slots_.load()) return;
 
-template<typename... Values>
-inline std::function<void()> Signal<Values...>::bind(Values... values) const
-{
-    return std::bind([this](Values... values) { exec(values...); }, values...);
-}
-
-template<>
-class Signal<void>
-{
-public:
-    typedef std::function<void()> Slot;
-
-    Signal();
-    ~Signal();
-
-    Connection connect(Slot slot);
-    bool disconnect(Connection connection);
-    void clear();
-    std::function<void()> bind() const;
-    void operator()() const { exec(); }
-
-#ifdef SIGNALS_TEST
-    std::string getTextualState()
+    // Counting ourselves in before loading the list keeps it alive until we are done with it.
+    emitting_.fetch_add(1);
+    const SlotList* slots = slots_.load();
+    if (slots)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::stringstream ss;
-        ss << "next_: " << next_ << std::endl << "available_:";
-        for (auto n: available_) ss << " " << n;
-        ss << std::endl << "slots_:";
-        for (auto& slot: slots_) ss << " " << slot.first;
-        ss << std::endl;
-        return ss.str(); 
+        try
+        {
+            for (auto& slot: *slots) slot.second(values...);
+        }
+        catch (...)
+        {
+            emitting_.fetch_sub(1);
+            throw;
+        }
     }
-#endif
-
-private:
-    void exec() const;
-
-    mutable std::mutex mutex_;
-    Connection next_;
-    std::set<Connection> available_;
-    std::map<Connection, Slot> slots_;
-};
-
-template<>
-inline Signal<>::Signal() : next_(0)
-{
+    emitting_.fetch_sub(1);
 }
 
-template<>
-inline Signal<>::~Signal()
-{
-    std::lock_guard<std::mutex> lock(mutex_);
-}
-
-template<>
-inline Connection Signal<>::connect(Slot slot)
-{
-    std::lock_guard<std::mutex> lock(mutex_);
-    Connection connection;
-    auto it = available_.begin();
-    if (it == available_.end())
-    {
-        connection = next_++;
-    }
-    else
-    {
-        connection = *it;
-        available_.erase(it);
-    }
-    slots_.insert(std::pair<Connection, Slot>(connection, slot));
-    return connection;
-}
-
-template<>
-inline bool Signal<>::disconnect(Connection connection)
+template<typename... Values>
+inline std::function<void()> Signal<Values...>::bind(Values... values) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    const auto& it = slots_.find(connection);
-    if (it == slots_.end()) return false;
-
-    slots_.erase(it);
-    available_.insert(connection);
-
-    // remove contiguous available connections from end
-    auto rit = available_.rbegin();
-    for (; rit != available_.rend() && *rit == next_ - 1; ++rit, --next_);
-    available_.erase(rit.base(), available_.end());
-    return true;
+    return std::bind([this](Values... values) { exec(values...); }, values...);
 }
 
-template<>
-inline void Signal<>::clear()
+// Must be called with mutex_ held.
+template<typename... Values>
+inline void Signal<Values...>::replace(SlotList* slots)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    slots_.clear();
-    available_.clear();
-    next_ = 0;
+    const SlotList* old = slots_.exchange(slots);
+    if (old) { retired_.push_back(old); }
+    reclaim();
 }
 
-template<>
-inline void Signal<>::exec() const
+// Must be called with mutex_ held. An emission that starts after the exchange in replace() can
+// only see the new list, so once no emission is in progress the retired lists are unreachable.
+template<typename... Values>
+inline void Signal<Values...>::reclaim()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto slot: slots_) slot.second(); 
+    if (retired_.empty() || emitting_.load() > 0) return;
+    for (auto slots: retired_) { delete slots; }
+    retired_.clear();
 }
 
+// Signal<void> is the same as Signal<>.
 template<>
-inline std::function<void()> Signal<>::bind() const
+class Signal<void> : public Signal<>
 {
-    return [this]() { exec(); };
-}
+};
 
 }
@@ -0,0 +1,46 @@
+// Measures the cost of emitting a signal with 0, 1 and 8 connected slots.
+
+#include <Signals.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+using namespace Signals;
+using namespace std;
+
+const unsigned long DEFAULT_ITERATIONS = 10000000;
+
+volatile unsigned long counter = 0;
+
+double nanosPerEmit(unsigned int slots, unsigned long iterations)
+{
+    Signal<int> notifyInt;
+    for (unsigned int i = 0; i < slots; i++) { notifyInt.connect([](int n) { counter += n; }); }
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) { notifyInt(1); }
+    auto elapsed = chrono::steady_clock::now() - start;
+
+    return chrono::duration<double, nano>(elapsed).count() / iterations;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_ITERATIONS;
+    if (iterations == 0)
+    {
+        cerr << "Usage: " << argv[0] << " [iterations = " << DEFAULT_ITERATIONS << "]" << endl;
+        return -1;
+    }
+
+    cout << right << setw(8) << "slots" << setw(14) << "ns/emit" << endl;
+    const unsigned int slotCounts[] = { 0, 1, 8 };
+    for (auto slots: slotCounts)
+    {
+        cout << right << setw(8) << slots << setw(14) << fixed << setprecision(2) << nanosPerEmit(slots, iterations) << endl;
+    }
+
+    return 0;
+}
@@ -71,5 +71,21 @@ int main()
     signalQueue.flush();
     signalQueue.flush();
 
+    cout << endl << "SignalQueue coalescing test:" << endl;
+    signalQueue.push(SignalQueue::Key(&notifyInt, 1), std::bind(&coutInt, 1));
+    signalQueue.push(SignalQueue::Key(&notifyInt, 2), std::bind(&coutInt, 2));
+    signalQueue.push(std::bind(&coutString, "unkeyed"));
+    signalQueue.push(SignalQueue::Key(&notifyInt, 1), std::bind(&coutInt, 11));
+    signalQueue.flush();
+
+    cout << endl << "SignalQueue clear test:" << endl;
+    signalQueue.push(std::bind(&coutString, "cleared"));
+    signalQueue.clear();
+    signalQueue.push(std::bind(&coutString, "kept"));
+    signalQueue.flush();
+
+    auto stats = signalQueue.stats();
+    cout << endl << "pushed: " << stats.pushed << ", delivered: " << stats.delivered << ", coalesced: " << stats.coalesced << ", discarded: " << stats.discarded << endl;
+
     return 0;
 }
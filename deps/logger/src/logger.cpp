@@ -25,13 +25,378 @@
 #include "logger.h"
 
 #include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <time.h>
 
 namespace logger {
-    std::ofstream file;
-    void init_logger(const char* filename)
+    std::atomic<int> threshold(fatal + 1);
+    std::ostream no_out(NULL);
+
+    namespace {
+        // Appends to a string that keeps its capacity from one line to the next.
+        class string_buf : public std::streambuf
+        {
+        public:
+            std::string text;
+
+        protected:
+            int_type overflow(int_type c)
+            {
+                if (c != traits_type::eof()) { text.push_back(traits_type::to_char_type(c)); }
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize xsputn(const char* s, std::streamsize n)
+            {
+                text.append(s, n);
+                return n;
+            }
+        };
+
+        struct node
+        {
+            std::string text;
+            bool sync; // the producer waits until this line is written
+            node* next;
+        };
+
+        // Written nodes go back to the producers with their strings' capacity, except for the odd
+        // huge line.
+        const std::size_t MAX_RECYCLED_CAPACITY = 16384;
+
+        void delete_list(node* list)
+        {
+            while (list)
+            {
+                node* next = list->next;
+                delete list;
+                list = next;
+            }
+        }
+
+        const char* const level_labels[] = { " [trace] ", " [debug] ", " [info] ", " [warning] ", " [error] ", " [fatal] " };
+        const char* const level_names[] = { "trace", "debug", "info", "warning", "error", "fatal" };
+
+        // Producers push completed lines with a single compare-and-swap. The writer takes the
+        // whole list at once and reverses it to restore the order the lines were pushed in.
+        // Written nodes are pushed onto a free list that a producer takes whole when it runs
+        // out of nodes, so neither list ever has single nodes popped from it.
+        class writer
+        {
+        public:
+            writer() : head_(nullptr), free_(nullptr), running_(false), stopping_(false), level_(trace), max_file_size_(0), max_files_(0), file_size_(0), flush_requested_(0), flush_done_(0) { }
+            ~writer()
+            {
+                stop();
+                delete_list(free_.exchange(nullptr));
+            }
+
+            void start(const char* filename, level_t level, std::size_t max_file_size, unsigned int max_files)
+            {
+                stop();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                filename_ = filename;
+                level_ = level;
+                max_file_size_ = max_file_size;
+                max_files_ = max_files;
+                open();
+                if (!file_.is_open()) return;
+
+                stopping_ = false;
+                running_ = true;
+                thread_ = std::thread(&writer::run, this);
+                threshold = level_;
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!running_) return;
+                    threshold = fatal + 1;
+                    stopping_ = true;
+                }
+                cond_.notify_all();
+                thread_.join();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                write_all(); // anything pushed while the writer was finishing
+                running_ = false;
+                file_.close();
+            }
+
+            void set_level(level_t level)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                level_ = level;
+                if (running_) { threshold = level_; }
+            }
+
+            level_t get_level()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return level_;
+            }
+
+            void push(node* n)
+            {
+                if (threshold.load(std::memory_order_relaxed) > fatal)
+                {
+                    // Not running, or shutting down.
+                    delete n;
+                    return;
+                }
+
+                // Once the node is pushed it belongs to the writer.
+                bool sync = n->sync;
+                node* prev = head_.load(std::memory_order_relaxed);
+                do { n->next = prev; } while (!head_.compare_exchange_weak(prev, n, std::memory_order_release, std::memory_order_relaxed));
+
+                // The writer polls anyway, so only wake it for the first line of a batch.
+                if (!prev) { cond_.notify_one(); }
+                if (sync) { flush(); }
+            }
+
+            node* take_free()
+            {
+                if (!free_.load(std::memory_order_relaxed)) return nullptr;
+                return free_.exchange(nullptr, std::memory_order_acquire);
+            }
+
+            void flush()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (!running_) return;
+                uint64_t ticket = ++flush_requested_;
+                cond_.notify_all();
+                while (running_ && flush_done_ < ticket) { flushed_cond_.wait(lock); }
+            }
+
+        private:
+            std::atomic<node*> head_;
+            std::atomic<node*> free_;
+
+            std::mutex mutex_;
+            std::condition_variable cond_;
+            std::condition_variable flushed_cond_;
+            std::thread thread_;
+            bool running_;
+            bool stopping_;
+            level_t level_;
+
+            std::string filename_;
+            std::size_t max_file_size_;
+            unsigned int max_files_;
+            std::ofstream file_;
+            std::size_t file_size_;
+
+            uint64_t flush_requested_;
+            uint64_t flush_done_;
+
+            void open()
+            {
+                file_.open(filename_.c_str(), std::ios_base::app);
+                file_.seekp(0, std::ios_base::end);
+                std::streamoff size = file_.tellp();
+                file_size_ = size > 0 ? (std::size_t)size : 0;
+            }
+
+            void rotate()
+            {
+                file_.close();
+                for (unsigned int i = max_files_; i > 1; i--)
+                {
+                    std::string to = filename_ + "." + std::to_string(i);
+                    std::string from = filename_ + "." + std::to_string(i - 1);
+                    std::remove(to.c_str());
+                    std::rename(from.c_str(), to.c_str());
+                }
+                std::string to = filename_ + ".1";
+                if (max_files_ > 0)
+                {
+                    std::remove(to.c_str());
+                    std::rename(filename_.c_str(), to.c_str());
+                }
+                else
+                {
+                    std::remove(filename_.c_str());
+                }
+                open();
+            }
+
+            void write_all()
+            {
+                node* list = head_.exchange(nullptr, std::memory_order_acquire);
+                node* ordered = nullptr;
+                while (list)
+                {
+                    node* next = list->next;
+                    list->next = ordered;
+                    ordered = list;
+                    list = next;
+                }
+
+                if (!ordered) return;
+                node* recycled = nullptr;
+                node* recycled_tail = nullptr;
+                while (ordered)
+                {
+                    node* next = ordered->next;
+                    if (file_.is_open())
+                    {
+                        file_.write(ordered->text.data(), ordered->text.size());
+                        file_size_ += ordered->text.size();
+                        if (max_file_size_ > 0 && file_size_ >= max_file_size_) { file_.flush(); rotate(); }
+                    }
+                    if (ordered->text.capacity() > MAX_RECYCLED_CAPACITY)
+                    {
+                        delete ordered;
+                    }
+                    else
+                    {
+                        ordered->next = recycled;
+                        recycled = ordered;
+                        if (!recycled_tail) { recycled_tail = ordered; }
+                    }
+                    ordered = next;
+                }
+                file_.flush();
+
+                if (recycled)
+                {
+                    node* prev = free_.load(std::memory_order_relaxed);
+                    do { recycled_tail->next = prev; } while (!free_.compare_exchange_weak(prev, recycled, std::memory_order_release, std::memory_order_relaxed));
+                }
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (true)
+                {
+                    bool stopping = stopping_;
+                    uint64_t ticket = flush_requested_;
+                    lock.unlock();
+
+                    write_all();
+
+                    lock.lock();
+                    if (flush_done_ < ticket)
+                    {
+                        flush_done_ = ticket;
+                        flushed_cond_.notify_all();
+                    }
+                    if (stopping) break;
+                    if (!stopping_ && flush_requested_ == flush_done_) { cond_.wait_for(lock, std::chrono::milliseconds(100)); }
+                }
+
+                // Wake anyone still waiting for a flush.
+                flush_done_ = flush_requested_;
+                flushed_cond_.notify_all();
+            }
+        };
+
+        writer& the_writer()
+        {
+            static writer w;
+            return w;
+        }
+
+        // Built before main so the writer outlives anything static that might log on the way out.
+        struct writer_init { writer_init() { the_writer(); } } writer_init_instance;
+
+        struct timestamp_cache
+        {
+            timestamp_cache() : seconds(-1) { text[0] = '\0'; }
+
+            time_t seconds;
+            char text[20];
+
+            const char* get()
+            {
+                time_t now;
+                time(&now);
+                if (now != seconds)
+                {
+                    struct tm timeinfo;
+#if defined(_WIN32)
+                    gmtime_s(&timeinfo, &now);
+#else
+                    gmtime_r(&now, &timeinfo);
+#endif
+                    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &timeinfo);
+                    seconds = now;
+                }
+                return text;
+            }
+        };
+    }
+
+    struct line_buffer
+    {
+        line_buffer() : stream(&buf), busy(false), spare(nullptr) { }
+        ~line_buffer() { delete_list(spare); }
+
+        string_buf buf;
+        std::ostream stream;
+        bool busy;
+        timestamp_cache timestamp;
+        node* spare; // nodes taken from the writer's free list
+    };
+
+    namespace {
+        thread_local std::unique_ptr<line_buffer> thread_buffer;
+    }
+
+    void init_logger(const char* filename, level_t level, std::size_t max_file_size, unsigned int max_files)
+    {
+        the_writer().start(filename, level, max_file_size, max_files);
+    }
+
+    void shutdown_logger()
+    {
+        the_writer().stop();
+    }
+
+    void flush()
+    {
+        the_writer().flush();
+    }
+
+    void set_level(level_t level)
     {
-        file.open(filename, std::ios_base::app);
+        the_writer().set_level(level);
+    }
+
+    level_t get_level()
+    {
+        return the_writer().get_level();
+    }
+
+    bool parse_level(const std::string& name, level_t& level)
+    {
+        for (int i = trace; i <= fatal; i++)
+        {
+            if (name == level_names[i])
+            {
+                level = (level_t)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* level_name(level_t level)
+    {
+        return level_names[level];
     }
 
     std::string timestamp()
@@ -45,6 +410,41 @@ namespace logger {
         return std::string(buffer);
     }
 
-    std::ostream out(file.rdbuf());
-    std::ostream no_out(NULL);
+    line::line(level_t level)
+        : level_(level)
+    {
+        if (!thread_buffer) { thread_buffer.reset(new line_buffer()); }
+        buffer_ = thread_buffer.get();
+        owns_buffer_ = buffer_->busy;
+        if (owns_buffer_) { buffer_ = new line_buffer(); }
+        buffer_->busy = true;
+        buffer_->buf.text.clear();
+
+        // Undo any manipulators the previous line on this thread left behind.
+        stream_ = &buffer_->stream;
+        stream_->flags(std::ios_base::skipws | std::ios_base::dec);
+        stream_->fill(' ');
+        stream_->precision(6);
+        stream_->width(0);
+        stream_->clear();
+
+        *stream_ << buffer_->timestamp.get() << level_labels[level_];
+    }
+
+    line::~line()
+    {
+        // The node's string trades places with the line, so the buffer keeps a string with room
+        // for the next line and nothing is allocated or copied once the nodes are warmed up.
+        line_buffer& cache = *thread_buffer;
+        if (!cache.spare) { cache.spare = the_writer().take_free(); }
+        node* n = cache.spare;
+        if (n)  { cache.spare = n->next; }
+        else    { n = new node(); }
+        n->text.swap(buffer_->buf.text);
+        n->sync = (level_ == fatal);
+        the_writer().push(n);
+
+        if (owns_buffer_)   { delete buffer_; }
+        else                { buffer_->busy = false; }
+    }
 }
@@ -25,14 +25,59 @@
 #ifndef _LOGGER_H__
 #define _LOGGER_H__
 
+#include <atomic>
+#include <ostream>
 #include <sstream>
 #include <string>
 
+// Lines are formatted on the calling thread into a buffer that thread reuses, then handed to a
+// background thread that writes them to the log file. Lines below the runtime level are skipped
+// before any of their arguments are evaluated. Levels below the compile-time level selected with
+// LOGGER_TRACE ... LOGGER_FATAL are compiled out altogether.
 namespace logger {
-    void init_logger(const char* filename);
+    enum level_t { trace, debug, info, warning, error, fatal };
+
+    // Opens the log file and starts the writer thread. When max_file_size is nonzero the file is
+    // rotated to filename.1 ... filename.<max_files> once it grows past that many bytes.
+    void init_logger(const char* filename, level_t level = trace, std::size_t max_file_size = 0, unsigned int max_files = 5);
+    void shutdown_logger(); // writes out every pending line and stops the writer thread
+    void flush(); // returns once every line logged so far has been written
+
+    void set_level(level_t level);
+    level_t get_level();
+    bool parse_level(const std::string& name, level_t& level); // "trace", "debug", ...
+    const char* level_name(level_t level);
+
     std::string timestamp();
-    extern "C" std::ostream out;
-    extern "C" std::ostream no_out;
+
+    extern std::atomic<int> threshold; // lowest level written, or above fatal while no file is open
+    inline bool enabled(level_t level) { return level >= threshold.load(std::memory_order_relaxed); }
+
+    struct line_buffer;
+
+    // Formats one line and queues it when destroyed.
+    class line
+    {
+    public:
+        explicit line(level_t level);
+        ~line();
+
+        std::ostream& stream() { return *stream_; }
+
+    private:
+        line(const line&);
+        line& operator=(const line&);
+
+        level_t level_;
+        line_buffer* buffer_;
+        bool owns_buffer_; // a line logged while formatting another on the same thread gets its own
+        std::ostream* stream_;
+    };
+
+    // Lets a streaming expression be one arm of a conditional.
+    struct voidify { void operator&(std::ostream&) { } };
+
+    extern std::ostream no_out;
 }
 
 #define INIT_LOGGER(filename) logger::init_logger(filename)
@@ -43,36 +88,39 @@ namespace logger {
 
 #define LOGGER(level) LOGGER_##level
 
+#define LOGGER_AT(level) !logger::enabled(logger::level) ? (void)0 : logger::voidify() & logger::line(logger::level).stream()
+#define LOGGER_OFF true ? (void)0 : logger::voidify() & logger::no_out
+
 #if defined(LOGGER_TRACE)
-    #define LOGGER_trace logger::out << logger::timestamp() << " [trace] "
+    #define LOGGER_trace LOGGER_AT(trace)
 #else
-    #define LOGGER_trace logger::no_out
+    #define LOGGER_trace LOGGER_OFF
 #endif
 
 #if defined(LOGGER_TRACE) || defined(LOGGER_DEBUG)
-    #define LOGGER_debug logger::out << logger::timestamp() << " [debug] "
+    #define LOGGER_debug LOGGER_AT(debug)
 #else
-    #define LOGGER_debug logger::no_out
+    #define LOGGER_debug LOGGER_OFF
 #endif
 
 #if defined(LOGGER_TRACE) || defined(LOGGER_DEBUG) || defined(LOGGER_INFO)
-    #define LOGGER_info logger::out << logger::timestamp() << " [info] "
+    #define LOGGER_info LOGGER_AT(info)
 #else
-    #define LOGGER_info logger::no_out
+    #define LOGGER_info LOGGER_OFF
 #endif
 
 #if defined(LOGGER_TRACE) || defined(LOGGER_DEBUG) || defined(LOGGER_INFO) || defined(LOGGER_WARNING)
-    #define LOGGER_warning logger::out << logger::timestamp() << " [warning] "
+    #define LOGGER_warning LOGGER_AT(warning)
 #else
-    #define LOGGER_warning logger::no_out
+    #define LOGGER_warning LOGGER_OFF
 #endif
 
 #if defined(LOGGER_TRACE) || defined(LOGGER_DEBUG) || defined(LOGGER_INFO) || defined(LOGGER_WARNING) || defined(LOGGER_ERROR)
-    #define LOGGER_error logger::out << logger::timestamp() << " [error] "
+    #define LOGGER_error LOGGER_AT(error)
 #else
-    #define LOGGER_error logger:no_out
+    #define LOGGER_error LOGGER_OFF
 #endif
 
-#define LOGGER_fatal logger::out << logger::timestamp() << " [fatal] "
+#define LOGGER_fatal LOGGER_AT(fatal)
 
 #endif // _LOGGER_H__
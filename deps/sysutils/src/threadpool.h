@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////
+//
+// threadpool.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#pragma once
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include <atomic>
+#include <exception>
+#include <functional>
+
+namespace sysutils {
+
+// A fixed set of worker threads for splitting CPU bound loops across cores.
+// The calling thread takes part in the work, so a pool of size n starts n - 1 threads.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int size = 0)
+        : m_bStopping(false), m_generation(0), m_busyWorkers(0), m_fn(nullptr), m_end(0)
+    {
+        if (size == 0) size = boost::thread::hardware_concurrency();
+        for (unsigned int i = 1; i < size; i++) { m_threads.create_thread(boost::bind(&ThreadPool::workerLoop, this)); }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            m_bStopping = true;
+        }
+        m_workCond.notify_all();
+        m_threads.join_all();
+    }
+
+    unsigned int size() const { return m_threads.size() + 1; }
+
+    // Calls fn(i) for every i in [begin, end) and returns once all calls are done.
+    // If any call throws, the remaining indices are skipped and the first exception is rethrown.
+    void parallel_for(size_t begin, size_t end, const std::function<void(size_t)>& fn)
+    {
+        if (begin >= end) return;
+
+        boost::lock_guard<boost::mutex> callLock(m_callMutex);
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            m_fn = &fn;
+            m_next = begin;
+            m_end = end;
+            m_error = nullptr;
+            m_busyWorkers = m_threads.size();
+            m_generation++;
+        }
+        m_workCond.notify_all();
+
+        work();
+
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        while (m_busyWorkers > 0) { m_doneCond.wait(lock); }
+        m_fn = nullptr;
+        if (m_error) std::rethrow_exception(m_error);
+    }
+
+private:
+    boost::thread_group m_threads;
+
+    boost::mutex m_callMutex;
+    boost::mutex m_mutex;
+    boost::condition_variable m_workCond;
+    boost::condition_variable m_doneCond;
+    bool m_bStopping;
+    unsigned long m_generation;
+    unsigned int m_busyWorkers;
+
+    const std::function<void(size_t)>* m_fn;
+    std::atomic<size_t> m_next;
+    size_t m_end;
+    std::exception_ptr m_error;
+
+    void work()
+    {
+        while (true)
+        {
+            size_t i = m_next++;
+            if (i >= m_end) break;
+
+            try
+            {
+                (*m_fn)(i);
+            }
+            catch (...)
+            {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                if (!m_error) { m_error = std::current_exception(); }
+                m_next = m_end;
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned long generation = 0;
+        while (true)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(m_mutex);
+                while (!m_bStopping && m_generation == generation) { m_workCond.wait(lock); }
+                if (m_bStopping) return;
+                generation = m_generation;
+            }
+
+            work();
+
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            if (--m_busyWorkers == 0) { m_doneCond.notify_one(); }
+        }
+    }
+};
+
+}
@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////
+//
+// threadpooltest.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#include <threadpool.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+int main()
+{
+    sysutils::ThreadPool pool;
+    cout << "Pool size: " << pool.size() << endl;
+
+    vector<int> squares(100000, 0);
+    for (int round = 0; round < 10; round++)
+    {
+        pool.parallel_for(0, squares.size(), [&](size_t i) { squares[i] = i * i + round; });
+        for (size_t i = 0; i < squares.size(); i++)
+        {
+            if (squares[i] != (int)(i * i) + round)
+            {
+                cout << "Wrong result at " << i << endl;
+                return 1;
+            }
+        }
+    }
+    cout << "Results OK" << endl;
+
+    try
+    {
+        pool.parallel_for(0, 1000, [&](size_t i) { if (i == 500) throw runtime_error("Error at 500."); });
+        cout << "Exception was not propagated" << endl;
+        return 1;
+    }
+    catch (const exception& e)
+    {
+        cout << "Caught: " << e.what() << endl;
+    }
+
+    return 0;
+}